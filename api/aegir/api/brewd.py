@@ -21,6 +21,8 @@ def init(app, api):
     api.add_resource(BrewMaintenance, '/api/brewd/maintenance')
     api.add_resource(BrewOverride, '/api/brewd/override')
     api.add_resource(BrewStateCoolTemp, '/api/brewd/state/cooltemp')
+    api.add_resource(BrewMetrics, '/api/brewd/metrics')
+    api.add_resource(BrewLoop, '/api/brewd/loop')
     pass
 
 class BrewProgram(flask_restful.Resource):
@@ -93,6 +95,47 @@ class BrewProgram(flask_restful.Resource):
         return zresp
     pass
 
+class BrewMetrics(flask_restful.Resource):
+    '''
+    The runtime metrics of brewd: counters, gauges and latency histograms
+    '''
+    def get(self):
+        zresp = None
+        try:
+            zresp = aegir.zmq.prmessage("getMetrics", None)
+        except Exception as e:
+            return {"status": "error", "errors": [str(e)]}, 422
+
+        if not 'status' in zresp:
+            return {"status": "error", "errors": ['Malformed response']}, 422
+
+        if zresp['status'] != 'success':
+            return {"status": "error", "errors": [zresp.get('message', 'Unknown error')]}, 422
+
+        return {'status': 'success', 'data': zresp['data']}
+    pass
+
+class BrewLoop(flask_restful.Resource):
+    '''
+    The control loop's counters, its last and worst cycles' timings and
+    its alert
+    '''
+    def get(self):
+        zresp = None
+        try:
+            zresp = aegir.zmq.prmessage("getLoop", None)
+        except Exception as e:
+            return {"status": "error", "errors": [str(e)]}, 422
+
+        if not 'status' in zresp:
+            return {"status": "error", "errors": ['Malformed response']}, 422
+
+        if zresp['status'] != 'success':
+            return {"status": "error", "errors": [zresp.get('message', 'Unknown error')]}, 422
+
+        return {'status': 'success', 'data': zresp['data']}
+    pass
+
 class BrewConfig(flask_restful.Resource):
     def get(self):
         zresp = None
@@ -155,9 +198,22 @@ class BrewState(flask_restful.Resource):
         needhistory = history == 'yes'
         #pprint(['got getstate request'])
 
+        if needhistory:
+            return self.getWithHistory()
+
+        zdata = {}
+        # the state version is used as the ETag
+        etag = flask.request.headers.get('If-None-Match', None)
+        if etag is not None:
+            try:
+                zdata['since'] = int(etag.strip('"'))
+            except ValueError:
+                pass
+            pass
+
         zresp = None
         try:
-            zresp = aegir.zmq.prmessage("getState", {"history": needhistory})
+            zresp = aegir.zmq.prmessage("getState", zdata)
         except Exception as e:
             #pprint(e)
             return {"status": "error", "errors": [str(e)]}, 422
@@ -169,7 +225,44 @@ class BrewState(flask_restful.Resource):
         if zresp['status'] != 'success':
             return {"status": "error", "errors": [zresp.get('message', 'Unknown error')]}, 422
 
-        return {'status': 'success', 'data': zresp['data']}
+        headers = {'ETag': '"{v}"'.format(v = zresp.get('version', 0))}
+        if zresp.get('unchanged', False):
+            return None, 304, headers
+
+        return {'status': 'success', 'data': zresp['data']}, 200, headers
+
+    def getWithHistory(self):
+        '''
+        The state and the temperature history in one round-trip, both
+        served from the same published state snapshot: the history stops
+        at the readings that snapshot saw
+        '''
+        hdata = {}
+        frm = flask.request.args.get('from', None)
+        if not frm is None:
+            try:
+                hdata['from'] = int(frm)
+            except Exception as e:
+                return {"status": "error", "errors": [str(e)]}, 422
+            pass
+
+        try:
+            zstate, zhistory = aegir.zmq.prbatch([("getState", {}),
+                                                  ("getTempHistory", hdata)])
+        except Exception as e:
+            return {"status": "error", "errors": [str(e)]}, 422
+
+        if zstate.get('status', None) != 'success':
+            return {"status": "error", "errors": [zstate.get('message', 'Unknown error')]}, 422
+
+        data = zstate['data']
+        # the history is not available before mashing
+        if zhistory.get('status', None) == 'success':
+            data['temphistory'] = zhistory['data']
+        else:
+            data['temphistory'] = None
+
+        return {'status': 'success', 'data': data}
 
     def post(self):
         '''
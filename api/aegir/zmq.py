@@ -60,3 +60,19 @@ def prmessage(command, data):
         #pprint(['zmq_recv', e])
         raise Exception("Cannot parse brewd response: {err}".format(err = str(e)))
     pass
+
+def prbatch(commands):
+    '''
+    Sends several commands in one round-trip, they are executed by brewd
+    one after the other. getState and getTempHistory are served from the
+    same state snapshot.
+    commands is a list of (command, data) tuples, the replies are returned
+    in the same order
+    '''
+    zdata = {'commands': [{'command': cmd, 'data': data} for cmd, data in commands]}
+    zresp = prmessage('batch', zdata)
+
+    if zresp.get('status', None) != 'success':
+        raise Exception(zresp.get('message', 'Unknown error'))
+
+    return zresp['data']
@@ -0,0 +1,661 @@
+
+#include "AsyncLog.hh"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstddef>
+#include <algorithm>
+#include <type_traits>
+#include <chrono>
+
+#include <boost/log/core.hpp>
+
+namespace blk = ::boost::log::keywords;
+
+namespace aegir {
+
+  // a record in the ring: the header, the channel, the format and the args
+  struct RecordHeader {
+    uint64_t seq;
+    uint16_t fmtlen; // with the terminating 0
+    uint16_t arglen;
+    uint8_t level;
+    uint8_t chanlen;
+    // the format is the event, the args are the fields
+    uint8_t structured;
+  };
+  // the ring of every thread
+  static constexpr uint32_t c_ringsize = 64*1024;
+  // the longest format and the most argument bytes of a record
+  static constexpr uint32_t c_maxfmt = 512;
+  static constexpr uint32_t c_maxargs = 1024;
+  // the marker of a record wrapping to the start of the ring
+  static constexpr uint32_t c_wrap = 0xffffffff;
+
+  static inline uint32_t align8(uint32_t _size) {
+    return (_size + 7) & ~7u;
+  }
+
+  /*
+   * LogRing
+   * The records are prefixed with their length. A record never wraps,
+   * the rest of the buffer is skipped with a wrap marker instead.
+   */
+  LogRing::LogRing(uint32_t _capacity): c_capacity(64), c_head(0), c_reserved(0), c_tail(0) {
+    while ( c_capacity < _capacity ) c_capacity <<= 1;
+    c_buffer = std::make_unique<uint8_t[]>(c_capacity);
+  }
+
+  LogRing::~LogRing() {
+  }
+
+  uint8_t *LogRing::reserve(uint32_t _size) {
+    uint64_t head = c_head.load(std::memory_order_relaxed);
+    uint64_t tail = c_tail.load(std::memory_order_acquire);
+    uint32_t total = align8(sizeof(uint32_t) + _size);
+    uint32_t idx = head & (c_capacity-1);
+    uint32_t padding = (idx + total > c_capacity) ? c_capacity - idx : 0;
+
+    if ( padding + total > c_capacity - (head - tail) ) return nullptr;
+
+    if ( padding ) {
+      *(uint32_t*)(c_buffer.get()+idx) = c_wrap;
+      head += padding;
+      idx = 0;
+    }
+    c_reserved = head;
+    return c_buffer.get() + idx + sizeof(uint32_t);
+  }
+
+  void LogRing::commit(uint32_t _size) {
+    *(uint32_t*)(c_buffer.get() + (c_reserved & (c_capacity-1))) = _size;
+    c_head.store(c_reserved + align8(sizeof(uint32_t) + _size), std::memory_order_release);
+  }
+
+  const uint8_t *LogRing::peek(uint32_t &_size) {
+    uint64_t tail = c_tail.load(std::memory_order_relaxed);
+
+    while ( tail != c_head.load(std::memory_order_acquire) ) {
+      uint32_t idx = tail & (c_capacity-1);
+      uint32_t len = *(uint32_t*)(c_buffer.get()+idx);
+      if ( len == c_wrap ) {
+	tail += c_capacity - idx;
+	c_tail.store(tail, std::memory_order_release);
+	continue;
+      }
+      _size = len;
+      return c_buffer.get() + idx + sizeof(uint32_t);
+    }
+    return nullptr;
+  }
+
+  void LogRing::release() {
+    uint64_t tail = c_tail.load(std::memory_order_relaxed);
+    uint32_t len = *(uint32_t*)(c_buffer.get() + (tail & (c_capacity-1)));
+    c_tail.store(tail + align8(sizeof(uint32_t) + len), std::memory_order_release);
+  }
+
+  /*
+   * The printf conversions
+   */
+  struct Spec {
+    // from the % to the conversion
+    const char *begin, *end;
+    char conv;
+    // 'H' for hh, 'q' for ll
+    char length;
+    uint8_t stars;
+  };
+
+  // the next conversion from _p, false at the end of the format
+  static bool nextSpec(const char *&_p, Spec &_spec) {
+    const char *p = std::strchr(_p, '%');
+    if ( !p ) return false;
+
+    _spec.begin = p++;
+    _spec.length = 0;
+    _spec.stars = 0;
+    while ( *p && std::strchr("-+ #0'", *p) ) ++p;
+    if ( *p == '*' ) {
+      ++_spec.stars;
+      ++p;
+    } else {
+      while ( *p >= '0' && *p <= '9' ) ++p;
+    }
+    if ( *p == '.' ) {
+      ++p;
+      if ( *p == '*' ) {
+	++_spec.stars;
+	++p;
+      } else {
+	while ( *p >= '0' && *p <= '9' ) ++p;
+      }
+    }
+    if ( *p && std::strchr("hljztLq", *p) ) {
+      _spec.length = *p++;
+      if ( _spec.length == 'h' && *p == 'h' ) {
+	_spec.length = 'H';
+	++p;
+      } else if ( _spec.length == 'l' && *p == 'l' ) {
+	_spec.length = 'q';
+	++p;
+      }
+    }
+    // a broken conversion at the end is printed as it is
+    if ( !*p ) return false;
+
+    _spec.conv = *p;
+    _spec.end = p;
+    _p = p+1;
+    return true;
+  }
+
+  template<typename T>
+  static inline bool put(uint8_t *&_out, uint8_t *_end, T _v) {
+    if ( _out + sizeof(T) > _end ) return false;
+    std::memcpy(_out, &_v, sizeof(T));
+    _out += sizeof(T);
+    return true;
+  }
+
+  template<typename T>
+  static inline bool get(const uint8_t *&_in, const uint8_t *_end, T &_v) {
+    if ( _in + sizeof(T) > _end ) return false;
+    std::memcpy(&_v, _in, sizeof(T));
+    _in += sizeof(T);
+    return true;
+  }
+
+  static bool putString(uint8_t *&_out, uint8_t *_end, const char *_str) {
+    if ( !_str ) _str = "(null)";
+    std::size_t len = std::strlen(_str);
+    if ( _out + sizeof(uint16_t) > _end ) return false;
+    len = std::min<std::size_t>(len, _end - _out - sizeof(uint16_t));
+    len = std::min<std::size_t>(len, 0xffff);
+    put(_out, _end, (uint16_t)len);
+    std::memcpy(_out, _str, len);
+    _out += len;
+    return true;
+  }
+
+  uint32_t AsyncLog::capture(const char *_fmt, std::va_list _args, uint8_t *_out, uint32_t _max) {
+    uint8_t *out = _out, *end = _out + _max;
+    const char *p = _fmt;
+    Spec spec;
+    bool ok = true;
+
+    while ( ok && nextSpec(p, spec) ) {
+      for (int i=0; i < spec.stars && ok; ++i) ok = put(out, end, va_arg(_args, int));
+      if ( !ok ) break;
+
+      switch (spec.conv) {
+      case 'd': case 'i': {
+	int64_t v;
+	switch (spec.length) {
+	case 'H': v = (signed char)va_arg(_args, int); break;
+	case 'h': v = (short)va_arg(_args, int); break;
+	case 'l': v = va_arg(_args, long); break;
+	case 'q': v = va_arg(_args, long long); break;
+	case 'j': v = va_arg(_args, intmax_t); break;
+	case 'z': v = va_arg(_args, std::make_signed_t<std::size_t>); break;
+	case 't': v = va_arg(_args, std::ptrdiff_t); break;
+	default: v = va_arg(_args, int);
+	}
+	ok = put(out, end, v);
+	break;
+      }
+      case 'u': case 'o': case 'x': case 'X': {
+	uint64_t v;
+	switch (spec.length) {
+	case 'H': v = (unsigned char)va_arg(_args, unsigned int); break;
+	case 'h': v = (unsigned short)va_arg(_args, unsigned int); break;
+	case 'l': v = va_arg(_args, unsigned long); break;
+	case 'q': v = va_arg(_args, unsigned long long); break;
+	case 'j': v = va_arg(_args, uintmax_t); break;
+	case 'z': v = va_arg(_args, std::size_t); break;
+	case 't': v = va_arg(_args, std::ptrdiff_t); break;
+	default: v = va_arg(_args, unsigned int);
+	}
+	ok = put(out, end, v);
+	break;
+      }
+      case 'c':
+	ok = put(out, end, (int64_t)va_arg(_args, int));
+	break;
+      case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+	if ( spec.length == 'L' ) ok = put(out, end, va_arg(_args, long double));
+	else ok = put(out, end, va_arg(_args, double));
+	break;
+      case 's':
+	ok = putString(out, end, va_arg(_args, const char*));
+	break;
+      case 'p':
+	ok = put(out, end, (uint64_t)(uintptr_t)va_arg(_args, void*));
+	break;
+      case 'n':
+	// nothing's written back
+	va_arg(_args, void*);
+	break;
+      }
+    }
+    return out - _out;
+  }
+
+  // prints a single conversion with its star arguments
+  template<typename T>
+  static void append(std::string &_out, const std::string &_spec, const int *_stars,
+		     uint8_t _nstars, T _v) {
+    char buff[1024];
+    int len;
+
+    switch (_nstars) {
+    case 0: len = std::snprintf(buff, sizeof(buff), _spec.c_str(), _v); break;
+    case 1: len = std::snprintf(buff, sizeof(buff), _spec.c_str(), _stars[0], _v); break;
+    default: len = std::snprintf(buff, sizeof(buff), _spec.c_str(), _stars[0], _stars[1], _v);
+    }
+    if ( len > 0 ) _out.append(buff, std::min<int>(len, sizeof(buff)-1));
+  }
+
+  std::string AsyncLog::format(const char *_fmt, const uint8_t *_args, uint32_t _size) {
+    const uint8_t *in = _args, *end = _args + _size;
+    const char *p = _fmt, *lit = _fmt;
+    std::string out;
+    Spec spec;
+
+    while ( nextSpec(p, spec) ) {
+      out.append(lit, spec.begin - lit);
+      lit = p;
+      if ( spec.conv == '%' ) {
+	out += '%';
+	continue;
+      }
+
+      int stars[2];
+      bool ok = true;
+      for (int i=0; i < spec.stars && ok; ++i) ok = get(in, end, stars[i]);
+      // the arguments ran out, the rest is left out
+      if ( !ok ) return out;
+
+      // the spec without its length modifier
+      std::string fmt(spec.begin, spec.end - spec.begin);
+      fmt.erase(std::remove_if(fmt.begin()+1, fmt.end(),
+			       [](char c) { return std::strchr("hljztLq", c) != nullptr; }),
+		fmt.end());
+
+      switch (spec.conv) {
+      case 'd': case 'i': {
+	int64_t v;
+	if ( !get(in, end, v) ) return out;
+	append(out, fmt + "ll" + spec.conv, stars, spec.stars, (long long)v);
+	break;
+      }
+      case 'u': case 'o': case 'x': case 'X': {
+	uint64_t v;
+	if ( !get(in, end, v) ) return out;
+	append(out, fmt + "ll" + spec.conv, stars, spec.stars, (unsigned long long)v);
+	break;
+      }
+      case 'c': {
+	int64_t v;
+	if ( !get(in, end, v) ) return out;
+	append(out, fmt + 'c', stars, spec.stars, (int)v);
+	break;
+      }
+      case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+	if ( spec.length == 'L' ) {
+	  long double v;
+	  if ( !get(in, end, v) ) return out;
+	  append(out, fmt + 'L' + spec.conv, stars, spec.stars, v);
+	} else {
+	  double v;
+	  if ( !get(in, end, v) ) return out;
+	  append(out, fmt + spec.conv, stars, spec.stars, v);
+	}
+	break;
+      case 's': {
+	uint16_t len;
+	if ( !get(in, end, len) || in + len > end ) return out;
+	std::string s((const char*)in, len);
+	in += len;
+	append(out, fmt + 's', stars, spec.stars, s.c_str());
+	break;
+      }
+      case 'p': {
+	uint64_t v;
+	if ( !get(in, end, v) ) return out;
+	append(out, fmt + 'p', stars, spec.stars, (void*)(uintptr_t)v);
+	break;
+      }
+      case 'n':
+	break;
+      default:
+	// unknown conversion, printed as it is
+	out.append(spec.begin, spec.end - spec.begin + 1);
+      }
+    }
+    out.append(lit);
+    return out;
+  }
+
+  /*
+   * The structured records
+   * Every field is its key, its type and its value.
+   */
+  uint32_t AsyncLog::capture(const logging::Field *_fields, std::size_t _count, uint8_t *_out, uint32_t _max) {
+    uint8_t *out = _out, *end = _out + _max;
+
+    for (std::size_t i=0; i < _count; ++i) {
+      const logging::Field &f(_fields[i]);
+      uint8_t *start = out;
+      bool ok = putString(out, end, f.key) && put(out, end, (uint8_t)f.type);
+
+      if ( ok ) {
+	switch (f.type) {
+	case logging::Field::Type::Int: ok = put(out, end, f.i); break;
+	case logging::Field::Type::UInt: ok = put(out, end, f.u); break;
+	case logging::Field::Type::Double: ok = put(out, end, f.d); break;
+	case logging::Field::Type::Bool: ok = put(out, end, (uint8_t)f.b); break;
+	case logging::Field::Type::String: ok = putString(out, end, f.s); break;
+	}
+      }
+      // the fields that don't fit are left out as a whole
+      if ( !ok ) return start - _out;
+    }
+    return out - _out;
+  }
+
+  // the strings with whitespace, quotes or = are quoted
+  static void appendValue(std::string &_out, const char *_str, uint16_t _len) {
+    bool quote = _len == 0;
+
+    for (uint16_t i=0; i < _len && !quote; ++i)
+      quote = _str[i] <= ' ' || _str[i] == '"' || _str[i] == '=';
+    if ( !quote ) {
+      _out.append(_str, _len);
+      return;
+    }
+
+    _out += '"';
+    for (uint16_t i=0; i < _len; ++i) {
+      if ( _str[i] == '"' || _str[i] == '\\' ) _out += '\\';
+      _out += _str[i];
+    }
+    _out += '"';
+  }
+
+  std::string AsyncLog::formatFields(const char *_event, const uint8_t *_args, uint32_t _size) {
+    const uint8_t *in = _args, *end = _args + _size;
+    std::string out(_event);
+    char buff[32];
+
+    while ( in < end ) {
+      uint16_t keylen;
+      uint8_t type;
+      if ( !get(in, end, keylen) || in + keylen > end ) break;
+      const char *key = (const char*)in;
+      in += keylen;
+      if ( !get(in, end, type) ) break;
+
+      if ( !out.empty() ) out += ' ';
+      out.append(key, keylen);
+      out += '=';
+
+      switch ((logging::Field::Type)type) {
+      case logging::Field::Type::Int: {
+	int64_t v;
+	if ( !get(in, end, v) ) return out;
+	std::snprintf(buff, sizeof(buff), "%lli", (long long)v);
+	out += buff;
+	break;
+      }
+      case logging::Field::Type::UInt: {
+	uint64_t v;
+	if ( !get(in, end, v) ) return out;
+	std::snprintf(buff, sizeof(buff), "%llu", (unsigned long long)v);
+	out += buff;
+	break;
+      }
+      case logging::Field::Type::Double: {
+	double v;
+	if ( !get(in, end, v) ) return out;
+	std::snprintf(buff, sizeof(buff), "%.6g", v);
+	out += buff;
+	break;
+      }
+      case logging::Field::Type::Bool: {
+	uint8_t v;
+	if ( !get(in, end, v) ) return out;
+	out += v ? "true" : "false";
+	break;
+      }
+      case logging::Field::Type::String: {
+	uint16_t len;
+	if ( !get(in, end, len) || in + len > end ) return out;
+	appendValue(out, (const char*)in, len);
+	in += len;
+	break;
+      }
+      default:
+	return out;
+      }
+    }
+    return out;
+  }
+
+  /*
+   * AsyncLog
+   */
+  AsyncLog::Ring::Ring(): ring(c_ringsize), released(false) {
+  }
+
+  AsyncLog::AsyncLog(): c_running(false), c_seq(0), c_written(0), c_dropped(0) {
+  }
+
+  AsyncLog::~AsyncLog() {
+  }
+
+  AsyncLog &AsyncLog::getInstance() {
+    // never destroyed, the static LogChannels might log during the exit
+    static AsyncLog *instance = new AsyncLog();
+    return *instance;
+  }
+
+  void AsyncLog::start() {
+    static std::once_flag atexit;
+
+    if ( c_running ) return;
+    // Boost.Log creates its core and the thread's severity storage on the
+    // first use; they have to exist before the atexit handler is registered,
+    // otherwise they're destroyed before the handler drains the rings
+    ::boost::log::core::get();
+    ::boost::log::sources::aux::get_severity_level();
+    c_running = true;
+    c_thread = std::thread(&AsyncLog::run, this);
+    // write out everything before the exit
+    std::call_once(atexit, []() { std::atexit([]() { AsyncLog::getInstance().stop(); }); });
+  }
+
+  void AsyncLog::stop() {
+    if ( !c_running.exchange(false) ) return;
+    if ( c_thread.joinable() ) c_thread.join();
+    // the ones pushed while it was stopping
+    drain();
+  }
+
+  AsyncLog::Ring &AsyncLog::threadRing() {
+    // marks the ring released when the thread exits
+    struct Holder {
+      std::shared_ptr<Ring> ring;
+      ~Holder() { if ( ring ) ring->released = true; };
+    };
+    static thread_local Holder holder;
+
+    if ( !holder.ring ) {
+      holder.ring = std::make_shared<Ring>();
+      std::lock_guard<std::mutex> g(c_mtx);
+      c_rings.push_back(holder.ring);
+    }
+    return *holder.ring;
+  }
+
+  uint8_t *AsyncLog::reserve(Ring &_ring, const std::string &_channel, uint32_t _fmtlen) {
+    uint32_t chanlen = std::min<std::size_t>(_channel.length(), 255);
+    uint8_t *rec = _ring.ring.reserve(sizeof(RecordHeader) + chanlen + _fmtlen + c_maxargs);
+
+    if ( !rec ) {
+      c_dropped.fetch_add(1, std::memory_order_relaxed);
+      return nullptr;
+    }
+    std::memcpy(rec + sizeof(RecordHeader), _channel.data(), chanlen);
+    return rec;
+  }
+
+  void AsyncLog::commit(Ring &_ring, uint8_t *_rec, const std::string &_channel, blt::severity_level _level,
+			uint32_t _fmtlen, uint32_t _arglen, bool _structured) {
+    RecordHeader hdr;
+
+    hdr.level = (uint8_t)_level;
+    hdr.chanlen = std::min<std::size_t>(_channel.length(), 255);
+    hdr.fmtlen = _fmtlen;
+    hdr.arglen = _arglen;
+    hdr.structured = _structured;
+    hdr.seq = c_seq.fetch_add(1, std::memory_order_relaxed);
+    std::memcpy(_rec, &hdr, sizeof(hdr));
+    _ring.ring.commit(sizeof(RecordHeader) + hdr.chanlen + _fmtlen + _arglen);
+  }
+
+  bool AsyncLog::push(const std::string &_channel, blt::severity_level _level,
+		      const char *_fmt, std::va_list _args) {
+    if ( !c_running ) return false;
+
+    Ring &r = threadRing();
+    uint32_t fmtlen = std::strlen(_fmt) + 1;
+    bool preformat = fmtlen > c_maxfmt;
+    if ( preformat ) fmtlen = sizeof("%s");
+
+    uint8_t *rec = reserve(r, _channel, fmtlen);
+    if ( !rec ) return true;
+
+    uint8_t *p = rec + sizeof(RecordHeader) + std::min<std::size_t>(_channel.length(), 255);
+    uint32_t arglen;
+    if ( preformat ) {
+      // the too long formats are formatted right away
+      char buff[c_maxargs];
+      std::vsnprintf(buff, sizeof(buff) - sizeof(uint16_t), _fmt, _args);
+      std::memcpy(p, "%s", fmtlen);
+      p += fmtlen;
+      uint8_t *args = p;
+      putString(p, p + c_maxargs, buff);
+      arglen = p - args;
+    } else {
+      std::memcpy(p, _fmt, fmtlen);
+      p += fmtlen;
+      arglen = capture(_fmt, _args, p, c_maxargs);
+    }
+    commit(r, rec, _channel, _level, fmtlen, arglen, false);
+    return true;
+  }
+
+  bool AsyncLog::push(const std::string &_channel, blt::severity_level _level,
+		      const char *_event, const logging::Field *_fields, std::size_t _count) {
+    if ( !c_running ) return false;
+
+    Ring &r = threadRing();
+    uint32_t fmtlen = std::min<std::size_t>(std::strlen(_event), c_maxfmt - 1) + 1;
+
+    uint8_t *rec = reserve(r, _channel, fmtlen);
+    if ( !rec ) return true;
+
+    uint8_t *p = rec + sizeof(RecordHeader) + std::min<std::size_t>(_channel.length(), 255);
+    std::memcpy(p, _event, fmtlen - 1);
+    p[fmtlen - 1] = 0;
+    p += fmtlen;
+    commit(r, rec, _channel, _level, fmtlen, capture(_fields, _count, p, c_maxargs), true);
+    return true;
+  }
+
+  void AsyncLog::flush() {
+    uint64_t seq = c_seq.load();
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+
+    while ( c_running && c_written.load() < seq &&
+	    std::chrono::steady_clock::now() < deadline )
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  void AsyncLog::run() {
+    while ( c_running ) {
+      if ( !drain() ) std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+  }
+
+  uint32_t AsyncLog::drain() {
+    struct Entry {
+      uint64_t seq;
+      blt::severity_level level;
+      std::string channel;
+      std::string message;
+    };
+    std::vector<std::shared_ptr<Ring>> rings;
+    std::vector<Entry> entries;
+
+    {
+      std::lock_guard<std::mutex> g(c_mtx);
+      rings = c_rings;
+    }
+
+    for (auto &it: rings) {
+      const uint8_t *rec;
+      uint32_t size;
+      while ( (rec = it->ring.peek(size)) ) {
+	RecordHeader hdr;
+	std::memcpy(&hdr, rec, sizeof(hdr));
+	const char *chan = (const char*)rec + sizeof(hdr);
+	const char *fmt = chan + hdr.chanlen;
+	const uint8_t *args = (const uint8_t*)fmt + hdr.fmtlen;
+	entries.push_back({hdr.seq, (blt::severity_level)hdr.level,
+			   std::string(chan, hdr.chanlen),
+			   hdr.structured ? formatFields(fmt, args, hdr.arglen)
+			   : format(fmt, args, hdr.arglen)});
+	it->ring.release();
+      }
+    }
+
+    // in the order they were logged across the threads
+    std::sort(entries.begin(), entries.end(),
+	      [](const Entry &_a, const Entry &_b) { return _a.seq < _b.seq; });
+    for (auto &it: entries) {
+      if ( auto rec = c_logger.open_record((blk::channel = it.channel, blk::severity = it.level)) ) {
+	boost::log::record_ostream strm(rec);
+	strm << it.message;
+	strm.flush();
+	c_logger.push_record(boost::move(rec));
+      }
+    }
+
+    if ( uint64_t dropped = c_dropped.exchange(0) ) {
+      if ( auto rec = c_logger.open_record((blk::channel = std::string("AsyncLog"),
+					   blk::severity = blt::severity_level::warning)) ) {
+	boost::log::record_ostream strm(rec);
+	strm << dropped << " log records were dropped, the rings were full";
+	strm.flush();
+	c_logger.push_record(boost::move(rec));
+      }
+    }
+
+    // the rings of the finished threads
+    {
+      std::lock_guard<std::mutex> g(c_mtx);
+      c_rings.erase(std::remove_if(c_rings.begin(), c_rings.end(),
+				   [](const std::shared_ptr<Ring> &_r) {
+				     uint32_t size;
+				     return _r->released && !_r->ring.peek(size);
+				   }),
+		    c_rings.end());
+    }
+
+    c_written.fetch_add(entries.size());
+    return entries.size();
+  }
+}
@@ -0,0 +1,126 @@
+/*
+ * Asynchronous logging
+ * The log calls don't format anything: the printf-style arguments are
+ * captured in binary into a lock-free ring of the calling thread, and a
+ * background thread formats them and pushes them into Boost.Log and
+ * syslog. A full ring drops the record instead of blocking the caller,
+ * the number of the dropped ones is logged later.
+ * The structured records are captured the same way, and written as the
+ * event followed by its key=value fields.
+ */
+
+#ifndef AEGIR_ASYNCLOG_H
+#define AEGIR_ASYNCLOG_H
+
+#include <cstdint>
+#include <cstdarg>
+#include <string>
+#include <memory>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <thread>
+
+#include <boost/log/sources/severity_channel_logger.hpp>
+#include <boost/log/trivial.hpp>
+
+#include "logging.hh"
+
+namespace blt = ::boost::log::trivial;
+
+namespace aegir {
+
+  /*
+   * Single producer, single consumer ring of variable sized records
+   */
+  class LogRing {
+    LogRing() = delete;
+    LogRing(LogRing&&) = delete;
+    LogRing(const LogRing &) = delete;
+    LogRing &operator=(LogRing &&) = delete;
+    LogRing &operator=(const LogRing &) = delete;
+  public:
+    // _capacity is rounded up to a power of 2
+    explicit LogRing(uint32_t _capacity);
+    ~LogRing();
+
+    // producer: room for a record of at most _size bytes, nullptr when full
+    uint8_t *reserve(uint32_t _size);
+    // the reserved record is _size bytes long
+    void commit(uint32_t _size);
+
+    // consumer: the next record, nullptr when empty
+    const uint8_t *peek(uint32_t &_size);
+    void release();
+
+  private:
+    std::unique_ptr<uint8_t[]> c_buffer;
+    uint32_t c_capacity;
+    // the producer's and the consumer's positions, on separate cache lines
+    alignas(64) std::atomic<uint64_t> c_head;
+    uint64_t c_reserved;
+    alignas(64) std::atomic<uint64_t> c_tail;
+  };
+
+  class AsyncLog {
+    AsyncLog();
+    AsyncLog(AsyncLog&&) = delete;
+    AsyncLog(const AsyncLog &) = delete;
+    AsyncLog &operator=(AsyncLog &&) = delete;
+    AsyncLog &operator=(const AsyncLog &) = delete;
+  public:
+    ~AsyncLog();
+    static AsyncLog &getInstance();
+
+    void start();
+    // stops the background thread, once everything is written out
+    void stop();
+    inline bool isRunning() const { return c_running; };
+    // false when it's not running, then the caller has to log by itself
+    bool push(const std::string &_channel, blt::severity_level _level,
+	      const char *_fmt, std::va_list _args);
+    bool push(const std::string &_channel, blt::severity_level _level,
+	      const char *_event, const logging::Field *_fields, std::size_t _count);
+    // waits until the records pushed so far are written out
+    void flush();
+
+    // the binary arguments of _fmt, at most _max bytes, returns the size
+    static uint32_t capture(const char *_fmt, std::va_list _args, uint8_t *_out, uint32_t _max);
+    // formats the captured arguments
+    static std::string format(const char *_fmt, const uint8_t *_args, uint32_t _size);
+    // the same for the structured records
+    static uint32_t capture(const logging::Field *_fields, std::size_t _count, uint8_t *_out, uint32_t _max);
+    static std::string formatFields(const char *_event, const uint8_t *_args, uint32_t _size);
+
+  private:
+    struct Ring {
+      Ring();
+      LogRing ring;
+      // its thread is gone, the ring is removed once drained
+      std::atomic<bool> released;
+    };
+    // the calling thread's ring, registered on first use
+    Ring &threadRing();
+    // reserves a record in the calling thread's ring, nullptr when it's full
+    uint8_t *reserve(Ring &_ring, const std::string &_channel, uint32_t _fmtlen);
+    // fills in the header, and commits the record
+    void commit(Ring &_ring, uint8_t *_rec, const std::string &_channel, blt::severity_level _level,
+		uint32_t _fmtlen, uint32_t _arglen, bool _structured);
+    void run();
+    // writes out everything in the rings, returns the number of records
+    uint32_t drain();
+
+  private:
+    std::mutex c_mtx;
+    std::vector<std::shared_ptr<Ring>> c_rings;
+    std::thread c_thread;
+    std::atomic<bool> c_running;
+    std::atomic<uint64_t> c_seq;
+    // the records drained so far, for flush()
+    std::atomic<uint64_t> c_written;
+    std::atomic<uint64_t> c_dropped;
+    boost::log::sources::severity_channel_logger<blt::severity_level, std::string> c_logger;
+  };
+}
+
+#endif
@@ -0,0 +1,334 @@
+
+#include "AutoTuner.hh"
+
+#include <cmath>
+#include <algorithm>
+#include <deque>
+
+namespace aegir {
+
+  // water only, it shouldn't get anywhere near these
+  static constexpr float c_maxrims = 85.0f;
+  static constexpr float c_maxmt = 70.0f;
+  // the least rise of the tube's temperature on the step
+  static constexpr float c_minresponse = 1.0f;
+  // steady: the two halves of the window are this close, C
+  static constexpr std::size_t c_steadywindow = 30;
+  static constexpr float c_steadytrend = 0.03f;
+  // the tolerated PWM ripple in the tube, C peak-to-peak
+  static constexpr float c_maxripple = 0.2f;
+  // the prediction: step size, horizon and control interval
+  static constexpr float c_predictstep = 5.0f;
+  static constexpr float c_predicthorizon = 3600.0f;
+  static constexpr float c_predictival = 10.0f;
+
+  static const char *g_phase_to_string[] = {
+    "idle", "settle", "stepup", "stepdown", "done", "failed"
+  };
+
+  AutoTuner::AutoTuner(): c_phase(Phases::Idle), c_ratio(0), c_hepower(0),
+			  c_volume(0), c_tempaccuracy(0.3f), c_starttime(0),
+			  c_phasestart(0), c_phasefirst(0), c_stepfirst(0),
+			  c_x0(0), c_xup(0), c_drift(0),
+			  c_results{}, c_log("AutoTuner") {
+  }
+
+  AutoTuner::~AutoTuner() {
+  }
+
+  const char *AutoTuner::getPhaseName() const {
+    return g_phase_to_string[(int)c_phase];
+  }
+
+  void AutoTuner::start(time_t _now, float _hepower, float _volume, float _tempaccuracy) {
+    c_hepower = _hepower;
+    c_volume = _volume;
+    c_tempaccuracy = _tempaccuracy;
+    c_starttime = _now;
+    c_samples.clear();
+    c_results = {};
+    c_error.clear();
+    c_phasestart = _now;
+    enter(Phases::Settle, 0);
+  }
+
+  void AutoTuner::stop() {
+    if ( isRunning() ) c_log.info("Auto-tuning stopped in phase %s", getPhaseName());
+    c_phase = Phases::Idle;
+    c_ratio = 0;
+  }
+
+  void AutoTuner::enter(Phases _phase, float _ratio) {
+    c_phase = _phase;
+    c_ratio = _ratio;
+    c_phasefirst = c_samples.size();
+    if ( c_samples.size() ) c_phasestart = c_samples.back().time;
+    c_log.info("Auto-tuning phase %s, on-ratio %.2f", getPhaseName(), _ratio);
+  }
+
+  void AutoTuner::fail(const char *_error) {
+    c_log.error("Auto-tuning failed in phase %s: %s", getPhaseName(), _error);
+    c_error = _error;
+    c_phase = Phases::Failed;
+    c_ratio = 0;
+  }
+
+  float AutoTuner::update(time_t _now, float _mt, float _rims) {
+    if ( !isRunning() ) return 0;
+    // no readings yet
+    if ( _mt == 0.0f || _rims == 0.0f ) return c_ratio;
+
+    if ( _rims > c_maxrims || _mt > c_maxmt ) {
+      fail("The water is too hot");
+      return 0;
+    }
+
+    c_samples.push_back({_now, _mt, _rims});
+    uint32_t elapsed = _now - c_phasestart;
+    bool steady = elapsed >= c_mintime && isSteady();
+
+    switch ( c_phase ) {
+    case Phases::Settle:
+      if ( steady ) {
+	c_x0 = meanX(c_steadywindow);
+	c_drift = driftMT();
+	enter(Phases::StepUp, c_stepratio);
+	c_stepfirst = c_phasefirst;
+      } else if ( elapsed > c_maxtime ) {
+	fail("The temperatures aren't settling");
+      }
+      break;
+
+    case Phases::StepUp:
+      if ( steady ) {
+	if ( identifyUp() ) enter(Phases::StepDown, 0);
+      } else if ( elapsed > c_maxtime ) {
+	fail("The heating doesn't settle");
+      }
+      break;
+
+    case Phases::StepDown:
+      // the step down only refines the model
+      if ( steady || elapsed > c_maxtime ) {
+	identifyDown();
+	if ( !identifyMT() ) break;
+	propose();
+	enter(Phases::Done, 0);
+      }
+      break;
+
+    default:
+      break;
+    }
+
+    return c_ratio;
+  }
+
+  bool AutoTuner::isSteady() const {
+    if ( c_samples.size() - c_phasefirst < c_steadywindow ) return false;
+
+    float first(0), second(0);
+    std::size_t half = c_steadywindow / 2;
+    auto it = c_samples.end() - c_steadywindow;
+    for (std::size_t i=0; i < c_steadywindow; ++i, ++it)
+      (i < half ? first : second) += it->x();
+
+    return std::fabs(second - first) / half < c_steadytrend;
+  }
+
+  float AutoTuner::meanX(std::size_t _n) const {
+    _n = std::min(_n, c_samples.size() - c_phasefirst);
+    if ( !_n ) return 0;
+
+    float sum = 0;
+    for (auto it = c_samples.end() - _n; it != c_samples.end(); ++it) sum += it->x();
+    return sum / _n;
+  }
+
+  /*
+   * Two-point method on the current phase's samples: the 28.3% and the
+   * 63.2% of the response are at deadtime + tau/3 and deadtime + tau
+   */
+  bool AutoTuner::fitStep(float _from, float _to, float &_tau, float &_deadtime) const {
+    float t28(-1), t63(-1);
+
+    for (std::size_t i=c_phasefirst+1; i+1 < c_samples.size(); ++i) {
+      // smoothing the sensor noise a bit
+      float x = (c_samples[i-1].x() + c_samples[i].x() + c_samples[i+1].x()) / 3;
+      float y = (x - _from) / (_to - _from);
+      float t = c_samples[i].time - c_phasestart;
+
+      if ( t28 < 0 && y >= 0.283f ) t28 = t;
+      if ( t63 < 0 && y >= 0.632f ) {
+	t63 = t;
+	break;
+      }
+    }
+
+    if ( t28 < 0 || t63 <= t28 ) return false;
+
+    _tau = 1.5f * (t63 - t28);
+    _deadtime = std::max(0.0f, t63 - _tau);
+    return true;
+  }
+
+  bool AutoTuner::identifyUp() {
+    float xup = meanX(10);
+
+    if ( xup - c_x0 < c_minresponse ) {
+      fail("No response from the heating element, is the pump running?");
+      return false;
+    }
+
+    float tau, deadtime;
+    if ( !fitStep(c_x0, xup, tau, deadtime) ) {
+      fail("Unable to fit the step response");
+      return false;
+    }
+
+    c_xup = xup;
+    c_results.gain = (xup - c_x0) / c_stepratio;
+    c_results.tau = tau;
+    c_results.deadtime = deadtime;
+
+    c_log.info("Auto-tuning step up: K:%.2f tau:%.1f L:%.1f",
+	       c_results.gain, tau, deadtime);
+    return true;
+  }
+
+  void AutoTuner::identifyDown() {
+    float tau, deadtime;
+
+    if ( fitStep(c_xup, meanX(10), tau, deadtime) ) {
+      c_log.info("Auto-tuning step down: tau:%.1f L:%.1f", tau, deadtime);
+      c_results.tau = (c_results.tau + tau) / 2;
+      c_results.deadtime = (c_results.deadtime + deadtime) / 2;
+    } else {
+      c_log.warn("Auto-tuning: no fit on the step down, using the step up only");
+    }
+  }
+
+  /*
+   * The mash tun's heating rate over both steps: by the end of the step
+   * down the heat in the hose and the sensors' lag are settled as well.
+   * The MT's drift while settling is the heat loss, that's compensated
+   */
+  bool AutoTuner::identifyMT() {
+    const std::size_t first = c_stepfirst, last = c_samples.size() - 1;
+    double heat = 0;
+
+    for (std::size_t i=first+1; i <= last; ++i)
+      heat += (c_samples[i].x() - c_x0) * (c_samples[i].time - c_samples[i-1].time);
+
+    float mtfirst(0), mtlast(0);
+    for (std::size_t i=0; i < 5; ++i) {
+      mtfirst += c_samples[first + i].mt / 5;
+      mtlast += c_samples[last - i].mt / 5;
+    }
+    float rise = mtlast - mtfirst - c_drift * (c_samples[last].time - c_samples[first].time);
+
+    if ( heat <= 0 || rise <= 0 ) {
+      fail("The mash tun isn't heating up");
+      return false;
+    }
+
+    c_results.mtrate = rise / heat;
+    c_log.info("Auto-tuning mash tun: g:%.5f drift:%.6f", c_results.mtrate, c_drift);
+    return true;
+  }
+
+  // least squares slope of the MT during the current phase
+  float AutoTuner::driftMT() const {
+    double st(0), smt(0), stt(0), stmt(0);
+    std::size_t n = c_samples.size() - c_phasefirst;
+
+    for (std::size_t i=c_phasefirst; i < c_samples.size(); ++i) {
+      double t = c_samples[i].time - c_phasestart;
+      st += t;
+      smt += c_samples[i].mt;
+      stt += t*t;
+      stmt += t*c_samples[i].mt;
+    }
+
+    double det = n*stt - st*st;
+    return det > 0 ? (n*stmt - st*smt) / det : 0;
+  }
+
+  void AutoTuner::propose() {
+    Results &r(c_results);
+
+    // the ripple at 50% is K * cycletime / (4 * tau)
+    r.hecycletime = std::clamp(std::round(8 * r.tau * c_maxripple / r.gain) / 2,
+			       1.0f, 5.0f);
+    r.hedelay = std::clamp<uint32_t>(std::ceil(r.deadtime), 0, 30);
+
+    // the fastest one within the accuracy, or the least overshooting one
+    float maxoverhead = std::clamp(0.8f * r.gain, 0.5f, 4.75f);
+    float bestsettle(INFINITY), bestovershoot(INFINITY);
+    bool within(false);
+
+    for (float oh = 0.5f; oh <= maxoverhead + 1e-3f; oh += 0.25f) {
+      float overshoot;
+      float settle = predict(oh, r.hecycletime, overshoot);
+      bool ok = overshoot <= c_tempaccuracy;
+
+      if ( (ok && (!within || settle < bestsettle)) ||
+	   (!ok && !within && overshoot < bestovershoot) ) {
+	within = ok;
+	bestsettle = settle;
+	bestovershoot = overshoot;
+	r.heatoverhead = oh;
+      }
+    }
+    r.settlingtime = bestsettle;
+    r.overshoot = bestovershoot;
+
+    // the element's effective power at full on-ratio: 4.2 * V * g * K
+    r.maxcorrectionfactor = 0;
+    if ( c_volume > 0 && c_hepower > 0 ) {
+      float effective = 4.2f * c_volume * r.mtrate * r.gain;
+      // an element delivering its nominal power needs no correction
+      r.maxcorrectionfactor = std::clamp(1.05f * c_hepower / effective, 1.0f, 1.25f);
+    }
+
+    c_log.info("Auto-tuning done: hecycletime:%.1f heatoverhead:%.2f hedelay:%u maxcorrection:%.2f settling:%.0fs overshoot:%.2fC",
+	       r.hecycletime, r.heatoverhead, r.hedelay, r.maxcorrectionfactor,
+	       r.settlingtime, r.overshoot);
+  }
+
+  /*
+   * The Controller's way of heating: the RIMS tube is aimed at
+   * target + heatoverhead until the MT gets within the accuracy
+   */
+  float AutoTuner::predict(float _heatoverhead, float _hecycletime, float &_overshoot) const {
+    const float dt = 0.1f;
+    const float K = c_results.gain, tau = c_results.tau, g = c_results.mtrate;
+    const int ctrlsteps = std::lround(c_predictival / dt);
+    std::deque<float> delayed(std::lround(c_results.deadtime / dt), 0.0f);
+    float mt(0), x(0), u(0), maxmt(0), settled(0);
+
+    for (int i=0; i < std::lround(c_predicthorizon / dt); ++i) {
+      float t = i * dt;
+
+      if ( i % ctrlsteps == 0 ) {
+	float rimstarget = mt < c_predictstep - c_tempaccuracy ?
+	  c_predictstep + _heatoverhead : c_predictstep;
+	u = std::clamp((rimstarget - mt) / K, 0.0f, 1.0f);
+      }
+
+      // PWM and the dead time
+      delayed.push_back(std::fmod(t, _hecycletime) < u * _hecycletime ? 1.0f : 0.0f);
+      float on = delayed.front();
+      delayed.pop_front();
+
+      x += (K * on - x) * dt / tau;
+      mt += g * x * dt;
+
+      maxmt = std::max(maxmt, mt);
+      if ( std::fabs(mt - c_predictstep) > c_tempaccuracy ) settled = t + dt;
+    }
+
+    _overshoot = std::max(0.0f, maxmt - c_predictstep);
+    return settled;
+  }
+}
@@ -0,0 +1,129 @@
+/*
+ * Auto-tuning of the heating parameters
+ * Runs in maintenance mode with water only and the pump on. The heating
+ * element is driven through a step up and a step down, and the RIMS tube's
+ * response (RIMS - MT) is identified as a first order system with dead time:
+ *   gain at full power, time constant and dead time
+ * while the mash tun's heating rate is identified from its rise over the
+ * two steps, compensated with its drift while settling:
+ *   dT_mt/dt = g * (T_rims - T_mt)
+ * The heating parameters are derived from the model:
+ *  - hecycletime: the longest PWM cycle with an acceptable ripple in the tube
+ *  - hedelay: the tube's dead time
+ *  - heatoverhead: the fastest simulated step without overshooting more than
+ *    the temperature accuracy
+ *  - maxcorrectionfactor: the nominal vs the identified element power
+ * The settling time and the overshoot of a 5C step are predicted by simulating
+ * the identified model with these parameters.
+ */
+
+#ifndef AEGIR_AUTOTUNER_H
+#define AEGIR_AUTOTUNER_H
+
+#include <time.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "LogChannel.hh"
+
+namespace aegir {
+
+  class AutoTuner {
+    AutoTuner(AutoTuner&&) = delete;
+    AutoTuner(const AutoTuner &) = delete;
+    AutoTuner &operator=(AutoTuner &&) = delete;
+    AutoTuner &operator=(const AutoTuner &) = delete;
+  public:
+    enum class Phases {
+      Idle,
+      Settle,		// heating off, waiting for steady temperatures
+      StepUp,		// heating on with c_stepratio
+      StepDown,		// heating off again
+      Done,
+      Failed
+    };
+    struct Results {
+      // the tube's temperature rise at full power, C
+      float gain;
+      // the tube's time constant and dead time, secs
+      float tau;
+      float deadtime;
+      // the mash tun's heating rate, 1/s
+      float mtrate;
+      // the proposed configuration, maxcorrectionfactor is 0 when the
+      // volume isn't known
+      float hecycletime;
+      float heatoverhead;
+      uint32_t hedelay;
+      float maxcorrectionfactor;
+      // predicted on a 5C step, secs and C
+      float settlingtime;
+      float overshoot;
+    };
+
+    // the on-ratio of the step test
+    static constexpr float c_stepratio = 0.5f;
+    // the least time spent in every phase, secs
+    static constexpr uint32_t c_mintime = 60;
+    // a phase fails after this long, secs
+    static constexpr uint32_t c_maxtime = 900;
+
+  public:
+    AutoTuner();
+    ~AutoTuner();
+
+    // _hepower is the nominal element power in kW, _volume is the water
+    // in the mash tun in liters, 0 when not known
+    void start(time_t _now, float _hepower, float _volume, float _tempaccuracy);
+    void stop();
+    // processes a reading, returns the on-ratio to set
+    float update(time_t _now, float _mt, float _rims);
+
+    inline Phases getPhase() const { return c_phase; };
+    const char *getPhaseName() const;
+    inline bool isRunning() const {
+      return c_phase != Phases::Idle && c_phase != Phases::Done && c_phase != Phases::Failed;
+    };
+    inline time_t getStartTime() const { return c_starttime; };
+    inline const std::string &getError() const { return c_error; };
+    inline const Results &getResults() const { return c_results; };
+
+    // simulates a 5C step on the identified model, returns the settling time
+    float predict(float _heatoverhead, float _hecycletime, float &_overshoot) const;
+
+  private:
+    struct sample {
+      time_t time;
+      float mt, rims;
+      inline float x() const { return rims - mt; };
+    };
+    void enter(Phases _phase, float _ratio);
+    void fail(const char *_error);
+    bool isSteady() const;
+    float meanX(std::size_t _n) const;
+    bool fitStep(float _from, float _to, float &_tau, float &_deadtime) const;
+    bool identifyUp();
+    void identifyDown();
+    bool identifyMT();
+    float driftMT() const;
+    void propose();
+
+  private:
+    Phases c_phase;
+    float c_ratio;
+    float c_hepower, c_volume, c_tempaccuracy;
+    time_t c_starttime, c_phasestart;
+    std::size_t c_phasefirst, c_stepfirst;
+    std::vector<sample> c_samples;
+    // RIMS - MT when settled, and at the end of the step up
+    float c_x0, c_xup;
+    // the MT's drift with the heating off, C/s
+    float c_drift;
+    Results c_results;
+    std::string c_error;
+    LogChannel c_log;
+  };
+}
+
+#endif
@@ -0,0 +1,8 @@
+
+#include "Clock.hh"
+
+namespace aegir {
+
+  std::atomic<time_t> Clock::c_replaynow(0);
+
+}
@@ -0,0 +1,44 @@
+/*
+ * The wall clock of the control logic
+ * It's the system time, except when a recorded brew is replayed: then the
+ * time is set by the replay from the trace, so the control logic sees the
+ * same time passing as it did during the brew, but at full speed.
+ */
+
+#ifndef AEGIR_CLOCK_H
+#define AEGIR_CLOCK_H
+
+#include <cstdint>
+#include <ctime>
+#include <atomic>
+#include <chrono>
+
+namespace aegir {
+
+  class Clock {
+    Clock() = delete;
+    Clock(Clock&&) = delete;
+    Clock(const Clock &) = delete;
+    Clock &operator=(Clock &&) = delete;
+    Clock &operator=(const Clock &) = delete;
+
+  public:
+    static inline time_t now() {
+      time_t replay = c_replaynow.load(std::memory_order_relaxed);
+      return replay ? replay : time(0);
+    };
+    // stops the clock at _now, 0 switches back to the system time
+    static inline void setReplay(time_t _now) { c_replaynow = _now; };
+    static inline bool isReplay() { return c_replaynow != 0; };
+    // usecs of the monotonic clock for the latencies, it's never replayed
+    static inline uint64_t monotonic() {
+      return std::chrono::duration_cast<std::chrono::microseconds>
+	(std::chrono::steady_clock::now().time_since_epoch()).count();
+    };
+
+  private:
+    static std::atomic<time_t> c_replaynow;
+  };
+}
+
+#endif
@@ -2,13 +2,16 @@
 #include "Config.hh"
 
 #include <stdio.h>
+#include <sched.h>
 
 #include <iostream>
 #include <fstream>
+#include <mutex>
 
 #include <yaml-cpp/yaml.h>
 
 #include "Exception.hh"
+#include "Snapshot.hh"
 #include "logging.hh"
 
 namespace aegir {
@@ -20,13 +23,21 @@ namespace aegir {
     {"cs1", PinConfig(PinMode::OUT, PinPull::NONE)},
     {"cs2", PinConfig(PinMode::OUT, PinPull::NONE)},
     {"cs3", PinConfig(PinMode::OUT, PinPull::NONE)},
+    // the chips of the extra sensors, optional
+    {"cs4", PinConfig(PinMode::OUT, PinPull::NONE)},
+    {"cs5", PinConfig(PinMode::OUT, PinPull::NONE)},
+    {"cs6", PinConfig(PinMode::OUT, PinPull::NONE)},
+    {"cs7", PinConfig(PinMode::OUT, PinPull::NONE)},
     {"mtpump", PinConfig(PinMode::OUT, PinPull::NONE)},
     {"bkpump", PinConfig(PinMode::OUT, PinPull::NONE)},
     {"mtheat", PinConfig(PinMode::OUT, PinPull::NONE)},
+    {"bkheat", PinConfig(PinMode::OUT, PinPull::NONE)},
+    {"hltheat", PinConfig(PinMode::OUT, PinPull::NONE)},
     {"buzzer", PinConfig(PinMode::OUT, PinPull::NONE)}
   };
 
-  static std::set<std::string> g_tcnames{"HERMS", "MashTun", "HLT", "BK"};
+  // the pins of the vessels' heating elements
+  static std::set<std::string> g_heaterpins{"bkheat", "hltheat"};
 
   // SPI ChipSelector string translations
   static std::map<ChipSelectors, std::string> g_spi_cs_to_string{
@@ -63,20 +74,98 @@ namespace aegir {
     {NoiseFilters::HZ50, "50Hz"},
       {NoiseFilters::HZ60, "60Hz"}
   };
+  // Control strategy lookups
+  static std::map<std::string, ControlStrategies> g_string_to_strategy{
+    {"heuristic", ControlStrategies::Heuristic},
+    {"mpc", ControlStrategies::MPC}
+  };
+  static std::map<ControlStrategies, std::string> g_strategy_to_string{
+    {ControlStrategies::Heuristic, "heuristic"},
+    {ControlStrategies::MPC, "mpc"}
+  };
+  // Thread scheduling policy lookups
+  static std::map<std::string, SchedPolicies> g_string_to_policy{
+    {"other", SchedPolicies::Other},
+    {"fifo", SchedPolicies::FIFO},
+    {"rr", SchedPolicies::RR}
+  };
+  static std::map<SchedPolicies, std::string> g_policy_to_string{
+    {SchedPolicies::Other, "other"},
+    {SchedPolicies::FIFO, "fifo"},
+    {SchedPolicies::RR, "rr"}
+  };
+  // Thread restart policy lookups
+  static std::map<std::string, RestartPolicies> g_string_to_restart{
+    {"never", RestartPolicies::Never},
+    {"onfailure", RestartPolicies::OnFailure}
+  };
+  static std::map<RestartPolicies, std::string> g_restart_to_string{
+    {RestartPolicies::Never, "never"},
+    {RestartPolicies::OnFailure, "onfailure"}
+  };
+  // the threads not configured aren't watched, but restarted
+  static const SupervisorConfig g_supervisor_default{0, RestartPolicies::OnFailure, 5, 1000};
 
-  Config::Config() {
+  // the snapshots' writers, the readers never wait for it
+  static std::mutex g_writers;
+
+  Config::Config(): c_version(0) {
     setDefaults();
   }
 
+  Config::Config(const Config &) = default;
+
   Config::~Config() {
-    save();
   }
 
-  std::shared_ptr<Config> Config::getInstance() {
-    static std::shared_ptr<Config> instance{new Config()};
+  Snapshot<Config> &Config::snapshots() {
+    static Snapshot<Config> instance(std::shared_ptr<const Config>(new Config()));
     return instance;
   }
 
+  std::shared_ptr<const Config> Config::getInstance() {
+    return snapshots().load();
+  }
+
+  std::shared_ptr<Config> Config::edit() {
+    return std::shared_ptr<Config>(new Config(*getInstance()));
+  }
+
+  std::shared_ptr<const Config> Config::publish(std::shared_ptr<Config> _cfg) {
+    _cfg->c_version = snapshots().load()->c_version + 1;
+    logging::setLevel(_cfg->c_loglevel);
+    snapshots().store(_cfg);
+    return _cfg;
+  }
+
+  std::shared_ptr<const Config> Config::reload(const std::string& _file) {
+    std::shared_ptr<Config> next(new Config());
+
+    // parsed off the lock, a broken file leaves the current snapshot in place
+    next->load(_file);
+
+    std::lock_guard<std::mutex> g(g_writers);
+    return publish(next);
+  }
+
+  std::shared_ptr<const Config> Config::reload() {
+    std::string file = getInstance()->c_cfgfile;
+
+    if ( file.empty() )
+      throw Exception("No config file to reload");
+    return reload(file);
+  }
+
+  std::shared_ptr<const Config> Config::update(const std::function<void(Config&)> &_change) {
+    std::lock_guard<std::mutex> g(g_writers);
+    std::shared_ptr<Config> next(new Config(*snapshots().load()));
+
+    _change(*next);
+    publish(next);
+    next->save();
+    return next;
+  }
+
   void Config::setDefaults() {
     c_device = "/dev/gpioc0";
 
@@ -106,6 +195,7 @@ namespace aegir {
     c_thermocouples.tcs[ThermoCouple::HERMS] = 0;
     c_thermocouples.tcs[ThermoCouple::BK] = 3;
     c_thermocouples.tcs[ThermoCouple::HLT] = 2;
+    c_thermocouples.size = ThermoCouple::_SIZE;
 
     // thermocouple reading interval
     c_thermoival = 1;
@@ -113,6 +203,9 @@ namespace aegir {
     // the PR ZMQ socket
     c_zmq_pr_port = 42069;
 
+    // the embedded HTTP server is disabled by default
+    c_http_port = 0;
+
     // the heating element's power
     c_hepower = 9000;
 
@@ -133,9 +226,38 @@ namespace aegir {
 
     // HE startup delay
     c_hedelay = 10;
+    c_mashgrace = 15;
 
     // loglevel
-    c_loglevel = blt::severity_level::info;
+    setLogLevel(blt::severity_level::info);
+
+    // max correction factor
+    c_maxcorrectionfactor = 1.15f;
+
+    // temperature control strategy
+    c_controlstrategy = ControlStrategies::Heuristic;
+
+    // only the RIMS/HERMS element, without a limit
+    c_heaters.clear();
+    c_maxpower = 0;
+
+    // the control loop's budgets within its 1s period
+    c_loopbudget = {50, 50, 200, 300, 100, 500, 10};
+
+    // the threads are started with the defaults
+    c_threadsched.clear();
+    c_memlock = false;
+    c_stackprefault = 0;
+
+    // the heartbeats of the control loop and the IO
+    c_supervisor.clear();
+    c_supervisor["Controller"] = {5000, RestartPolicies::OnFailure, 5, 1000};
+    c_supervisor["IOHandler"] = {2000, RestartPolicies::OnFailure, 5, 1000};
+
+    // the output latch, without a hardware watchdog
+    c_watchdogtimeout = 5000;
+    c_watchdogdevice = "";
+    c_watchdogstandin = false;
   }
 
   void Config::load(const std::string& _file) {
@@ -216,8 +338,8 @@ namespace aegir {
 	if ( spi["DirectSelect"] && spi["DirectSelect"].IsMap() ) {
 	  YAML::Node ds = spi["DirectSelect"];
 
-	  // we have 3 hardcoded sensors at this level, for now
-	  for (int i=0; i<3; ++i) {
+	  // a chip for every sensor at most
+	  for (int i=0; i<ThermoCouple::_MAX; ++i) {
 	    if ( !ds[i] ) continue;
 	    std::string pin = ds[i].as<std::string>();
 	    auto it = g_pinconfig.find(pin);
@@ -240,21 +362,32 @@ namespace aegir {
 	if ( spi["thermocouples"] && spi["thermocouples"].IsMap() ) {
 	  YAML::Node tc = spi["thermocouples"];
 
-	  // We are going through only the valid ones, the rest are ignored
-	  // also, not emptying the list, because that's how unset values default
-	  for (auto &it: g_tcnames) {
-	    if ( tc[it] ) {
-	      int id = tc[it].as<int>();
-	      if ( id < 0 || id > 3 )
-		throw Exception("Thermocouple id out of range: %i", id);
-	      c_thermocouples.tcs[ThermoCouple(it)] = id;
+	  // The well-known ones are set by their names, unset values default.
+	  // The rest are the extra sensors, they're named by the config.
+	  c_sensornames.clear();
+	  c_thermocouples.size = ThermoCouple::_SIZE;
+	  for (auto it: tc) {
+	    std::string name = it.first.as<std::string>();
+	    int id = it.second.as<int>();
+	    if ( c_spi_dschips.find(id) == c_spi_dschips.end() )
+	      throw Exception("Thermocouple id out of range: %i", id);
+
+	    try {
+	      c_thermocouples.tcs[ThermoCouple(name)] = id;
+	      continue;
 	    }
+	    catch (Exception &e) {
+	    }
+	    if ( c_thermocouples.size == ThermoCouple::_MAX )
+	      throw Exception("Too many thermocouples, the limit is %i", ThermoCouple::_MAX);
+	    c_sensornames.set(c_thermocouples.size, name);
+	    c_thermocouples.tcs[c_thermocouples.size++] = id;
 	  }
 	  // now verify whether any of them is on the same id
 	  std::set<int> tmp;
-	  for (uint8_t i=0; i < ThermoCouple::_SIZE; ++i) {
-	    if ( tmp.find(c_thermocouples.tcs[i]) != tmp.end() )
-	      throw Exception("Duplicate thermocouple id: %i", i);
+	  for (uint8_t i=0; i < c_thermocouples.size; ++i) {
+	    if ( !tmp.insert(c_thermocouples.tcs[i]).second )
+	      throw Exception("Duplicate thermocouple id: %i", c_thermocouples.tcs[i]);
 	  }
 	} // thermocouples
 	if ( spi["thermointerval"] && spi["thermointerval"].IsScalar() ) {
@@ -271,6 +404,12 @@ namespace aegir {
 	c_zmq_pr_port = prsock.as<uint16_t>();
       }
 
+      // embedded HTTP server
+      if ( config["httpport"] && config["httpport"].IsScalar() ) {
+	YAML::Node httpport = config["httpport"];
+	c_http_port = httpport.as<uint16_t>();
+      }
+
       // Heating Element's Power
       if ( config["elementpower"] && config["elementpower"].IsScalar() ) {
 	YAML::Node hep = config["elementpower"];
@@ -327,6 +466,13 @@ namespace aegir {
 	  throw Exception("HE startup delay must be less than 30");
       }
 
+      // the mash steps' grace period
+      if ( config["mashgrace"] && config["mashgrace"].IsScalar() ) {
+	c_mashgrace = config["mashgrace"].as<uint32_t>();
+	if ( c_mashgrace > 120 )
+	  throw Exception("The mash steps' grace period must be at most 120 minutes");
+      }
+
       // LogLevel
       if ( config["loglevel"] && config["loglevel"].IsScalar() ) {
 	std::string level = config["loglevel"].as<std::string>();
@@ -337,8 +483,176 @@ namespace aegir {
       if ( config["maxcorrection"] && config["maxcorrection"].IsScalar() ) {
 	YAML::Node ct = config["maxcorrection"];
 	c_maxcorrectionfactor = ct.as<float>();
-	if ( c_maxcorrectionfactor < 1.10f || c_maxcorrectionfactor > 1.25f )
-	  throw Exception("Cooling MaxCorrectionFactor must be between 1.10 and 1.25");
+	if ( c_maxcorrectionfactor < 1.0f || c_maxcorrectionfactor > 1.25f )
+	  throw Exception("Cooling MaxCorrectionFactor must be between 1.0 and 1.25");
+      }
+
+      // temperature control strategy
+      if ( config["controlstrategy"] && config["controlstrategy"].IsScalar() ) {
+	std::string strategy = config["controlstrategy"].as<std::string>();
+	auto it = g_string_to_strategy.find(strategy);
+	if ( it == g_string_to_strategy.end() )
+	  throw Exception("Unknown control strategy: %s", strategy.c_str());
+	c_controlstrategy = it->second;
+      }
+
+      // the circuit's power limit
+      if ( config["maxpower"] && config["maxpower"].IsScalar() ) {
+	c_maxpower = config["maxpower"].as<uint32_t>();
+	if ( c_maxpower && (c_maxpower < 1000 || c_maxpower > 20000) )
+	  throw Exception("The maximum power is out of range");
+      }
+
+      // the control loop's budgets
+      if ( config["loopbudget"] && config["loopbudget"].IsMap() ) {
+	YAML::Node lb = config["loopbudget"];
+	std::pair<const char*, uint32_t*> budgets[] = {
+	  {"wakeup", &c_loopbudget.wakeup},
+	  {"inputs", &c_loopbudget.inputs},
+	  {"stages", &c_loopbudget.stages},
+	  {"tempcontrol", &c_loopbudget.tempcontrol},
+	  {"endcycle", &c_loopbudget.endcycle},
+	  {"cycle", &c_loopbudget.cycle},
+	};
+
+	for (auto &it: budgets) {
+	  if ( !lb[it.first] ) continue;
+	  *it.second = lb[it.first].as<uint32_t>();
+	  if ( *it.second > 1000 )
+	    throw Exception("The loop budget of %s is over the 1s period", it.first);
+	}
+	if ( lb["worst"] ) {
+	  c_loopbudget.worst = lb["worst"].as<uint32_t>();
+	  if ( c_loopbudget.worst > 100 )
+	    throw Exception("At most 100 of the worst cycles can be kept");
+	}
+      }
+
+      // the threads' scheduling
+      if ( config["threads"] && config["threads"].IsMap() ) {
+	std::map<std::string, ThreadSchedConfig> threadsched;
+
+	for (const auto &it: config["threads"]) {
+	  std::string name = it.first.as<std::string>();
+	  YAML::Node thread = it.second;
+	  ThreadSchedConfig tsc{{}, SchedPolicies::Other, 0};
+
+	  if ( thread["cpus"] ) {
+	    if ( !thread["cpus"].IsSequence() )
+	      throw Exception("Thread %s's cpus must be a list", name.c_str());
+	    for (const auto &cpu: thread["cpus"]) {
+	      tsc.cpus.push_back(cpu.as<uint32_t>());
+	      if ( tsc.cpus.back() >= 256 )
+		throw Exception("Thread %s's CPU %u is out of range", name.c_str(), tsc.cpus.back());
+	    }
+	  }
+	  if ( thread["policy"] ) {
+	    std::string policy = thread["policy"].as<std::string>();
+	    auto pit = g_string_to_policy.find(policy);
+	    if ( pit == g_string_to_policy.end() )
+	      throw Exception("Thread %s has an unknown scheduling policy: %s", name.c_str(), policy.c_str());
+	    tsc.policy = pit->second;
+	  }
+	  if ( thread["priority"] ) {
+	    tsc.priority = thread["priority"].as<int>();
+	    int policy = tsc.policy == SchedPolicies::FIFO ? SCHED_FIFO : SCHED_RR;
+	    if ( tsc.policy == SchedPolicies::Other && tsc.priority )
+	      throw Exception("Thread %s's priority needs the fifo or the rr policy", name.c_str());
+	    if ( tsc.policy != SchedPolicies::Other &&
+		 (tsc.priority < sched_get_priority_min(policy) ||
+		  tsc.priority > sched_get_priority_max(policy)) )
+	      throw Exception("Thread %s's priority must be between %i and %i", name.c_str(),
+			      sched_get_priority_min(policy), sched_get_priority_max(policy));
+	  }
+	  threadsched[name] = tsc;
+	}
+	c_threadsched = threadsched;
+      }
+
+      if ( config["memlock"] && config["memlock"].IsScalar() )
+	c_memlock = config["memlock"].as<bool>();
+
+      if ( config["stackprefault"] && config["stackprefault"].IsScalar() ) {
+	c_stackprefault = config["stackprefault"].as<uint32_t>();
+	if ( c_stackprefault > 1024 )
+	  throw Exception("At most 1024KiB of the stacks can be pre-faulted");
+      }
+
+      // the threads' supervision, merged into the defaults
+      if ( config["supervisor"] && config["supervisor"].IsMap() ) {
+	std::map<std::string, SupervisorConfig> supervisor(c_supervisor);
+
+	for (const auto &it: config["supervisor"]) {
+	  std::string name = it.first.as<std::string>();
+	  YAML::Node thread = it.second;
+	  auto sit = supervisor.find(name);
+	  SupervisorConfig sc = sit != supervisor.end() ? sit->second : g_supervisor_default;
+
+	  if ( !thread.IsMap() )
+	    throw Exception("Supervisor of thread %s must be a map", name.c_str());
+	  if ( thread["timeout"] ) {
+	    sc.timeout = thread["timeout"].as<uint32_t>();
+	    if ( sc.timeout && sc.timeout < 500 )
+	      throw Exception("Thread %s's heartbeat timeout must be at least 500ms", name.c_str());
+	  }
+	  if ( thread["restart"] ) {
+	    std::string restart = thread["restart"].as<std::string>();
+	    auto rit = g_string_to_restart.find(restart);
+	    if ( rit == g_string_to_restart.end() )
+	      throw Exception("Thread %s has an unknown restart policy: %s", name.c_str(), restart.c_str());
+	    sc.restart = rit->second;
+	  }
+	  if ( thread["maxrestarts"] )
+	    sc.maxrestarts = thread["maxrestarts"].as<uint32_t>();
+	  if ( thread["backoff"] )
+	    sc.backoff = thread["backoff"].as<uint32_t>();
+	  supervisor[name] = sc;
+	}
+	c_supervisor = supervisor;
+      }
+
+      // the watchdog
+      if ( config["watchdog"] && config["watchdog"].IsMap() ) {
+	YAML::Node wd = config["watchdog"];
+
+	if ( wd["timeout"] ) {
+	  uint32_t timeout = wd["timeout"].as<uint32_t>();
+	  if ( timeout && timeout < 2000 )
+	    throw Exception("The watchdog's timeout must be at least 2000ms, the control loop's period is 1s");
+	  c_watchdogtimeout = timeout;
+	}
+	if ( wd["device"] )
+	  c_watchdogdevice = wd["device"].as<std::string>();
+	if ( wd["standin"] )
+	  c_watchdogstandin = wd["standin"].as<bool>();
+      }
+
+      // the vessels' heating elements
+      if ( config["heaters"] && config["heaters"].IsMap() ) {
+	std::vector<HeaterConfig> heaters;
+
+	for (const auto &it: config["heaters"]) {
+	  std::string pin = it.first.as<std::string>();
+	  YAML::Node heater = it.second;
+
+	  if ( g_heaterpins.find(pin) == g_heaterpins.end() )
+	    throw Exception("Not a heater pin: %s", pin.c_str());
+	  if ( c_pinlayout.find(pin) == c_pinlayout.end() )
+	    throw Exception("Heater pin %s has no GPIO pin", pin.c_str());
+	  if ( !heater["power"] || !heater["vessel"] || !heater["temp"] )
+	    throw Exception("Heater %s needs power, vessel and temp", pin.c_str());
+
+	  HeaterConfig hc{pin, heater["power"].as<uint32_t>(),
+	    c_sensornames.find(heater["vessel"].as<std::string>()), heater["temp"].as<float>()};
+	  if ( hc.power < 500 || hc.power > 10000 )
+	    throw Exception("Heater %s's power is out of range", pin.c_str());
+	  if ( hc.vessel != ThermoCouple::BK && hc.vessel != ThermoCouple::HLT )
+	    throw Exception("Heater %s has to heat the BK or the HLT", pin.c_str());
+	  if ( hc.temp < 20.0f || hc.temp > 100.0f )
+	    throw Exception("Heater %s's temperature must be between 20C and 100C", pin.c_str());
+	  heaters.push_back(hc);
+	}
+	c_heaters = heaters;
       }
 
     }
@@ -365,10 +679,11 @@ namespace aegir {
 
   Config &Config::save(const std::string& _file) {
     c_cfgfile = _file;
-    return save();
+    save();
+    return *this;
   }
 
-  Config &Config::save() {
+  const Config &Config::save() const {
     // don't save if we don't have a file but the defaults
     if ( c_cfgfile.empty() ) return *this;
     YAML::Emitter yout;
@@ -403,8 +718,8 @@ namespace aegir {
     yout << YAML::Key << "thermocouples";
     {
       std::map<std::string, int> tcmap;
-      for (uint8_t i=0; i < ThermoCouple::_SIZE; ++i)
-	tcmap[ThermoCouple(i).toStr()] = c_thermocouples.tcs[i];
+      for (uint8_t i=0; i < c_thermocouples.size; ++i)
+	tcmap[c_sensornames.name(i)] = c_thermocouples.tcs[i];
       yout << YAML::Value << tcmap;
     }
 
@@ -417,6 +732,9 @@ namespace aegir {
     // ZMQ PR port
     yout << YAML::Key << "prport" << YAML::Value << c_zmq_pr_port;
 
+    // embedded HTTP server's port
+    yout << YAML::Key << "httpport" << YAML::Value << c_http_port;
+
     // Heating element's power in watts
     yout << YAML::Key << "elementpower" << YAML::Value << c_hepower;
 
@@ -438,6 +756,9 @@ namespace aegir {
     // cooling temperature
     yout << YAML::Key << "hedelay" << YAML::Value << c_hedelay;
 
+    // the mash steps' grace period
+    yout << YAML::Key << "mashgrace" << YAML::Value << c_mashgrace;
+
     // loglevel
     yout << YAML::Key << "loglevel"
 	 << YAML::Value << logging::str(c_loglevel);
@@ -446,6 +767,75 @@ namespace aegir {
     yout << YAML::Key << "maxcorrection"
 	 << YAML::Value << c_maxcorrectionfactor;
 
+    // temperature control strategy
+    yout << YAML::Key << "controlstrategy"
+	 << YAML::Value << g_strategy_to_string[c_controlstrategy];
+
+    // the circuit's power limit
+    yout << YAML::Key << "maxpower" << YAML::Value << c_maxpower;
+
+    // the control loop's budgets
+    yout << YAML::Key << "loopbudget" << YAML::Value << YAML::BeginMap;
+    yout << YAML::Key << "wakeup" << YAML::Value << c_loopbudget.wakeup;
+    yout << YAML::Key << "inputs" << YAML::Value << c_loopbudget.inputs;
+    yout << YAML::Key << "stages" << YAML::Value << c_loopbudget.stages;
+    yout << YAML::Key << "tempcontrol" << YAML::Value << c_loopbudget.tempcontrol;
+    yout << YAML::Key << "endcycle" << YAML::Value << c_loopbudget.endcycle;
+    yout << YAML::Key << "cycle" << YAML::Value << c_loopbudget.cycle;
+    yout << YAML::Key << "worst" << YAML::Value << c_loopbudget.worst;
+    yout << YAML::EndMap;
+
+    // the threads' scheduling
+    if ( c_threadsched.size() ) {
+      yout << YAML::Key << "threads" << YAML::Value << YAML::BeginMap;
+      for (auto &it: c_threadsched) {
+	yout << YAML::Key << it.first << YAML::Value << YAML::BeginMap;
+	if ( it.second.cpus.size() )
+	  yout << YAML::Key << "cpus" << YAML::Value << YAML::Flow << it.second.cpus;
+	yout << YAML::Key << "policy" << YAML::Value << g_policy_to_string[it.second.policy];
+	if ( it.second.policy != SchedPolicies::Other )
+	  yout << YAML::Key << "priority" << YAML::Value << it.second.priority;
+	yout << YAML::EndMap;
+      }
+      yout << YAML::EndMap;
+    }
+    yout << YAML::Key << "memlock" << YAML::Value << c_memlock;
+    yout << YAML::Key << "stackprefault" << YAML::Value << c_stackprefault;
+
+    // the watchdog
+    yout << YAML::Key << "watchdog" << YAML::Value << YAML::BeginMap;
+    yout << YAML::Key << "timeout" << YAML::Value << c_watchdogtimeout;
+    if ( c_watchdogdevice.length() )
+      yout << YAML::Key << "device" << YAML::Value << c_watchdogdevice;
+    if ( c_watchdogstandin )
+      yout << YAML::Key << "standin" << YAML::Value << c_watchdogstandin;
+    yout << YAML::EndMap;
+
+    // the threads' supervision
+    yout << YAML::Key << "supervisor" << YAML::Value << YAML::BeginMap;
+    for (auto &it: c_supervisor) {
+      yout << YAML::Key << it.first << YAML::Value << YAML::BeginMap;
+      yout << YAML::Key << "timeout" << YAML::Value << it.second.timeout;
+      yout << YAML::Key << "restart" << YAML::Value << g_restart_to_string[it.second.restart];
+      yout << YAML::Key << "maxrestarts" << YAML::Value << it.second.maxrestarts;
+      yout << YAML::Key << "backoff" << YAML::Value << it.second.backoff;
+      yout << YAML::EndMap;
+    }
+    yout << YAML::EndMap;
+
+    // the vessels' heating elements
+    if ( c_heaters.size() ) {
+      yout << YAML::Key << "heaters" << YAML::Value << YAML::BeginMap;
+      for (auto &it: c_heaters) {
+	yout << YAML::Key << it.pin << YAML::Value << YAML::BeginMap;
+	yout << YAML::Key << "power" << YAML::Value << it.power;
+	yout << YAML::Key << "vessel" << YAML::Value << it.vessel.toStr();
+	yout << YAML::Key << "temp" << YAML::Value << it.temp;
+	yout << YAML::EndMap;
+      }
+      yout << YAML::EndMap;
+    }
+
     // End the config
     yout << YAML::EndMap;
 
@@ -462,7 +852,7 @@ namespace aegir {
     return c_device;
   }
 
-  Config &Config::getPinConfig(pinlayout_t &_layout) {
+  const Config &Config::getPinConfig(pinlayout_t &_layout) const {
     _layout = c_pinlayout;
     return *this;
   }
@@ -482,6 +872,11 @@ namespace aegir {
     return *this;
   }
 
+  Config &Config::setHECycleTime(float _v) {
+    c_hecycletime = _v;
+    return *this;
+  }
+
   Config &Config::setCoolTemp(float _v) {
     c_cooltemp = _v;
     return *this;
@@ -511,13 +906,33 @@ namespace aegir {
   }
 
   Config &Config::setLogLevel(blt::severity_level _level) {
+    // applied when the snapshot is published
     c_loglevel = _level;
     return *this;
   }
 
   Config &Config::setMaxCorrectionFactor(float _factor) {
-    if ( _factor >= 1.10f && _factor <= 1.25f )
+    if ( _factor >= 1.0f && _factor <= 1.25f )
       c_maxcorrectionfactor = _factor;
     return *this;
   }
+
+  const SupervisorConfig &Config::getSupervisor(const std::string &_name) const {
+    auto it = c_supervisor.find(_name);
+    if ( it == c_supervisor.end() ) return g_supervisor_default;
+    return it->second;
+  }
+
+  const std::string &Config::getControlStrategyName() const {
+    return g_strategy_to_string[c_controlstrategy];
+  }
+
+  Config &Config::setControlStrategy(const std::string &_strategy) {
+    auto it = g_string_to_strategy.find(_strategy);
+    if ( it == g_string_to_strategy.end() )
+      throw Exception("Unknown control strategy: %s", _strategy.c_str());
+
+    c_controlstrategy = it->second;
+    return *this;
+  }
 }
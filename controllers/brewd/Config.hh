@@ -1,7 +1,9 @@
 /*
   aegir-brewd config file reader and writer
   Config file is YAML, handled with yaml-cpp
-  This should be a singleton
+  The config is published as immutable, versioned snapshots: the readers
+  take the current one without locking, the changes and the reloads are
+  made on a copy, and swapped in when they're complete
  */
 
 #ifndef AEGIR_CONFIG_H
@@ -10,7 +12,9 @@
 #include <string>
 #include <map>
 #include <set>
+#include <functional>
 #include <memory>
+#include <vector>
 
 #include <boost/log/trivial.hpp>
 
@@ -26,6 +30,9 @@ namespace aegir {
   enum class PinPull { NONE, DOWN, UP};
   enum class ChipSelectors {DirectSelect};
   enum class NoiseFilters {HZ50, HZ60};
+  enum class ControlStrategies {Heuristic, MPC};
+  enum class SchedPolicies {Other, FIFO, RR};
+  enum class RestartPolicies {Never, OnFailure};
   // we will have to add default states for out pins
   struct PinConfig {
     PinConfig() {};
@@ -37,25 +44,77 @@ namespace aegir {
 
   using pinconfig_t = std::map<std::string, PinConfig>;
 
+  // a vessel's own heating element, besides the RIMS/HERMS one
+  struct HeaterConfig {
+    std::string pin;
+    // W
+    uint32_t power;
+    ThermoCouple vessel;
+    // the vessel's target temperature
+    float temp;
+  };
+
+  // a thread's CPU affinity and scheduling
+  struct ThreadSchedConfig {
+    // any of them when empty
+    std::vector<uint32_t> cpus;
+    SchedPolicies policy;
+    // only with the real-time policies
+    int priority;
+  };
+
+  // how a thread is supervised
+  struct SupervisorConfig {
+    // no heartbeat for this long is a stall, msecs, 0 doesn't watch it
+    uint32_t timeout;
+    RestartPolicies restart;
+    // the restarts allowed within the restart window
+    uint32_t maxrestarts;
+    // the delay before the first restart, doubled by every further one, msecs
+    uint32_t backoff;
+  };
+
   extern pinconfig_t g_pinconfig;
 
+  template<typename T> class Snapshot;
+
   class Config {
     Config();
+    // the snapshots are copied to be changed
+    Config(const Config&);
     Config(Config&&) = delete;
     Config &operator=(const Config&) = delete;
     Config &operator=(Config&&) = delete;
 
   public:
+    // the chip id of every sensor
     struct tcids {
-      int tcs[ThermoCouple::_SIZE];
+      int tcs[ThermoCouple::_MAX];
+      uint8_t size;
+    };
+    // the control loop's deadline budgets, msecs, 0 is not checked
+    struct LoopBudget {
+      uint32_t wakeup;
+      uint32_t inputs;
+      uint32_t stages;
+      uint32_t tempcontrol;
+      uint32_t endcycle;
+      uint32_t cycle;
+      // the number of the worst cycles kept
+      uint32_t worst;
     };
 
   private:
     void setDefaults();
     void checkPinConfig(std::map<std::string, int> &_layout);
+    static Snapshot<Config> &snapshots();
+    // makes _cfg the current snapshot with the next version, the writers' lock held
+    static std::shared_ptr<const Config> publish(std::shared_ptr<Config> _cfg);
 
   private:
     std::string c_cfgfile;
+    // bumped by every published snapshot
+    uint64_t c_version;
     // Config parameters
     // The device for the GPIO controller
     std::string c_device;
@@ -72,10 +131,14 @@ namespace aegir {
     // thermocouple layout
     // std::map<std::string, int> c_thermocouples;
     tcids c_thermocouples;
+    // the extra sensors' names
+    SensorNames c_sensornames;
     // thermocouple reading interval in seconds
     uint32_t c_thermoival;
     // PR ZMQ address
     uint16_t c_zmq_pr_port;
+    // embedded HTTP server's port, 0 disables it
+    uint16_t c_http_port;
     // The heating element's power
     uint32_t c_hepower;
     // pin handling interval, milisecs
@@ -90,30 +153,65 @@ namespace aegir {
     float c_cooltemp;
     // heating start delay time, circ pump is not instant, seconds
     uint32_t c_hedelay;
+    // a mash step ends this long after its hold time, even if the mash
+    // didn't stay at the temperature for the whole hold, minutes
+    uint32_t c_mashgrace;
     // loglevel
     blt::severity_level c_loglevel;
     // max correction factor
     float c_maxcorrectionfactor;
+    // the temperature control strategy
+    ControlStrategies c_controlstrategy;
+    // the vessels' heating elements, in priority order
+    std::vector<HeaterConfig> c_heaters;
+    // the circuit's limit for the heating elements, W, 0 is unlimited
+    uint32_t c_maxpower;
+    LoopBudget c_loopbudget;
+    // the threads' scheduling by their names, the rest is left as it is
+    std::map<std::string, ThreadSchedConfig> c_threadsched;
+    // mlockall() the process
+    bool c_memlock;
+    // the threads' stack pre-faulted on start, KiB
+    uint32_t c_stackprefault;
+    // the threads' supervision by their names
+    std::map<std::string, SupervisorConfig> c_supervisor;
+    // the Controller not feeding the watchdog for this long latches the outputs, msecs
+    uint32_t c_watchdogtimeout;
+    // the hardware watchdog, none when empty
+    std::string c_watchdogdevice;
+    // the device is a regular file standing in for the watchdog
+    bool c_watchdogstandin;
 
   public:
-    Config(const Config&) = delete;
     ~Config();
-    static std::shared_ptr<Config> getInstance();
+    // the current snapshot, it never changes, the readers keep it as long as they need
+    static std::shared_ptr<const Config> getInstance();
+    // a copy of the current snapshot, to be changed and saved
+    static std::shared_ptr<Config> edit();
+    // _file loaded into a new snapshot, published only when it's all valid
+    static std::shared_ptr<const Config> reload(const std::string& _file);
+    // the current snapshot's file
+    static std::shared_ptr<const Config> reload();
+    // _change applied to a copy of the current snapshot, published and saved
+    static std::shared_ptr<const Config> update(const std::function<void(Config&)> &_change);
     void load(const std::string& _file);
     Config &save(const std::string& _file);
-    Config &save();
+    const Config &save() const;
+    inline uint64_t getVersion() const { return c_version; };
 
     // retrieve config elements
     const std::string &getGPIODevice() const;
-    Config &getPinConfig(pinlayout_t &_layout);
+    const Config &getPinConfig(pinlayout_t &_layout) const;
     inline const std::string &getSPIDevice() const {return c_spidev;};
     inline const ChipSelectors getSPIChipSelector() const {return c_spi_chipselector;};
     inline const MAX31856::TCType getMAX31856TCType() const {return c_spi_max31856_tctype;};
     inline const NoiseFilters getMAX31856NoiseFilter() const { return c_spi_max31856_noisefilter;};
     inline const void getSPIDSChips(std::map<int, std::string> &_chips) const {_chips = c_spi_dschips;};
     inline const tcids& getThermocouples() const { return c_thermocouples; };
+    inline const SensorNames& getSensorNames() const { return c_sensornames; };
     inline const uint32_t getTCival() const { return c_thermoival;};
     inline const uint16_t getPRPort() const { return c_zmq_pr_port; };
+    inline const uint16_t getHTTPPort() const { return c_http_port; };
     inline const uint32_t getHEPower() const { return c_hepower; };
     inline const uint32_t getPINival() const { return c_pinival; };
     inline const float getTempAccuracy() const { return c_tempaccuracy; };
@@ -121,18 +219,34 @@ namespace aegir {
     inline const float getHECycleTime() const { return c_hecycletime; };
     inline const float getCoolTemp() const { return c_cooltemp; };
     inline const uint32_t getHEDelay() const { return c_hedelay; };
+    inline const uint32_t getMashGrace() const { return c_mashgrace; };
     inline const blt::severity_level getLogLevel() const { return c_loglevel; };
     inline const float getMaxCorrectionFactor() const { return c_maxcorrectionfactor; };
+    inline const ControlStrategies getControlStrategy() const { return c_controlstrategy; };
+    const std::string &getControlStrategyName() const;
+    inline const std::vector<HeaterConfig> &getHeaters() const { return c_heaters; };
+    inline const uint32_t getMaxPower() const { return c_maxpower; };
+    inline const LoopBudget &getLoopBudget() const { return c_loopbudget; };
+    inline const std::map<std::string, ThreadSchedConfig> &getThreadSched() const { return c_threadsched; };
+    inline const bool getMemLock() const { return c_memlock; };
+    inline const uint32_t getStackPrefault() const { return c_stackprefault; };
+    // the supervision of thread _name, the defaults when it's not configured
+    const SupervisorConfig &getSupervisor(const std::string &_name) const;
+    inline const uint32_t getWatchdogTimeout() const { return c_watchdogtimeout; };
+    inline const std::string &getWatchdogDevice() const { return c_watchdogdevice; };
+    inline const bool getWatchdogStandin() const { return c_watchdogstandin; };
 
     // Setting config elements
     Config &setHEPower(uint32_t _v);
     Config &setTempAccuracy(float _v);
     Config &setHeatOverhead(float _v);
+    Config &setHECycleTime(float _v);
     Config &setCoolTemp(float _v);
     Config &setHEDelay(uint32_t _v);
     Config &setLogLevel(const std::string& _level);
     Config &setLogLevel(blt::severity_level _level);
     Config &setMaxCorrectionFactor(float _factor);
+    Config &setControlStrategy(const std::string &_strategy);
   };
 }
 
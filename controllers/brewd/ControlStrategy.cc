@@ -0,0 +1,18 @@
+
+#include "ControlStrategy.hh"
+
+#include "HeuristicStrategy.hh"
+#include "MPCStrategy.hh"
+
+namespace aegir {
+
+  std::unique_ptr<ControlStrategy> ControlStrategy::create(ControlStrategies _strategy) {
+    switch ( _strategy ) {
+    case ControlStrategies::MPC:
+      return std::make_unique<MPCStrategy>();
+    case ControlStrategies::Heuristic:
+    default:
+      return std::make_unique<HeuristicStrategy>();
+    }
+  }
+}
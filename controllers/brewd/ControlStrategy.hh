@@ -0,0 +1,86 @@
+/*
+ * Temperature control strategies
+ * The Controller asks its strategy for the heating element's on-ratio and for
+ * the time of the next control cycle. The strategies only see the brewing
+ * system through the Plant interface, so they can be driven by a simulated
+ * plant or a replay of a recorded brew as well
+ *  - HeuristicStrategy: the original hand-tuned controller
+ *  - MPCStrategy: model predictive control on a fitted FOPDT model
+ */
+
+#ifndef AEGIR_CONTROLSTRATEGY_H
+#define AEGIR_CONTROLSTRATEGY_H
+
+#include <time.h>
+
+#include <memory>
+
+#include "TSDB.hh"
+#include "HERatioDB.hh"
+#include "PlantEstimator.hh"
+#include "Config.hh"
+
+namespace aegir {
+
+  class Plant {
+  public:
+    virtual ~Plant() = default;
+
+    // the temperature readings, one entry per thermo reading interval
+    virtual const TSDB &getReadings() const = 0;
+    // the on-ratios set on the heating element
+    virtual const HERatioDB &getHERatios() const = 0;
+    // the on-ratio the heating element is set to now
+    virtual float getHERatio() const = 0;
+    // a sensor's last reading, even before the readings are recorded
+    virtual float getTemp(ThermoCouple _tc) const = 0;
+    // the heating element's power in kW
+    virtual float getHEPower() const = 0;
+    // the limit of the heuristic's correction factor
+    virtual float getMaxCorrectionFactor() const = 0;
+    // the volume of the mash in liters
+    virtual float getVolume() const = 0;
+    virtual time_t getNow() const = 0;
+    // the start of the process, 0 when not known
+    virtual time_t getStartAt() const = 0;
+    // whether we're heating water only (PreHeat/Maintenance)
+    virtual bool isPreHeating() const = 0;
+    // the online estimates of the plant's parameters
+    virtual const PlantEstimator::Estimates &getEstimates() const = 0;
+  };
+
+  class ControlStrategy {
+    ControlStrategy(ControlStrategy&&) = delete;
+    ControlStrategy(const ControlStrategy &) = delete;
+    ControlStrategy &operator=(ControlStrategy &&) = delete;
+    ControlStrategy &operator=(const ControlStrategy &) = delete;
+  public:
+    struct Decision {
+      // the heating element's on-ratio
+      float heratio;
+      // seconds till the next control cycle
+      int nextcontrol;
+      // without the readings there's no decision, the element is left as
+      // it is
+      bool decided = true;
+    };
+
+  protected:
+    ControlStrategy() = default;
+
+  public:
+    virtual ~ControlStrategy() = default;
+    static std::unique_ptr<ControlStrategy> create(ControlStrategies _strategy);
+
+    virtual const char *getName() const = 0;
+    // a new brew is started, forget everything learned
+    virtual void reset() = 0;
+    // the process moved to a new stage
+    virtual void restart() = 0;
+    // _target is the mash tun's target temperature, the RIMS tube
+    // should not go over _target + _overheat
+    virtual Decision control(const Plant &_plant, float _target, float _overheat) = 0;
+  };
+}
+
+#endif
@@ -13,56 +13,20 @@
 #include <set>
 #include <string>
 
+#include <json/json.h>
+
 #include "Exception.hh"
 #include "Environment.hh"
+#include "Clock.hh"
+#include "Trace.hh"
+#include "SpanTracer.hh"
+#include "Watchdog.hh"
 
 namespace aegir {
-  /*
-   * Controller::HERratioDB
-   */
-  Controller::HERatioDB::HERatioDB(): c_data(0), c_alloc_size(4096),
-				      c_capacity(0), c_size(0) {
-    c_data = (data*)std::malloc(c_alloc_size);
-    c_capacity = c_alloc_size = sizeof(data);
-    clear();
-  };
-
-  Controller::HERatioDB::~HERatioDB() {
-    if ( c_data ) std::free(c_data);
-  };
-
-  Controller::HERatioDB& Controller::HERatioDB::clear() {
-    std::memset((void*)c_data, 0, c_alloc_size);
-    c_size = 0;
-    return *this;
-  }
-
-  Controller::HERatioDB& Controller::HERatioDB::insert(float _value) {
-    uint32_t idx = c_size++;
 
-    c_data[idx].time = time(0);
-    c_data[idx].ratio = _value;
-    return *this;
-  }
-
-  const Controller::HERatioDB::data& Controller::HERatioDB::operator[](const std::size_t _at) const {
-    if ( _at >= c_size )
-      throw Exception("HERatioDB out of range (size:%lu at:%lu", c_size, _at);
-
-    return c_data[_at];
-  }
-
-  void Controller::HERatioDB::grow() {
-    uint32_t prevsize = c_alloc_size;
-    uint32_t increment = getpagesize();
-    c_alloc_size += increment;
-    c_data = (data*)std::realloc((void*)c_data, c_alloc_size);
-    c_capacity = c_alloc_size / sizeof(data);
+  // the pre-heating is started this much earlier than estimated
+  static constexpr float c_preheatmargin = 1.15f;
 
-    // and finally zero the newly allocated region
-    void *start = (void*)(((uint8_t*)c_data)+prevsize);
-    std::memset(start, 0, increment);
-  }
   /*
    * Controller
    */
@@ -71,14 +35,26 @@ namespace aegir {
 			    c_mq_io(ZMQ::SocketType::SUB),
 			    c_ps(ProcessState::getInstance()),
 			    c_mq_iocmd(ZMQ::SocketType::PUB),
+			    c_mq_failsafe(ZMQ::SocketType::PUB),
+			    c_resync(false), c_kq(-1),
 			    c_levelerror(false), c_needcontrol(false),
 			    c_hestartdelay(-1), c_hepause(false),
+			    c_replaying(false),
 			    c_log("Controller"),
-			    c_correctionfactor(1.0f) {
+			    c_loop(1000000, 10),
+			    c_m_period(Metrics::getInstance().histogram("aegir_controller_period_seconds",
+									"The time between the control events")),
+			    c_m_jitter(Metrics::getInstance().histogram("aegir_controller_jitter_seconds",
+									"The control events' deviation from their period")),
+			    c_m_iobacklog(Metrics::getInstance().gauge("aegir_controller_io_backlog",
+								       "The IO messages received in the last cycle")),
+			    c_m_tsdbsize(Metrics::getInstance().gauge("aegir_tsdb_entries",
+								      "The entries of the temperature history")) {
     // subscribe to our publisher for IO events
     try {
       c_mq_io.connect("inproc://iopub").subscribe("");
       c_mq_iocmd.connect("inproc://iocmd");
+      c_mq_failsafe.connect("inproc://iocmd");
     }
     catch (std::exception &e) {
       c_log.error("Sub failed: %s", e.what());
@@ -88,10 +64,14 @@ namespace aegir {
     }
 
     c_cfg = Config::getInstance();
+    c_sensorcfg = c_cfg;
 
     // reconfigure state variables
     reconfigure();
 
+    // the initial state for the PR side
+    publishState();
+
     // state change callback
     c_ps.registerStateChange(std::bind(&Controller::onStateChange, this, std::placeholders::_1, std::placeholders::_2));
 
@@ -129,6 +109,7 @@ namespace aegir {
   }
 
   Controller::~Controller() {
+    if ( c_kq >= 0 ) close(c_kq);
   }
 
   std::shared_ptr<Controller> Controller::getInstance() {
@@ -141,7 +122,9 @@ namespace aegir {
 
     c_mythread = std::this_thread::get_id();
 
-    int kq = kqueue();
+    // a restart after a failure reuses it
+    if ( c_kq < 0 ) c_kq = kqueue();
+    int kq = c_kq;
     int kq_id_control = 1;
     int kq_id_temp = 2;
     int kqerr;
@@ -155,16 +138,17 @@ namespace aegir {
     kqerr = kevent(kq, kevchanges, 1, 0, 0, 0);
 
     // The main event loop
-    std::shared_ptr<Message> msg;
     std::set<int> events;
     int nevents;
     int nexttempcontrol = 1;
     bool tc_installed = false;	// tempcontrol timer installed
+    std::chrono::steady_clock::time_point lastcontrol, tcdeadline;
     while ( c_run ) {
 
       // first, gather the events
       // timeout=NULL, kevent blocks here until there's an event
       nevents = kevent(kq, 0, 0, kevents, 2, 0);
+      heartbeat();
 
       // in case of errors, check again
       if ( nevents <= 0 ) continue;
@@ -174,96 +158,39 @@ namespace aegir {
       for ( int i=0; i<nevents; ++i )
 	events.insert(kevents[i].ident);
 
-      // PINTracker's cycle
-      startCycle();
-
-      // read the GPIO PINs and SPI bus first
-      try {
-	while ( (msg = c_mq_io.recv()) != nullptr ) {
-	  if ( msg->type() == MessageType::PINSTATE ) {
-	    auto psmsg = std::static_pointer_cast<PinStateMessage>(msg);
-#ifdef AEGIR_DEBUG
-	    printf("Controller: received %s:%hhu\n", psmsg->getName().c_str(), psmsg->getState());
-#endif
-	    try {
-	      setPIN(psmsg->getName(), psmsg->getState());
-	    }
-	    catch (Exception &e) {
-	      c_log.warn("Error on PIN '%s'/%lu: %s", psmsg->getName().c_str(), psmsg->getName().length(), e.what());
-	      continue;
-	    }
-	  } else if ( msg->type() == MessageType::THERMOREADING ) {
-	    auto trmsg = std::static_pointer_cast<ThermoReadingMessage>(msg);
-	    // add it to the process state
-	    c_ps.addThermoReadings(trmsg->getTimestamp(), trmsg->getTemps());
-	  } else {
-	    c_log.warn("Got unhandled message type: %i", (int)msg->type());
-	    continue;
-	  }
+      // the IOHandler's latch is released by the feed, and the fail-safe
+      // might have turned the heating off meanwhile
+      if ( Watchdog::getInstance().feed(Clock::monotonic()) ) c_resync = true;
+      if ( c_resync.exchange(false) ) resyncOutputs();
+
+      // the control timer's period and jitter, and how late the timers
+      // woke us up
+      auto now = std::chrono::steady_clock::now();
+      int64_t wakeup = 0;
+      if ( events.find(kq_id_control) != events.end() ) {
+	if ( lastcontrol.time_since_epoch().count() ) {
+	  int64_t period = std::chrono::duration_cast<std::chrono::microseconds>(now - lastcontrol).count();
+	  c_m_period.record(period);
+	  c_m_jitter.record(std::abs(period - 1000000));
+	  wakeup = period - 1000000;
 	}
-      } // End of pin and sensor readings
-      catch (Exception &e) {
-	c_log.error("Controller::run exception: %s", e.what());
+	lastcontrol = now;
       }
-
-      // state changes and controlling goes hand-in-hand
-      ProcessState::States state, oldstate;
-      state = c_ps.getState();
-      do {
-	oldstate = state;
-	// handle the state changes
-	{
-	  // trigger the state change queue handler
-	  std::lock_guard<std::mutex> g(c_mtx_stchqueue);
-	  if ( c_stchqueue.size() ) {
-	    for ( auto &it: c_stchqueue ) {
-	      onStateChange(it.first, it.second);
-	    }
-	    c_stchqueue.clear();
-	  }
-	}
-
-	// the control event
-	// also run it after the tempcontrol
-	if ( events.find(kq_id_control) != events.end() ) {
-	  // handle the current state
-	  controlProcess(*this);
-	}
-	state = c_ps.getState();
-      } while ( state != oldstate );
-
-      // check the tube's temperature, watch for overheating
-      try {
-	float rimstemp = Environment::getInstance()->getTempRIMS();
-	if ( c_needcontrol && !c_hepause &&
-	     rimstemp >= (c_temptarget+c_cfg->getHeatOverhead()*1.15) ) {
-	  c_log.info("Pausing heat: RIMS:%.2f Target:%.2f Overhead:%.2f (%.2f)",
-		     rimstemp, c_temptarget, c_cfg->getHeatOverhead(),
-		     c_temptarget+c_cfg->getHeatOverhead());
-	  c_hepause = true;
-	  setPIN("mtheat", PINState::Pulsate, 5.0f, 0.01f);
-	} else if ( c_needcontrol && c_hepause &&
-		    rimstemp < (c_temptarget+c_cfg->getHeatOverhead()*0.95) ) {
-	  c_log.info("hepause:off newtemptarget:true");
-	  c_hepause = false;
-	  c_newtemptarget = true;
-	}
-      }
-      catch (Exception &e) {
-	c_log.error("RIMS safety check failed: %s", e.what());
+      if ( events.find(kq_id_temp) != events.end() )
+	wakeup = std::max<int64_t>(wakeup, std::chrono::duration_cast<std::chrono::microseconds>
+				   (now - tcdeadline).count());
+      // the timer fired more than once since the last cycle
+      for ( int i=0; i<nevents; ++i ) {
+	if ( kevents[i].ident == (uintptr_t)kq_id_control && kevents[i].data > 1 &&
+	     c_loop.missed(Clock::now(), kevents[i].data - 1) )
+	  AEGIR_LOG_EVENT(c_log, warning, "loop.missed", {"periods", kevents[i].data - 1});
       }
 
-      // the temp control event
-      if ( !c_hepause &&
-	   (events.find(kq_id_temp) != events.end() ||
-	    (c_needcontrol && c_newtemptarget)) ) {
-	c_log.debug("Running tempcontrol...");
-	nexttempcontrol = tempControl();
-	c_log.trace("Tempcontrol said %i secs", nexttempcontrol);
-	if ( nexttempcontrol < 3 ) nexttempcontrol = 3;
-	else if ( nexttempcontrol > 30 ) nexttempcontrol = 30;
+      // the control logic's cycle
+      if ( cycle(events.find(kq_id_control) != events.end(),
+		 events.find(kq_id_temp) != events.end(), nexttempcontrol,
+		 wakeup > 0 ? wakeup : 0) )
 	tc_installed = false;	// oneshot fired, needs reinstall
-      }
 
       // if we need tempcontrols, then keep on
       // installing the oneshot event
@@ -273,7 +200,8 @@ namespace aegir {
 
 	// register the events
 	kqerr = kevent(kq, kevchanges, 1, 0, 0, 0);
-	c_log.debug("Installed tempcontrol for %i secs", nexttempcontrol);
+	tcdeadline = std::chrono::steady_clock::now() + std::chrono::seconds(nexttempcontrol);
+	AEGIR_LOG_DEBUG(c_log, "Installed tempcontrol for %i secs", nexttempcontrol);
 	tc_installed = true;
       }
 
@@ -285,58 +213,265 @@ namespace aegir {
 
 	// register the events
 	kqerr = kevent(kq, kevchanges, 1, 0, 0, 0);
-	c_log.debug("Removed tempcontrol");
+	AEGIR_LOG_DEBUG(c_log, "Removed tempcontrol");
 	tc_installed = false;
       }
+    } // while ( c_run )
+
+    c_mq_io.close();
+    c_mq_iocmd.close();
+    c_mq_failsafe.close();
+    c_log.info("Controller stopped");
+  }
+
+  bool Controller::cycle(bool _control, bool _tempcontrol, int &_nexttempcontrol, uint32_t _wakeup) {
+    AEGIR_TRACE_SPAN("controller.cycle");
+    std::shared_ptr<Message> msg;
+    auto trace = TraceRecorder::getInstance();
+    uint32_t received = 0;
+
+    c_loop.begin(Clock::now(), _wakeup);
+
+    // a reloaded config is picked up between the cycles, never within one,
+    // the strategy is switched when the next program is loaded
+    if ( auto cfg = Config::getInstance(); cfg != c_cfg ) {
+      c_cfg = cfg;
+      applyConfig();
+      checkSensors();
+      AEGIR_LOG_EVENT(c_log, info, "config.reload", {"version", c_cfg->getVersion()});
+    }
 
-      // TODO: REVISE, seprate the level error case
-      // if the recirc button is pushed, or we don't need tempcontrol anymore
-      // stop the pump and the heating element
-      if ( c_levelerror || !c_needcontrol ) {
-	if ( c_ps.getState() != ProcessState::States::Maintenance  ) {
-	  if ( c_ps.getForceMTPump() ) {
-	    setPIN("mtpump", PINState::On);
-	  } else {
-	    setPIN("mtpump", PINState::Off);
+    // PINTracker's cycle
+    startCycle();
+
+    // read the GPIO PINs and SPI bus first
+    try {
+      while ( (msg = recvIO()) != nullptr ) {
+	++received;
+	if ( trace->isRecording() )
+	  trace->record(Trace::RecordType::Input, msg->serialize());
+	if ( msg->type() == MessageType::PINSTATE ) {
+	  auto psmsg = std::static_pointer_cast<PinStateMessage>(msg);
+	  setAcquired(psmsg->getAcquired());
+#ifdef AEGIR_DEBUG
+	  printf("Controller: received %s:%hhu\n", psmsg->getName().c_str(), psmsg->getState());
+#endif
+	  try {
+	    setPIN(psmsg->getName(), psmsg->getState());
 	  }
+	  catch (Exception &e) {
+	    c_log.warn("Error on PIN '%s'/%lu: %s", psmsg->getName().c_str(), psmsg->getName().length(), e.what());
+	    continue;
+	  }
+	} else if ( msg->type() == MessageType::THERMOREADING ) {
+	  auto trmsg = std::static_pointer_cast<ThermoReadingMessage>(msg);
+	  setAcquired(trmsg->getAcquired());
+	  // add it to the process state
+	  c_ps.addThermoReadings(trmsg->getTimestamp(), trmsg->getTemps());
+	  // the TSDB only records from mashing, the ETAs need every stage
+	  c_eta.addReadings(trmsg->getTimestamp(), trmsg->getTemps());
+	} else {
+	  c_log.warn("Got unhandled message type: %i", (int)msg->type());
+	  continue;
+	}
+      }
+    } // End of pin and sensor readings
+    catch (Exception &e) {
+      c_log.error("Controller::run exception: %s", e.what());
+    }
+    c_m_iobacklog.set(received);
+    c_m_tsdbsize.set(c_ps.getThermoReadings().size());
+    c_loop.lap(LoopMonitor::Phase::Inputs);
+    if ( trace->isRecording() )
+      trace->record(Trace::RecordType::Cycle,
+		    msgstring(1, (_control ? Trace::Control : 0) |
+			      (_tempcontrol ? Trace::TempControl : 0)));
+
+    // feed the new readings to the plant estimator
+    c_estimator.update(c_ps.getThermoReadings(), c_heratiohistory, c_ps.getVolume());
+
+    // state changes and controlling goes hand-in-hand
+    ProcessState::States state, oldstate;
+    state = c_ps.getState();
+    do {
+      oldstate = state;
+      // handle the state changes
+      {
+	// trigger the state change queue handler
+	std::lock_guard<std::mutex> g(c_mtx_stchqueue);
+	if ( c_stchqueue.size() ) {
+	  // they're the user's commands, not reactions to the inputs,
+	  // so their pin changes aren't stamped
+	  uint64_t acquired = getAcquired();
+	  clearAcquired();
+	  for ( auto &it: c_stchqueue ) {
+	    onStateChange(it.first, it.second);
+	  }
+	  c_stchqueue.clear();
+	  setAcquired(acquired);
 	}
-	//printf("Setting mtheat off %i\n", __LINE__);
-	setPIN("mtheat", PINState::Off);
-      } // stop recirculation if we don't need control anymore, OR there's level error
-      if ( c_needcontrol && c_ps.getBlockHeat() ) {
-	c_log.warn("Setting mtheat off");
-	setPIN("mtheat", PINState::Off);
       }
 
-      // check whether the mtheat had just been turned on
-      auto mtheat = getPIN("mtheat");
-      if ( mtheat->getOldValue() == PINState::Off &&
-	   mtheat->getNewValue() != PINState::Off ) {
-	//printf("Starting hedelay\n");
-	setPIN("mtheat", PINState::Pulsate, 5.0f, 0.01f);
-	c_hestartdelay = c_cfg->getHEDelay();
-      } else if ( c_hestartdelay > 0 ) {
-	--c_hestartdelay;
-	//printf("Still in hedelay: %i\n", c_hestartdelay);
+      // the control event
+      // also run it after the tempcontrol
+      if ( _control ) {
+	// handle the current state
+	controlProcess(*this);
+      }
+      state = c_ps.getState();
+    } while ( state != oldstate );
+
+    // check the tube's temperature, watch for overheating
+    try {
+      float rimstemp = Environment::getInstance()->getTempRIMS();
+      if ( c_needcontrol && !c_hepause &&
+	   rimstemp >= (c_temptarget+c_cfg->getHeatOverhead()*1.15) ) {
+	c_log.info("Pausing heat: RIMS:%.2f Target:%.2f Overhead:%.2f (%.2f)",
+		   rimstemp, c_temptarget, c_cfg->getHeatOverhead(),
+		   c_temptarget+c_cfg->getHeatOverhead());
+	c_hepause = true;
 	setPIN("mtheat", PINState::Pulsate, 5.0f, 0.01f);
+      } else if ( c_needcontrol && c_hepause &&
+		  rimstemp < (c_temptarget+c_cfg->getHeatOverhead()*0.95) ) {
+	c_log.info("hepause:off newtemptarget:true");
+	c_hepause = false;
+	c_newtemptarget = true;
+      }
+    }
+    catch (Exception &e) {
+      c_log.error("RIMS safety check failed: %s", e.what());
+    }
+    c_loop.lap(LoopMonitor::Phase::Stages);
+
+    // the temp control event
+    bool tempcontrolled = false;
+    if ( !c_hepause &&
+	 (_tempcontrol || (c_needcontrol && c_newtemptarget)) ) {
+      AEGIR_LOG_DEBUG(c_log, "Running tempcontrol...");
+      _nexttempcontrol = tempControl();
+      AEGIR_LOG_TRACE(c_log, "Tempcontrol said %i secs", _nexttempcontrol);
+      if ( _nexttempcontrol < 3 ) _nexttempcontrol = 3;
+      else if ( _nexttempcontrol > 30 ) _nexttempcontrol = 30;
+      tempcontrolled = true;
+    }
+    c_loop.lap(LoopMonitor::Phase::TempControl);
+
+    // TODO: REVISE, seprate the level error case
+    // if the recirc button is pushed, or we don't need tempcontrol anymore
+    // stop the pump and the heating element
+    if ( c_levelerror || (!c_needcontrol && !c_autotuner.isRunning()) ) {
+      if ( c_ps.getState() != ProcessState::States::Maintenance  ) {
+	if ( c_ps.getForceMTPump() ) {
+	  setPIN("mtpump", PINState::On);
+	} else {
+	  setPIN("mtpump", PINState::Off);
+	}
       }
+      //printf("Setting mtheat off %i\n", __LINE__);
+      setPIN("mtheat", PINState::Off);
+    } // stop recirculation if we don't need control anymore, OR there's level error
+    if ( (c_needcontrol || c_autotuner.isRunning()) && c_ps.getBlockHeat() ) {
+      c_log.warn("Setting mtheat off");
+      setPIN("mtheat", PINState::Off);
+    }
 
-      // end the GPIO change cycle
-      endCycle();
-    } // while ( c_run )
+    // check whether the mtheat had just been turned on
+    // the auto-tuning's step has to be a clean one
+    auto mtheat = getPIN("mtheat");
+    if ( c_autotuner.isRunning() ) {
+      c_hestartdelay = -1;
+    } else if ( mtheat->getOldValue() == PINState::Off &&
+		mtheat->getNewValue() != PINState::Off ) {
+      //printf("Starting hedelay\n");
+      setPIN("mtheat", PINState::Pulsate, 5.0f, 0.01f);
+      c_hestartdelay = c_cfg->getHEDelay();
+    } else if ( c_hestartdelay > 0 ) {
+      --c_hestartdelay;
+      //printf("Still in hedelay: %i\n", c_hestartdelay);
+      setPIN("mtheat", PINState::Pulsate, 5.0f, 0.01f);
+    }
 
-    close(kq);
+    // the vessels' heating elements
+    controlHeaters();
+
+    // end the GPIO change cycle
+    endCycle();
+
+    // and let the PR side know where we are
+    publishState();
+    c_loop.lap(LoopMonitor::Phase::EndCycle);
+
+    // the state above carries the timing up to the previous cycle
+    if ( c_loop.end() ) {
+      auto &last = c_loop.getLast();
+      AEGIR_LOG_EVENT(c_log, warning, "loop.overrun", {"reason", c_loop.getAlert()},
+		      {"wakeup", last.phases[(uint8_t)LoopMonitor::Phase::Wakeup]},
+		      {"inputs", last.phases[(uint8_t)LoopMonitor::Phase::Inputs]},
+		      {"stages", last.phases[(uint8_t)LoopMonitor::Phase::Stages]},
+		      {"tempcontrol", last.phases[(uint8_t)LoopMonitor::Phase::TempControl]},
+		      {"endcycle", last.phases[(uint8_t)LoopMonitor::Phase::EndCycle]},
+		      {"total", last.total});
+    }
 
-    c_mq_io.close();
-    c_mq_iocmd.close();
-    c_log.info("Controller stopped");
+    return tempcontrolled;
+  }
+
+  std::shared_ptr<Message> Controller::recvIO() {
+    if ( !c_replaying ) return c_mq_io.recv();
+    if ( c_replayinputs.empty() ) return nullptr;
+
+    auto msg = c_replayinputs.front();
+    c_replayinputs.pop_front();
+    return msg;
   }
 
   void Controller::reconfigure() {
     PINTracker::reconfigure();
-    c_hecycletime = c_cfg->getHECycleTime();
     c_needcontrol = false;
-    c_correctionfactor = 1.0f;
+    c_estimator.reset(getHEPower());
+    // the IOHandler's reading interval is set on its start
+    c_eta.setInterval(c_cfg->getTCival());
+    selectStrategy();
+    applyConfig();
+  }
+
+  void Controller::applyConfig() {
+    c_hecycletime = c_cfg->getHECycleTime();
+
+    // the loop's budgets are in msecs
+    auto &lb = c_cfg->getLoopBudget();
+    LoopMonitor::Budget budget{};
+    budget.phases[(uint8_t)LoopMonitor::Phase::Wakeup] = lb.wakeup * 1000;
+    budget.phases[(uint8_t)LoopMonitor::Phase::Inputs] = lb.inputs * 1000;
+    budget.phases[(uint8_t)LoopMonitor::Phase::Stages] = lb.stages * 1000;
+    budget.phases[(uint8_t)LoopMonitor::Phase::TempControl] = lb.tempcontrol * 1000;
+    budget.phases[(uint8_t)LoopMonitor::Phase::EndCycle] = lb.endcycle * 1000;
+    budget.cycle = lb.cycle * 1000;
+    c_loop.setBudget(budget);
+    c_loop.setWorst(lb.worst);
+  }
+
+  void Controller::checkSensors() {
+    auto &curr = c_sensorcfg->getThermocouples();
+    auto &next = c_cfg->getThermocouples();
+    std::map<int, std::string> currchips, nextchips;
+    bool changed = curr.size != next.size;
+
+    c_sensorcfg->getSPIDSChips(currchips);
+    c_cfg->getSPIDSChips(nextchips);
+    changed = changed || currchips != nextchips;
+    for (uint8_t i=0; !changed && i < curr.size; ++i)
+      changed = curr.tcs[i] != next.tcs[i]
+	|| strcmp(c_sensorcfg->getSensorNames().name(i), c_cfg->getSensorNames().name(i)) != 0;
+
+    // the readings still come in the old order, so they're named by it
+    if ( changed )
+      c_log.error("The thermocouple and chip select changes are ignored, they need a restart");
+  }
+
+  void Controller::selectStrategy() {
+    c_strategy = ControlStrategy::create(c_cfg->getControlStrategy());
+    c_log.info("Using the %s temperature control strategy", c_strategy->getName());
   }
 
   void Controller::controlProcess(PINTracker &_pt) {
@@ -365,6 +500,289 @@ namespace aegir {
 
   } // controlProcess
 
+  void Controller::publishState() {
+    Json::Value data;
+    auto env = Environment::getInstance();
+
+    try {
+      ProcessState::Guard guard_ps(c_ps);
+      ProcessState::States state = c_ps.getState();
+
+      data["state"] = c_ps.getStringState();
+
+      // TC readings
+      data["currtemp"]["MT"] = env->getTempMT();
+      data["currtemp"]["RIMS"] = env->getTempRIMS();
+      data["currtemp"]["BK"] = env->getTempBK();
+      data["currtemp"]["HLT"] = env->getTempHLT();
+      // the extra sensors by the names the IOHandler reads them by
+      for (uint8_t i=ThermoCouple::_SIZE; i < env->getSensorCount()
+	     && i < c_sensorcfg->getThermocouples().size; ++i)
+	data["currtemp"][c_sensorcfg->getSensorNames().name(i)] = env->getTemp(i);
+
+      // Add the current target temperature
+      data["targettemp"] = c_ps.getTargetTemp();
+
+      // water level sensor
+      data["levelerror"] = c_ps.getLevelError();
+
+      // the temperature history's size, a batch's getTempHistory stops there
+      if ( state >= ProcessState::States::Mashing )
+	data["readings"] = c_ps.getThermoReadings().size();
+
+      // the control loop's alerts, its timing is published on its own
+      c_loop.alertToJSON(data["loop"], Clock::now());
+      Watchdog::getInstance().toJSON(data["watchdog"]);
+
+      // the heating's requested and delivered on-ratio
+      if ( c_heratiohistory.size() ) {
+	data["heater"]["requested"] = c_heratiohistory[c_heratiohistory.size()-1].ratio;
+	data["heater"]["delivered"] = env->getHEDelivered();
+      }
+
+      // the vessels' heating elements
+      if ( c_cfg->getHeaters().size() ) {
+	Json::Value heaters(Json::arrayValue);
+
+	for (auto &h: c_cfg->getHeaters()) {
+	  Json::Value heater;
+
+	  heater["pin"] = h.pin;
+	  heater["vessel"] = h.vessel.toStr();
+	  heater["temp"] = h.temp;
+	  heater["ratio"] = getPIN(h.pin)->getNewOnratio();
+	  heaters.append(heater);
+	}
+	data["heaters"] = heaters;
+	data["maxpower"] = c_cfg->getMaxPower();
+      }
+
+      // If we have a loaded program, return its id
+      if ( state >= ProcessState::States::Loaded ) {
+	if ( auto prog = c_ps.getProgram(); prog )
+	  data["programid"] = prog->getId();
+      }
+
+      // If we're mashing, then display the current step
+      if ( state == ProcessState::States::Mashing ) {
+	Json::Value jms;
+	time_t now = Clock::now();
+	time_t diff = now - c_ps.getMashStepStart();
+
+	jms["orderno"] = c_ps.getMashStep();
+	jms["time"] = diff<0 ? 0 : diff;
+	jms["delay"] = c_planner.getDelay(now);
+	data["mashstep"] = jms;
+      }
+
+      // the schedule adherence of the mash steps
+      if ( state >= ProcessState::States::Mashing && c_planner.getReports().size() ) {
+	Json::Value plan;
+	Json::Value steps(Json::arrayValue);
+
+	for (auto &r: c_planner.getReports()) {
+	  Json::Value step;
+
+	  step["orderno"] = r.orderno;
+	  step["temp"] = r.temp;
+	  step["holdtime"] = r.holdtime;
+	  step["held"] = r.held;
+	  step["planned"] = (Json::Int64)r.planned;
+	  step["reached"] = (Json::Int64)r.reached;
+	  step["adherence"] = r.adherence;
+	  step["capped"] = r.capped;
+	  steps.append(step);
+	}
+	plan["steps"] = steps;
+	plan["lag"] = c_planner.getLag();
+	plan["ramprate"] = c_planner.getRampRate();
+	data["mashplan"] = plan;
+      }
+
+      // the completion estimates of the current and the remaining stages
+      if ( state >= ProcessState::States::PreWait && state < ProcessState::States::Transfer &&
+	   c_prog ) {
+	Json::Value eta;
+	Json::Value stages(Json::arrayValue);
+	time_t now = Clock::now();
+	int32_t total = 0;
+	float confidence = 1;
+
+	for (auto st = (uint8_t)state; st < (uint8_t)ProcessState::States::Transfer; ++st) {
+	  auto e = estimateStage((ProcessState::States)st, now);
+	  // the manual stages
+	  if ( e.seconds < 0 && e.confidence < 0 ) continue;
+
+	  Json::Value stage;
+	  stage["state"] = ProcessState::getStringState((ProcessState::States)st);
+	  stage["seconds"] = e.seconds;
+	  stage["confidence"] = e.confidence;
+	  if ( st == (uint8_t)state ) eta["current"] = stage;
+	  stages.append(stage);
+
+	  if ( e.seconds > 0 ) total += e.seconds;
+	  confidence = std::min(confidence, e.seconds < 0 ? 0.0f : e.confidence);
+	}
+	eta["stages"] = stages;
+	eta["total"]["seconds"] = total;
+	eta["total"]["confidence"] = confidence;
+	eta["total"]["at"] = (Json::Int64)(now + total);
+	data["eta"] = eta;
+      }
+
+      // during cooling let the UI know whether we're good to finish
+      if ( state == ProcessState::States::Cooling ) {
+	Json::Value cooling;
+	float bktemp;
+	float cooltemp = c_ps.getCoolTemp();
+
+	try {
+	  bktemp = c_ps.getSensorTemp(ThermoCouple::BK);
+	}
+	catch (Exception &e) {
+	  bktemp = env->getTempBK();
+	}
+
+	cooling["ready"] = (bktemp < cooltemp);
+	cooling["cooltemp"] = cooltemp;
+
+	data["cooling"] = cooling;
+      }
+
+      // During hopping, we publicate the hoptime for the UI
+      if ( state == ProcessState::States::Hopping ) {
+	Json::Value hopdata;
+
+	hopdata["hoptime"] = c_ps.getHopTime();
+
+	data["hopping"] = hopdata;
+      }
+
+      // the plant's identified parameters
+      if ( auto &est = c_estimator.getEstimates(); est.samples ) {
+	Json::Value plant;
+
+	plant["hepower"] = est.hepower;
+	plant["loss"] = est.loss;
+	plant["flow"] = est.flow;
+	plant["samples"] = est.samples;
+	plant["valid"] = est.valid;
+	data["plant"] = plant;
+      }
+
+      // the auto-tuning's progress and its results
+      if ( state == ProcessState::States::Maintenance &&
+	   c_autotuner.getPhase() != AutoTuner::Phases::Idle ) {
+	Json::Value autotune;
+
+	autotune["phase"] = c_autotuner.getPhaseName();
+	autotune["elapsed"] = (uint32_t)(Clock::now() - c_autotuner.getStartTime());
+	if ( c_autotuner.getPhase() == AutoTuner::Phases::Failed )
+	  autotune["error"] = c_autotuner.getError();
+	if ( c_autotuner.getPhase() == AutoTuner::Phases::Done ) {
+	  auto &r = c_autotuner.getResults();
+	  Json::Value results;
+
+	  results["gain"] = r.gain;
+	  results["tau"] = r.tau;
+	  results["deadtime"] = r.deadtime;
+	  results["mtrate"] = r.mtrate;
+	  results["hecycletime"] = r.hecycletime;
+	  results["heatoverhead"] = r.heatoverhead;
+	  results["hedelay"] = r.hedelay;
+	  results["maxcorrection"] = r.maxcorrectionfactor;
+	  results["settlingtime"] = r.settlingtime;
+	  results["overshoot"] = r.overshoot;
+	  autotune["results"] = results;
+	}
+	data["autotune"] = autotune;
+      }
+
+      c_ps.getSnapshot().publish(data);
+
+      // the loop's counters and timings change on every cycle
+      Json::Value loop;
+      c_loop.toJSON(loop, Clock::now());
+      c_ps.getLoopSnapshot().publish(loop);
+    }
+    catch (std::exception &e) {
+      c_log.error("Unable to publish the state: %s", e.what());
+    }
+  }
+
+  /*
+   * The remaining time of _state: the current stage from the live curves,
+   * the ones ahead from the program and the rates learned on the previous
+   * brews. The manual stages are {-1, -1}.
+   */
+  ETAEngine::Estimate Controller::estimateStage(ProcessState::States _state, time_t _now) const {
+    // the wort's boiling point, without altitude
+    static constexpr float c_boiltemp = 98.0f;
+    const bool current = _state == c_ps.getState();
+    // the TSDB is empty before mashing
+    const float mttemp = Environment::getInstance()->getTempMT();
+
+    switch (_state) {
+    case ProcessState::States::PreWait: {
+      auto heat = c_eta.heatTime(c_ps.getVolume(), mttemp, c_prog->getStartTemp(), getHEPower());
+      int32_t wait = (int32_t)c_ps.getStartat() - _now - std::max(heat.seconds, 0)*c_preheatmargin;
+      return {std::max(wait, 0), heat.confidence};
+    }
+
+    case ProcessState::States::PreHeat: {
+      if ( current ) {
+	auto e = c_eta.timeTo(ThermoCouple::MT, c_prog->getStartTemp());
+	if ( e.seconds >= 0 ) return e;
+      }
+      return c_eta.heatTime(c_ps.getVolume(), mttemp, c_prog->getStartTemp(), getHEPower());
+    }
+
+    case ProcessState::States::Mashing: {
+      // the holds are known, the ramps are estimated
+      const Program::MashSteps &steps = c_prog->getMashSteps();
+      auto &reports = c_planner.getReports();
+      int msno = current ? c_ps.getMashStep() : -1;
+      float ramprate = current ? c_planner.getRampRate() : getRampRate();
+      float temp = current ? mttemp : c_prog->getStartTemp();
+      uint32_t holds = 0, ramps = 0;
+
+      if ( ramprate <= 0 ) return {-1, 0};
+      for (int i = std::max(msno, 0); i < (int)steps.size(); ++i) {
+	uint32_t held = (current && i < (int)reports.size()) ? reports[i].held : 0;
+
+	if ( i > msno && steps[i].temp > temp )
+	  ramps += (steps[i].temp - temp) / ramprate;
+	holds += steps[i].holdtime*60 > held ? steps[i].holdtime*60 - held : 0;
+	temp = std::max(temp, steps[i].temp);
+      }
+      // the mash-out
+      if ( c_prog->getEndTemp() > temp )
+	ramps += (c_prog->getEndTemp() - temp) / ramprate;
+
+      uint32_t total = holds + ramps;
+      if ( !total ) return {0, 1};
+      return {(int32_t)total, (holds + 0.5f*ramps) / total};
+    }
+
+    case ProcessState::States::PreBoil:
+      if ( current ) return c_eta.timeTo(ThermoCouple::BK, c_boiltemp);
+      return c_eta.byRate(ThermoCouple::BK, c_prog->getEndTemp(), c_boiltemp);
+
+    case ProcessState::States::Hopping: {
+      int32_t boiltime = c_prog->getBoilTime();
+      if ( current ) boiltime += (int32_t)c_ps.getHoppingStart() - _now;
+      return {std::max(boiltime, 0), 1};
+    }
+
+    case ProcessState::States::Cooling:
+      if ( current ) return c_eta.timeTo(ThermoCouple::BK, c_ps.getCoolTemp());
+      return c_eta.byRate(ThermoCouple::BK, c_boiltemp, c_ps.getCoolTemp());
+
+    default:
+      return {-1, -1};
+    }
+  }
+
   void Controller::onStateChange(ProcessState::States _old, ProcessState::States _new) {
     // if it's not in our thread, then queue the call and return
     if ( std::this_thread::get_id() != c_mythread ) {
@@ -373,10 +791,12 @@ namespace aegir {
       return;
     }
 
-    c_lastcontrol = 0;
-    uint32_t now = time(0);
+    c_strategy->restart();
+    uint32_t now = Clock::now();
 
     if ( _new == ProcessState::States::Maintenance ) {
+      c_autotuner.stop();
+      c_ps.setMaintAutoTune(false);
       setPIN("buzzer", PINState::Off);
       setPIN("mtheat", PINState::Off);
       setPIN("mtpump", PINState::Off);
@@ -395,12 +815,25 @@ namespace aegir {
       setPIN("buzzer", PINState::Off);
       c_ps.setMashStep(-1);
       c_ps.setMashStepStart(0);
+      if ( auto prog = c_ps.getProgram(); prog )
+	c_planner.reset(prog->getMashSteps(), c_cfg->getTempAccuracy(), getRampRate(),
+			c_cfg->getMashGrace()*60, now);
     }
 
     if ( _new == ProcessState::States::Hopping ) {
       c_ps.setHoppingStart(now);
     }
 
+    // the heating and cooling rates of the stages for the next brews' ETAs
+    if ( _old == ProcessState::States::PreHeat )
+      c_eta.learn(ThermoCouple::MT, c_ps.getVolume());
+    if ( _old == ProcessState::States::PreBoil || _old == ProcessState::States::Cooling )
+      c_eta.learn(ThermoCouple::BK);
+    if ( _new == ProcessState::States::PreHeat ||
+	 _new == ProcessState::States::PreBoil ||
+	 _new == ProcessState::States::Cooling )
+      c_eta.mark();
+
     if ( _new == ProcessState::States::Cooling ) {
       setPIN("bkpump", PINState::On);
     }
@@ -425,7 +858,10 @@ namespace aegir {
 
     if ( _new == ProcessState::States::Empty ) {
       c_prog = nullptr;
+      c_planner.reset({}, c_cfg->getTempAccuracy(), 0, c_cfg->getMashGrace()*60, now);
+      c_eta.reset();
       c_heratiohistory.clear();
+      c_estimator.reset(getHEPower());
       setPIN("buzzer", PINState::Off);
       setPIN("mtheat", PINState::Off);
       setPIN("mtpump", PINState::Off);
@@ -435,10 +871,13 @@ namespace aegir {
     // when the state is reset
     if ( _old == ProcessState::States::Empty ||
 	 _old == ProcessState::States::Maintenance ) {
+      c_autotuner.stop();
+      c_ps.setMaintAutoTune(false);
       c_prog = nullptr;
       c_last_flow_volume = -1;
       c_temptarget = 0;
       c_heratiohistory.clear();
+      c_estimator.reset(getHEPower());
       setPIN("buzzer", PINState::Off);
       setPIN("mtheat", PINState::Off);
       setPIN("mtpump", PINState::Off);
@@ -451,6 +890,21 @@ namespace aegir {
     bool bkpump = c_ps.getMaintBKPump();
     bool heat = c_ps.getMaintHeat();
     float temp = c_ps.getMaintTemp();
+    // the pumps follow the user's settings, their changes aren't stamped
+    uint64_t acquired = getAcquired();
+
+    // the auto-tuning takes over the pump and the heating
+    if ( c_ps.getMaintAutoTune() ) {
+      clearAcquired();
+      setPIN("bkpump", (bkpump ? PINState::On : PINState::Off));
+      setAcquired(acquired);
+      autoTune();
+      return;
+    }
+    if ( c_autotuner.isRunning() ) {
+      c_autotuner.stop();
+      setPIN("mtheat", PINState::Off);
+    }
 
 #if 0
     printf("Controller::maintenanceMode P:%c H:%c T:%2.f\n",
@@ -461,28 +915,77 @@ namespace aegir {
 
     // controlling mtpump on heat is needed when the heating element
     // is directly on that circle, without an exchanger
+    clearAcquired();
 #if 0
     setPIN("mtpump", ((pump || heat) ? PINState::On : PINState::Off));
 #else
     setPIN("mtpump", (pump ? PINState::On : PINState::Off));
 #endif
     setPIN("bkpump", (bkpump ? PINState::On : PINState::Off));
+    setAcquired(acquired);
 
     setTempTarget(temp, 6.0f);
     c_needcontrol = heat;
 
   }
 
+  /*
+   * Runs the auto-tuning with water in the MT, and saves the tuned
+   * heating parameters when it's done
+   */
+  void Controller::autoTune() {
+    auto env = Environment::getInstance();
+    time_t now = Clock::now();
+
+    c_needcontrol = false;
+    if ( !c_autotuner.isRunning() )
+      c_autotuner.start(now, getHEPower(), c_ps.getVolume(), c_cfg->getTempAccuracy());
+
+    setPIN("mtpump", PINState::On);
+    float ratio = c_autotuner.update(now, env->getTempMT(), env->getTempRIMS());
+
+    if ( c_autotuner.isRunning() ) {
+      if ( ratio > 0 ) setPIN("mtheat", PINState::Pulsate, c_hecycletime, ratio);
+      else setPIN("mtheat", PINState::Off);
+      return;
+    }
+
+    // finished, one way or another
+    c_ps.setMaintAutoTune(false);
+    setPIN("mtheat", PINState::Off);
+    if ( c_autotuner.getPhase() != AutoTuner::Phases::Done ) return;
+
+    auto &r = c_autotuner.getResults();
+    try {
+      c_cfg = Config::update([&](Config &_cfg) {
+	_cfg.setHECycleTime(r.hecycletime).
+	  setHeatOverhead(r.heatoverhead).
+	  setHEDelay(r.hedelay);
+	if ( r.maxcorrectionfactor > 0 )
+	  _cfg.setMaxCorrectionFactor(r.maxcorrectionfactor);
+      });
+    }
+    catch (std::exception &e) {
+      c_log.error("Unable to save the auto-tuned config: %s", e.what());
+    }
+    c_hecycletime = r.hecycletime;
+
+    c_log.info("Auto-tuned: hecycletime:%.1f heatoverhead:%.2f hedelay:%u maxcorrection:%.2f predicted settling:%.0fs overshoot:%.2fC",
+	       r.hecycletime, r.heatoverhead, r.hedelay, c_cfg->getMaxCorrectionFactor(),
+	       r.settlingtime, r.overshoot);
+  }
+
   void Controller::stageEmpty(PINTracker &_pt) {
     setPIN("mtheat", PINState::Off);
     setPIN("mtpump", PINState::Off);
     c_needcontrol = false;
-    c_correctionfactor = 1.0f;
+    c_strategy->reset();
   }
 
   void Controller::stageLoaded(PINTracker &_pt) {
     c_prog = c_ps.getProgram();
-    c_correctionfactor = 1.0f;
+    // the strategy might have been changed in the config
+    selectStrategy();
     // Loaded, so we should verify the timestamps
     uint32_t startat = c_ps.getStartat();
     c_hecycletime = c_cfg->getHECycleTime();
@@ -516,19 +1019,21 @@ namespace aegir {
     float mttemp = env->getTempMT();
     if ( mttemp == 0 ) return;
     // let's see how much time do we have till we have to start pre-heating
-    uint32_t now = time(0);
+    uint32_t now = Clock::now();
     // calculate how much time
     float tempdiff = c_prog->getStartTemp() - mttemp;
     // Pre-Heat time
     // the time we have till pre-heating has to actually start
     uint32_t phtime = 0;
 
-    if ( tempdiff > 0 )
-      phtime = calcHeatTime(c_ps.getVolume(), tempdiff, 0.001*c_cfg->getHEPower());
+    if ( tempdiff > 0 ) {
+      auto eta = c_eta.heatTime(c_ps.getVolume(), mttemp, c_prog->getStartTemp(), getHEPower());
+      if ( eta.seconds > 0 ) phtime = eta.seconds;
+    }
 
-    c_log.trace("Controller::controllProcess() td:%.2f PreHeatTime:%u", tempdiff, phtime);
+    AEGIR_LOG_EVENT(c_log, trace, "preheat", {"tempdiff", tempdiff}, {"preheattime", phtime});
     uint32_t startat = c_ps.getStartat();
-    if ( (now + phtime*1.15) > startat ) {
+    if ( (now + phtime*c_preheatmargin) > startat ) {
       c_ps.setState(ProcessState::States::PreHeat);
     }
     c_needcontrol = false;
@@ -578,7 +1083,7 @@ namespace aegir {
 
     // here we are doing the steps
     Program::MashStep ms(steps[msno<0?0:msno]);
-    time_t now = time(0);
+    time_t now = Clock::now();
     // if it's <0, then we still have to get to
     // the first step's temperature
     if ( msno < 0 ) {
@@ -587,6 +1092,7 @@ namespace aegir {
       if ( mttemp >= ms.temp - c_cfg->getTempAccuracy() ) {
 	c_ps.setMashStep(0);
 	c_ps.setMashStepStart(now);
+	c_planner.stepReached(0, now);
 	c_log.info("Controller::stageMashing(): starting step 0 at %.2f/%.2f", mttemp, ms.temp);
 	return;
       }
@@ -594,18 +1100,22 @@ namespace aegir {
       // here we are doing the regular steps
       // heating up to the next step, is the responsibility of
       // the previous one, hence the -1 previously, heating up to the 0th step
-      time_t start = c_ps.getMashStepStart();
       float target = ms.temp;
       float overhead = 0.8f;
-      time_t held = now - start;
 
       // we held it for long enough, now we're aiming for the next step
       // and if we've reached it, we bump the step
-      if ( held > ms.holdtime*60 ) {
+      // the planner only counts the time at the step's temperature, and
+      // starts heating ahead by the system's lag
+      if ( c_planner.update(msno, now, mttemp) ) {
+	if ( auto &r = c_planner.getReports()[msno]; r.capped && r.rampstart == now )
+	  AEGIR_LOG_EVENT(c_log, warning, "mash.capped", {"step", msno}, {"held", r.held},
+			  {"holdtime", r.holdtime});
 	target = ((msno+1)<nsteps) ? steps[msno+1].temp : c_prog->getStartTemp();
 	if ( mttemp + c_cfg->getTempAccuracy() > target) {
 	  c_ps.setMashStep(msno+1);
 	  c_ps.setMashStepStart(now);
+	  c_planner.stepReached(msno+1, now);
 #if 0
 	  printf("Controller::stageMashing(): step %i->%i\n", msno, msno+1);
 #endif
@@ -617,8 +1127,8 @@ namespace aegir {
       static time_t lastreport;
 #if 0
       if ( lastreport != now && now % 5 == 0 ) {
-	printf("Controller::stageMashing(): S:%hhi HT:%li/%i MT:%.2f T:%.2f\n",
-	       msno, held, ms.holdtime, mttemp, target);
+	printf("Controller::stageMashing(): S:%hhi HT:%u/%i MT:%.2f T:%.2f\n",
+	       msno, c_planner.getReports()[msno].held, ms.holdtime, mttemp, target);
 	lastreport = now;
       }
 #endif
@@ -648,7 +1158,7 @@ namespace aegir {
 
     auto prog = c_ps.getProgram();
     auto hops = prog->getHops();
-    uint32_t now = time(0);
+    uint32_t now = Clock::now();
 
     uint32_t hopstart = c_ps.getHoppingStart();
     uint32_t boiltime = prog->getBoilTime();
@@ -732,10 +1242,38 @@ namespace aegir {
 
 
   void Controller::handleOutPIN(PINTracker::PIN &_pin) {
-    c_mq_iocmd.send(PinStateMessage(_pin.getName(),
-				    _pin.getNewValue(),
-				    _pin.getNewCycletime(),
-				    _pin.getNewOnratio()));
+    PinStateMessage msg(_pin.getName(), _pin.getNewValue(),
+			_pin.getNewCycletime(), _pin.getNewOnratio(), _pin.getAcquired());
+
+    if ( c_replaying ) {
+      c_replayoutputs.push_back(msg.serialize());
+      return;
+    }
+    auto trace = TraceRecorder::getInstance();
+    if ( trace->isRecording() )
+      trace->record(Trace::RecordType::Output, msg.serialize());
+    c_mq_iocmd.send(msg);
+  }
+
+  void Controller::failsafe() {
+    std::set<std::string> pins{"mtheat"};
+
+    // it's on the supervisor's thread, c_cfg belongs to the cycle
+    for (auto &it: Config::getInstance()->getHeaters()) pins.insert(it.pin);
+    for (auto &it: pins)
+      c_mq_failsafe.send(PinStateMessage(it, PINState::Off));
+    c_resync = true;
+    c_log.error("Fail-safe: heating elements are turned off");
+  }
+
+  void Controller::resyncOutputs() {
+    try {
+      resendOutPINs();
+    }
+    catch (Exception &e) {
+      c_log.error("Unable to resync the outputs: %s", e.what());
+    }
+    AEGIR_LOG_EVENT(c_log, warning, "failsafe.resync", {"watchdog", Watchdog::getInstance().getTrips()});
   }
 
   void Controller::setTempTarget(float _target, float _maxoverheat) {
@@ -748,8 +1286,7 @@ namespace aegir {
   };
 
   int Controller::tempControl() {
-    std::vector<int> lines;
-
+    AEGIR_TRACE_SPAN("controller.tempcontrol");
     c_ps.setTargetTemp(c_temptarget);
     c_newtemptarget = false;
 
@@ -759,428 +1296,111 @@ namespace aegir {
       return 1;
     }
 
-    int nextcontrol = 30;
-    TSDB& tsdb = c_ps.getThermoReadings();
-    auto env = Environment::getInstance();
-
-    time_t now = time(0);
-
     if ( getPIN("mtpump")->getOldValue() != PINState::On )
       setPIN("mtpump", PINState::On);
 
-    float dt = now - c_lastcontrol;
-    c_lastcontrol = now;
-
-    float curr_rims(0), curr_mt(0), last_rims(0), last_mt(0);
-    float dT_mt(0), dT_rims(0);
-    bool nodata(false);
-
-    // if we don't have enough data, then wait
-    if ( !getTemps(ThermoCouple::RIMS, dt, last_rims, curr_rims, dT_rims) ||
-	 !getTemps(ThermoCouple::MT, dt, last_mt, curr_mt, dT_mt) ) {
-      setHERatio(c_hecycletime, 0);
-      // if we don't have historical data, then simply use the last one
-      curr_rims = env->getTempRIMS();
-      curr_mt = env->getTempMT();
-      nodata = true;
-    }
-    if ( curr_mt == 0.0f || curr_rims == 0.0f ) return 3;
-
-    // set the RIMS tube target temperature
-    float T_target_rims;
-    if ( curr_mt >= c_temptarget ) {
-      T_target_rims = c_temptarget * 1.01;
-    } else {
-      T_target_rims = c_temptarget + std::min(c_tempoverheat, 0.2f+(c_temptarget - curr_mt)*2.3f);
-    }
-
-    c_log.debug("Controller::tempControl(): %li RIMS: dt:%.2f last:%.2f curr:%.2f dT:%.4f RIMS_target:%.2f",
-	   now, dt, last_rims, curr_rims, dT_rims, T_target_rims);
-    c_log.debug("Controller::tempControl(): %li MT: dt:%.2f last:%.2f curr:%.2f dT:%.4f",
-	   now, dt, last_mt, curr_mt, dT_mt);
-
-    float last_ratio = getPIN("mtheat")->getOldOnratio();
-
-    // First calculate how much power is needed to
-    // heat up the whole stuff in the mashtun to the
-    // target temperature
-
-    float dT_mtc_temptarget = c_temptarget - curr_mt; // temp difference
-    float dt_mt = dT_mtc_temptarget * 60.0; // heating with 1C/60s
+    auto decision = c_strategy->control(*this, c_temptarget, c_tempoverheat);
 
-    float hepwr = (1.0*c_cfg->getHEPower())/1000; // in kW
-    float pwr_max = hepwr;
-    float pwr_mt;
-    float pwr_dissipation = 0;
-    float pwr_dissipation_rims = 0;
-    float pwr_abs_min = 0;
-    float dTadjust = 1.2f; // FIXME should be moved to a config variable
-
-    // get the previous iteration's power. <0 == unknown
-    float lastpwr = -1;
-    if ( std::size_t i=c_heratiohistory.size(); i>0 ) {
-      lastpwr = c_heratiohistory[i-1].ratio * hepwr;
-    }
-
-    // when we're getting close to the target, but we don't have
-    // data, then try to throttle the heating
-    // this typically happens at Pre-Heating
-    if ( dT_mtc_temptarget < dTadjust && nodata ) {
-      float coeff_tgt = 0;
-      float coeff_rt = 1;
-
-      float halfpi = std::atan(INFINITY);
-      float tgtdiff = c_temptarget*1.01 - curr_mt;
-      float rimsdiff = curr_rims - c_temptarget;
-
-      if ( tgtdiff > 0 ) {
-	coeff_tgt = std::atan(tgtdiff)/halfpi;
-	coeff_tgt = std::pow(coeff_tgt, 0.91);
-      }
-      if ( rimsdiff > 0 ) {
-	coeff_rt = std::max(0.0f, std::atan(c_tempoverheat - rimsdiff)/halfpi);
-	coeff_rt = std::pow(coeff_rt, 0.25);
-      }
-      float heratio = std::pow(coeff_tgt * coeff_rt, 0.71);
-
-      c_log.debug("Controller::tempControl(): nodata heratio:%.2f", heratio);
-      setHERatio(c_hecycletime, heratio);
-      return 3;
-    }
-
-    // now calculate the MT heating requirements
-    if ( nodata ) {
-      // during preheat we don't have to care for 1C/60s
-      if ( c_ps.getState() == ProcessState::States::PreHeat ||
-	   c_ps.getState() == ProcessState::States::Maintenance ) {
-	pwr_mt = hepwr;
-      } else {
-	// dT_mtc_temptarget is present on both sides of the division, that's why it's
-	// omitted. This way the required power only depends on the volume -
-	// as it's a constant heating
-	pwr_mt = (4.2 * c_ps.getVolume() )/60;
-      }
-    } else {
-      pwr_mt = (4.2 * c_ps.getVolume() )/60;
-      // historical data is available here, so we use that to approximate
-      // when we're hitting the target temperature
-
-      if ( dT_mt > 0 ) {
-	// when the temperature of the MashTun is increasing
-
-	// check whether we're over the target temperature
-	if ( dT_mtc_temptarget > 0 ) {
-	  // linear approximation of the time it will take to
-	  // heat it up with the current HERatio
-	  float timetotarget = dT_mtc_temptarget / dT_mt;
-
-	  if ( timetotarget < 45 ) {
-	    pwr_mt *= 0.3;
-	    nextcontrol = 5;
-	  } else if ( timetotarget < 120 ) {
-	    pwr_mt *= 0.6;
-	    nextcontrol = 10;
-	  }
-	} else {
-	  // if we're over the MT target temp, then stop heating
-	  pwr_mt = 0;
-	}
-      } else {			// dT_mt < 0
-	// when the MT is cooling, check whether we need to heat at all
-	if ( dT_mtc_temptarget < 0 ) {
-	  // it's fine here, we're already over the target temp
-	  pwr_mt = 0;
-	} else {
-	  // pwr_mt's default should be good here, we're just decreasing the
-	  // control time, if we're close to the target temp
-	  if ( dT_mtc_temptarget < 1 ) {
-	    nextcontrol = 10;
-	  } else if ( dT_mtc_temptarget < 2 ) {
-	    nextcontrol = 15;
-	  }
-	  pwr_mt = calcPower(dT_mtc_temptarget, dt_mt);
-
-	  // adjust the max power. let's see how intensively we're cooling
-	  {
-	    int size = tsdb.size();
-	    float mt300 = 0;
-	    float pwr_min = calcPower(std::abs(dT_mtc_temptarget)+0.2);
-	    if ( size > 300 ) mt300 = tsdb.at(size-300)[ThermoCouple::MT];
-	    else mt300 = tsdb.at(0)[ThermoCouple::MT];
-
-	    if ( size<300 || mt300 < curr_mt) {
-	      c_log.warn("!! MT cooling, can't find t-300 or it's cooler than current temp");
-	      pwr_min = std::max(lastpwr, pwr_mt) * 1.05;
-	      if ( lastpwr > 0 ) {
-		c_correctionfactor *= 1.02f;
-		// revist this frequently, so the increment can kick in
-		nextcontrol = 10;
-	      } else {
-		pwr_min = std::max(pwr_min, hepwr * 0.45f);
-	      }
-	      c_log.warn("Limiting min power to: %.2f kW", pwr_min);
-	    } else {
-	      // size>30 || mt300>curr_mt -> MT cooling
-	      float diff_temp = mt300 - curr_mt;
-	      uint32_t diff_time = size > 300 ? 300 : size;
-	      float pwr_cooling = calcPower(diff_temp, diff_time);
-
-	      pwr_min = pwr_mt + pwr_cooling*3;
-	      // and limiting the absolute minimum power above the previous setting
-
-	      c_log.warn("Cooling (%.2f C / %i sec) limiting min power to %.2f/%.2f kW",
-			 diff_temp, diff_time, pwr_max, pwr_min);
-	    }
-	  }
-	}
-      }	// if ( dT_mt > 0 ) else
-    }	// if ( nodata ) else
-
-    c_log.debug("Controller::tempControl(): MT: dTc_temptarget:%.2f dt:%.2f hepwr:%.2f pwr_mt:%.2f nodata:%c",
-		dT_mtc_temptarget, dt_mt, hepwr, pwr_mt,
-		nodata ? 't' : 'f');
-
-    // adjust the next control time
-    if ( dt_mt < 60 ) {
-      nextcontrol = std::max(10, int(dt/3));
-    }
-
-    // calculate the dissipation during the last cycle
-    if ( !nodata ) {
-      float pwr_last_effective = calcPower(dT_mt*dt, dt);
-      float pwr_last = hepwr * last_ratio;
-      float diff = pwr_last - pwr_last_effective;
-
-      // we only apply dissipation if it's positive, and
-      // it's value is less than 5% of the heating element
-      // otherwise we're probably measuring lag.
-      if ( diff > 0 && curr_rims > 50.0)
-	pwr_dissipation = diff * ((curr_rims - 50)/40);
-
-      if ( pwr_last_effective < 0 && (curr_mt + dt*30)<c_temptarget)
-	pwr_abs_min = std::fabs(pwr_last_effective);
-      c_log.debug("Controller::tempControl(): pwr last:%.2f eff:%.2f diff:%.5f",
-		  pwr_last, pwr_last_effective, diff);
-      c_log.debug("Controller::tempControl(): dissipation: %.3f pwr_abs_min:%.2f",
-		  pwr_dissipation, pwr_abs_min);
-    }
+    if ( decision.decided ) setHERatio(c_hecycletime, decision.heratio);
+    return decision.nextcontrol;
+  }
 
-    // adjust the minimum power if it's cooling
-    if ( !nodata && dT_mtc_temptarget > 0 && dT_mt < 0 ) {
-      auto herd = c_heratiohistory[c_heratiohistory.size()-1];
-      pwr_abs_min = std::min(pwr_abs_min, (herd.ratio * hepwr) * 1.05f);
-      c_log.info("Adjusting absolute minimum power to previous + 5%%: %.2f kW",
-		 pwr_abs_min);
-    }
+  void Controller::setHERatio(float _cycletime, float _ratio) {
+    setPIN("mtheat", PINState::Pulsate, _cycletime, _ratio);
+    c_heratiohistory.insert(Clock::now(), _ratio);
+  }
 
-    /* The RIMS tube has a min a max value limiting its power,
-     * and in between an actual calculated value
-     * defaults are here, later we are limiting them
-     */
-    float pwr_rims_max = hepwr;
-    float pwr_rims_min = hepwr * 0.02;
-    float pwr_rims = hepwr;
-    float pwr_rims_final;
-
-    /*   ***********
-     *   * R I M S *
-     *   ***********/
-
-    // without data, the RIMS tube is practically not adjustable
-    if ( !nodata ) {
-      float flowrate = calcFlowRate();
-      c_log.trace("Flowrate: %.6f", flowrate);
-
-      if ( flowrate > 0  ) {
-	// again, time would be on both sides of the equation
-	// V=flowrate*dt
-	pwr_rims = (4.2 * flowrate * (T_target_rims - curr_mt))/1;
-	if ( curr_rims < (T_target_rims - 1.5f) )
-	  pwr_rims = (pwr_rims + hepwr)/2;
-
-	c_log.info("pwr_rms(%.2f) = (4.2 * flowrate(%.5f) * (T_target_rims(%.2f) - curr_mt(%.2f)))/1",
-		   pwr_rims, flowrate, T_target_rims, curr_mt);
-      }
+  /*
+   * The vessels' heating elements: the HLT heats the sparge water during
+   * the mash, the BK is pre-heated while sparging, then it boils. The
+   * IOHandler fits them into the power budget around the RIMS/HERMS element.
+   */
+  void Controller::controlHeaters() {
+    // the proportional band of the vessels
+    static constexpr float c_band = 2.0f;
+    auto env = Environment::getInstance();
+    ProcessState::States state = c_ps.getState();
 
-      if ( dT_mtc_temptarget < 0.5 ) {
-	pwr_rims *= 0.83;
-      } else if ( dT_mtc_temptarget < 1.0 ) {
-	pwr_rims *= 0.89;
-      } else if ( dT_mtc_temptarget < 2.0 ) {
-	pwr_rims *= 0.95;
+    for (auto &h: c_cfg->getHeaters()) {
+      float temp = h.vessel == ThermoCouple::BK ? env->getTempBK() : env->getTempHLT();
+      float ratio = 0;
+
+      if ( h.vessel == ThermoCouple::HLT &&
+	   (state == ProcessState::States::Mashing || state == ProcessState::States::Sparging) ) {
+	ratio = (h.temp - temp) / c_band;
+      } else if ( h.vessel == ThermoCouple::BK && state == ProcessState::States::Sparging ) {
+	ratio = (h.temp - temp) / c_band;
+      } else if ( h.vessel == ThermoCouple::BK &&
+		  (state == ProcessState::States::PreBoil || state == ProcessState::States::Hopping) ) {
+	ratio = 1;
       }
 
-      // set the max boundary
-      if ( curr_mt > (c_temptarget + 0.5) ) {
-	pwr_rims_max = 0;
-      } else if ( curr_mt >= c_temptarget ) {
-	// we are only compensating for the heat loss here
-	pwr_rims_max = pwr_rims_min;
-      }
-      // if ( !nodata )
-    } else {
-      if ( curr_mt+2 < T_target_rims ) pwr_rims = pwr_rims_max;
+      // no reading, no heating
+      if ( temp == 0 ) ratio = 0;
+      setPIN(h.pin, PINState::Pulsate, c_hecycletime, std::clamp(ratio, 0.0f, 1.0f));
     }
+  }
 
-    // apply min/max boundaries
-    // Controller::tempControl(): RIMS pwr: final:0.00 min:0.06 max:3.00 calc:1.93 max:0.00
-    pwr_rims_final = std::min({std::max(pwr_rims_min, pwr_rims)+ pwr_dissipation_rims, pwr_rims_max, pwr_max});
-    c_log.debug("Controller::tempControl(): RIMS pwr: final:%.2f min:%.2f max:%.2f calc:%.2f max:%.2f",
-		pwr_rims_final, pwr_rims_min, pwr_rims_max, pwr_rims, pwr_max);
-    float her_rims = pwr_rims_final / hepwr;
-
-
-    // MashTun heating element on-ratio
-    float her_mt = pwr_mt / hepwr;
-
-    // here we also define a minimum power, because there's heat
-    // dissipation around the tubing
-    float pwr_final = std::max(pwr_abs_min, std::min({pwr_mt + pwr_dissipation, pwr_rims_final}));
-    float heratio = pwr_final / hepwr;
-    if ( heratio < 0.004f && curr_mt < c_temptarget && curr_rims < c_temptarget)
-      heratio = 0.05f;
-
-    // limit the max correction factor
-    c_correctionfactor = std::min(c_correctionfactor, c_cfg->getMaxCorrectionFactor());
-
-    // apply the correction factor
-    if ( c_correctionfactor > 1.0 )
-      heratio = std::min(heratio * c_correctionfactor, 1.0f);
+  /*
+   * The expected ramp rate of the MT in C/s: the RIMS tube is kept
+   * heatoverhead above the MT, and that's carried over by the flow
+   */
+  float Controller::getRampRate() const {
+    auto &est = c_estimator.getEstimates();
+    float volume = std::max(getVolume(), 1.0f);
 
-    c_log.info("Controller::tempControl(%.2f, %.2f): dT_rims:%.2f dT_MT_tgt:%.2f P_he:%.2f P_mt:%.2f P_rims:%.2f R:%.3f(MT:%.2f / RIMS:%.2f) corr:%.2f",
-	       c_temptarget, c_tempoverheat,
-	       dT_rims, dT_mtc_temptarget,
-	       hepwr, pwr_mt, pwr_rims_final,
-	       heratio, her_mt, her_rims,
-	       c_correctionfactor);
+    if ( !est.valid ) return getHEPower() / (4.2f * volume);
 
-    setHERatio(c_hecycletime, heratio);
-    return nextcontrol;
+    return std::min(est.hepower / (4.2f * volume),
+		    est.flow * c_cfg->getHeatOverhead() / volume);
   }
 
-  uint32_t Controller::calcHeatTime(uint32_t _vol, uint32_t _tempdiff, float _pkw) const {
-    return (4.2 * _vol * _tempdiff)/_pkw;
+  /*
+   * Plant
+   */
+  const TSDB &Controller::getReadings() const {
+    return c_ps.getThermoReadings();
   }
 
-  bool Controller::getTemps(ThermoCouple _tc, uint32_t _dt, float &_last, float &_curr, float &_dT) {
-    TSDB& db(c_ps.getThermoReadings());
-    uint32_t size = db.size();
-    if ( size <= _dt || _dt < 3 ) return false;
-    try {
-      ThermoReadings curr,last;
-      _curr = db.last()[_tc];
-      _last = db.at(size-1-_dt)[_tc];
-    }
-    catch (std::exception &e) {
-      c_log.error("getTemps() failed %s", e.what());
-      return false;
-    }
-    catch ( ... ) {
-      c_log.error("getTemps() failed with unknown exception");
-      return false;
-    }
-    _dT = (_curr - _last)/(1.0*_dt);
-    return true;
+  const HERatioDB &Controller::getHERatios() const {
+    return c_heratiohistory;
   }
 
-  void Controller::setHERatio(float _cycletime, float _ratio) {
-    setPIN("mtheat", PINState::Pulsate, _cycletime, _ratio);
-    c_heratiohistory.insert(_ratio);
+  float Controller::getHERatio() const {
+    return getPIN("mtheat")->getOldOnratio();
   }
 
-  /* Flow rate calculation
-   * Formula: V = (P * dt) /(4.2 * dT)
-   * V = volume
-   * dt = time delta
-   * P = power [kW]
-   * dT = temperature delta
-   */
-  float Controller::calcFlowRate() {
-    TSDB& db(c_ps.getThermoReadings());
-
-    if ( db.size() < 30 ) return -1;
-    uint32_t dbsize = db.size();
-
-    uint32_t t_min_rims, t_min_mt;
-    uint32_t startedat(0);
-    uint32_t now = time(0);
-
-    // started is the start time of the Mashing state
-    startedat = c_ps.getStartat();
-    // if it's 0, then we'll use the temphistory's
-    // last timestamp
-    if ( startedat <= 0 ) startedat = db.last().time;
-
-    c_log.trace("calcFlowRate(): startedat: %u", startedat);
-
-
-    uint32_t t_total(0);
-    float V_total(0);
-    uint32_t last_end = now - startedat;
-    float hepwr = (1.0*c_cfg->getHEPower())/1000; // in kW
-
-#if 0
-    printf("now:%u startedat:%u last_end:%u\n", now, startedat, last_end);
-#endif
-
-    // loop on the heratio history backwards
-    // MashTun
-    for (ssize_t i=c_heratiohistory.size()-1; i>=0 && t_total < 180; --i) {
-      auto heratiodata = c_heratiohistory[i];
-      float heratio = heratiodata.ratio;
-      uint32_t dt_start = std::abs(heratiodata.time - startedat);
-      uint32_t dt_end = last_end;
-      float T_start;
-      float T_end;
-
-      if ( dt_start >= db.size() ) continue;
-
-#if 0
-      printf("calcFlowRate()/dt_start:%u\n", dt_start);
-
-      printf("calcFlowRate()/dbsize:&u - last_end:%u = %u",
-	     dbsize, last_end, dbsize-last_end);
-#endif
-      auto tr = db.atDeltaTime(dbsize-last_end);
-
-      auto tempsit = db.atDeltaTime(dt_start);
-      if ( tempsit->dt != dt_start ) {
-	c_log.trace("%s:%i: db.atDeltaTime(%u) miss: %lu",
-		    __FILE__, __LINE__,
-		    dt_start, tempsit->dt);
-	last_end = dt_start;
-	continue;
-      }
-      T_start = (*tempsit)[ThermoCouple::MT];
-      T_end = (*tempsit)[ThermoCouple::RIMS];
-
-      float dt = dt_end - dt_start;
-      float pwr = hepwr * heratio;
-      float dT = T_end - T_start;
+  float Controller::getTemp(ThermoCouple _tc) const {
+    return Environment::getInstance()->getTemp(_tc);
+  }
 
-      last_end = dt_start;
-      // if the current cycle cooled down, skip it
-      if ( dT < 0 ) continue;
+  float Controller::getHEPower() const {
+    return (1.0*c_cfg->getHEPower())/1000;
+  }
 
-      float V = (pwr * dt) / (4.2 * dT);
+  float Controller::getMaxCorrectionFactor() const {
+    return c_cfg->getMaxCorrectionFactor();
+  }
 
-#if 0
-      printf("Controller::calcFlowRate(): %u: %.4f = (%.2f * %.2f) / (4.2 * %.2f) (t_total:%u)\n",
-	     it->first, V, pwr, dt, dT, t_total);
-#endif
+  float Controller::getVolume() const {
+    return c_ps.getVolume();
+  }
 
-      if ( V <= 0 ) continue;
+  time_t Controller::getNow() const {
+    return Clock::now();
+  }
 
-      V_total += V;
-      t_total += dt;
-    }
+  time_t Controller::getStartAt() const {
+    return c_ps.getStartat();
+  }
 
-    float flowrate = V_total / t_total;
-#if 0
-    printf("Controller::calcFlowRate(): flowrate: %.4f = %.2f / %u\n",
-	   flowrate, V_total, t_total);
-#endif
-    return flowrate;
+  bool Controller::isPreHeating() const {
+    ProcessState::States state = c_ps.getState();
+    return state == ProcessState::States::PreHeat ||
+      state == ProcessState::States::Maintenance;
   }
 
+  const PlantEstimator::Estimates &Controller::getEstimates() const {
+    return c_estimator.getEstimates();
+  }
 }
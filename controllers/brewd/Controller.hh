@@ -14,6 +14,9 @@
 #include <list>
 #include <utility>
 #include <memory>
+#include <atomic>
+#include <deque>
+#include <vector>
 
 #include "ThreadManager.hh"
 #include "PINTracker.hh"
@@ -21,40 +24,19 @@
 #include "ProcessState.hh"
 #include "Config.hh"
 #include "LogChannel.hh"
+#include "HERatioDB.hh"
+#include "ControlStrategy.hh"
+#include "AutoTuner.hh"
+#include "MashPlanner.hh"
+#include "ETAEngine.hh"
+#include "Message.hh"
+#include "LoopMonitor.hh"
+#include "Metrics.hh"
 
 namespace aegir {
 
-  class Controller: public ThreadBase, public PINTracker {
-  private:
-    class HERatioDB {
-    public:
-      struct alignas(sizeof(long)) data {
-	time_t time;
-	float ratio;
-      };
-    public:
-      HERatioDB();
-      HERatioDB(HERatioDB&) = delete;
-      HERatioDB(const HERatioDB&) = delete;
-      HERatioDB(HERatioDB&&) = delete;
-      ~HERatioDB();
-
-      HERatioDB& clear();
-      HERatioDB& insert(float _value);
-
-      const data& operator[](const std::size_t) const;
-      inline const uint32_t size() const {return c_size;};
-
-    private:
-      void grow();
-
-    private:
-      std::uint32_t c_alloc_size;
-      std::uint32_t c_capacity;
-      std::uint32_t c_size;
-      data *c_data;
-    };
-
+  class Controller: public ThreadBase, public PINTracker, public Plant {
+    friend class Replay;
   private:
     Controller();
     Controller(Controller &&) = delete;
@@ -67,17 +49,35 @@ namespace aegir {
     static std::shared_ptr<Controller> getInstance();
     virtual void run() override;
 
+  protected:
+    // turns the heating elements off, behind the PINTracker's back
+    virtual void failsafe() override;
+
   private:
+    // sends the outputs' state again after a fail-safe or the watchdog's latch
+    void resyncOutputs();
+    // a control cycle on the events fired, returns whether the tempcontrol ran
+    // _wakeup is how late the timer woke the loop up, usecs
+    bool cycle(bool _control, bool _tempcontrol, int &_nexttempcontrol, uint32_t _wakeup = 0);
+    // the next message from the IOHandler, or from the Replay
+    std::shared_ptr<Message> recvIO();
     void reconfigure();
+    // the settings of the current config snapshot taking effect right away
+    void applyConfig();
+    void checkSensors();
+    void selectStrategy();
     void controlProcess(PINTracker &_pt);
     virtual void handleOutPIN(PINTracker::PIN &_pin) override;
-    uint32_t calcHeatTime(uint32_t _vol, uint32_t _tempdiff, float _pkw) const;
+    void publishState();
+    // the remaining time of a stage, the current one or one ahead
+    ETAEngine::Estimate estimateStage(ProcessState::States _state, time_t _now) const;
 
     // control stages
     typedef std::function<void(Controller*, PINTracker&)> stagefunc_t;
     std::map<ProcessState::States, stagefunc_t> c_stagehandlers;
     void onStateChange(ProcessState::States _old, ProcessState::States _new);
     void maintenanceMode(PINTracker &_pt);
+    void autoTune();
     void stageEmpty(PINTracker &_pt);
     void stageLoaded(PINTracker &_pt);
     void stagePreWait(PINTracker &_pt);
@@ -95,35 +95,64 @@ namespace aegir {
     // tempareture control
     void setTempTarget(float _target, float _maxoverheat);
     int tempControl();
-    bool getTemps(ThermoCouple _tc, uint32_t _dt, float &_last, float &_curr, float &_dT);
     void setHERatio(float _cycletime, float _ratio);
-    float calcFlowRate();
-
-    inline float calcPower(float _dT, float _dt=60) {
-      return (4.2 * c_ps.getVolume() * _dT)/ _dt;
-    }
+    void controlHeaters();
+    float getRampRate() const;
+
+    // the Plant, as the control strategies see it
+    virtual const TSDB &getReadings() const override;
+    virtual const HERatioDB &getHERatios() const override;
+    virtual float getHERatio() const override;
+    virtual float getTemp(ThermoCouple _tc) const override;
+    virtual float getHEPower() const override;
+    virtual float getMaxCorrectionFactor() const override;
+    virtual float getVolume() const override;
+    virtual time_t getNow() const override;
+    virtual time_t getStartAt() const override;
+    virtual bool isPreHeating() const override;
+    virtual const PlantEstimator::Estimates &getEstimates() const override;
 
   private:
     ZMQ::Socket c_mq_io, c_mq_iocmd;
+    // only used by the fail-safe, on the supervisor's thread
+    ZMQ::Socket c_mq_failsafe;
+    std::atomic<bool> c_resync;
+    // kept over the restarts
+    int c_kq;
     std::thread::id c_mythread;
     std::mutex c_mtx_stchqueue;
     std::list<std::pair<ProcessState::States, ProcessState::States> > c_stchqueue;
     bool c_levelerror;
-    time_t c_lastcontrol;
     float c_last_flow_volume;
     ProcessState &c_ps;
     std::shared_ptr<Program> c_prog;
-    std::shared_ptr<Config> c_cfg;
+    // the config snapshot of the current cycle
+    std::shared_ptr<const Config> c_cfg;
+    // the snapshot the sensors were set up from, the IOHandler and the
+    // SPI bus only take them on start
+    std::shared_ptr<const Config> c_sensorcfg;
     float c_hecycletime;
     bool c_needcontrol; // whether to do tempcontrols
     float c_temptarget;
     bool c_newtemptarget;
     float c_tempoverheat;
     HERatioDB c_heratiohistory;
+    std::unique_ptr<ControlStrategy> c_strategy;
+    PlantEstimator c_estimator;
+    AutoTuner c_autotuner;
+    MashPlanner c_planner;
+    ETAEngine c_eta;
     int32_t c_hestartdelay;
     bool c_hepause;
+    // the Replay's inputs and the pin decisions taken on them
+    bool c_replaying;
+    std::deque<std::shared_ptr<Message>> c_replayinputs;
+    std::vector<msgstring> c_replayoutputs;
     LogChannel c_log;
-    float c_correctionfactor;
+    // the cycles' timing and the runtime metrics
+    LoopMonitor c_loop;
+    Metrics::Histogram &c_m_period, &c_m_jitter;
+    Metrics::Gauge &c_m_iobacklog, &c_m_tsdbsize;
   };
 }
 
@@ -0,0 +1,201 @@
+
+#include "ETAEngine.hh"
+
+#include <cmath>
+#include <algorithm>
+
+namespace aegir {
+
+  // below this temperature spread the curve is taken linear
+  static constexpr float c_minspread = 1.0f;
+  // the relative change of the rate until the target, below that it's linear
+  static constexpr float c_mincurvature = 0.01f;
+  // closer than this is reached
+  static constexpr float c_reached = 0.1f;
+  // the confidence of the learned rates and powers
+  static constexpr float c_learnedconfidence = 0.3f;
+  static constexpr float c_powerconfidence = 0.7f;
+  static constexpr float c_nominalconfidence = 0.4f;
+
+  ETAEngine::ETAEngine(): c_interval(1), c_effpower(0) {
+    for (auto &c: c_curves) c.samples.resize(c_window);
+  }
+
+  ETAEngine::~ETAEngine() {
+  }
+
+  void ETAEngine::reset() {
+    for (auto &c: c_curves) {
+      c.next = c.size = 0;
+      c.mark = {0, 0};
+    }
+  }
+
+  void ETAEngine::addReadings(time_t _time, const ThermoReadings &_temps) {
+    for (std::size_t i=0; i < _temps.size; ++i) {
+      Curve &c(c_curves[i]);
+      float temp = _temps[i];
+
+      // not read yet, or not newer
+      if ( temp == 0.0f ) continue;
+      if ( c.size && c.at(c.size-1).time >= _time ) continue;
+
+      c.samples[c.next] = {_time, temp};
+      c.next = (c.next + 1) % c.samples.size();
+      if ( c.size < c.samples.size() ) ++c.size;
+    }
+  }
+
+  bool ETAEngine::fit(const Curve &_curve, float &_alpha, float &_beta, float &_rms,
+		      float &_coverage) const {
+    const std::size_t nblocks = _curve.size / c_block;
+    if ( nblocks < 3 ) return false;
+
+    // the slope and the mean temperature of every block
+    std::vector<float> slopes(nblocks), temps(nblocks);
+    const std::size_t first = _curve.size - nblocks * c_block;
+    for (std::size_t b=0; b < nblocks; ++b) {
+      double st(0), sT(0), stt(0), stT(0);
+      time_t t0 = _curve.at(first + b*c_block).time;
+
+      for (std::size_t i=0; i < c_block; ++i) {
+	const sample &s(_curve.at(first + b*c_block + i));
+	double t = s.time - t0;
+	st += t;
+	sT += s.temp;
+	stt += t*t;
+	stT += t*s.temp;
+      }
+      double det = c_block*stt - st*st;
+      slopes[b] = det > 0 ? (c_block*stT - st*sT) / det : 0;
+      temps[b] = sT / c_block;
+    }
+
+    // the slopes on the temperatures
+    double mT(0), ms(0);
+    for (std::size_t b=0; b < nblocks; ++b) {
+      mT += temps[b];
+      ms += slopes[b];
+    }
+    mT /= nblocks;
+    ms /= nblocks;
+
+    double sTT(0), sTs(0);
+    for (std::size_t b=0; b < nblocks; ++b) {
+      sTT += (temps[b] - mT) * (temps[b] - mT);
+      sTs += (temps[b] - mT) * (slopes[b] - ms);
+    }
+
+    auto [mint, maxt] = std::minmax_element(temps.begin(), temps.end());
+    if ( *maxt - *mint >= c_minspread && sTT > 0 ) {
+      _beta = sTs / sTT;
+      _alpha = ms - _beta * mT;
+    } else {
+      _beta = 0;
+      _alpha = ms;
+    }
+
+    double sse = 0;
+    for (std::size_t b=0; b < nblocks; ++b) {
+      double e = slopes[b] - (_alpha + _beta * temps[b]);
+      sse += e*e;
+    }
+    _rms = std::sqrt(sse / nblocks);
+    _coverage = (1.0f * nblocks * c_block) / c_window;
+    return true;
+  }
+
+  ETAEngine::Estimate ETAEngine::timeTo(ThermoCouple _tc, float _target) const {
+    const Curve &c(c_curves[_tc]);
+    if ( !c.size ) return {-1, 0};
+
+    // the current temperature, a bit smoothed
+    std::size_t n = std::min<std::size_t>(c.size, 5);
+    float temp = 0;
+    for (std::size_t i=c.size-n; i < c.size; ++i) temp += c.at(i).temp / n;
+
+    float diff = _target - temp;
+    if ( std::fabs(diff) < c_reached ) return {0, 1};
+
+    // the target was passed within the window and it's moving away
+    float mintemp(temp), maxtemp(temp);
+    for (std::size_t i=0; i < c.size; ++i) {
+      mintemp = std::min(mintemp, c.at(i).temp);
+      maxtemp = std::max(maxtemp, c.at(i).temp);
+    }
+    bool passed = _target >= mintemp && _target <= maxtemp;
+
+    float alpha, beta, rms, coverage;
+    if ( !fit(c, alpha, beta, rms, coverage) )
+      return passed ? Estimate{0, 1} : byRate(_tc, temp, _target);
+
+    // moving away from the target
+    float rate = alpha + beta * temp;
+    if ( rate * diff <= 0 )
+      return passed ? Estimate{0, 1} : byRate(_tc, temp, _target);
+
+    float confidence = std::clamp(1 - rms / std::fabs(rate), 0.0f, 1.0f) * coverage;
+
+    // approaching an asymptote, when the rate changes noticeably on the way
+    if ( beta < 0 && -beta * std::fabs(diff) > c_mincurvature * std::fabs(rate) ) {
+      double asymptote = -(double)alpha / beta;
+      double ratio = (asymptote - _target) / (asymptote - temp);
+
+      if ( ratio > 0 && ratio < 1 )
+	return {(int32_t)std::lround(std::log(ratio) / beta), confidence};
+
+      // beyond the asymptote by the fit, going on with the current rate
+      confidence /= 2;
+    }
+
+    return {(int32_t)std::lround(diff / rate), confidence};
+  }
+
+  ETAEngine::Estimate ETAEngine::byRate(ThermoCouple _tc, float _from, float _to) const {
+    const Curve &c(c_curves[_tc]);
+    float diff = _to - _from;
+
+    if ( std::fabs(diff) < c_reached ) return {0, 1};
+
+    float rate = diff > 0 ? c.heatrate : c.coolrate;
+    if ( rate == 0 ) return {-1, 0};
+
+    return {(int32_t)std::lround(diff / rate), c_learnedconfidence};
+  }
+
+  ETAEngine::Estimate ETAEngine::heatTime(float _volume, float _from, float _to,
+					  float _hepower) const {
+    if ( _to <= _from ) return {0, 1};
+
+    float power = c_effpower > 0 ? c_effpower : _hepower;
+    if ( power <= 0 || _volume <= 0 ) return {-1, 0};
+
+    return {(int32_t)std::lround(4.2f * _volume * (_to - _from) / power),
+	c_effpower > 0 ? c_powerconfidence : c_nominalconfidence};
+  }
+
+  void ETAEngine::mark() {
+    for (auto &c: c_curves)
+      c.mark = c.size ? c.at(c.size-1) : sample{0, 0};
+  }
+
+  void ETAEngine::learn(ThermoCouple _tc, float _volume) {
+    Curve &c(c_curves[_tc]);
+
+    if ( !c.mark.time || !c.size ) return;
+
+    const sample &last(c.at(c.size-1));
+    sample mark(c.mark);
+    time_t dt = last.time - mark.time;
+    c.mark = {0, 0};
+    if ( dt < (time_t)(c_block * c_interval) ) return;
+
+    float rate = (last.temp - mark.temp) / dt;
+    if ( rate > 0 ) {
+      c.heatrate = rate;
+      if ( _volume > 0 ) c_effpower = 4.2f * _volume * rate;
+    } else if ( rate < 0 ) {
+      c.coolrate = rate;
+    }
+  }
+}
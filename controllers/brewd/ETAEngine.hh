@@ -0,0 +1,99 @@
+/*
+ * Completion estimates of the process stages
+ * The temperature curve of every sensor is fitted on the last readings as
+ *   dT/dt = alpha + beta * T
+ * on the slopes of 30-reading blocks, which covers the linear heating of a
+ * powered kettle and the exponential approach to an asymptote, like cooling
+ * towards the coolant's temperature. The time to a target is solved from the
+ * fitted curve, its confidence comes from the fit's residuals.
+ * The average rates of the finished stages are kept across brews, they're
+ * the estimates of the stages that haven't started yet.
+ */
+
+#ifndef AEGIR_ETAENGINE_H
+#define AEGIR_ETAENGINE_H
+
+#include <time.h>
+#include <cstdint>
+#include <array>
+#include <vector>
+
+#include "types.hh"
+
+namespace aegir {
+
+  class ETAEngine {
+    ETAEngine(ETAEngine&&) = delete;
+    ETAEngine(const ETAEngine &) = delete;
+    ETAEngine &operator=(ETAEngine &&) = delete;
+    ETAEngine &operator=(const ETAEngine &) = delete;
+  public:
+    struct Estimate {
+      // secs, <0 when unknown
+      int32_t seconds;
+      // 0..1
+      float confidence;
+    };
+
+    // the readings the curves are fitted on, and the ones in a block, these
+    // are seconds with the default 1s thermo reading interval
+    static constexpr uint32_t c_window = 600;
+    static constexpr uint32_t c_block = 30;
+
+  public:
+    ETAEngine();
+    ~ETAEngine();
+
+    // a new brew, the learned rates are kept
+    void reset();
+    // the thermo reading interval, secs
+    inline void setInterval(uint32_t _secs) { c_interval = _secs ? _secs : 1; };
+    void addReadings(time_t _time, const ThermoReadings &_temps);
+
+    // the time for _tc to reach _target, from its curve or from its
+    // learned rate, 0 when it was passed and moving away
+    Estimate timeTo(ThermoCouple _tc, float _target) const;
+    // heating _volume liters from _from to _to: with the effective power
+    // learned on the previous heatings, or the nominal _hepower in kW
+    Estimate heatTime(float _volume, float _from, float _to, float _hepower) const;
+    // the time for _tc from _from to _to with its learned rate, for the
+    // stages that haven't started yet
+    Estimate byRate(ThermoCouple _tc, float _from, float _to) const;
+
+    // the start of a stage, at the last readings
+    void mark();
+    // the end of a stage, learning _tc's average rate since the mark from
+    // at least a block's worth of readings, with the volume the effective
+    // heating power as well
+    void learn(ThermoCouple _tc, float _volume = 0);
+
+    inline float getEffectivePower() const { return c_effpower; };
+
+  private:
+    struct sample {
+      time_t time;
+      float temp;
+    };
+    struct Curve {
+      std::vector<sample> samples;
+      std::size_t next = 0;
+      std::size_t size = 0;
+      // the learned rates, C/s: heating and cooling, 0 when unknown
+      float heatrate = 0, coolrate = 0;
+      sample mark{0, 0};
+      inline const sample &at(std::size_t _i) const {
+	return samples[(next + samples.size() - size + _i) % samples.size()];
+      };
+    };
+    // the fitted curve, the residual of the slopes and the coverage of the window
+    bool fit(const Curve &_curve, float &_alpha, float &_beta, float &_rms,
+	     float &_coverage) const;
+
+  private:
+    std::array<Curve, ThermoCouple::_MAX> c_curves;
+    uint32_t c_interval;
+    float c_effpower;
+  };
+}
+
+#endif
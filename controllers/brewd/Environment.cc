@@ -3,7 +3,8 @@
 
 namespace aegir {
 
-  Environment::Environment() {
+  Environment::Environment(): c_sensors(ThermoCouple::_SIZE), c_he_delivered(0) {
+    for (auto &t: c_temps) t = 0;
   }
 
   Environment::~Environment() {
@@ -15,21 +16,7 @@ namespace aegir {
   }
 
   void Environment::setThermoReadings(ThermoReadings& _r) {
-    for (uint8_t i=0; i<ThermoCouple::_SIZE; ++i) {
-      switch (i) {
-      case ThermoCouple::MT:
-	c_temp_mt = _r[i];
-	break;
-      case ThermoCouple::RIMS:
-	c_temp_rims = _r[i];
-	break;
-      case ThermoCouple::BK:
-	c_temp_bk = _r[i];
-	break;
-      case ThermoCouple::HLT:
-	c_temp_hlt = _r[i];
-	break;
-      }
-    }
+    _r.forEach([&](uint8_t i) { c_temps[i] = _r[i]; });
+    c_sensors = _r.size;
   }
 }
@@ -8,6 +8,7 @@
 
 #include <memory>
 #include <atomic>
+#include <array>
 
 #include "types.hh"
 
@@ -25,16 +26,21 @@ namespace aegir {
     static std::shared_ptr<Environment> getInstance();
 
     void setThermoReadings(ThermoReadings& _r);
-    inline float getTempMT() const { return c_temp_mt; };
-    inline float getTempRIMS() const { return c_temp_rims; };
-    inline float getTempBK() const { return c_temp_bk; };
-    inline float getTempHLT() const { return c_temp_hlt; };
+    inline float getTempMT() const { return c_temps[ThermoCouple::MT]; };
+    inline float getTempRIMS() const { return c_temps[ThermoCouple::RIMS]; };
+    inline float getTempBK() const { return c_temps[ThermoCouple::BK]; };
+    inline float getTempHLT() const { return c_temps[ThermoCouple::HLT]; };
+    // any sensor, including the extra ones
+    inline float getTemp(ThermoCouple _tc) const { return c_temps[_tc]; };
+    inline uint8_t getSensorCount() const { return c_sensors; };
+    // the on-ratio the heating element actually got in its last cycle
+    inline void setHEDelivered(float _ratio) { c_he_delivered = _ratio; };
+    inline float getHEDelivered() const { return c_he_delivered; };
 
   private:
-    std::atomic<float> c_temp_mt;
-    std::atomic<float> c_temp_rims;
-    std::atomic<float> c_temp_bk;
-    std::atomic<float> c_temp_hlt;
+    std::array<std::atomic<float>, ThermoCouple::_MAX> c_temps;
+    std::atomic<uint8_t> c_sensors;
+    std::atomic<float> c_he_delivered;
   };
 }
 
@@ -0,0 +1,187 @@
+
+#include "FlowRateAccumulator.hh"
+
+#include <sys/types.h>
+#include <cstdlib>
+
+namespace aegir {
+
+  FlowRateAccumulator::FlowRateAccumulator() {
+    reset();
+  }
+
+  FlowRateAccumulator::~FlowRateAccumulator() {
+  }
+
+  void FlowRateAccumulator::reset() {
+    c_segments.clear();
+    c_next = 0;
+    c_startedat = 0;
+    c_dbsize = 0;
+    c_dbstart = 0;
+  }
+
+  float FlowRateAccumulator::get(const TSDB &_db, const HERatioDB &_heratios,
+				 uint32_t _startedat, uint32_t _now, float _hepower) {
+    if ( !update(_db, _heratios, _startedat) )
+      return rescan(_db, _heratios, _startedat, _now, _hepower);
+
+    uint32_t t_total(0);
+    float V_total(0);
+    uint32_t last_end = _now - _startedat;
+
+    trim(_hepower);
+
+    // the same arithmetic in the same order as rescan()'s,
+    // the float sums are bit-identical
+    for (ssize_t i=c_segments.size()-1; i>=0 && t_total < 180; --i) {
+      const segment &s = c_segments[i];
+      uint32_t dt_end = last_end;
+
+      last_end = s.dt_start;
+      if ( !s.hit ) continue;
+
+      float dt = dt_end - s.dt_start;
+      float pwr = _hepower * s.ratio;
+      float dT = s.T_end - s.T_start;
+
+      if ( dT < 0 ) continue;
+
+      float V = (pwr * dt) / (4.2 * dT);
+
+      if ( V <= 0 ) continue;
+
+      V_total += V;
+      t_total += dt;
+    }
+
+    float flowrate = V_total / t_total;
+    return flowrate;
+  }
+
+  /*
+   * Drops the segments before the window. The last segment ends with the
+   * next on-ratio, which might still be waiting for its reading, so the
+   * window is counted without it: the rest never changes, and the later
+   * get()s stop before the dropped ones.
+   */
+  void FlowRateAccumulator::trim(float _hepower) {
+    if ( c_segments.size() < 2 ) return;
+
+    uint32_t t_total(0);
+    uint32_t last_end = c_segments.back().dt_start;
+    ssize_t i;
+
+    for (i=c_segments.size()-2; i>=0 && t_total < 180; --i) {
+      const segment &s = c_segments[i];
+      uint32_t dt_end = last_end;
+
+      last_end = s.dt_start;
+      if ( !s.hit ) continue;
+
+      float dt = dt_end - s.dt_start;
+      float pwr = _hepower * s.ratio;
+      float dT = s.T_end - s.T_start;
+
+      if ( dT < 0 ) continue;
+      if ( (pwr * dt) / (4.2 * dT) <= 0 ) continue;
+
+      t_total += dt;
+    }
+
+    if ( t_total >= 180 )
+      for (; i>=0; --i) c_segments.pop_front();
+  }
+
+  /*
+   * Looks up the readings of the new on-ratios. Returns false when the
+   * history can't be followed incrementally, then rescan() has to do it.
+   */
+  bool FlowRateAccumulator::update(const TSDB &_db, const HERatioDB &_heratios,
+				   uint32_t _startedat) {
+    uint32_t size = _db.size();
+
+    if ( !size ) {
+      reset();
+      return true;
+    }
+
+    // a new brew or a different start, starting over
+    time_t dbstart = _db.at(0).time;
+    if ( _startedat != c_startedat || dbstart != c_dbstart
+	 || size < c_dbsize || _heratios.size() < c_next ) {
+      reset();
+      c_startedat = _startedat;
+      c_dbstart = dbstart;
+    }
+    c_dbsize = size;
+
+    for (; c_next < _heratios.size(); ++c_next) {
+      auto heratiodata = _heratios[c_next];
+      uint32_t dt_start = std::abs(heratiodata.time - _startedat);
+
+      // its reading isn't in yet
+      if ( dt_start >= size ) break;
+
+      auto tempsit = _db.atDeltaTime(dt_start);
+      // at the end of the TSDB the lookup moves with the new readings
+      if ( tempsit.index() == size-1 && tempsit->dt < dt_start ) break;
+
+      c_segments.push_back({dt_start, tempsit->dt == dt_start, heratiodata.ratio,
+	  (*tempsit)[ThermoCouple::MT], (*tempsit)[ThermoCouple::RIMS]});
+    }
+
+    // the rest has to be skipped by rescan() as well, which is the case
+    // unless the timestamps went backwards
+    for (uint32_t i=c_next; i < _heratios.size(); ++i)
+      if ( (uint32_t)std::abs(_heratios[i].time - _startedat) < size ) return false;
+
+    return true;
+  }
+
+  float FlowRateAccumulator::rescan(const TSDB &_db, const HERatioDB &_heratios,
+				    uint32_t _startedat, uint32_t _now, float _hepower) {
+    uint32_t t_total(0);
+    float V_total(0);
+    uint32_t last_end = _now - _startedat;
+
+    // loop on the heratio history backwards
+    // MashTun
+    for (ssize_t i=(ssize_t)_heratios.size()-1; i>=0 && t_total < 180; --i) {
+      auto heratiodata = _heratios[i];
+      float heratio = heratiodata.ratio;
+      uint32_t dt_start = std::abs(heratiodata.time - _startedat);
+      uint32_t dt_end = last_end;
+      float T_start;
+      float T_end;
+
+      if ( dt_start >= _db.size() ) continue;
+
+      auto tempsit = _db.atDeltaTime(dt_start);
+      if ( tempsit->dt != dt_start ) {
+	last_end = dt_start;
+	continue;
+      }
+      T_start = (*tempsit)[ThermoCouple::MT];
+      T_end = (*tempsit)[ThermoCouple::RIMS];
+
+      float dt = dt_end - dt_start;
+      float pwr = _hepower * heratio;
+      float dT = T_end - T_start;
+
+      last_end = dt_start;
+      // if the current cycle cooled down, skip it
+      if ( dT < 0 ) continue;
+
+      float V = (pwr * dt) / (4.2 * dT);
+
+      if ( V <= 0 ) continue;
+
+      V_total += V;
+      t_total += dt;
+    }
+
+    float flowrate = V_total / t_total;
+    return flowrate;
+  }
+}
@@ -0,0 +1,65 @@
+/*
+ * Flow rate from the heat balance of the RIMS tube
+ * Every on-ratio period is a segment: V = (P * dt) / (4.2 * dT), where dT is
+ * the tube's temperature rise at the start of the period. The flow rate is
+ * the sum of the volumes over the sum of the times of the last 180s.
+ * The TSDB is looked up once per on-ratio, when the reading at its start
+ * is in, so getting the flow rate doesn't touch the TSDB at all.
+ * The segments before the window are dropped once a get() has filled it.
+ * The results are the same as of the rescan(), it's kept as the reference.
+ */
+
+#ifndef AEGIR_FLOWRATEACCUMULATOR_H
+#define AEGIR_FLOWRATEACCUMULATOR_H
+
+#include <time.h>
+#include <cstdint>
+#include <deque>
+
+#include "TSDB.hh"
+#include "HERatioDB.hh"
+
+namespace aegir {
+
+  class FlowRateAccumulator {
+    FlowRateAccumulator(FlowRateAccumulator&&) = delete;
+    FlowRateAccumulator(const FlowRateAccumulator &) = delete;
+    FlowRateAccumulator &operator=(FlowRateAccumulator &&) = delete;
+    FlowRateAccumulator &operator=(const FlowRateAccumulator &) = delete;
+  public:
+    FlowRateAccumulator();
+    ~FlowRateAccumulator();
+
+    void reset();
+    // the flow rate in l/s, _startedat is the time the TSDB's dt is
+    // relative to, _hepower is in kW
+    float get(const TSDB &_db, const HERatioDB &_heratios,
+	      uint32_t _startedat, uint32_t _now, float _hepower);
+    // the same, scanning the on-ratio history backwards
+    static float rescan(const TSDB &_db, const HERatioDB &_heratios,
+			uint32_t _startedat, uint32_t _now, float _hepower);
+    // the segments kept
+    inline size_t size() const { return c_segments.size(); };
+
+  private:
+    // an on-ratio with the readings at its start
+    struct segment {
+      uint32_t dt_start;
+      bool hit;
+      float ratio;
+      float T_start;
+      float T_end;
+    };
+    bool update(const TSDB &_db, const HERatioDB &_heratios, uint32_t _startedat);
+    void trim(float _hepower);
+
+  private:
+    std::deque<segment> c_segments;
+    uint32_t c_next;
+    uint32_t c_startedat;
+    uint32_t c_dbsize;
+    time_t c_dbstart;
+  };
+}
+
+#endif
@@ -0,0 +1,73 @@
+
+#include "HERatioDB.hh"
+
+#include <unistd.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#include "Exception.hh"
+
+namespace aegir {
+
+  HERatioDB::HERatioDB(): c_alloc_size(0), c_capacity(0), c_size(0), c_data(0) {
+    grow();
+  };
+
+  HERatioDB::~HERatioDB() {
+    if ( c_data ) std::free(c_data);
+  };
+
+  HERatioDB& HERatioDB::clear() {
+    std::memset((void*)c_data, 0, c_alloc_size);
+    c_size = 0;
+    return *this;
+  }
+
+  HERatioDB& HERatioDB::insert(time_t _time, float _value) {
+    if ( c_size >= c_capacity ) grow();
+
+    uint32_t idx = c_size++;
+
+    c_data[idx].time = _time;
+    c_data[idx].ratio = _value;
+    return *this;
+  }
+
+  const HERatioDB::data& HERatioDB::operator[](const std::size_t _at) const {
+    if ( _at >= c_size )
+      throw Exception("HERatioDB out of range (size:%lu at:%lu", c_size, _at);
+
+    return c_data[_at];
+  }
+
+  float HERatioDB::ratioAt(time_t _time) const {
+    // the entries are inserted in time order, looking for the
+    // last one that's not after _time
+    uint32_t lo = 0, hi = c_size;
+
+    while ( lo < hi ) {
+      uint32_t mid = (lo + hi) / 2;
+      if ( c_data[mid].time <= _time ) lo = mid + 1;
+      else hi = mid;
+    }
+    return lo ? c_data[lo-1].ratio : 0;
+  }
+
+  void HERatioDB::grow() {
+    uint32_t prevsize = c_alloc_size;
+    uint32_t increment = getpagesize();
+    data *newdata = (data*)std::realloc((void*)c_data, c_alloc_size + increment);
+
+    if ( !newdata ) throw std::bad_alloc();
+
+    c_data = newdata;
+    c_alloc_size += increment;
+    c_capacity = c_alloc_size / sizeof(data);
+
+    // and finally zero the newly allocated region
+    void *start = (void*)(((uint8_t*)c_data)+prevsize);
+    std::memset(start, 0, increment);
+  }
+}
@@ -0,0 +1,51 @@
+/*
+  Heating element on-ratio history
+  Every on-ratio set on the heating element is recorded with its timestamp,
+  the control strategies are using it together with the TSDB
+ */
+
+#ifndef AEGIR_HERATIODB_H
+#define AEGIR_HERATIODB_H
+
+#include <time.h>
+#include <cstdint>
+#include <cstddef>
+
+namespace aegir {
+
+  class HERatioDB {
+  public:
+    struct alignas(sizeof(long)) data {
+      time_t time;
+      float ratio;
+    };
+  public:
+    HERatioDB();
+    HERatioDB(HERatioDB&) = delete;
+    HERatioDB(const HERatioDB&) = delete;
+    HERatioDB(HERatioDB&&) = delete;
+    ~HERatioDB();
+
+    HERatioDB& clear();
+    inline HERatioDB& insert(float _value) {
+      return insert(time(0), _value);
+    }
+    HERatioDB& insert(time_t _time, float _value);
+
+    const data& operator[](const std::size_t) const;
+    inline const uint32_t size() const {return c_size;};
+    // the ratio in effect at _time, 0 before the first entry
+    float ratioAt(time_t _time) const;
+
+  private:
+    void grow();
+
+  private:
+    std::uint32_t c_alloc_size;
+    std::uint32_t c_capacity;
+    std::uint32_t c_size;
+    data *c_data;
+  };
+}
+
+#endif
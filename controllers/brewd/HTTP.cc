@@ -0,0 +1,177 @@
+
+#include "HTTP.hh"
+
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <charconv>
+#include <algorithm>
+
+#include "Exception.hh"
+
+namespace aegir {
+
+  namespace HTTP {
+
+    static std::string lower(std::string _s) {
+      std::transform(_s.begin(), _s.end(), _s.begin(),
+		     [](char c) {return std::tolower(c);});
+      return _s;
+    }
+
+    static std::string trim(const char *_begin, const char *_end) {
+      while ( _begin < _end && (*_begin == ' ' || *_begin == '\t') ) ++_begin;
+      while ( _end > _begin && (_end[-1] == ' ' || _end[-1] == '\t') ) --_end;
+      return std::string(_begin, _end);
+    }
+
+    const std::string *Request::header(const std::string &_name) const {
+      auto it = headers.find(_name);
+      if ( it == headers.end() ) return nullptr;
+      return &it->second;
+    }
+
+    bool Request::hasToken(const std::string &_name, const std::string &_token) const {
+      const std::string *value = header(_name);
+      if ( !value ) return false;
+
+      std::string lvalue(lower(*value)), ltoken(lower(_token));
+      std::size_t pos = 0;
+      while ( pos <= lvalue.size() ) {
+	std::size_t comma = lvalue.find(',', pos);
+	if ( comma == std::string::npos ) comma = lvalue.size();
+	if ( trim(lvalue.data()+pos, lvalue.data()+comma) == ltoken ) return true;
+	pos = comma + 1;
+      }
+      return false;
+    }
+
+    bool Request::sameOrigin() const {
+      const std::string *origin = header("origin");
+      if ( !origin ) return true;
+
+      const std::string *host = header("host");
+      std::size_t pos = origin->find("://");
+      if ( !host || pos == std::string::npos ) return false;
+
+      // scheme://host[:port], without a path
+      std::string ohost(lower(origin->substr(pos + 3)));
+      if ( ohost.size() && ohost.back() == '/' ) ohost.pop_back();
+      return ohost.size() && ohost == lower(trim(host->data(), host->data() + host->size()));
+    }
+
+    bool Request::keepAlive() const {
+      if ( version == "HTTP/1.0" )
+	return hasToken("connection", "keep-alive");
+      return !hasToken("connection", "close");
+    }
+
+    std::size_t parseRequest(const char *_data, std::size_t _size, Request &_req) {
+      const char *end = _data + _size;
+      const char *hdrend = nullptr;
+
+      // find the end of the header
+      for (const char *p = _data; p + 3 < end; ++p) {
+	if ( p[0] == '\r' && p[1] == '\n' && p[2] == '\r' && p[3] == '\n' ) {
+	  hdrend = p;
+	  break;
+	}
+      }
+      if ( !hdrend ) {
+	if ( _size > c_maxheader )
+	  throw Exception("HTTP header too large");
+	return 0;
+      }
+
+      _req.headers.clear();
+      _req.body.clear();
+
+      // the request line
+      const char *lineend = (const char*)memchr(_data, '\r', hdrend - _data + 1);
+      const char *sp1 = (const char*)memchr(_data, ' ', lineend - _data);
+      if ( !sp1 )
+	throw Exception("Malformed HTTP request line");
+      const char *sp2 = (const char*)memchr(sp1 + 1, ' ', lineend - sp1 - 1);
+      if ( !sp2 )
+	throw Exception("Malformed HTTP request line");
+
+      _req.method.assign(_data, sp1);
+      std::string target(sp1 + 1, sp2);
+      _req.version.assign(sp2 + 1, lineend);
+      if ( _req.version != "HTTP/1.1" && _req.version != "HTTP/1.0" )
+	throw Exception("Unsupported HTTP version");
+
+      std::size_t qpos = target.find('?');
+      if ( qpos != std::string::npos ) {
+	_req.path = target.substr(0, qpos);
+	_req.query = target.substr(qpos + 1);
+      } else {
+	_req.path = target;
+	_req.query.clear();
+      }
+
+      // the header fields
+      const char *line = lineend + 2;
+      while ( line < hdrend ) {
+	const char *eol = (const char*)memchr(line, '\r', hdrend - line + 1);
+	const char *colon = (const char*)memchr(line, ':', eol - line);
+	if ( !colon )
+	  throw Exception("Malformed HTTP header line");
+	_req.headers[lower(std::string(line, colon))] = trim(colon + 1, eol);
+	line = eol + 2;
+      }
+
+      if ( _req.header("transfer-encoding") )
+	throw Exception("Chunked request bodies are not supported");
+
+      // and the body
+      std::size_t bodylen = 0;
+      if ( auto cl = _req.header("content-length") ) {
+	auto res = std::from_chars(cl->data(), cl->data() + cl->size(), bodylen);
+	if ( res.ec != std::errc() || res.ptr != cl->data() + cl->size() )
+	  throw Exception("Invalid Content-Length");
+	if ( bodylen > c_maxbody )
+	  throw Exception("HTTP body too large");
+      }
+
+      const char *body = hdrend + 4;
+      if ( (std::size_t)(end - body) < bodylen ) return 0;
+      _req.body.assign(body, bodylen);
+
+      return (body - _data) + bodylen;
+    }
+
+    const char *statusText(int _status) {
+      switch (_status) {
+      case 101: return "Switching Protocols";
+      case 200: return "OK";
+      case 304: return "Not Modified";
+      case 400: return "Bad Request";
+      case 404: return "Not Found";
+      case 405: return "Method Not Allowed";
+      case 413: return "Payload Too Large";
+      case 500: return "Internal Server Error";
+      }
+      return "Unknown";
+    }
+
+    void writeResponse(int _status, const char *_ctype, const std::string &_body,
+		       const std::string &_extraheaders, bool _keepalive, std::string &_out) {
+      char buff[128];
+
+      snprintf(buff, sizeof(buff), "HTTP/1.1 %i %s\r\n", _status, statusText(_status));
+      _out += buff;
+      if ( _ctype ) {
+	_out += "Content-Type: ";
+	_out += _ctype;
+	_out += "\r\n";
+      }
+      snprintf(buff, sizeof(buff), "Content-Length: %lu\r\n", (unsigned long)_body.size());
+      _out += buff;
+      _out += _keepalive ? "Connection: keep-alive\r\n" : "Connection: close\r\n";
+      _out += _extraheaders;
+      _out += "\r\n";
+      _out += _body;
+    }
+  }
+}
@@ -0,0 +1,49 @@
+/*
+ * Minimal HTTP/1.1 request parsing and response formatting
+ * for the embedded HTTP server. Only what brewd needs: no chunked
+ * request bodies, no pipelining beyond sequential keep-alive requests
+ */
+
+#ifndef AEGIR_HTTP_H
+#define AEGIR_HTTP_H
+
+#include <cstddef>
+#include <map>
+#include <string>
+
+namespace aegir {
+
+  namespace HTTP {
+    constexpr std::size_t c_maxheader = 8192;
+    constexpr std::size_t c_maxbody = 65536;
+
+    struct Request {
+      std::string method;
+      std::string path;
+      std::string query;
+      std::string version;
+      // the header names are lowercased
+      std::map<std::string, std::string> headers;
+      std::string body;
+
+      const std::string *header(const std::string &_name) const;
+      bool keepAlive() const;
+      // whether the header contains the token, case insensitive (e.g. Connection: Upgrade)
+      bool hasToken(const std::string &_name, const std::string &_token) const;
+      // whether a browser sent it from a page served by this Host, the
+      // clients without an Origin (curl, the REST API) aren't browsers
+      bool sameOrigin() const;
+    };
+
+    // Parses a request from the buffer, returns the number of bytes consumed,
+    // or 0 when it's incomplete. Throws Exception on malformed requests
+    std::size_t parseRequest(const char *_data, std::size_t _size, Request &_req);
+
+    const char *statusText(int _status);
+    // Appends a complete response to _out
+    void writeResponse(int _status, const char *_ctype, const std::string &_body,
+		       const std::string &_extraheaders, bool _keepalive, std::string &_out);
+  }
+}
+
+#endif
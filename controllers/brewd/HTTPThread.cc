@@ -0,0 +1,480 @@
+#include "HTTPThread.hh"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/event.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <json/json.h>
+
+#include "Config.hh"
+#include "Exception.hh"
+#include "JSONCodec.hh"
+#include "ProcessState.hh"
+#include "Metrics.hh"
+#include "SpanTracer.hh"
+
+#define KE_LEN 32
+
+namespace aegir {
+
+  HTTPThread::HTTPThread(): c_kq(-1), c_listen(-1),
+			    c_handler("httpworker", true),
+			    c_log("HTTPThread") {
+    auto cfg = Config::getInstance();
+    int on = 1;
+    struct sockaddr_in sin;
+
+    if ( (c_listen = socket(AF_INET, SOCK_STREAM, 0)) < 0 )
+      throw Exception("HTTPThread: socket() failed: %s", strerror(errno));
+
+    setsockopt(c_listen, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+    // only local, the same as the PR socket
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_port = htons(cfg->getHTTPPort());
+    sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if ( bind(c_listen, (struct sockaddr*)&sin, sizeof(sin)) < 0 ) {
+      close(c_listen);
+      throw Exception("HTTPThread: bind() to port %u failed: %s",
+		      cfg->getHTTPPort(), strerror(errno));
+    }
+    if ( listen(c_listen, 16) < 0 ) {
+      close(c_listen);
+      throw Exception("HTTPThread: listen() failed: %s", strerror(errno));
+    }
+    fcntl(c_listen, F_SETFL, fcntl(c_listen, F_GETFL) | O_NONBLOCK);
+
+    c_kq = kqueue();
+
+    auto thrmgr = ThreadManager::getInstance();
+    thrmgr->addThread("HTTP", *this);
+  }
+
+  HTTPThread::~HTTPThread() {
+    for (auto &it: c_clients)
+      close(it.first);
+    c_clients.clear();
+
+    if ( c_listen >= 0 ) close(c_listen);
+    if ( c_kq >= 0 ) close(c_kq);
+  }
+
+  void HTTPThread::run() {
+    c_log.info("HTTPThread started on port %u", Config::getInstance()->getHTTPPort());
+
+    struct kevent ke[KE_LEN];
+    // kevent returns periodically, so that stopping is noticed
+    struct timespec timeout{0, 200000000};
+    int nevents;
+
+    // EV_SET(kev, ident, filter, flags, fflags, data, udata);
+    EV_SET(&ke[0], c_listen, EVFILT_READ, EV_ADD|EV_ENABLE, 0, 0, 0);
+    EV_SET(&ke[1], 0, EVFILT_TIMER, EV_ADD|EV_ENABLE, NOTE_MSECONDS, c_pushival, 0);
+    if ( kevent(c_kq, ke, 2, 0, 0, 0) < 0 ) {
+      c_log.error("kevent failed: %i/%s", errno, strerror(errno));
+    }
+
+    while ( c_run ) {
+      nevents = kevent(c_kq, 0, 0, ke, KE_LEN, &timeout);
+      heartbeat();
+      if ( nevents <= 0 )
+	continue;
+
+      for (int i=0; i<nevents; ++i) {
+	if ( ke[i].filter == EVFILT_TIMER ) {
+	  pushUpdates();
+	  continue;
+	}
+	if ( (int)ke[i].ident == c_listen ) {
+	  acceptClients();
+	  continue;
+	}
+
+	int fd = ke[i].ident;
+	auto it = c_clients.find(fd);
+	if ( it == c_clients.end() ) continue;
+	Client &client(*it->second);
+
+	if ( ke[i].filter == EVFILT_READ ) {
+	  readClient(client);
+	} else if ( ke[i].filter == EVFILT_WRITE ) {
+	  flushClient(client);
+	}
+
+	if ( client.closing && client.out.empty() )
+	  closeClient(fd);
+      }
+
+      // clients that were closed by the update pushes
+      for (auto it = c_clients.begin(); it != c_clients.end(); ) {
+	int fd = it->first;
+	bool done = it->second->closing && it->second->out.empty();
+	++it;
+	if ( done ) closeClient(fd);
+      }
+    }
+
+    c_log.info("HTTPThread stopped");
+  }
+
+  void HTTPThread::acceptClients() {
+    struct kevent ke;
+    int fd;
+
+    while ( (fd = accept(c_listen, 0, 0)) >= 0 ) {
+      fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+      auto client = std::make_unique<Client>();
+      client->fd = fd;
+      client->writing = false;
+      client->closing = false;
+      client->websocket = false;
+      client->stateversion = 0;
+      client->histnext = 0;
+      c_clients[fd] = std::move(client);
+
+      EV_SET(&ke, fd, EVFILT_READ, EV_ADD|EV_ENABLE, 0, 0, 0);
+      if ( kevent(c_kq, &ke, 1, 0, 0, 0) < 0 ) {
+	c_log.error("kevent failed: %i/%s", errno, strerror(errno));
+	closeClient(fd);
+      }
+    }
+  }
+
+  void HTTPThread::closeClient(int _fd) {
+    // closing the fd removes its kevents as well
+    close(_fd);
+    c_clients.erase(_fd);
+  }
+
+  void HTTPThread::readClient(Client &_client) {
+    char buff[4096];
+
+    while ( true ) {
+      ssize_t len = read(_client.fd, buff, sizeof(buff));
+      if ( len > 0 ) {
+	if ( !_client.closing ) _client.in.append(buff, len);
+	continue;
+      }
+      if ( len < 0 && errno == EINTR ) continue;
+      if ( len < 0 && errno == EAGAIN ) break;
+      // EOF or error
+      _client.out.clear();
+      _client.closing = true;
+      return;
+    }
+
+    try {
+      while ( !_client.closing ) {
+	std::size_t consumed;
+
+	if ( _client.websocket ) {
+	  WebSocket::Frame frame;
+	  if ( !(consumed = WebSocket::decodeFrame(_client.in.data(), _client.in.size(), true, frame)) )
+	    break;
+	  _client.in.erase(0, consumed);
+	  handleWebSocket(_client, frame);
+	} else {
+	  HTTP::Request req;
+	  if ( !(consumed = HTTP::parseRequest(_client.in.data(), _client.in.size(), req)) )
+	    break;
+	  _client.in.erase(0, consumed);
+	  handleHTTP(_client, req);
+	}
+      }
+    }
+    catch (Exception &e) {
+      c_log.error("HTTPThread: closing client %i: %s", _client.fd, e.what());
+      if ( _client.websocket ) {
+	// 1002: protocol error
+	sendWebSocket(_client, WebSocket::Opcode::Close, std::string("\x03\xea", 2));
+      } else {
+	std::string body("{\"status\":\"error\",\"message\":\"Bad request\"}");
+	HTTP::writeResponse(400, "application/json", body, "", false, _client.out);
+      }
+      _client.in.clear();
+      _client.closing = true;
+    }
+
+    flushClient(_client);
+  }
+
+  void HTTPThread::flushClient(Client &_client) {
+    while ( !_client.out.empty() ) {
+      ssize_t len = send(_client.fd, _client.out.data(), _client.out.size(), MSG_NOSIGNAL);
+      if ( len > 0 ) {
+	_client.out.erase(0, len);
+	continue;
+      }
+      if ( len < 0 && errno == EINTR ) continue;
+      if ( len < 0 && errno == EAGAIN ) break;
+      _client.out.clear();
+      _client.closing = true;
+      return;
+    }
+
+    if ( _client.out.size() > c_maxoutput ) {
+      c_log.error("HTTPThread: client %i is not reading, dropping it", _client.fd);
+      _client.out.clear();
+      _client.closing = true;
+      return;
+    }
+
+    // only wait for writability while there's pending output
+    bool want = !_client.out.empty();
+    if ( want != _client.writing ) {
+      struct kevent ke;
+      EV_SET(&ke, _client.fd, EVFILT_WRITE, want ? EV_ADD|EV_ENABLE : EV_DELETE, 0, 0, 0);
+      kevent(c_kq, &ke, 1, 0, 0, 0);
+      _client.writing = want;
+    }
+  }
+
+  void HTTPThread::handleHTTP(Client &_client, const HTTP::Request &_req) {
+    AEGIR_TRACE_SPAN("http.request");
+    bool keepalive = _req.keepAlive();
+
+    // any page the brewer opens could send commands to the LAN otherwise
+    if ( (_req.path == "/ws" || _req.path == "/api/command") && !_req.sameOrigin() ) {
+      c_log.warn("Rejected a request to %s from origin %s", _req.path.c_str(),
+		 _req.header("origin")->c_str());
+      HTTP::writeResponse(403, "text/plain", "Cross-origin requests are not allowed\n", "",
+			  false, _client.out);
+      _client.closing = true;
+      return;
+    }
+
+    if ( _req.path == "/ws" ) {
+      if ( _req.method == "GET" && _req.hasToken("upgrade", "websocket") ) {
+	upgradeWebSocket(_client, _req);
+	return;
+      }
+      HTTP::writeResponse(400, "text/plain", "WebSocket upgrade required\n", "",
+			  keepalive, _client.out);
+    } else if ( _req.path == "/api/state" ) {
+      if ( _req.method == "GET" ) {
+	handleState(_client, _req);
+      } else {
+	HTTP::writeResponse(405, "text/plain", "Method not allowed\n", "Allow: GET\r\n",
+			    keepalive, _client.out);
+      }
+    } else if ( _req.path == "/metrics" ) {
+      if ( _req.method == "GET" ) {
+	c_reply.clear();
+	Metrics::getInstance().expose(c_reply);
+	HTTP::writeResponse(200, "text/plain; version=0.0.4", c_reply, "", keepalive, _client.out);
+      } else {
+	HTTP::writeResponse(405, "text/plain", "Method not allowed\n", "Allow: GET\r\n",
+			    keepalive, _client.out);
+      }
+    } else if ( _req.path == "/api/command" ) {
+      if ( _req.method == "POST" ) {
+	handleCommand(_req.body.data(), _req.body.size(), c_reply);
+	HTTP::writeResponse(200, "application/json", c_reply, "", keepalive, _client.out);
+      } else {
+	HTTP::writeResponse(405, "text/plain", "Method not allowed\n", "Allow: POST\r\n",
+			    keepalive, _client.out);
+      }
+    } else {
+      HTTP::writeResponse(404, "text/plain", "Not found\n", "", keepalive, _client.out);
+    }
+
+    if ( !keepalive ) _client.closing = true;
+  }
+
+  /*
+   * The state snapshot, the version is used as the ETag
+   */
+  void HTTPThread::handleState(Client &_client, const HTTP::Request &_req) {
+    bool keepalive = _req.keepAlive();
+    uint64_t since = 0;
+
+    if ( auto inm = _req.header("if-none-match") ) {
+      std::string etag(*inm);
+      if ( etag.size() >= 2 && etag.front() == '"' && etag.back() == '"' )
+	etag = etag.substr(1, etag.size() - 2);
+      since = strtoull(etag.c_str(), 0, 10);
+    }
+
+    StateSnapshot::Reader snap(ProcessState::getInstance().getSnapshot());
+
+    if ( snap.version() == 0 ) {
+      HTTP::writeResponse(500, "application/json",
+			  "{\"status\":\"error\",\"message\":\"State is not available yet\"}",
+			  "", keepalive, _client.out);
+      return;
+    }
+
+    std::string etag("ETag: \"");
+    etag += std::to_string(snap.version());
+    etag += "\"\r\n";
+
+    if ( since == snap.version() ) {
+      HTTP::writeResponse(304, nullptr, "", etag, keepalive, _client.out);
+      return;
+    }
+
+    c_reply = "{\"status\":\"success\",\"version\":";
+    c_reply += std::to_string(snap.version());
+    c_reply += ",\"data\":";
+    c_reply += snap.json();
+    c_reply += "}";
+    HTTP::writeResponse(200, "application/json", c_reply, etag, keepalive, _client.out);
+  }
+
+  void HTTPThread::upgradeWebSocket(Client &_client, const HTTP::Request &_req) {
+    auto key = _req.header("sec-websocket-key");
+
+    if ( !key || !_req.hasToken("connection", "upgrade") ) {
+      HTTP::writeResponse(400, "text/plain", "Invalid WebSocket handshake\n", "",
+			  false, _client.out);
+      _client.closing = true;
+      return;
+    }
+
+    _client.out += "HTTP/1.1 101 Switching Protocols\r\n"
+      "Upgrade: websocket\r\n"
+      "Connection: Upgrade\r\n"
+      "Sec-WebSocket-Accept: ";
+    _client.out += WebSocket::acceptKey(*key);
+    _client.out += "\r\n\r\n";
+
+    _client.websocket = true;
+    _client.stateversion = 0;
+    _client.histnext = 0;
+  }
+
+  void HTTPThread::handleWebSocket(Client &_client, WebSocket::Frame &_frame) {
+    switch (_frame.opcode) {
+    case WebSocket::Opcode::Text:
+    case WebSocket::Opcode::Binary:
+      if ( !_frame.fin ) {
+	_client.fragment.swap(_frame.payload);
+	return;
+      }
+      handleCommand(_frame.payload.data(), _frame.payload.size(), c_reply);
+      sendWebSocket(_client, WebSocket::Opcode::Text, c_reply);
+      break;
+
+    case WebSocket::Opcode::Continuation:
+      _client.fragment.append(_frame.payload);
+      if ( _client.fragment.size() > WebSocket::c_maxpayload )
+	throw Exception("WebSocket message too large");
+      if ( !_frame.fin ) return;
+      handleCommand(_client.fragment.data(), _client.fragment.size(), c_reply);
+      _client.fragment.clear();
+      sendWebSocket(_client, WebSocket::Opcode::Text, c_reply);
+      break;
+
+    case WebSocket::Opcode::Ping:
+      sendWebSocket(_client, WebSocket::Opcode::Pong, _frame.payload);
+      break;
+
+    case WebSocket::Opcode::Pong:
+      break;
+
+    case WebSocket::Opcode::Close:
+      // echo the status code back
+      sendWebSocket(_client, WebSocket::Opcode::Close, _frame.payload.substr(0, 2));
+      _client.closing = true;
+      break;
+
+    default:
+      throw Exception("Unknown WebSocket opcode %u", (unsigned)_frame.opcode);
+    }
+  }
+
+  void HTTPThread::handleCommand(const char *_data, std::size_t _size, std::string &_reply) {
+    Json::Value msg;
+
+    try {
+      getJSONCodec().parse(_data, _size, msg);
+    }
+    catch (Exception &e) {
+      Json::Value root;
+      root["status"] = "error";
+      root["message"] = e.what();
+      getJSONCodec().write(root, _reply);
+      return;
+    }
+
+    c_handler.handleRequest(msg, _reply);
+  }
+
+  void HTTPThread::sendWebSocket(Client &_client, WebSocket::Opcode _opcode, const std::string &_payload) {
+    WebSocket::encodeFrame(_opcode, _payload.data(), _payload.size(), _client.out);
+  }
+
+  /*
+   * Sends the new state snapshot and temperature readings
+   * to the websocket clients
+   */
+  void HTTPThread::pushUpdates() {
+    ProcessState &ps(ProcessState::getInstance());
+    static thread_local TSDB::entry tcvals[512];
+    std::string statemsg;
+    // the same snapshot for every client, its message is serialized only once
+    StateSnapshot::Reader snap(ps.getSnapshot());
+
+    for (auto &it: c_clients) {
+      Client &client(*it.second);
+      if ( !client.websocket || client.closing ) continue;
+
+      if ( snap.version() && snap.version() != client.stateversion ) {
+	if ( statemsg.empty() ) {
+	  statemsg = "{\"type\":\"state\",\"version\":";
+	  statemsg += std::to_string(snap.version());
+	  statemsg += ",\"data\":";
+	  statemsg += snap.json();
+	  statemsg += "}";
+	}
+	sendWebSocket(client, WebSocket::Opcode::Text, statemsg);
+	client.stateversion = snap.version();
+      }
+
+      // the new temperature readings, only recorded from mashing
+      uint32_t from = client.histnext, entries = 0;
+      {
+	ProcessState::Guard guard_ps(ps);
+	if ( ps.getState() >= ProcessState::States::Mashing ) {
+	  auto &db = ps.getThermoReadings();
+	  // the process was restarted
+	  if ( from > db.size() ) from = 0;
+	  if ( from < db.size() )
+	    entries = db.from(from, tcvals, 512);
+	} else {
+	  client.histnext = 0;
+	}
+      }
+
+      if ( entries ) {
+	Json::Value root, tcdata;
+	tcdata["dt"] = Json::Value(Json::ValueType::arrayValue);
+	tcdata["rims"] = Json::Value(Json::ValueType::arrayValue);
+	tcdata["mt"] = Json::Value(Json::ValueType::arrayValue);
+	for (uint32_t i=0; i < entries; ++i) {
+	  tcdata["dt"].append(tcvals[i].dt);
+	  tcdata["rims"].append(tcvals[i][ThermoCouple::RIMS]);
+	  tcdata["mt"].append(tcvals[i][ThermoCouple::MT]);
+	}
+	tcdata["last"] = from + entries;
+	root["type"] = "temphistory";
+	root["data"] = tcdata;
+
+	getJSONCodec().write(root, c_reply);
+	sendWebSocket(client, WebSocket::Opcode::Text, c_reply);
+	client.histnext = from + entries;
+      }
+
+      flushClient(client);
+    }
+  }
+}
@@ -0,0 +1,85 @@
+/*
+ * Embedded HTTP/WebSocket front-end
+ * Serves the PR commands directly, without the REST API and the ZMQ hops:
+ *  GET  /api/state    the state snapshot, with ETag/If-None-Match
+ *  POST /api/command  a {"command": ..., "data": ...} envelope, the reply
+ *                     is the same as on the PR socket
+ *  GET  /metrics      the runtime metrics in the Prometheus text format
+ *  GET  /ws           WebSocket. Text frames carry command envelopes and
+ *                     get their replies back. The server pushes
+ *                     {"type":"state", ...} on every new state snapshot and
+ *                     {"type":"temphistory", ...} with the new readings
+ * The commands are run by an embedded PRWorkerThread's handlers. Browsers
+ * may only reach /api/command and /ws from pages served on the same host,
+ * the requests with a foreign Origin are refused
+ */
+
+#ifndef AEGIR_HTTPTHREAD_H
+#define AEGIR_HTTPTHREAD_H
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+
+#include "ThreadManager.hh"
+#include "PRWorkerThread.hh"
+#include "HTTP.hh"
+#include "WebSocket.hh"
+#include "LogChannel.hh"
+
+namespace aegir {
+
+  class HTTPThread: public ThreadBase {
+    HTTPThread(HTTPThread&&) = delete;
+    HTTPThread(const HTTPThread &) = delete;
+    HTTPThread &operator=(HTTPThread &&) = delete;
+    HTTPThread &operator=(const HTTPThread &) = delete;
+  public:
+    HTTPThread();
+    virtual ~HTTPThread();
+
+  public:
+    virtual void run();
+
+  private:
+    // the update push interval for the websocket clients, msecs
+    static constexpr int c_pushival = 250;
+    // clients not reading their output are dropped above this
+    static constexpr std::size_t c_maxoutput = 1024*1024;
+
+    struct Client {
+      int fd;
+      std::string in, out;
+      bool writing;
+      bool closing;
+      bool websocket;
+      // the last pushed snapshot version and the next TSDB entry to push
+      uint64_t stateversion;
+      uint32_t histnext;
+      // fragmented websocket messages are assembled here
+      std::string fragment;
+    };
+
+    int c_kq, c_listen;
+    std::map<int, std::unique_ptr<Client>> c_clients;
+    PRWorkerThread c_handler;
+    std::string c_reply;
+    LogChannel c_log;
+
+  private:
+    void acceptClients();
+    void readClient(Client &_client);
+    void flushClient(Client &_client);
+    void closeClient(int _fd);
+    void handleHTTP(Client &_client, const HTTP::Request &_req);
+    void handleState(Client &_client, const HTTP::Request &_req);
+    void upgradeWebSocket(Client &_client, const HTTP::Request &_req);
+    void handleWebSocket(Client &_client, WebSocket::Frame &_frame);
+    void handleCommand(const char *_data, std::size_t _size, std::string &_reply);
+    void sendWebSocket(Client &_client, WebSocket::Opcode _opcode, const std::string &_payload);
+    void pushUpdates();
+  };
+}
+
+#endif
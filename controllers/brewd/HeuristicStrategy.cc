@@ -0,0 +1,384 @@
+
+#include "HeuristicStrategy.hh"
+
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+
+#include "Exception.hh"
+
+namespace aegir {
+
+  HeuristicStrategy::HeuristicStrategy(): c_lastcontrol(0),
+					  c_correctionfactor(1.0f),
+					  c_log("HeuristicStrategy") {
+  }
+
+  HeuristicStrategy::~HeuristicStrategy() {
+  }
+
+  void HeuristicStrategy::reset() {
+    c_lastcontrol = 0;
+    c_correctionfactor = 1.0f;
+    c_flowrate.reset();
+  }
+
+  void HeuristicStrategy::restart() {
+    c_lastcontrol = 0;
+  }
+
+  ControlStrategy::Decision HeuristicStrategy::control(const Plant &_plant, float _target, float _overheat) {
+    int nextcontrol = 30;
+    const TSDB& tsdb = _plant.getReadings();
+    const HERatioDB& heratios = _plant.getHERatios();
+    float volume = _plant.getVolume();
+
+    time_t now = _plant.getNow();
+
+    float dt = now - c_lastcontrol;
+    c_lastcontrol = now;
+
+    float curr_rims(0), curr_mt(0), last_rims(0), last_mt(0);
+    float dT_mt(0), dT_rims(0);
+    bool nodata(false);
+
+    // if we don't have enough data, then wait
+    // The Controller used to switch the element off here first, the decision
+    // below overrode it within the same cycle, only a spurious 0 was left in
+    // the on-ratio history. It's not recorded anymore.
+    if ( !getTemps(_plant, ThermoCouple::RIMS, dt, last_rims, curr_rims, dT_rims) ||
+	 !getTemps(_plant, ThermoCouple::MT, dt, last_mt, curr_mt, dT_mt) ) {
+      // if we don't have historical data, then simply use the last one
+      curr_rims = _plant.getTemp(ThermoCouple::RIMS);
+      curr_mt = _plant.getTemp(ThermoCouple::MT);
+      nodata = true;
+    }
+    // the Controller used to return here without touching the element
+    if ( curr_mt == 0.0f || curr_rims == 0.0f ) return {0, 3, false};
+
+    // set the RIMS tube target temperature
+    float T_target_rims;
+    if ( curr_mt >= _target ) {
+      T_target_rims = _target * 1.01;
+    } else {
+      T_target_rims = _target + std::min(_overheat, 0.2f+(_target - curr_mt)*2.3f);
+    }
+
+    AEGIR_LOG_EVENT(c_log, debug, "heuristic.temps", {"now", now}, {"dt", dt},
+		    {"last_rims", last_rims}, {"curr_rims", curr_rims}, {"dT_rims", dT_rims},
+		    {"T_target_rims", T_target_rims},
+		    {"last_mt", last_mt}, {"curr_mt", curr_mt}, {"dT_mt", dT_mt});
+
+    float last_ratio = _plant.getHERatio();
+
+    // First calculate how much power is needed to
+    // heat up the whole stuff in the mashtun to the
+    // target temperature
+
+    float dT_mtc_temptarget = _target - curr_mt; // temp difference
+    float dt_mt = dT_mtc_temptarget * 60.0; // heating with 1C/60s
+
+    float hepwr = _plant.getHEPower(); // in kW
+    // prefer the identified effective power of the element
+    if ( auto &est = _plant.getEstimates(); est.valid )
+      hepwr = std::clamp(est.hepower, hepwr*0.5f, hepwr*1.5f);
+    float pwr_max = hepwr;
+    float pwr_mt;
+    float pwr_dissipation = 0;
+    float pwr_dissipation_rims = 0;
+    float pwr_abs_min = 0;
+    float dTadjust = 1.2f; // FIXME should be moved to a config variable
+
+    // get the previous iteration's power. <0 == unknown
+    float lastpwr = -1;
+    if ( std::size_t i=heratios.size(); i>0 ) {
+      lastpwr = heratios[i-1].ratio * hepwr;
+    }
+
+    // when we're getting close to the target, but we don't have
+    // data, then try to throttle the heating
+    // this typically happens at Pre-Heating
+    if ( dT_mtc_temptarget < dTadjust && nodata ) {
+      float coeff_tgt = 0;
+      float coeff_rt = 1;
+
+      float halfpi = std::atan(INFINITY);
+      float tgtdiff = _target*1.01 - curr_mt;
+      float rimsdiff = curr_rims - _target;
+
+      if ( tgtdiff > 0 ) {
+	coeff_tgt = std::atan(tgtdiff)/halfpi;
+	coeff_tgt = std::pow(coeff_tgt, 0.91);
+      }
+      if ( rimsdiff > 0 ) {
+	coeff_rt = std::max(0.0f, std::atan(_overheat - rimsdiff)/halfpi);
+	coeff_rt = std::pow(coeff_rt, 0.25);
+      }
+      float heratio = std::pow(coeff_tgt * coeff_rt, 0.71);
+
+      AEGIR_LOG_EVENT(c_log, debug, "heuristic.nodata", {"heratio", heratio});
+      return {heratio, 3};
+    }
+
+    // now calculate the MT heating requirements
+    if ( nodata ) {
+      // during preheat we don't have to care for 1C/60s
+      if ( _plant.isPreHeating() ) {
+	pwr_mt = hepwr;
+      } else {
+	// dT_mtc_temptarget is present on both sides of the division, that's why it's
+	// omitted. This way the required power only depends on the volume -
+	// as it's a constant heating
+	pwr_mt = (4.2 * volume )/60;
+      }
+    } else {
+      pwr_mt = (4.2 * volume )/60;
+      // historical data is available here, so we use that to approximate
+      // when we're hitting the target temperature
+
+      if ( dT_mt > 0 ) {
+	// when the temperature of the MashTun is increasing
+
+	// check whether we're over the target temperature
+	if ( dT_mtc_temptarget > 0 ) {
+	  // linear approximation of the time it will take to
+	  // heat it up with the current HERatio
+	  float timetotarget = dT_mtc_temptarget / dT_mt;
+
+	  if ( timetotarget < 45 ) {
+	    pwr_mt *= 0.3;
+	    nextcontrol = 5;
+	  } else if ( timetotarget < 120 ) {
+	    pwr_mt *= 0.6;
+	    nextcontrol = 10;
+	  }
+	} else {
+	  // if we're over the MT target temp, then stop heating
+	  pwr_mt = 0;
+	}
+      } else {			// dT_mt < 0
+	// when the MT is cooling, check whether we need to heat at all
+	if ( dT_mtc_temptarget < 0 ) {
+	  // it's fine here, we're already over the target temp
+	  pwr_mt = 0;
+	} else {
+	  // pwr_mt's default should be good here, we're just decreasing the
+	  // control time, if we're close to the target temp
+	  if ( dT_mtc_temptarget < 1 ) {
+	    nextcontrol = 10;
+	  } else if ( dT_mtc_temptarget < 2 ) {
+	    nextcontrol = 15;
+	  }
+	  pwr_mt = calcPower(volume, dT_mtc_temptarget, dt_mt);
+
+	  // adjust the max power. let's see how intensively we're cooling
+	  {
+	    int size = tsdb.size();
+	    float mt300 = 0;
+	    float pwr_min = calcPower(volume, std::abs(dT_mtc_temptarget)+0.2);
+	    if ( size > 300 ) mt300 = tsdb.at(size-300)[ThermoCouple::MT];
+	    else mt300 = tsdb.at(0)[ThermoCouple::MT];
+
+	    if ( size<300 || mt300 < curr_mt) {
+	      c_log.warn("!! MT cooling, can't find t-300 or it's cooler than current temp");
+	      pwr_min = std::max(lastpwr, pwr_mt) * 1.05;
+	      if ( lastpwr > 0 ) {
+		c_correctionfactor *= 1.02f;
+		// revist this frequently, so the increment can kick in
+		nextcontrol = 10;
+	      } else {
+		pwr_min = std::max(pwr_min, hepwr * 0.45f);
+	      }
+	      c_log.warn("Limiting min power to: %.2f kW", pwr_min);
+	    } else {
+	      // size>30 || mt300>curr_mt -> MT cooling
+	      float diff_temp = mt300 - curr_mt;
+	      uint32_t diff_time = size > 300 ? 300 : size;
+	      float pwr_cooling = calcPower(volume, diff_temp, diff_time);
+
+	      pwr_min = pwr_mt + pwr_cooling*3;
+	      // and limiting the absolute minimum power above the previous setting
+
+	      c_log.warn("Cooling (%.2f C / %i sec) limiting min power to %.2f/%.2f kW",
+			 diff_temp, diff_time, pwr_max, pwr_min);
+	    }
+	  }
+	}
+      }	// if ( dT_mt > 0 ) else
+    }	// if ( nodata ) else
+
+    AEGIR_LOG_EVENT(c_log, debug, "heuristic.mt", {"dT_mtc_temptarget", dT_mtc_temptarget},
+		    {"dt_mt", dt_mt}, {"hepwr", hepwr}, {"pwr_mt", pwr_mt}, {"nodata", nodata});
+
+    // adjust the next control time
+    if ( dt_mt < 60 ) {
+      nextcontrol = std::max(10, int(dt/3));
+    }
+
+    // calculate the dissipation during the last cycle
+    if ( !nodata ) {
+      float pwr_last_effective = calcPower(volume, dT_mt*dt, dt);
+      float pwr_last = hepwr * last_ratio;
+      float diff = pwr_last - pwr_last_effective;
+
+      // we only apply dissipation if it's positive, and
+      // it's value is less than 5% of the heating element
+      // otherwise we're probably measuring lag.
+      if ( diff > 0 && curr_rims > 50.0)
+	pwr_dissipation = diff * ((curr_rims - 50)/40);
+
+      if ( pwr_last_effective < 0 && (curr_mt + dt*30)<_target)
+	pwr_abs_min = std::fabs(pwr_last_effective);
+      AEGIR_LOG_EVENT(c_log, debug, "heuristic.dissipation", {"pwr_last", pwr_last},
+		      {"pwr_last_effective", pwr_last_effective}, {"diff", diff},
+		      {"pwr_dissipation", pwr_dissipation}, {"pwr_abs_min", pwr_abs_min});
+    }
+
+    // adjust the minimum power if it's cooling, the history is empty
+    // right after a reset
+    if ( !nodata && dT_mtc_temptarget > 0 && dT_mt < 0 && heratios.size() ) {
+      auto herd = heratios[heratios.size()-1];
+      pwr_abs_min = std::min(pwr_abs_min, (herd.ratio * hepwr) * 1.05f);
+      c_log.info("Adjusting absolute minimum power to previous + 5%%: %.2f kW",
+		 pwr_abs_min);
+    }
+
+    /* The RIMS tube has a min a max value limiting its power,
+     * and in between an actual calculated value
+     * defaults are here, later we are limiting them
+     */
+    float pwr_rims_max = hepwr;
+    float pwr_rims_min = hepwr * 0.02;
+    float pwr_rims = hepwr;
+    float pwr_rims_final;
+
+    /*   ***********
+     *   * R I M S *
+     *   ***********/
+
+    // without data, the RIMS tube is practically not adjustable
+    if ( !nodata ) {
+      // the estimator's flow rate, scanning the history until it has enough data
+      float flowrate = _plant.getEstimates().valid ? _plant.getEstimates().flow : calcFlowRate(_plant);
+      AEGIR_LOG_EVENT(c_log, trace, "heuristic.flowrate", {"flowrate", flowrate});
+
+      if ( flowrate > 0  ) {
+	// again, time would be on both sides of the equation
+	// V=flowrate*dt
+	pwr_rims = (4.2 * flowrate * (T_target_rims - curr_mt))/1;
+	if ( curr_rims < (T_target_rims - 1.5f) )
+	  pwr_rims = (pwr_rims + hepwr)/2;
+
+	c_log.info("pwr_rms(%.2f) = (4.2 * flowrate(%.5f) * (T_target_rims(%.2f) - curr_mt(%.2f)))/1",
+		   pwr_rims, flowrate, T_target_rims, curr_mt);
+      }
+
+      if ( dT_mtc_temptarget < 0.5 ) {
+	pwr_rims *= 0.83;
+      } else if ( dT_mtc_temptarget < 1.0 ) {
+	pwr_rims *= 0.89;
+      } else if ( dT_mtc_temptarget < 2.0 ) {
+	pwr_rims *= 0.95;
+      }
+
+      // set the max boundary
+      if ( curr_mt > (_target + 0.5) ) {
+	pwr_rims_max = 0;
+      } else if ( curr_mt >= _target ) {
+	// we are only compensating for the heat loss here
+	pwr_rims_max = pwr_rims_min;
+      }
+      // if ( !nodata )
+    } else {
+      if ( curr_mt+2 < T_target_rims ) pwr_rims = pwr_rims_max;
+    }
+
+    // apply min/max boundaries
+    pwr_rims_final = std::min({std::max(pwr_rims_min, pwr_rims)+ pwr_dissipation_rims, pwr_rims_max, pwr_max});
+    AEGIR_LOG_EVENT(c_log, debug, "heuristic.rims", {"pwr_rims_final", pwr_rims_final},
+		    {"pwr_rims_min", pwr_rims_min}, {"pwr_rims_max", pwr_rims_max},
+		    {"pwr_rims", pwr_rims}, {"pwr_max", pwr_max});
+    float her_rims = pwr_rims_final / hepwr;
+
+
+    // MashTun heating element on-ratio
+    float her_mt = pwr_mt / hepwr;
+
+    // here we also define a minimum power, because there's heat
+    // dissipation around the tubing
+    float pwr_final = std::max(pwr_abs_min, std::min({pwr_mt + pwr_dissipation, pwr_rims_final}));
+    float heratio = pwr_final / hepwr;
+    if ( heratio < 0.004f && curr_mt < _target && curr_rims < _target)
+      heratio = 0.05f;
+
+    // limit the max correction factor
+    c_correctionfactor = std::min(c_correctionfactor, _plant.getMaxCorrectionFactor());
+
+    // apply the correction factor
+    if ( c_correctionfactor > 1.0 )
+      heratio = std::min(heratio * c_correctionfactor, 1.0f);
+
+    AEGIR_LOG_EVENT(c_log, info, "heuristic.control", {"target", _target}, {"overheat", _overheat},
+		    {"dT_rims", dT_rims}, {"dT_mt_target", dT_mtc_temptarget},
+		    {"P_he", hepwr}, {"P_mt", pwr_mt}, {"P_rims", pwr_rims_final},
+		    {"heratio", heratio}, {"heratio_mt", her_mt}, {"heratio_rims", her_rims},
+		    {"correction", c_correctionfactor});
+
+    return {heratio, nextcontrol};
+  }
+
+  bool HeuristicStrategy::getTemps(const Plant &_plant, ThermoCouple _tc, uint32_t _dt,
+				   float &_last, float &_curr, float &_dT) {
+    const TSDB& db(_plant.getReadings());
+    uint32_t size = db.size();
+    if ( size <= _dt || _dt < 3 ) return false;
+    try {
+      _curr = db.last()[_tc];
+      _last = db.at(size-1-_dt)[_tc];
+    }
+    catch (std::exception &e) {
+      c_log.error("getTemps() failed %s", e.what());
+      return false;
+    }
+    catch ( ... ) {
+      c_log.error("getTemps() failed with unknown exception");
+      return false;
+    }
+    _dT = (_curr - _last)/(1.0*_dt);
+    return true;
+  }
+
+  /* Flow rate calculation
+   * Formula: V = (P * dt) /(4.2 * dT)
+   * V = volume
+   * dt = time delta
+   * P = power [kW]
+   * dT = temperature delta
+   */
+  float HeuristicStrategy::calcFlowRate(const Plant &_plant) {
+    const TSDB& db(_plant.getReadings());
+    const HERatioDB& heratios(_plant.getHERatios());
+
+    if ( db.size() < 30 ) return -1;
+
+    uint32_t startedat(0);
+    uint32_t now = _plant.getNow();
+
+    // started is the start time of the Mashing state
+    startedat = _plant.getStartAt();
+    // if it's 0, then we'll use the temphistory's
+    // last timestamp
+    if ( startedat <= 0 ) startedat = db.last().time;
+
+    AEGIR_LOG_TRACE(c_log, "calcFlowRate(): startedat: %u", startedat);
+
+    float hepwr = _plant.getHEPower(); // in kW
+
+    // without a start time the TSDB's last timestamp moves with every
+    // reading, there's nothing to keep track of
+    if ( _plant.getStartAt() <= 0 )
+      return FlowRateAccumulator::rescan(db, heratios, startedat, now, hepwr);
+
+    return c_flowrate.get(db, heratios, startedat, now, hepwr);
+  }
+}
@@ -0,0 +1,49 @@
+/*
+ * The original, hand-tuned temperature control
+ * Calculates the MT's and the RIMS tube's power requirements separately,
+ * approximating the flow rate from the TSDB and the on-ratio history
+ * until the plant estimator has a better idea
+ */
+
+#ifndef AEGIR_HEURISTICSTRATEGY_H
+#define AEGIR_HEURISTICSTRATEGY_H
+
+#include <time.h>
+
+#include <memory>
+
+#include "ControlStrategy.hh"
+#include "FlowRateAccumulator.hh"
+#include "Config.hh"
+#include "LogChannel.hh"
+
+namespace aegir {
+
+  class HeuristicStrategy: public ControlStrategy {
+  public:
+    HeuristicStrategy();
+    virtual ~HeuristicStrategy();
+
+    virtual const char *getName() const override { return "heuristic"; };
+    virtual void reset() override;
+    virtual void restart() override;
+    virtual Decision control(const Plant &_plant, float _target, float _overheat) override;
+
+  private:
+    bool getTemps(const Plant &_plant, ThermoCouple _tc, uint32_t _dt,
+		  float &_last, float &_curr, float &_dT);
+    float calcFlowRate(const Plant &_plant);
+
+    inline float calcPower(float _volume, float _dT, float _dt=60) {
+      return (4.2 * _volume * _dT)/ _dt;
+    }
+
+  private:
+    time_t c_lastcontrol;
+    float c_correctionfactor;
+    FlowRateAccumulator c_flowrate;
+    LogChannel c_log;
+  };
+}
+
+#endif
@@ -16,30 +16,53 @@
 #include "GPIO.hh"
 #include "Config.hh"
 #include "Environment.hh"
+#include "Clock.hh"
+#include "SpanTracer.hh"
 
 #define KE_LEN 32
-// the oneshot offset for kqueue ident
-#define ID_OS_OFFSET 100
-// the pulse offset for kqueue ident
+// the heating elements' common window
+#define ID_HEATWINDOW 2
+// the offset for kqueue ident of switching on a heating element within its window
+#define ID_ON_OFFSET 100
+// the pulse offset for kqueue ident: +2*id+1 is the cycle, +2*id+0 the
+// oneshot switching it off
 #define ID_PULSE_OFFSET 1000
+// the shortest pulse of the outputs, msecs
+#define PWM_MINPULSE 20
 
 namespace aegir {
 
   IOHandler::IOHandler(GPIO &_gpio, SPI &_spi): c_gpio(_gpio), c_spi(_spi),
 						c_mq_pub(ZMQ::SocketType::PUB),
 						c_mq_iocmd(ZMQ::SocketType::SUB),
-						c_log("IOHandler") {
+						c_pwm(PWM_MINPULSE),
+						c_windowrunning(false),
+						c_watchdog(Watchdog::getInstance()),
+						c_log("IOHandler"),
+						c_m_readtcs(Metrics::getInstance().histogram("aegir_io_readtcs_seconds",
+											     "Reading the thermocouples over SPI")),
+						c_m_handlepins(Metrics::getInstance().histogram("aegir_io_handlepins_seconds",
+												"Polling the input pins and setting the outputs")),
+						c_m_actuation(Metrics::getInstance().histogram("aegir_io_actuation_latency_seconds",
+											       "From reading the input to applying the pin change on it")),
+						c_m_cmdbacklog(Metrics::getInstance().gauge("aegir_io_cmd_backlog",
+											    "The pin commands received in the last poll")),
+						c_m_senderrors(Metrics::getInstance().counter("aegir_io_send_errors_total",
+											      "The IO messages failed to be sent")) {
     auto cfg = Config::getInstance();
 
-    // first initialize the sensors
-    for (int i=0; i<4; ++i) {
-      c_tcs.push_back(std::make_unique<MAX31856>(c_spi, i));
+    // first initialize the sensors, a chip for every chip select
+    {
+      std::map<int, std::string> chips;
+      cfg->getSPIDSChips(chips);
+      for (auto &it: chips)
+	c_tcs[it.first] = std::make_unique<MAX31856>(c_spi, it.first);
     }
     // now set them up
     {
       auto nf = cfg->getMAX31856NoiseFilter();
       auto tctype = cfg->getMAX31856TCType();
-      for (auto &it: c_tcs) {
+      for (auto &[id, it]: c_tcs) {
 	it->setAvgMode(MAX31856::AvgMode::S8); // averages of 4 samples
 	it->set50Hz(nf == NoiseFilters::HZ50);
 	it->setTCType(tctype);
@@ -58,8 +81,12 @@ namespace aegir {
     c_mq_pub.bind("inproc://iopub");
     c_mq_iocmd.bind("inproc://iocmd").subscribe("");
 
-    // later we might need to handle unused pins for multiple configs here
+    // the optional pins might not be wired
+    pinlayout_t layout;
+    cfg->getPinConfig(layout);
     for ( auto &it: g_pinconfig ) {
+      if ( layout.find(it.first) == layout.end() ) continue;
+
       if ( it.second.mode == PinMode::IN ) {
 #ifdef AEGIR_DEBUG
 	printf("IOHandle: Loading PIN %s\n", it.first.c_str());
@@ -73,6 +100,20 @@ namespace aegir {
     }
 
     c_kq = kqueue();
+    setupHeaters(*cfg);
+
+    // the Controller's watchdog, and the hardware one
+    c_cfgversion = cfg->getVersion();
+    c_watchdog.setTimeout(cfg->getWatchdogTimeout());
+    if ( cfg->getWatchdogDevice().length() ) {
+      try {
+	c_watchdog.openDevice(cfg->getWatchdogDevice(), cfg->getWatchdogStandin());
+	c_log.info("Hardware watchdog: %s", cfg->getWatchdogDevice().c_str());
+      }
+      catch (Exception &e) {
+	c_log.error("%s", e.what());
+      }
+    }
 
     thrmgr->addThread("IOHandler", *this);
   }
@@ -91,16 +132,21 @@ namespace aegir {
   }
 
   void IOHandler::readTCs() {
+    AEGIR_TRACE_SPAN("io.readtcs");
     struct timeval tv;
     gettimeofday(&tv, 0);
+    uint64_t acquired = Clock::monotonic();
     ThermoReadings tr;
-    for (int i=0; i < ThermoCouple::_SIZE; ++i) {
-      tr[i] = c_tcs[c_tcmap.tcs[i]]->readTCTemp();
+    tr.size = c_tcmap.size;
+    {
+      Metrics::Timer timer(c_m_readtcs);
+      tr.forEach([&](uint8_t i) { tr[i] = c_tcs[c_tcmap.tcs[i]]->readTCTemp(); });
     }
     try {
-      c_mq_pub.send(ThermoReadingMessage(tr, tv.tv_sec));
+      c_mq_pub.send(ThermoReadingMessage(tr, tv.tv_sec, acquired));
     }
     catch (Exception &e) {
+      c_m_senderrors.inc();
       c_log.error("IOHandler::readTCs zmq send failed: %s", e.what());
     }
     try {
@@ -112,8 +158,29 @@ namespace aegir {
   }
 
   void IOHandler::handlePins() {
+    AEGIR_TRACE_SPAN("io.handlepins");
+    Metrics::Timer timer(c_m_handlepins);
     PINState newval;
     std::shared_ptr<Message> msg;
+    uint32_t received = 0;
+    uint64_t now = Clock::monotonic();
+
+    // a changed config's timeout and heaters, the watchdog's device and the
+    // pins stay as they were set up
+    if ( auto cfg = Config::getInstance(); cfg->getVersion() != c_cfgversion ) {
+      c_cfgversion = cfg->getVersion();
+      c_watchdog.setTimeout(cfg->getWatchdogTimeout());
+      setupHeaters(*cfg);
+    }
+
+    // the Controller didn't feed the watchdog
+    if ( c_watchdog.check(now) ) latchOutputs();
+    try {
+      c_watchdog.pet(now);
+    }
+    catch (Exception &e) {
+      c_log.error("%s", e.what());
+    }
 
     // read the input pins
     for (auto &it: c_inpins) {
@@ -124,11 +191,12 @@ namespace aegir {
 	       (uint8_t)it.second, (uint8_t)newval);
 #endif
 	it.second = newval;
-	auto msg = PinStateMessage(it.first, newval);
+	auto msg = PinStateMessage(it.first, newval, 3.0f, 0.2f, Clock::monotonic());
 	try {
 	  c_mq_pub.send(msg);
 	}
 	catch (Exception &e) {
+	  c_m_senderrors.inc();
 	  c_log.error("IOHandler::handlePins() zmq send failure: %s", e.what());
 	}
       }
@@ -136,6 +204,9 @@ namespace aegir {
 
     // check our input queue
     while ( (msg = c_mq_iocmd.recv()) != nullptr ) {
+      ++received;
+      // the latched outputs wait for the Controller's resync
+      if ( !c_watchdog.admits(msg->type()) ) continue;
       if ( msg->type() == MessageType::PINSTATE ) {
 	auto psmsg = std::static_pointer_cast<PinStateMessage>(msg);
 	auto it = c_outpins.find(psmsg->getName());
@@ -143,55 +214,60 @@ namespace aegir {
 #if defined(AEGIR_DEBUG)
 	  printf("IOHandler: setting %s to %hhu\n", psmsg->getName().c_str(), (uint8_t)psmsg->getState());
 #endif
-	  // always clear the pulsate state, it's either not needed,
-	  // or has to be replaced by new parameters
-	  if ( c_outpins[psmsg->getName()].state == PINState::Pulsate ) {
+	  // the heating elements are scheduled within the power budget
+	  if ( int id = c_gpio[psmsg->getName()].getID(); c_heaters.find(id) != c_heaters.end() ) {
+	    setHeater(id, &it->second, psmsg->getState(), psmsg->getOnratio(), psmsg->getAcquired());
+	    if ( psmsg->getName() == "mtheat" && psmsg->getState() != PINState::Pulsate )
+	      Environment::getInstance()->setHEDelivered(psmsg->getState() == PINState::On ? 1 : 0);
+	    continue;
+	  }
+
+	  // a pulsating pin keeps its phase when only its parameters change,
+	  // the scheduler applies them on the next cycle
+	  if ( c_outpins[psmsg->getName()].state == PINState::Pulsate &&
+	       psmsg->getState() != PINState::Pulsate ) {
 	    clearPulsate(c_gpio[psmsg->getName()].getID());
 	    c_gpio[psmsg->getName()].low();
 	  }
 
+	  // the read-to-actuate latency of the Controller's decisions, the
+	  // pulses' is measured by the cycle applying them
 	  if ( psmsg->getState() == PINState::On ) {
 	    c_gpio[psmsg->getName()].high();
 	    c_outpins[psmsg->getName()].state = PINState::On;
+	    if ( psmsg->getAcquired() ) c_m_actuation.record(Clock::monotonic() - psmsg->getAcquired());
 
 	  } else if ( psmsg->getState() == PINState::Off )  {
 	    c_gpio[psmsg->getName()].low();
 	    c_outpins[psmsg->getName()].state = PINState::Off;
+	    if ( psmsg->getAcquired() ) c_m_actuation.record(Clock::monotonic() - psmsg->getAcquired());
 
 	  } else if ( psmsg->getState() == PINState::Pulsate ) {
-	    // for pulsating, we have to start with an On state, then
-	    // create a oneshot for adding the repeating Off
-	    struct kevent ke[2];
 	    // cycle time in milliseconds
 	    int ctms = 1000*psmsg->getCycletime();
-	    // offset in milliseconds
-	    int offsetms = ctms*psmsg->getOnratio();
 	    // the gpio pin id
 	    int id = c_gpio[psmsg->getName()].getID();
 	    // the passed udata
 	    outpindata *opd = &(c_outpins[psmsg->getName()]);
-	    void *udata = (void*)opd;
 	    opd->cycletime = ctms;
 	    opd->onratio   = psmsg->getOnratio();
 
 #ifdef AEGIR_DEBUG
-	    printf("IOHandler starting pulsate: %s/%i C:%i OR:%.2f\n", psmsg->getName().c_str(), id,
+	    printf("IOHandler pulsate: %s/%i C:%i OR:%.2f\n", psmsg->getName().c_str(), id,
 		   opd->cycletime, opd->onratio);
 #endif
 
-	    // EV_SET(kev, ident, filter, flags, fflags, data, udata);
-#ifdef AEGIR_DEBUG
-	    printf("IOHandler EV_SET(%i, TIMER, ADD|ENABLE, MSECONDS, %i, udata)\n",
-		   ID_PULSE_OFFSET+2*id+1, ctms);
-	    printf("IOHandler EV_SET(%i, TIMER, ADD|ENABLE|ONESHOT, MSECONDS, %i, udata)\n",
-		   ID_OS_OFFSET+id, offsetms);
-#endif
-	    EV_SET(&ke[0], ID_PULSE_OFFSET+2*id+1, EVFILT_TIMER, EV_ADD|EV_ENABLE, NOTE_MSECONDS, ctms, udata);
-	    EV_SET(&ke[1], ID_OS_OFFSET+id, EVFILT_TIMER, EV_ADD|EV_ENABLE|EV_ONESHOT, NOTE_MSECONDS, offsetms, udata);
-	    if ( kevent(c_kq, ke, 2, 0, 0, 0) < 0 ) {
-	      c_log.error("kevent failed: %i/%s\n", errno, strerror(errno));
+	    // a new one starts its first cycle right away
+	    if ( c_pwm.set(id, ctms, opd->onratio, psmsg->getAcquired()) ) {
+	      struct kevent ke;
+
+	      // EV_SET(kev, ident, filter, flags, fflags, data, udata);
+	      EV_SET(&ke, ID_PULSE_OFFSET+2*id+1, EVFILT_TIMER, EV_ADD|EV_ENABLE, NOTE_MSECONDS, ctms, (void*)opd);
+	      if ( kevent(c_kq, &ke, 1, 0, 0, 0) < 0 ) {
+		c_log.error("kevent failed: %i/%s\n", errno, strerror(errno));
+	      }
+	      pulseCycle(id, opd);
 	    }
-	    c_gpio[psmsg->getName()].high();
 	    c_outpins[psmsg->getName()].state = PINState::Pulsate;
 	  } else {
 	    c_log.error("IOHandler:%i: Unhandled pinstate %hhu", __LINE__, psmsg->getState());
@@ -201,16 +277,185 @@ namespace aegir {
 	}
       }
     }
+    c_m_cmdbacklog.set(received);
+  }
+
+  void IOHandler::latchOutputs() {
+    for (auto &it: Watchdog::latchedStates(g_pinconfig)) {
+      auto opd = c_outpins.find(it.first);
+      if ( opd == c_outpins.end() ) continue;
+
+      int id = c_gpio[it.first].getID();
+      if ( c_pwm.isActive(id) ) clearPulsate(id);
+      if ( it.second == PINState::On ) c_gpio[it.first].high();
+      else c_gpio[it.first].low();
+      opd->second.state = it.second;
+    }
+    Environment::getInstance()->setHEDelivered(0);
+    AEGIR_LOG_EVENT(c_log, error, "watchdog.latched", {"timeout", c_watchdog.getTimeout()});
   }
 
   void IOHandler::clearPulsate(int id) {
     struct kevent ke[3];
 
+    c_pwm.clear(id);
     // EV_SET(kev, ident, filter, flags, fflags, data, udata);
     EV_SET(&ke[0], ID_PULSE_OFFSET+2*id+0, EVFILT_TIMER, EV_DELETE, 0, 0, 0);
     EV_SET(&ke[1], ID_PULSE_OFFSET+2*id+1, EVFILT_TIMER, EV_DELETE, 0, 0, 0);
-    EV_SET(&ke[2], ID_OS_OFFSET+id, EVFILT_TIMER, EV_DELETE, 0, 0, 0);
-    kevent(c_kq, ke, 3, 0, 0, 0);
+    EV_SET(&ke[2], ID_ON_OFFSET+id, EVFILT_TIMER, EV_DELETE, 0, 0, 0);
+    // the oneshots might have fired already, or not be used
+    for (auto &it: ke) kevent(c_kq, &it, 1, 0, 0, 0);
+  }
+
+  void IOHandler::pulseCycle(int _id, outpindata *_opd) {
+    struct timespec ts;
+    struct kevent ke;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    auto cycle = c_pwm.nextCycle(_id, ts.tv_sec*1000ull + ts.tv_nsec/1000000);
+    if ( cycle.acquired ) c_m_actuation.record(Clock::monotonic() - cycle.acquired);
+
+    // EV_SET(kev, ident, filter, flags, fflags, data, udata);
+    if ( cycle.rearm ) {
+      EV_SET(&ke, ID_PULSE_OFFSET+2*_id+1, EVFILT_TIMER, EV_ADD|EV_ENABLE, NOTE_MSECONDS, cycle.cycletime, (void*)_opd);
+      if ( kevent(c_kq, &ke, 1, 0, 0, 0) < 0 ) {
+	c_log.error("kevent failed: %i/%s", errno, strerror(errno));
+      }
+    }
+
+    if ( cycle.ontime == 0 ) {
+      c_gpio[_opd->name].low();
+    } else {
+      c_gpio[_opd->name].high();
+      if ( cycle.ontime < cycle.cycletime ) {
+	EV_SET(&ke, ID_PULSE_OFFSET+2*_id+0, EVFILT_TIMER, EV_ADD|EV_ENABLE|EV_ONESHOT, NOTE_MSECONDS, cycle.ontime, (void*)_opd);
+	if ( kevent(c_kq, &ke, 1, 0, 0, 0) < 0 ) {
+	  c_log.error("kevent failed: %i/%s", errno, strerror(errno));
+	}
+      }
+    }
+
+    // the heating's feedback
+    if ( _opd->name == "mtheat" )
+      Environment::getInstance()->setHEDelivered(c_pwm.getDelivered(_id).ratio);
+  }
+
+  void IOHandler::setHeater(int _id, outpindata *_opd, PINState _state, float _onratio,
+			    uint64_t _acquired) {
+    if ( _state == PINState::Off ) {
+      if ( c_pwm.isActive(_id) ) clearPulsate(_id);
+      c_gpio[_opd->name].low();
+      _opd->state = PINState::Off;
+      if ( _acquired ) c_m_actuation.record(Clock::monotonic() - _acquired);
+      return;
+    }
+
+    // fully on is still within the budget
+    float ratio = _state == PINState::On ? 1.0f : _onratio;
+    int ctms = 1000*Config::getInstance()->getHECycleTime();
+
+    _opd->state = _state;
+    _opd->cycletime = ctms;
+    _opd->onratio = ratio;
+    // the latency is measured by the window applying it
+    c_pwm.set(_id, ctms, ratio, _acquired);
+
+    // the first one starts the windows
+    if ( !c_windowrunning ) heatWindow();
+  }
+
+  void IOHandler::setupHeaters(const Config &_cfg) {
+    std::map<int, outpindata*> heaters;
+
+    // the heating elements by priority: the RIMS/HERMS one first
+    c_budget.clear();
+    c_budget.setMaxPower(_cfg.getMaxPower());
+    c_budget.addElement(c_gpio["mtheat"].getID(), _cfg.getHEPower());
+    heaters[c_gpio["mtheat"].getID()] = &c_outpins["mtheat"];
+    for (auto &it: _cfg.getHeaters()) {
+      if ( c_outpins.find(it.pin) == c_outpins.end() ) {
+	c_log.error("Heater pin %s is not set up, it needs a restart", it.pin.c_str());
+	continue;
+      }
+      c_budget.addElement(c_gpio[it.pin].getID(), it.power);
+      heaters[c_gpio[it.pin].getID()] = &c_outpins[it.pin];
+    }
+
+    std::lock_guard<std::mutex> g(c_heatersmtx);
+    for (auto &it: c_heaters) {
+      if ( heaters.find(it.first) != heaters.end() ) continue;
+      clearPulsate(it.first);
+      it.second->state = PINState::Off;
+      c_gpio[it.second->name].low();
+    }
+    c_heaters = std::move(heaters);
+  }
+
+  /*
+   * The window of the heating elements: every element's on-time comes from
+   * its sigma-delta, and it's placed in the window by the power budget
+   */
+  void IOHandler::heatWindow() {
+    struct timespec ts;
+    struct kevent ke;
+    std::map<int, uint32_t> ontimes;
+    std::map<int, uint64_t> stamps;
+    int window = 1000*Config::getInstance()->getHECycleTime();
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    uint64_t now = ts.tv_sec*1000ull + ts.tv_nsec/1000000;
+
+    for (auto &it: c_heaters) {
+      if ( !c_pwm.isActive(it.first) ) continue;
+      // the cycle time follows the config, e.g. after an auto-tune
+      c_pwm.set(it.first, window, it.second->onratio);
+      auto cycle = c_pwm.nextCycle(it.first, now);
+      ontimes[it.first] = cycle.ontime;
+      if ( cycle.acquired ) stamps[it.first] = cycle.acquired;
+    }
+
+    c_windowrunning = ontimes.size() > 0;
+    if ( !c_windowrunning ) return;
+
+    // EV_SET(kev, ident, filter, flags, fflags, data, udata);
+    EV_SET(&ke, ID_HEATWINDOW, EVFILT_TIMER, EV_ADD|EV_ENABLE|EV_ONESHOT, NOTE_MSECONDS, window, 0);
+    if ( kevent(c_kq, &ke, 1, 0, 0, 0) < 0 ) {
+      c_log.error("kevent failed: %i/%s", errno, strerror(errno));
+    }
+
+    for (auto &[id, slot]: c_budget.allocate(window, ontimes)) {
+      outpindata *opd = c_heaters[id];
+
+      c_pwm.shorten(id, slot.ontime);
+      if ( slot.ontime == 0 ) {
+	c_gpio[opd->name].low();
+      } else {
+	if ( slot.offset == 0 ) {
+	  c_gpio[opd->name].high();
+	} else {
+	  c_gpio[opd->name].low();
+	  EV_SET(&ke, ID_ON_OFFSET+id, EVFILT_TIMER, EV_ADD|EV_ENABLE|EV_ONESHOT, NOTE_MSECONDS, slot.offset, (void*)opd);
+	  if ( kevent(c_kq, &ke, 1, 0, 0, 0) < 0 ) {
+	    c_log.error("kevent failed: %i/%s", errno, strerror(errno));
+	  }
+	}
+	if ( slot.offset + slot.ontime < (uint32_t)window ) {
+	  EV_SET(&ke, ID_PULSE_OFFSET+2*id+0, EVFILT_TIMER, EV_ADD|EV_ENABLE|EV_ONESHOT, NOTE_MSECONDS,
+		 slot.offset + slot.ontime, (void*)opd);
+	  if ( kevent(c_kq, &ke, 1, 0, 0, 0) < 0 ) {
+	    c_log.error("kevent failed: %i/%s", errno, strerror(errno));
+	  }
+	}
+      }
+
+      // the new ratio is on the output from this window
+      if ( auto st = stamps.find(id); st != stamps.end() )
+	c_m_actuation.record(Clock::monotonic() - st->second);
+
+      // the heating's feedback
+      if ( opd->name == "mtheat" )
+	Environment::getInstance()->setHEDelivered(c_pwm.getDelivered(id).ratio);
+    }
   }
 
   void IOHandler::run() {
@@ -218,7 +463,6 @@ namespace aegir {
 
     // set our kqueue up
     struct kevent ke[KE_LEN];
-    struct kevent oske;
     int nchanges = KE_LEN;
     int ident;
     int filter;
@@ -231,7 +475,9 @@ namespace aegir {
 
     while ( c_run ) {
       // start with kevent
-      if ( (nchanges = kevent(c_kq, 0, 0, ke, KE_LEN, 0)) > 0 ) {
+      nchanges = kevent(c_kq, 0, 0, ke, KE_LEN, 0);
+      heartbeat();
+      if ( nchanges > 0 ) {
 	for (int i=0; i<nchanges; ++i) {
 	  ident  = ke[i].ident;
 	  filter = ke[i].filter;
@@ -243,28 +489,28 @@ namespace aegir {
 	  } else if ( filter == EVFILT_TIMER && ident == 1 ) {
 	    // general PIN handling
 	    handlePins();
-	  } else if ( filter == EVFILT_TIMER && ident >= ID_OS_OFFSET && ident < ID_PULSE_OFFSET ) {
-	    // offset timer installation
-	    int pindent = ident - ID_OS_OFFSET;
+	  } else if ( filter == EVFILT_TIMER && ident == ID_HEATWINDOW ) {
+	    // the heating elements' window
+	    heatWindow();
+	  } else if ( filter == EVFILT_TIMER && ident >= ID_ON_OFFSET && ident < ID_PULSE_OFFSET ) {
+	    // a heating element's slot within the window
 	    outpindata *opd = (outpindata*)ke[i].udata;
 
-	    EV_SET(&oske, ID_PULSE_OFFSET+2*pindent+0, EVFILT_TIMER, EV_ADD|EV_ENABLE, NOTE_MSECONDS, opd->cycletime, (void*)opd);
-	    c_gpio[opd->name].low();
-	    if ( kevent(c_kq, &oske, 1, 0, 0, 0) < 0 ) {
-	      c_log.error("kevent failed: %i/%s", errno, strerror(errno));
-	    }
-
+	    if ( c_pwm.isActive(ident - ID_ON_OFFSET) ) c_gpio[opd->name].high();
 	  } else if ( filter == EVFILT_TIMER && ident >= ID_PULSE_OFFSET ) {
 	    int pindent = ((ident - ID_PULSE_OFFSET) & 0x0ffe)/2;
 	    int up = ident & 1;
 	    outpindata *opd = (outpindata*)ke[i].udata;
 
+	    // fired before it was cleared
+	    if ( !c_pwm.isActive(pindent) ) continue;
+
 #ifdef AEGIR_DEBUG
 	    printf("IOHandler timer ident %i -> %i up:%i\n", ident, pindent, up);
 #endif
 
 	    if ( up ) {
-	      c_gpio[opd->name].high();
+	      pulseCycle(pindent, opd);
 	    } else {
 	      c_gpio[opd->name].low();
 	    }
@@ -274,6 +520,8 @@ namespace aegir {
 
     }
 
+    // a clean stop disarms the hardware watchdog
+    c_watchdog.closeDevice(true);
     c_mq_pub.close();
     c_mq_iocmd.close();
     // these are in the dtor
@@ -281,4 +529,12 @@ namespace aegir {
     //c_spi;
     c_log.info("IOHandler stopped");
   }
+
+  void IOHandler::failsafe() {
+    // the pulses of a stalled IOHandler don't fire either
+    std::lock_guard<std::mutex> g(c_heatersmtx);
+    for (auto &it: c_heaters)
+      c_gpio[it.second->name].low();
+    c_log.error("Fail-safe: heating elements are pulled low");
+  }
 }
@@ -8,6 +8,7 @@
 #include <vector>
 #include <memory>
 #include <map>
+#include <mutex>
 #include <string>
 
 #include "ThreadManager.hh"
@@ -16,6 +17,10 @@
 #include "MAX31856.hh"
 #include "Config.hh"
 #include "LogChannel.hh"
+#include "PWMScheduler.hh"
+#include "PowerBudget.hh"
+#include "Metrics.hh"
+#include "Watchdog.hh"
 
 namespace aegir {
 
@@ -40,7 +45,8 @@ namespace aegir {
     SPI &c_spi;
     ZMQ::Socket c_mq_pub;
     ZMQ::Socket c_mq_iocmd;
-    std::vector<std::unique_ptr<MAX31856>> c_tcs;
+    // by chip id
+    std::map<int, std::unique_ptr<MAX31856>> c_tcs;
     Config::tcids c_tcmap;
     uint32_t c_thermoival;
     uint32_t c_pinival;
@@ -49,15 +55,44 @@ namespace aegir {
     std::map<std::string, outpindata> c_outpins;
     // the kqueue socket
     int c_kq;
+    PWMScheduler c_pwm;
+    // the heating elements share a common window within the power budget
+    PowerBudget c_budget;
+    std::map<int, outpindata*> c_heaters;
+    // the fail-safe reads the heaters on the supervisor's thread
+    std::mutex c_heatersmtx;
+    bool c_windowrunning;
+    Watchdog &c_watchdog;
+    // the version of the config snapshot applied
+    uint64_t c_cfgversion;
     LogChannel c_log;
+    // runtime metrics
+    Metrics::Histogram &c_m_readtcs, &c_m_handlepins, &c_m_actuation;
+    Metrics::Gauge &c_m_cmdbacklog;
+    Metrics::Counter &c_m_senderrors;
 
   private:
     void readTCs();
     void handlePins();
     void clearPulsate(int id);
+    // a cycle boundary of a pulsating pin
+    void pulseCycle(int _id, outpindata *_opd);
+    // a heating element's new state, it's scheduled on the next window
+    void setHeater(int _id, outpindata *_opd, PINState _state, float _onratio, uint64_t _acquired);
+    // the heating elements' common window
+    void heatWindow();
+    // the heating elements and their budget from the config, the ones
+    // dropped are switched off
+    void setupHeaters(const Config &_cfg);
+    // the Controller stalled, the outputs are forced to their defval
+    void latchOutputs();
 
   public:
     virtual void run();
+
+  protected:
+    // the heating elements are pulled low directly
+    virtual void failsafe() override;
   };
 }
 
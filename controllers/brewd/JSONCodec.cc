@@ -0,0 +1,478 @@
+
+#include "JSONCodec.hh"
+
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+
+#include "Exception.hh"
+
+namespace aegir {
+
+  /*
+   * JsonCppCodec
+   */
+  JsonCppCodec::JsonCppCodec() {
+    Json::CharReaderBuilder crb;
+    c_reader.reset(crb.newCharReader());
+
+    Json::StreamWriterBuilder swb;
+    swb["indentation"] = "";
+    c_writer.reset(swb.newStreamWriter());
+  }
+
+  JsonCppCodec::~JsonCppCodec() = default;
+
+  void JsonCppCodec::parse(const char *_data, std::size_t _size, Json::Value &_out) {
+    std::string errors;
+
+    if ( !c_reader->parse(_data, _data + _size, &_out, &errors) )
+      throw Exception("Cannot parse message as JSON: %s", errors.c_str());
+  }
+
+  void JsonCppCodec::write(const Json::Value &_value, std::string &_out) {
+    c_stream.str(std::string());
+    c_stream.clear();
+    c_writer->write(_value, &c_stream);
+    _out = c_stream.str();
+  }
+
+  /*
+   * FastJSONCodec
+   */
+  FastJSONCodec::FastJSONCodec(): c_begin(nullptr), c_pos(nullptr),
+				  c_end(nullptr), c_depth(0) {
+  }
+
+  FastJSONCodec::~FastJSONCodec() = default;
+
+  void FastJSONCodec::error(const char *_what) const {
+    throw Exception("Cannot parse message as JSON: %s at offset %u",
+		    _what, (unsigned)(c_pos - c_begin));
+  }
+
+  void FastJSONCodec::skipWS() {
+    while ( c_pos < c_end &&
+	    (*c_pos == ' ' || *c_pos == '\t' || *c_pos == '\n' || *c_pos == '\r') )
+      ++c_pos;
+  }
+
+  void FastJSONCodec::parse(const char *_data, std::size_t _size, Json::Value &_out) {
+    c_begin = c_pos = _data;
+    c_end = _data + _size;
+    c_depth = 0;
+
+    skipWS();
+    parseValue(_out);
+    skipWS();
+    if ( c_pos != c_end )
+      error("trailing characters");
+  }
+
+  void FastJSONCodec::parseValue(Json::Value &_out) {
+    if ( c_pos >= c_end )
+      error("unexpected end of input");
+
+    switch (*c_pos) {
+    case '{':
+      parseObject(_out);
+      break;
+    case '[':
+      parseArray(_out);
+      break;
+    case '"': {
+      ++c_pos;
+      // the common case, no escapes: the value is taken from the input
+      const char *start = c_pos;
+      while ( c_pos < c_end && *c_pos != '"' && *c_pos != '\\'
+	      && (unsigned char)*c_pos >= 0x20 )
+	++c_pos;
+      if ( c_pos < c_end && *c_pos == '"' ) {
+	_out = Json::Value(start, c_pos);
+	++c_pos;
+	break;
+      }
+      c_pos = start - 1;
+      parseString(c_scratch);
+      _out = Json::Value(c_scratch.data(), c_scratch.data() + c_scratch.size());
+      break;
+    }
+    case 't':
+      parseLiteral("true", 4);
+      _out = Json::Value(true);
+      break;
+    case 'f':
+      parseLiteral("false", 5);
+      _out = Json::Value(false);
+      break;
+    case 'n':
+      parseLiteral("null", 4);
+      _out = Json::Value();
+      break;
+    default:
+      parseNumber(_out);
+      break;
+    }
+  }
+
+  void FastJSONCodec::parseLiteral(const char *_lit, std::size_t _len) {
+    if ( (std::size_t)(c_end - c_pos) < _len || memcmp(c_pos, _lit, _len) != 0 )
+      error("invalid literal");
+    c_pos += _len;
+  }
+
+  void FastJSONCodec::parseObject(Json::Value &_out) {
+    if ( ++c_depth > c_maxdepth )
+      error("nesting too deep");
+
+    ++c_pos; // '{'
+    _out = Json::Value(Json::ValueType::objectValue);
+
+    skipWS();
+    if ( c_pos < c_end && *c_pos == '}' ) {
+      ++c_pos;
+      --c_depth;
+      return;
+    }
+
+    while ( true ) {
+      skipWS();
+      if ( c_pos >= c_end || *c_pos != '"' )
+	error("expected a member name");
+      parseString(c_scratch);
+
+      skipWS();
+      if ( c_pos >= c_end || *c_pos != ':' )
+	error("expected ':'");
+      ++c_pos;
+      skipWS();
+
+      // the member is created before c_scratch gets reused by the value
+      parseValue(_out[c_scratch]);
+
+      skipWS();
+      if ( c_pos >= c_end )
+	error("unterminated object");
+      if ( *c_pos == ',' ) {
+	++c_pos;
+	continue;
+      }
+      if ( *c_pos == '}' ) {
+	++c_pos;
+	break;
+      }
+      error("expected ',' or '}'");
+    }
+    --c_depth;
+  }
+
+  void FastJSONCodec::parseArray(Json::Value &_out) {
+    if ( ++c_depth > c_maxdepth )
+      error("nesting too deep");
+
+    ++c_pos; // '['
+    _out = Json::Value(Json::ValueType::arrayValue);
+
+    skipWS();
+    if ( c_pos < c_end && *c_pos == ']' ) {
+      ++c_pos;
+      --c_depth;
+      return;
+    }
+
+    while ( true ) {
+      skipWS();
+      parseValue(_out.append(Json::Value()));
+
+      skipWS();
+      if ( c_pos >= c_end )
+	error("unterminated array");
+      if ( *c_pos == ',' ) {
+	++c_pos;
+	continue;
+      }
+      if ( *c_pos == ']' ) {
+	++c_pos;
+	break;
+      }
+      error("expected ',' or ']'");
+    }
+    --c_depth;
+  }
+
+  static int hexval(char _c) {
+    if ( _c >= '0' && _c <= '9' ) return _c - '0';
+    if ( _c >= 'a' && _c <= 'f' ) return _c - 'a' + 10;
+    if ( _c >= 'A' && _c <= 'F' ) return _c - 'A' + 10;
+    return -1;
+  }
+
+  void FastJSONCodec::parseString(std::string &_out) {
+    ++c_pos; // '"'
+    _out.clear();
+
+    while ( true ) {
+      // copy the unescaped runs at once
+      const char *start = c_pos;
+      while ( c_pos < c_end && *c_pos != '"' && *c_pos != '\\'
+	      && (unsigned char)*c_pos >= 0x20 )
+	++c_pos;
+      _out.append(start, c_pos - start);
+
+      if ( c_pos >= c_end )
+	error("unterminated string");
+      if ( *c_pos == '"' ) {
+	++c_pos;
+	return;
+      }
+      if ( *c_pos != '\\' )
+	error("control character in string");
+
+      if ( ++c_pos >= c_end )
+	error("unterminated string");
+      switch (*c_pos++) {
+      case '"': _out.push_back('"'); break;
+      case '\\': _out.push_back('\\'); break;
+      case '/': _out.push_back('/'); break;
+      case 'b': _out.push_back('\b'); break;
+      case 'f': _out.push_back('\f'); break;
+      case 'n': _out.push_back('\n'); break;
+      case 'r': _out.push_back('\r'); break;
+      case 't': _out.push_back('\t'); break;
+      case 'u': {
+	uint32_t cp = 0;
+	for (int pass=0; pass < 2; ++pass) {
+	  if ( c_end - c_pos < 4 )
+	    error("invalid unicode escape");
+	  uint32_t unit = 0;
+	  for (int i=0; i<4; ++i) {
+	    int h = hexval(c_pos[i]);
+	    if ( h < 0 )
+	      error("invalid unicode escape");
+	    unit = (unit << 4) | h;
+	  }
+	  c_pos += 4;
+
+	  if ( pass == 0 ) {
+	    cp = unit;
+	    // a high surrogate has to be followed by a low one
+	    if ( cp < 0xd800 || cp > 0xdbff ) break;
+	    if ( c_end - c_pos < 2 || c_pos[0] != '\\' || c_pos[1] != 'u' )
+	      error("missing low surrogate");
+	    c_pos += 2;
+	  } else {
+	    if ( unit < 0xdc00 || unit > 0xdfff )
+	      error("invalid low surrogate");
+	    cp = 0x10000 + ((cp - 0xd800) << 10) + (unit - 0xdc00);
+	  }
+	}
+
+	// and encode as utf-8
+	if ( cp < 0x80 ) {
+	  _out.push_back(cp);
+	} else if ( cp < 0x800 ) {
+	  _out.push_back(0xc0 | (cp >> 6));
+	  _out.push_back(0x80 | (cp & 0x3f));
+	} else if ( cp < 0x10000 ) {
+	  _out.push_back(0xe0 | (cp >> 12));
+	  _out.push_back(0x80 | ((cp >> 6) & 0x3f));
+	  _out.push_back(0x80 | (cp & 0x3f));
+	} else {
+	  _out.push_back(0xf0 | (cp >> 18));
+	  _out.push_back(0x80 | ((cp >> 12) & 0x3f));
+	  _out.push_back(0x80 | ((cp >> 6) & 0x3f));
+	  _out.push_back(0x80 | (cp & 0x3f));
+	}
+	break;
+      }
+      default:
+	error("invalid escape");
+      }
+    }
+  }
+
+  void FastJSONCodec::parseNumber(Json::Value &_out) {
+    const char *start = c_pos;
+    bool negative = false, isreal = false;
+
+    if ( *c_pos == '-' ) {
+      negative = true;
+      ++c_pos;
+    }
+    const char *digits = c_pos;
+    while ( c_pos < c_end && *c_pos >= '0' && *c_pos <= '9' ) ++c_pos;
+    if ( c_pos == digits )
+      error("invalid value");
+    if ( *digits == '0' && c_pos - digits > 1 )
+      error("leading zeroes");
+
+    if ( c_pos < c_end && *c_pos == '.' ) {
+      isreal = true;
+      const char *frac = ++c_pos;
+      while ( c_pos < c_end && *c_pos >= '0' && *c_pos <= '9' ) ++c_pos;
+      if ( c_pos == frac )
+	error("invalid fraction");
+    }
+    if ( c_pos < c_end && (*c_pos == 'e' || *c_pos == 'E') ) {
+      isreal = true;
+      ++c_pos;
+      if ( c_pos < c_end && (*c_pos == '+' || *c_pos == '-') ) ++c_pos;
+      const char *exp = c_pos;
+      while ( c_pos < c_end && *c_pos >= '0' && *c_pos <= '9' ) ++c_pos;
+      if ( c_pos == exp )
+	error("invalid exponent");
+    }
+
+    if ( !isreal ) {
+      // same typing as jsoncpp: signed unless it doesn't fit
+      uint64_t mag;
+      auto res = std::from_chars(digits, c_pos, mag);
+      if ( res.ec == std::errc() ) {
+	if ( negative ) {
+	  if ( mag <= (uint64_t)std::numeric_limits<int64_t>::max() + 1 ) {
+	    _out = Json::Value((Json::LargestInt)(-(int64_t)(mag - 1) - 1));
+	    return;
+	  }
+	} else if ( mag <= (uint64_t)std::numeric_limits<int64_t>::max() ) {
+	  _out = Json::Value((Json::LargestInt)mag);
+	  return;
+	} else {
+	  _out = Json::Value((Json::LargestUInt)mag);
+	  return;
+	}
+      }
+      // out of range integers are stored as real, like jsoncpp does
+    }
+
+    // strtod needs a terminated string, numbers are short
+    char buff[64];
+    std::size_t len = c_pos - start;
+    if ( len >= sizeof(buff) ) {
+      std::string tmp(start, len);
+      _out = Json::Value(std::strtod(tmp.c_str(), nullptr));
+      return;
+    }
+    memcpy(buff, start, len);
+    buff[len] = 0;
+    _out = Json::Value(std::strtod(buff, nullptr));
+  }
+
+  void FastJSONCodec::write(const Json::Value &_value, std::string &_out) {
+    _out.clear();
+    writeValue(_value, _out);
+  }
+
+  void FastJSONCodec::writeValue(const Json::Value &_value, std::string &_out) {
+    char buff[32];
+
+    switch (_value.type()) {
+    case Json::ValueType::nullValue:
+      _out.append("null", 4);
+      break;
+    case Json::ValueType::intValue: {
+      auto res = std::to_chars(buff, buff + sizeof(buff), _value.asLargestInt());
+      _out.append(buff, res.ptr - buff);
+      break;
+    }
+    case Json::ValueType::uintValue: {
+      auto res = std::to_chars(buff, buff + sizeof(buff), _value.asLargestUInt());
+      _out.append(buff, res.ptr - buff);
+      break;
+    }
+    case Json::ValueType::realValue: {
+      double d = _value.asDouble();
+      if ( !std::isfinite(d) ) {
+	_out.append("null", 4);
+	break;
+      }
+      // shortest representation that reads back the same
+      auto res = std::to_chars(buff, buff + sizeof(buff), d);
+      _out.append(buff, res.ptr - buff);
+      // keep it a real on the other side
+      if ( !memchr(buff, '.', res.ptr - buff) && !memchr(buff, 'e', res.ptr - buff) )
+	_out.append(".0", 2);
+      break;
+    }
+    case Json::ValueType::stringValue: {
+      const char *begin, *end;
+      if ( !_value.getString(&begin, &end) ) {
+	_out.append("\"\"", 2);
+	break;
+      }
+      writeString(begin, end, _out);
+      break;
+    }
+    case Json::ValueType::booleanValue:
+      if ( _value.asBool() )
+	_out.append("true", 4);
+      else
+	_out.append("false", 5);
+      break;
+    case Json::ValueType::arrayValue: {
+      Json::ArrayIndex size = _value.size();
+      _out.push_back('[');
+      for (Json::ArrayIndex i=0; i < size; ++i) {
+	if ( i ) _out.push_back(',');
+	writeValue(_value[i], _out);
+      }
+      _out.push_back(']');
+      break;
+    }
+    case Json::ValueType::objectValue: {
+      bool first = true;
+      _out.push_back('{');
+      for (auto it = _value.begin(); it != _value.end(); ++it) {
+	if ( !first ) _out.push_back(',');
+	first = false;
+
+	const char *end;
+	const char *name = it.memberName(&end);
+	writeString(name, end, _out);
+	_out.push_back(':');
+	writeValue(*it, _out);
+      }
+      _out.push_back('}');
+      break;
+    }
+    }
+  }
+
+  void FastJSONCodec::writeString(const char *_begin, const char *_end, std::string &_out) {
+    static const char hex[] = "0123456789abcdef";
+
+    _out.push_back('"');
+    while ( _begin < _end ) {
+      // copy the runs that don't need escaping at once
+      const char *run = _begin;
+      while ( _begin < _end && *_begin != '"' && *_begin != '\\'
+	      && (unsigned char)*_begin >= 0x20 )
+	++_begin;
+      _out.append(run, _begin - run);
+      if ( _begin == _end ) break;
+
+      char c = *_begin++;
+      switch (c) {
+      case '"': _out.append("\\\"", 2); break;
+      case '\\': _out.append("\\\\", 2); break;
+      case '\b': _out.append("\\b", 2); break;
+      case '\f': _out.append("\\f", 2); break;
+      case '\n': _out.append("\\n", 2); break;
+      case '\r': _out.append("\\r", 2); break;
+      case '\t': _out.append("\\t", 2); break;
+      default: {
+	char esc[6] = {'\\', 'u', '0', '0', hex[(c >> 4) & 0xf], hex[c & 0xf]};
+	_out.append(esc, 6);
+	break;
+      }
+      }
+    }
+    _out.push_back('"');
+  }
+
+  JSONCodec &getJSONCodec() {
+    thread_local JSONCodec codec;
+    return codec;
+  }
+}
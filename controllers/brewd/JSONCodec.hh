@@ -0,0 +1,88 @@
+/*
+ * JSON encoding/decoding for the PR protocol
+ * Two backends with the same interface, both produce/consume Json::Value:
+ *  - JsonCppCodec: jsoncpp's reader and writer, with cached instances
+ *  - FastJSONCodec: a recursive descent parser working on the input
+ *    buffer and a compact writer appending to a reused string
+ * The backend is selected at build time with AEGIR_FASTJSON
+ */
+
+#ifndef AEGIR_JSONCODEC_H
+#define AEGIR_JSONCODEC_H
+
+#include <json/json.h>
+
+#include <cstddef>
+#include <memory>
+#include <sstream>
+#include <string>
+
+namespace aegir {
+
+  class JsonCppCodec {
+  public:
+    JsonCppCodec();
+    JsonCppCodec(JsonCppCodec&&) = delete;
+    JsonCppCodec(const JsonCppCodec&) = delete;
+    JsonCppCodec &operator=(JsonCppCodec&&) = delete;
+    JsonCppCodec &operator=(const JsonCppCodec&) = delete;
+    ~JsonCppCodec();
+
+    // throws Exception on malformed input
+    void parse(const char *_data, std::size_t _size, Json::Value &_out);
+    // compact output, replaces the contents of _out
+    void write(const Json::Value &_value, std::string &_out);
+
+  private:
+    std::unique_ptr<Json::CharReader> c_reader;
+    std::unique_ptr<Json::StreamWriter> c_writer;
+    std::ostringstream c_stream;
+  };
+
+  class FastJSONCodec {
+  public:
+    // same as jsoncpp's default
+    static constexpr unsigned c_maxdepth = 1000;
+
+  public:
+    FastJSONCodec();
+    FastJSONCodec(FastJSONCodec&&) = delete;
+    FastJSONCodec(const FastJSONCodec&) = delete;
+    FastJSONCodec &operator=(FastJSONCodec&&) = delete;
+    FastJSONCodec &operator=(const FastJSONCodec&) = delete;
+    ~FastJSONCodec();
+
+    // throws Exception on malformed input
+    void parse(const char *_data, std::size_t _size, Json::Value &_out);
+    // compact output, replaces the contents of _out
+    void write(const Json::Value &_value, std::string &_out);
+
+  private:
+    const char *c_begin, *c_pos, *c_end;
+    unsigned c_depth;
+    // unescaped strings and keys are assembled here
+    std::string c_scratch;
+
+    [[noreturn]] void error(const char *_what) const;
+    void skipWS();
+    void parseValue(Json::Value &_out);
+    void parseObject(Json::Value &_out);
+    void parseArray(Json::Value &_out);
+    void parseString(std::string &_out);
+    void parseNumber(Json::Value &_out);
+    void parseLiteral(const char *_lit, std::size_t _len);
+    void writeValue(const Json::Value &_value, std::string &_out);
+    static void writeString(const char *_begin, const char *_end, std::string &_out);
+  };
+
+#ifdef AEGIR_FASTJSON
+  typedef FastJSONCodec JSONCodec;
+#else
+  typedef JsonCppCodec JSONCodec;
+#endif
+
+  // The codecs keep state, every thread gets its own
+  JSONCodec &getJSONCodec();
+}
+
+#endif
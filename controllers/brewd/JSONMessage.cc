@@ -1,24 +1,14 @@
 
 #include "JSONMessage.hh"
 #include "Exception.hh"
+#include "JSONCodec.hh"
 
 #include <string.h>
 #include <stdio.h>
 
-#include <sstream>
-
 namespace aegir {
   JSONMessage::JSONMessage(const msgstring &_msg) {
-    //    if ( !jsr.parse(msg, c_json, false) )
-    Json::CharReaderBuilder crf;
-    std::string msg;
-    msg.resize(_msg.size());
-    memcpy((void*)msg.data(), (void*)_msg.data(), msg.size());
-
-    std::istringstream iss(msg);
-    std::string errors;
-    if ( !Json::parseFromStream(crf, iss, &c_json, &errors) )
-      throw Exception("Cannot parse message as JSON: %s/%s", errors.c_str(), _msg.c_str());
+    getJSONCodec().parse((const char*)_msg.data(), _msg.size(), c_json);
 
 #if 0
     std::string typestr("unknown");
@@ -58,16 +48,11 @@ namespace aegir {
   JSONMessage::~JSONMessage() = default;
 
   msgstring JSONMessage::serialize() const {
-    Json::StreamWriterBuilder swb;
-    std::string buff;
-    msgstring msg;
-
-    buff = Json::writeString(swb, c_json);
+    thread_local std::string buff;
 
-    msg.resize(buff.size());
-    memcpy((void*)msg.data(), (void*)buff.data(), msg.size());
+    getJSONCodec().write(c_json, buff);
 
-    return msg;
+    return msgstring((const uint8_t*)buff.data(), buff.size());
   }
 
   MessageType JSONMessage::type() const {
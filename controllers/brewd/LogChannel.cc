@@ -1,6 +1,8 @@
 #include <cstdio>
 
 #include "LogChannel.hh"
+#include "AsyncLog.hh"
+#include "logging.hh"
 
 namespace bl = ::boost::log;
 namespace blt = ::boost::log::trivial;
@@ -9,6 +11,7 @@ namespace blk = ::boost::log::keywords;
 namespace aegir {
 
   LogChannel::LogChannel(const std::string _name, const blt::severity_level _level):
+    c_name(_name),
     c_channel(blk::severity = _level, blk::channel = _name),
     c_level(_level) {
   }
@@ -26,6 +29,17 @@ namespace aegir {
 
   void LogChannel::log(const blt::severity_level _level,
 		       const char* _fmt, std::va_list _args) {
+    // nothing's formatted or captured below the level
+    if ( !logging::isEnabled(_level) ) return;
+
+    // the arguments are formatted by the background thread
+    AsyncLog &async(AsyncLog::getInstance());
+    if ( async.push(c_name, _level, _fmt, _args) ) {
+      // the process is likely going down
+      if ( _level == blt::severity_level::fatal ) async.flush();
+      return;
+    }
+
     char buff[1024];
     int len;
 
@@ -39,6 +53,35 @@ namespace aegir {
     }
   }
 
+  void LogChannel::log(const blt::severity_level _level, const char* _fmt, ...) {
+    std::va_list args;
+
+    va_start(args, _fmt);
+    log(_level, _fmt, args);
+    va_end(args);
+  }
+
+  void LogChannel::event(const blt::severity_level _level, const char *_event,
+			 std::initializer_list<logging::Field> _fields) {
+    if ( !logging::isEnabled(_level) ) return;
+
+    AsyncLog &async(AsyncLog::getInstance());
+    if ( async.push(c_name, _level, _event, _fields.begin(), _fields.size()) ) {
+      if ( _level == blt::severity_level::fatal ) async.flush();
+      return;
+    }
+
+    uint8_t buff[1024];
+    uint32_t len = AsyncLog::capture(_fields.begin(), _fields.size(), buff, sizeof(buff));
+
+    if ( bl::record rec = c_channel.open_record(blk::severity = _level) ) {
+      bl::record_ostream strm(rec);
+      strm << AsyncLog::formatFields(_event, buff, len);
+      strm.flush();
+      c_channel.push_record(boost::move(rec));
+    }
+  }
+
   void LogChannel::trace(const char* _fmt, ...) {
     std::va_list args;
 
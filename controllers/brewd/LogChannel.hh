@@ -1,5 +1,8 @@
 /*
   A log channel with severity support
+  The AEGIR_LOG* macros check the level before the arguments are evaluated,
+  and the ones below AEGIR_LOG_MINLEVEL aren't compiled in at all, so the
+  trace and debug calls cost nothing in the Release builds.
  */
 
 #ifndef AEGIR_LOGCHANNEL_H
@@ -7,12 +10,38 @@
 
 #include <string>
 #include <cstdarg>
+#include <initializer_list>
 
 #include <boost/log/sources/severity_channel_logger.hpp>
 #include <boost/log/trivial.hpp>
 
+#include "logging.hh"
+
 namespace blt = ::boost::log::trivial;
 
+// the lowest severity compiled in, see blt::severity_level
+#ifndef AEGIR_LOG_MINLEVEL
+#define AEGIR_LOG_MINLEVEL 0
+#endif
+
+#define AEGIR_LOG(_channel, _level, ...) do {				\
+    if constexpr ( (int)blt::severity_level::_level >= AEGIR_LOG_MINLEVEL ) { \
+      if ( ::aegir::logging::isEnabled(blt::severity_level::_level) )	\
+	(_channel).log(blt::severity_level::_level, __VA_ARGS__);	\
+    }									\
+  } while (0)
+
+// a structured record: AEGIR_LOG_EVENT(c_log, debug, "event", {"key", value}, ...)
+#define AEGIR_LOG_EVENT(_channel, _level, _event, ...) do {		\
+    if constexpr ( (int)blt::severity_level::_level >= AEGIR_LOG_MINLEVEL ) { \
+      if ( ::aegir::logging::isEnabled(blt::severity_level::_level) )	\
+	(_channel).event(blt::severity_level::_level, _event, {__VA_ARGS__}); \
+    }									\
+  } while (0)
+
+#define AEGIR_LOG_TRACE(_channel, ...) AEGIR_LOG(_channel, trace, __VA_ARGS__)
+#define AEGIR_LOG_DEBUG(_channel, ...) AEGIR_LOG(_channel, debug, __VA_ARGS__)
+
 namespace aegir {
   class LogChannel {
   private:
@@ -24,6 +53,10 @@ namespace aegir {
     // default severity
     void log(const char* _fmt, ...);
     void log(const blt::severity_level _level, const char* _fmt, std::va_list _args);
+    void log(const blt::severity_level _level, const char* _fmt, ...);
+    // a structured record, the event followed by its key=value fields
+    void event(const blt::severity_level _level, const char *_event,
+	       std::initializer_list<logging::Field> _fields);
     // per-severity
     void trace(const char* _fmt, ...);
     void debug(const char* _fmt, ...);
@@ -34,6 +67,7 @@ namespace aegir {
     void fatal(const char* _fmt, ...);
 
   private:
+    std::string c_name;
     boost::log::sources::severity_channel_logger_mt<blt::severity_level, std::string> c_channel;
     blt::severity_level c_level;
   };
@@ -0,0 +1,159 @@
+#include "LoopMonitor.hh"
+
+#include <algorithm>
+
+namespace aegir {
+
+  static const char *g_phasenames[LoopMonitor::c_nphases] = {
+    "wakeup",
+    "inputs",
+    "stages",
+    "tempcontrol",
+    "endcycle",
+  };
+
+  LoopMonitor::LoopMonitor(uint32_t _period, uint32_t _worst): c_period(_period), c_maxworst(_worst),
+							       c_budget{}, c_cycles(0), c_overruns(0),
+							       c_missed(0), c_current{}, c_last{},
+							       c_alerttime(0),
+							       c_m_cycle(Metrics::getInstance()
+									 .histogram("aegir_controller_cycle_seconds",
+										    "The duration of the control loop's cycles")),
+							       c_m_overruns(Metrics::getInstance()
+									    .counter("aegir_controller_overruns_total",
+										     "The cycles over their budget")),
+							       c_m_missed(Metrics::getInstance()
+									  .counter("aegir_controller_missed_total",
+										   "The periods missed by the control loop")) {
+    for (uint8_t i=0; i < c_nphases; ++i)
+      c_m_phases[i] = &Metrics::getInstance()
+	.histogram("aegir_controller_phase_seconds", "The phases of the control loop's cycles",
+		   std::string("phase=\"") + g_phasenames[i] + "\"");
+  }
+
+  LoopMonitor::~LoopMonitor() {
+  }
+
+  const char *LoopMonitor::phaseName(Phase _phase) {
+    return g_phasenames[(uint8_t)_phase];
+  }
+
+  void LoopMonitor::setWorst(uint32_t _worst) {
+    c_maxworst = _worst;
+    if ( c_worst.size() > c_maxworst ) c_worst.resize(c_maxworst);
+  }
+
+  void LoopMonitor::begin(time_t _now, uint32_t _wakeup) {
+    c_current = Cycle{};
+    c_current.time = _now;
+    c_current.phases[(uint8_t)Phase::Wakeup] = _wakeup;
+    c_cyclestart = c_lapstart = std::chrono::steady_clock::now();
+  }
+
+  void LoopMonitor::lap(Phase _phase) {
+    auto now = std::chrono::steady_clock::now();
+
+    c_current.phases[(uint8_t)_phase] +=
+      std::chrono::duration_cast<std::chrono::microseconds>(now - c_lapstart).count();
+    c_lapstart = now;
+  }
+
+  bool LoopMonitor::end() {
+    c_current.total = std::chrono::duration_cast<std::chrono::microseconds>
+      (std::chrono::steady_clock::now() - c_cyclestart).count();
+    return add(c_current);
+  }
+
+  bool LoopMonitor::add(const Cycle &_cycle) {
+    ++c_cycles;
+    c_last = _cycle;
+
+    for (uint8_t i=0; i < c_nphases; ++i)
+      c_m_phases[i]->record(_cycle.phases[i]);
+    c_m_cycle.record(_cycle.total);
+
+    // the worst ones, by their total
+    if ( c_maxworst ) {
+      if ( c_worst.size() < c_maxworst || _cycle.total > c_worst.back().total ) {
+	if ( c_worst.size() >= c_maxworst ) c_worst.pop_back();
+	auto pos = std::upper_bound(c_worst.begin(), c_worst.end(), _cycle,
+				    [](const Cycle &_a, const Cycle &_b) { return _a.total > _b.total; });
+	c_worst.insert(pos, _cycle);
+      }
+    }
+
+    std::string reason = check(_cycle);
+    if ( reason.empty() ) return false;
+
+    ++c_overruns;
+    c_m_overruns.inc();
+    return raise(_cycle.time, reason);
+  }
+
+  bool LoopMonitor::missed(time_t _now, uint32_t _periods) {
+    if ( !_periods ) return false;
+
+    c_missed += _periods;
+    c_m_missed.inc(_periods);
+    return raise(_now, std::to_string(_periods) + " timer period(s) missed");
+  }
+
+  std::string LoopMonitor::check(const Cycle &_cycle) const {
+    uint64_t late = (uint64_t)_cycle.phases[(uint8_t)Phase::Wakeup] + _cycle.total;
+
+    if ( c_period && late > c_period )
+      return "the cycle missed its period";
+    if ( c_budget.cycle && _cycle.total > c_budget.cycle )
+      return "the cycle is over its budget";
+    for (uint8_t i=0; i < c_nphases; ++i) {
+      if ( c_budget.phases[i] && _cycle.phases[i] > c_budget.phases[i] )
+	return std::string(g_phasenames[i]) + " is over its budget";
+    }
+    return "";
+  }
+
+  bool LoopMonitor::raise(time_t _now, const std::string &_reason) {
+    bool raised = !isAlerting(_now);
+
+    c_alert = _reason;
+    c_alerttime = _now;
+    return raised;
+  }
+
+  bool LoopMonitor::isAlerting(time_t _now) const {
+    return c_alerttime && _now - c_alerttime < c_alertwindow;
+  }
+
+  // the phases in msecs
+  static Json::Value cycleToJSON(const LoopMonitor::Cycle &_cycle) {
+    Json::Value out;
+
+    out["time"] = (Json::Int64)_cycle.time;
+    for (uint8_t i=0; i < LoopMonitor::c_nphases; ++i)
+      out[LoopMonitor::phaseName((LoopMonitor::Phase)i)] = _cycle.phases[i] / 1000.0;
+    out["total"] = _cycle.total / 1000.0;
+    return out;
+  }
+
+  void LoopMonitor::toJSON(Json::Value &_out, time_t _now) const {
+    _out["cycles"] = Json::Value::UInt64(c_cycles);
+    _out["overruns"] = Json::Value::UInt64(c_overruns);
+    _out["missed"] = Json::Value::UInt64(c_missed);
+    if ( c_cycles ) _out["last"] = cycleToJSON(c_last);
+
+    Json::Value worst(Json::arrayValue);
+    for (auto &it: c_worst) worst.append(cycleToJSON(it));
+    _out["worst"] = worst;
+
+    alertToJSON(_out, _now);
+  }
+
+  void LoopMonitor::alertToJSON(Json::Value &_out, time_t _now) const {
+    _out["alerting"] = isAlerting(_now);
+    if ( c_alerttime ) {
+      _out["alert"]["active"] = isAlerting(_now);
+      _out["alert"]["reason"] = c_alert;
+      _out["alert"]["time"] = (Json::Int64)c_alerttime;
+    }
+  }
+}
@@ -0,0 +1,124 @@
+/*
+ * Timing of the control loop's cycles
+ * Every cycle is split into phases: how late the timer woke the loop up,
+ * reading the inputs, the stage handlers, the temperature control and
+ * ending the cycle (the outputs and the state snapshot). The phases are
+ * checked against their deadline budgets, and a cycle not finishing within
+ * the loop's period, or a timer firing more than once before it was
+ * handled, is a missed period. The worst cycles are kept for the
+ * post-mortem, and the overruns are raised as alerts in getState. The
+ * counters and the timings change on every cycle, they're served by
+ * getLoop, so getState's snapshot isn't renewed by them.
+ */
+
+#ifndef AEGIR_LOOPMONITOR_H
+#define AEGIR_LOOPMONITOR_H
+
+#include <cstdint>
+#include <ctime>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <json/json.h>
+
+#include "Metrics.hh"
+
+namespace aegir {
+
+  class LoopMonitor {
+    LoopMonitor() = delete;
+    LoopMonitor(LoopMonitor&&) = delete;
+    LoopMonitor(const LoopMonitor &) = delete;
+    LoopMonitor &operator=(LoopMonitor &&) = delete;
+    LoopMonitor &operator=(const LoopMonitor &) = delete;
+  public:
+    enum class Phase: uint8_t {
+      Wakeup,
+      Inputs,
+      Stages,
+      TempControl,
+      EndCycle,
+      _SIZE
+    };
+    static constexpr uint8_t c_nphases = (uint8_t)Phase::_SIZE;
+
+    // usecs, 0 is not checked
+    struct Budget {
+      uint32_t phases[c_nphases];
+      uint32_t cycle;
+    };
+
+    struct Cycle {
+      time_t time;
+      uint32_t phases[c_nphases];
+      // without the wakeup, usecs
+      uint32_t total;
+    };
+
+    // an alert stays active this long, secs
+    static constexpr time_t c_alertwindow = 60;
+
+  public:
+    // _period is the loop's period, _worst is the number of the worst cycles kept
+    LoopMonitor(uint32_t _period, uint32_t _worst);
+    ~LoopMonitor();
+
+    inline void setBudget(const Budget &_budget) { c_budget = _budget; };
+    inline const Budget &getBudget() const { return c_budget; };
+    void setWorst(uint32_t _worst);
+
+    // the cycles measured by the monitor
+    void begin(time_t _now, uint32_t _wakeup);
+    // the time since the previous lap is added to _phase
+    void lap(Phase _phase);
+    // returns true when it raised a new alert
+    bool end();
+
+    // the cycles measured by the caller, returns true on a new alert
+    bool add(const Cycle &_cycle);
+    // the timer fired _periods more times than it was handled, the
+    // missed periods are only counted here
+    bool missed(time_t _now, uint32_t _periods);
+
+    inline uint64_t getCycles() const { return c_cycles; };
+    inline uint64_t getOverruns() const { return c_overruns; };
+    inline uint64_t getMissed() const { return c_missed; };
+    inline const Cycle &getLast() const { return c_last; };
+    // by total time, the worst first
+    inline const std::vector<Cycle> &getWorst() const { return c_worst; };
+    bool isAlerting(time_t _now) const;
+    inline const std::string &getAlert() const { return c_alert; };
+
+    // the counters, the timings and the alert, for getLoop
+    void toJSON(Json::Value &_out, time_t _now) const;
+    // only the alert, the loop section of getState
+    void alertToJSON(Json::Value &_out, time_t _now) const;
+
+    static const char *phaseName(Phase _phase);
+
+  private:
+    // checks a cycle against the budgets, the reason or empty
+    std::string check(const Cycle &_cycle) const;
+    bool raise(time_t _now, const std::string &_reason);
+
+  private:
+    uint32_t c_period;
+    uint32_t c_maxworst;
+    Budget c_budget;
+    uint64_t c_cycles;
+    uint64_t c_overruns;
+    uint64_t c_missed;
+    Cycle c_current, c_last;
+    std::vector<Cycle> c_worst;
+    std::chrono::steady_clock::time_point c_lapstart, c_cyclestart;
+    // the last alert and when it was raised
+    std::string c_alert;
+    time_t c_alerttime;
+    Metrics::Histogram *c_m_phases[c_nphases];
+    Metrics::Histogram &c_m_cycle;
+    Metrics::Counter &c_m_overruns, &c_m_missed;
+  };
+}
+
+#endif
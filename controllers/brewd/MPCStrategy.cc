@@ -0,0 +1,270 @@
+
+#include "MPCStrategy.hh"
+
+#include <algorithm>
+
+#include "Exception.hh"
+
+namespace aegir {
+
+  // the least amount of samples to fit the model on
+  static constexpr std::size_t c_minsamples = 60;
+  // the least variance of the on-ratio that's considered excitation
+  static constexpr double c_minexcitation = 1e-3;
+  // the bias is the mean prediction error of this many samples
+  static constexpr std::size_t c_biassamples = 15;
+  // cost weights, relative to the squared tracking error
+  static constexpr float c_wovershoot = 4.0f;
+  static constexpr float c_wrims = 50.0f;
+  static constexpr float c_wenergy = 0.005f;
+
+  MPCStrategy::MPCStrategy(): c_bias(0), c_log("MPCStrategy") {
+    c_model.fitted = false;
+  }
+
+  MPCStrategy::~MPCStrategy() {
+  }
+
+  void MPCStrategy::reset() {
+    c_model.fitted = false;
+    c_bias = 0;
+  }
+
+  void MPCStrategy::restart() {
+    // the plant doesn't change between the stages
+  }
+
+  ControlStrategy::Decision MPCStrategy::control(const Plant &_plant, float _target, float _overheat) {
+    if ( !resample(_plant) ) return {0, 3};
+    if ( c_mt.back() == 0.0f || c_rims.back() == 0.0f ) return {0, 3};
+
+    fit();
+    if ( !c_model.fitted ) defaultModel(_plant);
+    updateBias();
+
+    // coarse search on both blocks of the on-ratio
+    float best = INFINITY, u1 = 0, u2 = 0;
+    for (int i=0; i<=20; ++i) {
+      for (int j=0; j<=20; ++j) {
+	float c = cost(i*0.05f, j*0.05f, _target, _overheat);
+	if ( c < best ) {
+	  best = c;
+	  u1 = i*0.05f;
+	  u2 = j*0.05f;
+	}
+      }
+    }
+
+    // then refine around the best one
+    float cu1 = u1, cu2 = u2;
+    for (int i=-5; i<=5; ++i) {
+      for (int j=-5; j<=5; ++j) {
+	float t1 = cu1 + i*0.01f, t2 = cu2 + j*0.01f;
+	if ( t1 < 0 || t1 > 1 || t2 < 0 || t2 > 1 ) continue;
+	float c = cost(t1, t2, _target, _overheat);
+	if ( c < best ) {
+	  best = c;
+	  u1 = t1;
+	  u2 = t2;
+	}
+      }
+    }
+
+    AEGIR_LOG_DEBUG(c_log, "MPCStrategy::control(%.2f, %.2f): MT:%.2f RIMS:%.2f R:%.3f/%.3f tau:%.1f K:%.2f d:%u g:%.5f l:%.6f bias:%.4f %s",
+		    _target, _overheat, c_mt.back(), c_rims.back(), u1, u2,
+		    c_model.getTau(), c_model.getGain(), c_model.getDeadTime(),
+		    c_model.g, c_model.l, c_bias,
+		    c_model.fitted ? "fitted" : "default");
+
+    return {u1, c_controlival};
+  }
+
+  /*
+   * Until there's enough data to fit, we're using a conservative guess:
+   * 30s time constant, 12C/full power for the tube with 6s dead time,
+   * and the mash tun taking all the power. The tube's gain comes from the
+   * identified power and flow rate when they're known.
+   */
+  void MPCStrategy::defaultModel(const Plant &_plant) {
+    float volume = std::max(_plant.getVolume(), 5.0f);
+    float gain = 12.0f;
+    auto &est = _plant.getEstimates();
+
+    if ( est.valid )
+      gain = std::clamp(est.hepower / (4.2f * est.flow), 2.0f, 30.0f);
+
+    c_model.a = std::exp(-1.0f*c_sampletime / 30.0f);
+    c_model.b = gain * (1 - c_model.a);
+    c_model.deadtime = 6 / c_sampletime;
+    c_model.g = (_plant.getHEPower() * c_sampletime) / (4.2f * volume * gain);
+    c_model.l = 1e-4f * c_sampletime;
+    c_model.fitted = false;
+  }
+
+  bool MPCStrategy::resample(const Plant &_plant) {
+    const TSDB &db(_plant.getReadings());
+    const HERatioDB &heratios(_plant.getHERatios());
+    uint32_t size = db.size();
+
+    c_mt.clear();
+    c_rims.clear();
+    c_u.clear();
+
+    if ( size < 2 ) return false;
+
+    // the last entries of the TSDB, from() leaves out the last one
+    uint32_t n = std::min(size, c_fitwindow + c_maxdeadtime);
+    c_entries.resize(n);
+    n = db.from(size - n, c_entries.data(), n);
+    c_entries.resize(n);
+    c_entries.push_back(db.last());
+
+    // resample them to c_sampletime, with the on-ratio that was in effect
+    time_t tfirst = c_entries.front().time;
+    time_t tlast = c_entries.back().time;
+    uint32_t nsamples = (tlast - tfirst) / c_sampletime + 1;
+    std::size_t e = 0;
+
+    for (uint32_t k=0; k < nsamples; ++k) {
+      time_t t = tlast - (nsamples - 1 - k) * c_sampletime;
+
+      while ( e+1 < c_entries.size() && c_entries[e+1].time <= t ) ++e;
+      c_mt.push_back(c_entries[e][ThermoCouple::MT]);
+      c_rims.push_back(c_entries[e][ThermoCouple::RIMS]);
+      c_u.push_back(heratios.ratioAt(t));
+    }
+
+    return true;
+  }
+
+  void MPCStrategy::fit() {
+    std::size_t n = c_mt.size();
+
+    if ( n < c_minsamples ) return;
+
+    // without excitation there's nothing to learn, keep the last model
+    double umean = 0, uvar = 0;
+    for (auto u: c_u) umean += u;
+    umean /= n;
+    for (auto u: c_u) uvar += (u - umean) * (u - umean);
+    uvar /= n;
+    if ( uvar < c_minexcitation ) return;
+
+    // the RIMS tube, with every dead time
+    Model model;
+    double bestsse = INFINITY;
+    for (uint32_t d=0; d <= c_maxdeadtime / c_sampletime; ++d) {
+      double sxx(0), sxu(0), suu(0), sxy(0), suy(0), syy(0);
+      std::size_t cnt = 0;
+
+      for (std::size_t k=d; k+1 < n; ++k) {
+	double x = c_rims[k] - c_mt[k];
+	double y = c_rims[k+1] - c_mt[k+1];
+	double u = c_u[k-d];
+
+	sxx += x*x;
+	sxu += x*u;
+	suu += u*u;
+	sxy += x*y;
+	suy += u*y;
+	syy += y*y;
+	++cnt;
+      }
+
+      double det = sxx*suu - sxu*sxu;
+      if ( cnt < c_minsamples || std::fabs(det) < 1e-9 ) continue;
+
+      double a = (sxy*suu - suy*sxu) / det;
+      double b = (suy*sxx - sxy*sxu) / det;
+      if ( a <= 0 || a >= 1 || b <= 0 ) continue;
+
+      double sse = (syy - 2*a*sxy - 2*b*suy + a*a*sxx + 2*a*b*sxu + b*b*suu) / cnt;
+      if ( sse < bestsse ) {
+	bestsse = sse;
+	model.a = a;
+	model.b = b;
+	model.deadtime = d;
+      }
+    }
+    if ( bestsse == INFINITY ) return;
+
+    // the mash tun
+    double sff(0), sfl(0), sll(0), sfy(0), sly(0);
+    for (std::size_t k=0; k+1 < n; ++k) {
+      double f = c_rims[k] - c_mt[k];
+      double l = -(c_mt[k] - c_ambient);
+      double y = c_mt[k+1] - c_mt[k];
+
+      sff += f*f;
+      sfl += f*l;
+      sll += l*l;
+      sfy += f*y;
+      sly += l*y;
+    }
+
+    double det = sff*sll - sfl*sfl;
+    double g(0), l(0);
+    if ( std::fabs(det) > 1e-9 ) {
+      g = (sfy*sll - sly*sfl) / det;
+      l = (sly*sff - sfy*sfl) / det;
+    }
+    // the mash tun can't gain heat from the environment
+    if ( l < 0 && sff > 0 ) {
+      l = 0;
+      g = sfy / sff;
+    }
+    if ( g <= 0 ) return;
+
+    model.g = g;
+    model.l = l;
+    model.fitted = true;
+    c_model = model;
+  }
+
+  void MPCStrategy::updateBias() {
+    std::size_t n = c_mt.size();
+    std::size_t cnt = 0;
+    double sum = 0;
+
+    for (std::size_t k = n > c_biassamples ? n - c_biassamples - 1 : 0; k+1 < n; ++k) {
+      float predicted = c_mt[k] + c_model.g * (c_rims[k] - c_mt[k])
+	- c_model.l * (c_mt[k] - c_ambient);
+      sum += c_mt[k+1] - predicted;
+      ++cnt;
+    }
+
+    c_bias = cnt ? sum / cnt : 0;
+  }
+
+  float MPCStrategy::cost(float _u1, float _u2, float _target, float _overheat) const {
+    const std::size_t now = c_mt.size() - 1;
+    const uint32_t steps = c_horizon / c_sampletime;
+    const uint32_t firstblock = c_controlival / c_sampletime;
+    float mt = c_mt.back();
+    float x = c_rims.back() - mt;
+    float cost = 0;
+
+    for (uint32_t i=0; i < steps; ++i) {
+      float ucand = i < firstblock ? _u1 : _u2;
+      // the on-ratio reaching the tube now, set dead time ago
+      long j = (long)(now + i) - c_model.deadtime;
+      float u;
+      if ( j < (long)now ) u = c_u[std::max(j, 0l)];
+      else u = (j - (long)now) < firstblock ? _u1 : _u2;
+
+      float mtnext = mt + c_model.g * x - c_model.l * (mt - c_ambient) + c_bias;
+      x = c_model.a * x + c_model.b * u;
+      mt = mtnext;
+
+      float e = mt - _target;
+      cost += e > 0 ? c_wovershoot * e * e : e * e;
+
+      float over = mt + x - (_target + _overheat);
+      if ( over > 0 ) cost += c_wrims * over * over;
+
+      cost += c_wenergy * ucand;
+    }
+
+    return cost;
+  }
+}
@@ -0,0 +1,85 @@
+/*
+ * Model predictive temperature control
+ * The RIMS tube is modeled as first-order-plus-dead-time from the heating
+ * element's on-ratio to its temperature over the mash tun's, and the mash tun
+ * as a first-order lag heated by the RIMS tube's output:
+ *   x[k+1]    = a * x[k] + b * u[k-d]                  x = T_rims - T_mt
+ *   T_mt[k+1] = T_mt[k] + g * x[k] - l * (T_mt[k] - T_ambient) + bias
+ * The parameters are fitted online with least squares on the resampled TSDB
+ * and the on-ratio history, the dead time is the best fitting one. The bias
+ * is the recent prediction error, so model mismatch does not leave an offset.
+ * On every control cycle the on-ratio for the next cycle and the one after it
+ * are chosen by minimizing the predicted tracking error over the horizon,
+ * with overshoot, RIMS tube overheating and energy use penalized.
+ */
+
+#ifndef AEGIR_MPCSTRATEGY_H
+#define AEGIR_MPCSTRATEGY_H
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "ControlStrategy.hh"
+#include "LogChannel.hh"
+
+namespace aegir {
+
+  class MPCStrategy: public ControlStrategy {
+  public:
+    // model sample time, secs
+    static constexpr uint32_t c_sampletime = 2;
+    // the model is fitted on this much data, secs
+    static constexpr uint32_t c_fitwindow = 900;
+    // the longest dead time we're looking for, secs
+    static constexpr uint32_t c_maxdeadtime = 30;
+    // the prediction horizon, secs
+    static constexpr uint32_t c_horizon = 600;
+    // the control interval, secs
+    static constexpr int c_controlival = 10;
+    static constexpr float c_ambient = 20.0f;
+
+    struct Model {
+      float a, b;
+      // in samples
+      uint32_t deadtime;
+      float g, l;
+      // whether it's fitted or the default one
+      bool fitted;
+
+      // the RIMS tube's FOPDT parameters
+      inline float getTau() const { return -1.0f*c_sampletime / std::log(a); };
+      inline float getGain() const { return b / (1 - a); };
+      inline uint32_t getDeadTime() const { return deadtime * c_sampletime; };
+    };
+
+  public:
+    MPCStrategy();
+    virtual ~MPCStrategy();
+
+    virtual const char *getName() const override { return "mpc"; };
+    virtual void reset() override;
+    virtual void restart() override;
+    virtual Decision control(const Plant &_plant, float _target, float _overheat) override;
+
+    inline const Model &getModel() const { return c_model; };
+    inline float getBias() const { return c_bias; };
+
+  private:
+    void defaultModel(const Plant &_plant);
+    bool resample(const Plant &_plant);
+    void fit();
+    void updateBias();
+    float cost(float _u1, float _u2, float _target, float _overheat) const;
+
+  private:
+    std::vector<TSDB::entry> c_entries;
+    // the resampled mash tun and RIMS temperatures and on-ratios
+    std::vector<float> c_mt, c_rims, c_u;
+    Model c_model;
+    float c_bias;
+    LogChannel c_log;
+  };
+}
+
+#endif
@@ -0,0 +1,126 @@
+
+#include "MashPlanner.hh"
+
+#include <cmath>
+#include <algorithm>
+
+namespace aegir {
+
+  MashPlanner::MashPlanner(): c_accuracy(0.3f), c_ramprate(0), c_grace(0), c_lag(0),
+			      c_nlags(0), c_nramps(0), c_lastupdate(0),
+			      c_lagmeasured(false) {
+  }
+
+  MashPlanner::~MashPlanner() {
+  }
+
+  void MashPlanner::reset(const Program::MashSteps &_steps, float _accuracy,
+			  float _ramprate, uint32_t _grace, time_t _now) {
+    c_steps = _steps;
+    c_accuracy = _accuracy;
+    c_ramprate = _ramprate;
+    c_grace = _grace;
+    c_lag = 0;
+    c_nlags = c_nramps = 0;
+    c_lastupdate = _now;
+    c_lagmeasured = false;
+
+    // the program's schedule: the holds and the ramps in between
+    c_reports.clear();
+    time_t planned = _now;
+    for (std::size_t i=0; i < c_steps.size(); ++i) {
+      const Program::MashStep &ms(c_steps[i]);
+
+      if ( i > 0 && c_ramprate > 0 )
+	planned += std::lround(std::fabs(ms.temp - c_steps[i-1].temp) / c_ramprate);
+      c_reports.push_back({ms.orderno, ms.temp, ms.holdtime*60u, planned, 0, 0, 0, 0, false});
+      planned += ms.holdtime*60;
+    }
+  }
+
+  void MashPlanner::stepReached(int _step, time_t _now) {
+    if ( _step < 0 || _step >= (int)c_reports.size() ) return;
+
+    StepReport &r(c_reports[_step]);
+    if ( r.reached ) return;
+
+    r.reached = _now;
+    c_lastupdate = _now;
+    c_lagmeasured = false;
+
+    // the realised ramp rate, lag included
+    if ( _step > 0 && c_reports[_step-1].rampstart ) {
+      float dT = r.temp - c_reports[_step-1].temp;
+      time_t took = _now - c_reports[_step-1].rampstart;
+
+      if ( dT > 0 && took > 0 ) {
+	float rate = dT / took;
+	c_ramprate = c_nramps ? (c_ramprate * c_nramps + rate) / (c_nramps + 1) : rate;
+	++c_nramps;
+      }
+    }
+  }
+
+  bool MashPlanner::update(int _step, time_t _now, float _mt) {
+    if ( _step < 0 || _step >= (int)c_reports.size() ) return false;
+
+    StepReport &r(c_reports[_step]);
+    if ( !r.reached ) stepReached(_step, _now);
+
+    uint32_t dt = _now - c_lastupdate;
+    bool ramping = r.rampstart != 0;
+    c_lastupdate = _now;
+
+    // only the time at the step's temperature counts, and while heating
+    // towards the next one, only until the MT leaves it
+    if ( _mt >= r.temp - c_accuracy && (!ramping || _mt <= r.temp + c_accuracy) )
+      r.held += dt;
+    r.adherence = r.holdtime ? std::min(1.0f, (1.0f*r.held) / r.holdtime) : 1.0f;
+
+    // the response lag, the MT leaving the step's temperature
+    if ( ramping && !c_lagmeasured && _mt > r.temp + c_accuracy ) {
+      uint32_t lag = _now - r.rampstart;
+      c_lag = c_nlags ? (c_lag * c_nlags + lag) / (c_nlags + 1) : lag;
+      ++c_nlags;
+      c_lagmeasured = true;
+    }
+
+    if ( ramping ) return true;
+
+    if ( r.held + leadTime(_step) >= r.holdtime ) {
+      r.rampstart = _now;
+      return true;
+    }
+    // the mash might settle just below the temperature, the process
+    // isn't stalled by it
+    if ( _now - r.reached >= (time_t)(r.holdtime + c_grace) ) {
+      r.capped = true;
+      r.rampstart = _now;
+      return true;
+    }
+    return false;
+  }
+
+  uint32_t MashPlanner::leadTime(int _step) const {
+    // the last step is followed by the mash-out, it's not a step up
+    if ( _step+1 >= (int)c_steps.size() ) return 0;
+    if ( c_steps[_step+1].temp <= c_steps[_step].temp ) return 0;
+    if ( !c_nlags ) return 0;
+
+    return std::min<uint32_t>(c_lag, c_maxleadratio * c_reports[_step].holdtime);
+  }
+
+  int32_t MashPlanner::getDelay(time_t _now) const {
+    int32_t delay = 0;
+
+    for (auto &r: c_reports) {
+      if ( r.reached ) {
+	delay = r.reached - r.planned;
+      } else {
+	if ( _now > r.planned ) delay = std::max<int32_t>(delay, _now - r.planned);
+	break;
+      }
+    }
+    return delay;
+  }
+}
@@ -0,0 +1,94 @@
+/*
+ * Mash step scheduling
+ * The hold time of a step is only counted while the mash is at the step's
+ * temperature, so a drop (e.g. after dough-in) extends the hold instead of
+ * shortening the rest. The heating towards the next step starts early by the
+ * response lag of the system: the time the MT stays at the current step's
+ * temperature after the target is raised. The lag is learned on every step
+ * transition, so the first one isn't started early. The ramp rate is learned
+ * on every ramp, and the program's schedule is planned with the expected one,
+ * so every step's delay and adherence can be reported.
+ * The hold isn't waited for forever: a mash settling just below a step's
+ * temperature moves on after the hold time and a grace period on the wall
+ * clock, and the step is reported as capped.
+ */
+
+#ifndef AEGIR_MASHPLANNER_H
+#define AEGIR_MASHPLANNER_H
+
+#include <time.h>
+#include <cstdint>
+#include <vector>
+
+#include "Program.hh"
+
+namespace aegir {
+
+  class MashPlanner {
+    MashPlanner(MashPlanner&&) = delete;
+    MashPlanner(const MashPlanner &) = delete;
+    MashPlanner &operator=(MashPlanner &&) = delete;
+    MashPlanner &operator=(const MashPlanner &) = delete;
+  public:
+    struct StepReport {
+      uint32_t orderno;
+      float temp;
+      // the program's hold time, secs
+      uint32_t holdtime;
+      // when the step should have been reached by the plan, and when it
+      // was, 0 if not yet
+      time_t planned;
+      time_t reached;
+      // the time spent at the step's temperature, secs
+      uint32_t held;
+      // when the heating towards the next step started, 0 if not yet
+      time_t rampstart;
+      // held / holdtime, at most 1
+      float adherence;
+      // ended by the grace period, not by the hold
+      bool capped;
+    };
+
+    // the early start is at most this part of the hold time
+    static constexpr float c_maxleadratio = 0.25f;
+
+  public:
+    MashPlanner();
+    ~MashPlanner();
+
+    // a new mash starting at _now, _ramprate is the expected ramp rate in
+    // C/s, a step ends at most _grace secs after its hold time on the wall clock
+    void reset(const Program::MashSteps &_steps, float _accuracy, float _ramprate,
+	       uint32_t _grace, time_t _now);
+    // the step's temperature is reached, its hold starts
+    void stepReached(int _step, time_t _now);
+    // processes a reading while holding _step, returns whether it's time
+    // to heat towards the next step
+    bool update(int _step, time_t _now, float _mt);
+
+    inline float getRampRate() const { return c_ramprate; };
+    // the response lag, secs, 0 until it's measured
+    inline uint32_t getLag() const { return c_lag; };
+    inline const std::vector<StepReport> &getReports() const { return c_reports; };
+    // how far behind the program the schedule is, secs
+    int32_t getDelay(time_t _now) const;
+
+  private:
+    uint32_t leadTime(int _step) const;
+
+  private:
+    Program::MashSteps c_steps;
+    std::vector<StepReport> c_reports;
+    float c_accuracy;
+    float c_ramprate;
+    uint32_t c_grace;
+    uint32_t c_lag;
+    // the number of the measured lags and ramps
+    uint32_t c_nlags, c_nramps;
+    // the current step's bookkeeping
+    time_t c_lastupdate;
+    bool c_lagmeasured;
+  };
+}
+
+#endif
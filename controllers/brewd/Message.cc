@@ -2,6 +2,7 @@
 #include "Message.hh"
 
 #include <string.h>
+#include <cstring>
 #include <stdio.h>
 
 #include <algorithm>
@@ -79,8 +80,9 @@ namespace aegir {
    * State: 1 byte
    * cycletime: 4 bytes (sizeof float)
    * onratio: 4 bytes (sizeof float)
+   * acquired: 8 bytes, uint64_t, only when it's known
    */
-  PinStateMessage::PinStateMessage(const msgstring &_msg) {
+  PinStateMessage::PinStateMessage(const msgstring &_msg): c_acquired(0) {
 #ifdef AEGIR_DEBUG
     printf("PinStateMessage(L:%lu '%s') called: ", _msg.length(), hexdump(_msg).c_str());
 #endif
@@ -98,14 +100,19 @@ namespace aegir {
     offset += 4;
 
     c_onratio = *((float*)((char*)_msg.data()+offset));
+    offset += 4;
+
+    if ( (uint32_t)msglen >= offset + sizeof(c_acquired) )
+      std::memcpy(&c_acquired, _msg.data()+offset, sizeof(c_acquired));
 #ifdef AEGIR_DEBUG
     printf(" name:'%s' state:%hhu CT:%.3f OR:%.3f\n", c_name.c_str(), (uint8_t)c_state,
 	   c_cycletime, c_onratio);
 #endif
   }
 
-  PinStateMessage::PinStateMessage(const std::string &_name, PINState _state, float _cycletime, float _onratio):
-    c_name(_name), c_state(_state), c_cycletime(_cycletime), c_onratio(_onratio) {
+  PinStateMessage::PinStateMessage(const std::string &_name, PINState _state, float _cycletime, float _onratio,
+				   uint64_t _acquired):
+    c_name(_name), c_state(_state), c_cycletime(_cycletime), c_onratio(_onratio), c_acquired(_acquired) {
 #ifdef AEGIR_DEBUG
     printf("PinStateMessage('%s', %hhu, %.3f, %.3f) called: ", _name.c_str(), (uint8_t)_state,
 	   _cycletime, _onratio);
@@ -129,7 +136,7 @@ namespace aegir {
 
   msgstring PinStateMessage::serialize() const {
     uint8_t strsize(std::min((uint32_t)c_name.length(), (uint32_t)255));
-    uint32_t len(3+8+strsize);
+    uint32_t len(3+8+strsize + (c_acquired ? sizeof(c_acquired) : 0));
 
     msgstring buffer(len, 0);
     uint8_t *data = (uint8_t*)buffer.c_str();
@@ -146,6 +153,11 @@ namespace aegir {
     offset += 4;
     *(float*)(data+offset) = c_onratio;
 
+    if ( c_acquired ) {
+      offset += 4;
+      std::memcpy(data+offset, &c_acquired, sizeof(c_acquired));
+    }
+
     return buffer;
   }
 
@@ -161,25 +173,37 @@ namespace aegir {
    * ThermoReadingMessage
    * Format is:
    * MessageType: 1 byte
-   * Name: 1) stringsize: 1 byte + 2) stringsize-bytes
-   * Temp: sizeof(float)
+   * Count: 1 byte
+   * Temps: Count * sizeof(float)
    * Timestamp: 4 byte, uint32_t
+   * Acquired: 8 byte, uint64_t, only when it's known
    */
-  ThermoReadingMessage::ThermoReadingMessage(const msgstring &_msg) {
+  ThermoReadingMessage::ThermoReadingMessage(const msgstring &_msg): c_acquired(0) {
 #ifdef AEGIR_DEBUG
     printf("ThermoReadingMessage(L:%lu '%s') called\n", _msg.length(), hexdump(_msg).c_str());
 #endif
     // _msg[0] is the type, but we're already here
     int msglen = _msg.length();
     uint8_t *data = (uint8_t*)_msg.data();
-    int offset = 1;
+    if ( msglen < 2 )
+      throw Exception("ThermoReadingMessage too short: %i", msglen);
 
-    for (int i=0; i<ThermoCouple::_SIZE; ++i) {
-      c_data.data[i] = *(float*)(data+offset);
-      offset += sizeof(float);
-    }
+    c_data.size = data[1];
+    int baselen = 2 + c_data.size * sizeof(float) + sizeof(c_timestamp);
+    if ( c_data.size > ThermoCouple::_MAX ||
+	 (msglen != baselen && msglen != baselen + (int)sizeof(c_acquired)) )
+      throw Exception("ThermoReadingMessage with %i sensors has wrong length: %i",
+		      c_data.size, msglen);
+
+    int offset = 2;
+    std::memcpy(c_data.data, data+offset, c_data.size * sizeof(float));
+    offset += c_data.size * sizeof(float);
 
     c_timestamp = *(uint32_t*)(data+offset);
+    offset += sizeof(c_timestamp);
+
+    if ( msglen > baselen )
+      std::memcpy(&c_acquired, data+offset, sizeof(c_acquired));
 
 #ifdef AEGIR_DEBUG
     printf("ThermoReadingMessage(L:%lu '%s') decoded: Name:'%s' Temp:%.2f Time:%u\n", _msg.length(), hexdump(_msg).c_str(),
@@ -187,27 +211,31 @@ namespace aegir {
 #endif
   }
 
-  ThermoReadingMessage::ThermoReadingMessage(const ThermoReadings &_data, uint32_t _timestamp):
-    c_data(_data), c_timestamp(_timestamp) {
+  ThermoReadingMessage::ThermoReadingMessage(const ThermoReadings &_data, uint32_t _timestamp, uint64_t _acquired):
+    c_data(_data), c_timestamp(_timestamp), c_acquired(_acquired) {
   }
 
   ThermoReadingMessage::~ThermoReadingMessage() = default;
 
   msgstring ThermoReadingMessage::serialize() const {
-    uint32_t len = 2 + sizeof(c_data) + sizeof(c_timestamp);
+    uint32_t len = 2 + c_data.size * sizeof(float) + sizeof(c_timestamp)
+      + (c_acquired ? sizeof(c_acquired) : 0);
 
     msgstring buffer(len, 0);
     uint8_t *data = (uint8_t*)buffer.data();
     data[0] = (uint8_t)type();
+    data[1] = c_data.size;
 
-    int offset = 1;
-    for (int i=0; i<ThermoCouple::_SIZE; ++i) {
-      *(float*)(data+offset) = c_data.data[i];
-      offset += sizeof(float);
-    }
+    int offset = 2;
+    std::memcpy(data+offset, c_data.data, c_data.size * sizeof(float));
+    offset += c_data.size * sizeof(float);
 
     // c_timestamp is uint32_t
     *(uint32_t*)(data+offset) = c_timestamp;
+    offset += sizeof(c_timestamp);
+
+    if ( c_acquired )
+      std::memcpy(data+offset, &c_acquired, sizeof(c_acquired));
 
     return buffer;
   }
@@ -72,7 +72,8 @@ namespace aegir {
   public:
     PinStateMessage() = delete;
     PinStateMessage(const msgstring &_msg);
-    PinStateMessage(const std::string &_name, PINState _state, float _cycletime=3.0f, float _onratio=0.2f);
+    PinStateMessage(const std::string &_name, PINState _state, float _cycletime=3.0f, float _onratio=0.2f,
+		    uint64_t _acquired=0);
     virtual msgstring serialize() const override;
     virtual MessageType type() const override;
     inline const std::string &getName() const {return c_name;};
@@ -81,6 +82,8 @@ namespace aegir {
     inline bool isOff() const {return c_state==PINState::Off; };
     inline float getCycletime() const { return c_cycletime; };
     inline float getOnratio() const { return c_onratio; };
+    // the monotonic usecs of the input the change was decided on, 0 if unknown
+    inline uint64_t getAcquired() const { return c_acquired; };
     virtual ~PinStateMessage();
 
     static std::shared_ptr<Message> create(const msgstring &_msg);
@@ -90,6 +93,7 @@ namespace aegir {
     PINState c_state;
     float c_cycletime;
     float c_onratio;
+    uint64_t c_acquired;
   };
 
   // Thermocouple reading results
@@ -97,11 +101,13 @@ namespace aegir {
   public:
     ThermoReadingMessage() = delete;
     ThermoReadingMessage(const msgstring &_msg);
-    ThermoReadingMessage(const ThermoReadings &_data, uint32_t _timestamp);
+    ThermoReadingMessage(const ThermoReadings &_data, uint32_t _timestamp, uint64_t _acquired=0);
     virtual msgstring serialize() const override;
     virtual MessageType type() const override;
     inline const ThermoReadings& getTemps() const {return c_data;};
     inline uint32_t getTimestamp() const {return c_timestamp;};
+    // the monotonic usecs of the SPI read, 0 if unknown
+    inline uint64_t getAcquired() const { return c_acquired; };
     virtual ~ThermoReadingMessage();
 
     static std::shared_ptr<Message> create(const msgstring &_msg);
@@ -109,6 +115,7 @@ namespace aegir {
   public:
     ThermoReadings c_data;
     uint32_t c_timestamp;
+    uint64_t c_acquired;
   };
 }
 
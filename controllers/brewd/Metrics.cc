@@ -0,0 +1,206 @@
+#include "Metrics.hh"
+
+#include <cstdio>
+#include <cmath>
+#include <algorithm>
+
+#include "Exception.hh"
+
+namespace aegir {
+
+  static const char *typeName(Metrics::Type _type) {
+    switch (_type) {
+    case Metrics::Type::Counter: return "counter";
+    case Metrics::Type::Gauge: return "gauge";
+    case Metrics::Type::Histogram: return "histogram";
+    }
+    return "untyped";
+  }
+
+  // name{labels} value
+  static void sample(std::string &_out, const std::string &_name, const char *_suffix,
+		     const std::string &_labels, const char *_extra, const char *_value) {
+    _out += _name;
+    _out += _suffix;
+    if ( !_labels.empty() || *_extra ) {
+      _out += '{';
+      _out += _labels;
+      if ( !_labels.empty() && *_extra ) _out += ',';
+      _out += _extra;
+      _out += '}';
+    }
+    _out += ' ';
+    _out += _value;
+    _out += '\n';
+  }
+
+  /*
+   * Counter
+   */
+  void Metrics::Counter::toJSON(Json::Value &_out) const {
+    _out = Json::Value::UInt64(get());
+  }
+
+  void Metrics::Counter::expose(std::string &_out, const std::string &_name,
+				const std::string &_labels) const {
+    sample(_out, _name, "", _labels, "", std::to_string(get()).c_str());
+  }
+
+  /*
+   * Gauge
+   */
+  void Metrics::Gauge::toJSON(Json::Value &_out) const {
+    _out = get();
+  }
+
+  void Metrics::Gauge::expose(std::string &_out, const std::string &_name,
+			      const std::string &_labels) const {
+    char buff[32];
+
+    std::snprintf(buff, sizeof(buff), "%.9g", get());
+    sample(_out, _name, "", _labels, "", buff);
+  }
+
+  /*
+   * Histogram
+   */
+  Metrics::Histogram::Histogram(): c_count(0), c_sum(0), c_max(0) {
+    for (auto &it: c_buckets) it = 0;
+  }
+
+  uint64_t Metrics::Histogram::lowerBound(uint32_t _bucket) {
+    if ( _bucket < (1u << c_subbits) ) return _bucket;
+
+    uint32_t msb = (_bucket >> c_subbits) + c_subbits - 1;
+    return (uint64_t)((1u << c_subbits) + (_bucket & ((1u << c_subbits) - 1))) << (msb - c_subbits);
+  }
+
+  uint64_t Metrics::Histogram::quantile(double _q) const {
+    uint64_t total = count();
+    if ( !total ) return 0;
+
+    uint64_t rank = std::max<uint64_t>(1, std::ceil(_q * total));
+    uint64_t seen = 0;
+    for (uint32_t i=0; i < c_nbuckets; ++i) {
+      seen += c_buckets[i].load(std::memory_order_relaxed);
+      if ( seen >= rank )
+	return std::min(lowerBound(i+1) - 1, max());
+    }
+    return max();
+  }
+
+  uint64_t Metrics::Histogram::countBelow(uint64_t _usecs) const {
+    uint32_t last = bucket(_usecs);
+    uint64_t n = 0;
+
+    // the buckets completely below
+    for (uint32_t i=0; i < last; ++i)
+      n += c_buckets[i].load(std::memory_order_relaxed);
+    return n;
+  }
+
+  void Metrics::Histogram::toJSON(Json::Value &_out) const {
+    _out["count"] = Json::Value::UInt64(count());
+    _out["sum"] = Json::Value::UInt64(sum());
+    _out["max"] = Json::Value::UInt64(max());
+    _out["p50"] = Json::Value::UInt64(quantile(0.5));
+    _out["p90"] = Json::Value::UInt64(quantile(0.9));
+    _out["p99"] = Json::Value::UInt64(quantile(0.99));
+  }
+
+  void Metrics::Histogram::expose(std::string &_out, const std::string &_name,
+				  const std::string &_labels) const {
+    char le[32], value[32];
+
+    // the exposed buckets are the powers of 2 of usecs, from 16us
+    uint64_t top = max();
+    for (uint32_t bits = 4; bits < c_maxbits; ++bits) {
+      uint64_t bound = 1ull << bits;
+      std::snprintf(le, sizeof(le), "le=\"%.9g\"", bound / 1e6);
+      sample(_out, _name, "_bucket", _labels, le, std::to_string(countBelow(bound)).c_str());
+      if ( bound > top ) break;
+    }
+    sample(_out, _name, "_bucket", _labels, "le=\"+Inf\"", std::to_string(count()).c_str());
+    std::snprintf(value, sizeof(value), "%.9g", sum() / 1e6);
+    sample(_out, _name, "_sum", _labels, "", value);
+    sample(_out, _name, "_count", _labels, "", std::to_string(count()).c_str());
+  }
+
+  /*
+   * Metrics
+   */
+  Metrics::Metrics() {
+  }
+
+  Metrics::~Metrics() {
+  }
+
+  Metrics &Metrics::getInstance() {
+    // never destroyed, the threads might update their metrics during the exit
+    static Metrics *instance = new Metrics();
+    return *instance;
+  }
+
+  Metrics::Metric &Metrics::get(const std::string &_name, Type _type, const std::string &_help,
+				const std::string &_labels) {
+    std::lock_guard<std::mutex> g(c_mtx);
+
+    auto fit = c_families.find(_name);
+    if ( fit == c_families.end() ) {
+      fit = c_families.emplace(_name, Family{_type, _help, {}}).first;
+    } else if ( fit->second.type != _type ) {
+      throw Exception("Metric %s is already registered as a %s", _name.c_str(),
+		      typeName(fit->second.type));
+    }
+
+    auto &metric = fit->second.metrics[_labels];
+    if ( !metric ) {
+      switch (_type) {
+      case Type::Counter: metric = std::make_unique<Counter>(); break;
+      case Type::Gauge: metric = std::make_unique<Gauge>(); break;
+      case Type::Histogram: metric = std::make_unique<Histogram>(); break;
+      }
+    }
+    return *metric;
+  }
+
+  Metrics::Counter &Metrics::counter(const std::string &_name, const std::string &_help,
+				     const std::string &_labels) {
+    return static_cast<Counter&>(get(_name, Type::Counter, _help, _labels));
+  }
+
+  Metrics::Gauge &Metrics::gauge(const std::string &_name, const std::string &_help,
+				 const std::string &_labels) {
+    return static_cast<Gauge&>(get(_name, Type::Gauge, _help, _labels));
+  }
+
+  Metrics::Histogram &Metrics::histogram(const std::string &_name, const std::string &_help,
+					 const std::string &_labels) {
+    return static_cast<Histogram&>(get(_name, Type::Histogram, _help, _labels));
+  }
+
+  void Metrics::toJSON(Json::Value &_out) const {
+    std::lock_guard<std::mutex> g(c_mtx);
+
+    _out = Json::Value(Json::ValueType::objectValue);
+    for (auto &[name, family]: c_families) {
+      Json::Value &fam = _out[name];
+      fam["type"] = typeName(family.type);
+      fam["help"] = family.help;
+      Json::Value &values = (fam["values"] = Json::Value(Json::ValueType::objectValue));
+      for (auto &[labels, metric]: family.metrics)
+	metric->toJSON(values[labels]);
+    }
+  }
+
+  void Metrics::expose(std::string &_out) const {
+    std::lock_guard<std::mutex> g(c_mtx);
+
+    for (auto &[name, family]: c_families) {
+      _out += "# HELP " + name + " " + family.help + "\n";
+      _out += "# TYPE " + name + " " + typeName(family.type) + "\n";
+      for (auto &[labels, metric]: family.metrics)
+	metric->expose(_out, name, labels);
+    }
+  }
+}
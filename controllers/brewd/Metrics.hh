@@ -0,0 +1,177 @@
+/*
+ * Runtime metrics
+ * The counters, gauges and latency histograms are registered once, and
+ * their handles are kept by the instrumented code, so the updates are
+ * plain relaxed atomics without any locking or lookup. A thread usually
+ * keeps its own metrics, e.g. the per-command latencies are cached by
+ * every PR worker.
+ * The histograms are HDR-style: every power of 2 of microseconds is split
+ * into 8 linear buckets, so the quantiles are within 12.5% from 1us up to
+ * about 12 days.
+ * The registry is exposed as JSON for getMetrics, and in the Prometheus
+ * text format on the embedded HTTP server's /metrics.
+ */
+
+#ifndef AEGIR_METRICS_H
+#define AEGIR_METRICS_H
+
+#include <cstdint>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <json/json.h>
+
+namespace aegir {
+
+  class Metrics {
+    Metrics();
+    Metrics(Metrics&&) = delete;
+    Metrics(const Metrics &) = delete;
+    Metrics &operator=(Metrics &&) = delete;
+    Metrics &operator=(const Metrics &) = delete;
+  public:
+    enum class Type {
+      Counter,
+      Gauge,
+      Histogram
+    };
+
+    class Metric {
+    public:
+      virtual ~Metric() = default;
+      virtual void toJSON(Json::Value &_out) const = 0;
+      // the sample lines, _labels is the {...} part without the braces
+      virtual void expose(std::string &_out, const std::string &_name,
+			  const std::string &_labels) const = 0;
+    };
+
+    class Counter: public Metric {
+    public:
+      Counter(): c_value(0) {};
+      inline void inc(uint64_t _n = 1) { c_value.fetch_add(_n, std::memory_order_relaxed); };
+      inline uint64_t get() const { return c_value.load(std::memory_order_relaxed); };
+      virtual void toJSON(Json::Value &_out) const;
+      virtual void expose(std::string &_out, const std::string &_name,
+			  const std::string &_labels) const;
+
+    private:
+      std::atomic<uint64_t> c_value;
+    };
+
+    class Gauge: public Metric {
+    public:
+      Gauge(): c_value(0) {};
+      inline void set(double _value) { c_value.store(_value, std::memory_order_relaxed); };
+      inline double get() const { return c_value.load(std::memory_order_relaxed); };
+      virtual void toJSON(Json::Value &_out) const;
+      virtual void expose(std::string &_out, const std::string &_name,
+			  const std::string &_labels) const;
+
+    private:
+      std::atomic<double> c_value;
+    };
+
+    // latencies in microseconds, exposed in seconds
+    class Histogram: public Metric {
+    public:
+      // 8 buckets for every power of 2 up to 2^40 usecs
+      static constexpr uint32_t c_subbits = 3;
+      static constexpr uint32_t c_maxbits = 40;
+      static constexpr uint32_t c_nbuckets = (c_maxbits - 2) << c_subbits;
+
+      Histogram();
+      inline void record(uint64_t _usecs) {
+	c_buckets[bucket(_usecs)].fetch_add(1, std::memory_order_relaxed);
+	c_count.fetch_add(1, std::memory_order_relaxed);
+	c_sum.fetch_add(_usecs, std::memory_order_relaxed);
+	uint64_t max = c_max.load(std::memory_order_relaxed);
+	while ( _usecs > max && !c_max.compare_exchange_weak(max, _usecs, std::memory_order_relaxed) );
+      };
+      inline uint64_t count() const { return c_count.load(std::memory_order_relaxed); };
+      inline uint64_t sum() const { return c_sum.load(std::memory_order_relaxed); };
+      inline uint64_t max() const { return c_max.load(std::memory_order_relaxed); };
+      // the upper bound of the bucket of the _q quantile, usecs
+      uint64_t quantile(double _q) const;
+      // the number of recorded values below _usecs, rounded down to a bucket
+      uint64_t countBelow(uint64_t _usecs) const;
+      virtual void toJSON(Json::Value &_out) const;
+      virtual void expose(std::string &_out, const std::string &_name,
+			  const std::string &_labels) const;
+
+      static inline uint32_t bucket(uint64_t _usecs) {
+	if ( _usecs < (1u << c_subbits) ) return _usecs;
+	uint32_t msb = std::bit_width(_usecs) - 1;
+	if ( msb >= c_maxbits ) return c_nbuckets - 1;
+	return ((msb - c_subbits + 1) << c_subbits) + ((_usecs >> (msb - c_subbits)) & ((1u << c_subbits) - 1));
+      };
+      // the first value of a bucket
+      static uint64_t lowerBound(uint32_t _bucket);
+
+    private:
+      std::atomic<uint64_t> c_buckets[c_nbuckets];
+      std::atomic<uint64_t> c_count;
+      std::atomic<uint64_t> c_sum;
+      std::atomic<uint64_t> c_max;
+    };
+
+    // records the lifetime of the scope into a histogram
+    class Timer {
+      Timer() = delete;
+      Timer(Timer&&) = delete;
+      Timer(const Timer &) = delete;
+      Timer &operator=(Timer &&) = delete;
+      Timer &operator=(const Timer &) = delete;
+    public:
+      explicit Timer(Histogram &_histogram): c_histogram(_histogram),
+					     c_start(std::chrono::steady_clock::now()) {};
+      ~Timer() {
+	c_histogram.record(std::chrono::duration_cast<std::chrono::microseconds>
+			   (std::chrono::steady_clock::now() - c_start).count());
+      };
+
+    private:
+      Histogram &c_histogram;
+      std::chrono::steady_clock::time_point c_start;
+    };
+
+  public:
+    ~Metrics();
+    static Metrics &getInstance();
+
+    // registers a metric or returns the already registered one, the
+    // references are valid for the lifetime of the process
+    // _labels is e.g. command="getState"
+    Counter &counter(const std::string &_name, const std::string &_help,
+		     const std::string &_labels = "");
+    Gauge &gauge(const std::string &_name, const std::string &_help,
+		 const std::string &_labels = "");
+    Histogram &histogram(const std::string &_name, const std::string &_help,
+			 const std::string &_labels = "");
+
+    // {"name": {"type": ..., "help": ..., "values": {"labels": value}}}
+    void toJSON(Json::Value &_out) const;
+    // Prometheus text exposition format
+    void expose(std::string &_out) const;
+
+  private:
+    struct Family {
+      Type type;
+      std::string help;
+      std::map<std::string, std::unique_ptr<Metric>> metrics;
+    };
+
+    Metric &get(const std::string &_name, Type _type, const std::string &_help,
+		const std::string &_labels);
+
+  private:
+    mutable std::mutex c_mtx;
+    std::map<std::string, Family> c_families;
+  };
+}
+
+#endif
@@ -8,7 +8,7 @@ namespace aegir {
   /*
    * PINTracker::PIN
    */
-  PINTracker::PIN::PIN(const std::string &_name): c_name(_name) {
+  PINTracker::PIN::PIN(const std::string &_name): c_name(_name), c_acquired(0) {
     c_value = PINState::Off;
     c_newvalue = PINState::Off;
   }
@@ -39,6 +39,7 @@ namespace aegir {
     c_value = c_newvalue;
     c_cycletime = c_newcycletime;
     c_onratio = c_newonratio;
+    c_acquired = 0;
   }
 
   /*
@@ -138,7 +139,7 @@ namespace aegir {
   /*
    * PINTracker
    */
-  PINTracker::PINTracker() {
+  PINTracker::PINTracker(): c_acquired(0) {
   }
 
   PINTracker::~PINTracker() {
@@ -184,6 +185,17 @@ namespace aegir {
       }
       c_pinchangequeue.clear();
     }
+    // the next cycle's changes are stamped by its own inputs
+    c_acquired = 0;
+  }
+
+  void PINTracker::resendOutPINs() {
+    // the resends aren't reactions to an input, they carry no stamp
+    for (auto &it: c_pins)
+      if ( it.second->getType() == PIN::PINType::OUT ) {
+	it.second->setAcquired(0);
+	handleOutPIN(*it.second);
+      }
   }
 
   std::shared_ptr<PINTracker::PIN> PINTracker::getPIN(const std::string &_name) {
@@ -194,6 +206,14 @@ namespace aegir {
     return it->second;
   }
 
+  std::shared_ptr<const PINTracker::PIN> PINTracker::getPIN(const std::string &_name) const {
+    auto it = c_pins.find(_name);
+    if ( it == c_pins.end() )
+      throw Exception("Unknown PIN: %s", _name.c_str());
+
+    return it->second;
+  }
+
   void PINTracker::setPIN(const std::string &_name, PINState _value, float _cycletime, float _onratio) {
 #ifdef AEGIR_DEBUG
     printf("PINTracker::setPIN(%s, %hhu, %.2f %.2f)\n", _name.c_str(), _value, _cycletime, _onratio);
@@ -206,6 +226,7 @@ namespace aegir {
       if ( it->second->getType() == PIN::PINType::OUT ) {
 	auto sppin = std::static_pointer_cast<OutPIN>(it->second);
 	sppin->setValue(_value, _cycletime, _onratio);
+	sppin->setAcquired(c_acquired);
       } else if ( it->second->getType() == PIN::PINType::IN ) {
 	auto sppin = std::static_pointer_cast<InPIN>(it->second);
 	sppin->setValue(_value);
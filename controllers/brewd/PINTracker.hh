@@ -51,6 +51,10 @@ namespace aegir {
       virtual float getOnratio();
       virtual void setValue(PINState _v, float _cycletime = 3.0f, float _onratio=0.4f) = 0;
       PINType getType() const {return c_type; };
+      // the monotonic stamp of the input its new state was decided on,
+      // 0 for the user's commands and the resends
+      inline uint64_t getAcquired() const { return c_acquired; };
+      inline void setAcquired(uint64_t _acquired) { c_acquired = _acquired; };
 
       void pushback();
 
@@ -62,6 +66,7 @@ namespace aegir {
       float c_newcycletime;
       float c_onratio;
       float c_newonratio;
+      uint64_t c_acquired;
       PINType c_type;
     }; // PIN
     typedef std::map<std::string, std::shared_ptr<PIN> > PINMap;
@@ -117,19 +122,29 @@ namespace aegir {
     void endCycle();
 
     std::shared_ptr<PIN> getPIN(const std::string &_name);
+    std::shared_ptr<const PIN> getPIN(const std::string &_name) const;
     void setPIN(const std::string &_name, PINState _value, float _cycletime=2.0f, float _onratio=0.4f);
     bool hasChanged(const std::string &_name);
     bool hasChanged(const std::string &_name, std::shared_ptr<PIN> &_pin);
     inline bool hasChanges() const { return !!c_inpinchanges.size(); };
+    // the monotonic stamp of the newest input of the cycle, the out pins
+    // changed meanwhile carry it to the IOHandler
+    inline void setAcquired(uint64_t _acquired) { if ( _acquired > c_acquired ) c_acquired = _acquired; };
+    inline uint64_t getAcquired() const { return c_acquired; };
+    // the changes from here on aren't decided on the inputs
+    inline void clearAcquired() { c_acquired = 0; };
 
   protected:
     void reconfigure();
     virtual void handleOutPIN(PIN &) = 0;
+    // hands every out pin's state to handleOutPIN() again
+    void resendOutPINs();
 
   private:
     PINMap c_pins;
     PINChanges c_inpinchanges;
     PINChanges c_pinchangequeue;
+    uint64_t c_acquired;
   };
 }
 
@@ -9,12 +9,18 @@
 #include <set>
 #include <string>
 #include <limits>
+#include <optional>
 
 #include "JSONMessage.hh"
+#include "JSONCodec.hh"
+#include "PerfectHash.hh"
 #include "ProcessState.hh"
 #include "ElapsedTime.hh"
 #include "Config.hh"
 #include "Environment.hh"
+#include "Clock.hh"
+#include "Trace.hh"
+#include "SpanTracer.hh"
 #include "logging.hh"
 
 namespace aegir {
@@ -62,36 +68,16 @@ namespace aegir {
     return ret;
   }
 
-  PRWorkerThread::PRWorkerThread(std::string _name): c_name(_name),
-						     c_mq_prw(ZMQ::SocketType::REP),
-						     c_mq_iocmd(ZMQ::SocketType::PUB),
-						     c_log("PRWorkerThread") {
-    // Load the JSON Message handlers
-    c_handlers["loadProgram"] = std::bind(&PRWorkerThread::handleLoadProgram, this, std::placeholders::_1);
-    c_handlers["getProgram"] = std::bind(&PRWorkerThread::handleGetLoadedProgram, this, std::placeholders::_1);
-    c_handlers["getState"] = std::bind(&PRWorkerThread::handleGetState, this, std::placeholders::_1);
-    c_handlers["setState"] = std::bind(&PRWorkerThread::handleSetState, this, std::placeholders::_1);
-    c_handlers["buzzer"] = std::bind(&PRWorkerThread::handleBuzzer, this, std::placeholders::_1);
-    c_handlers["hasMalt"] = std::bind(&PRWorkerThread::handleHasMalt, this, std::placeholders::_1);
-    c_handlers["spargeDone"] = std::bind(&PRWorkerThread::handleSpargeDone, this, std::placeholders::_1);
-    c_handlers["coolingDone"] = std::bind(&PRWorkerThread::handleCoolingDone, this, std::placeholders::_1);
-    c_handlers["transferDone"] = std::bind(&PRWorkerThread::handleTransferDone, this, std::placeholders::_1);
-    c_handlers["startHopping"] = std::bind(&PRWorkerThread::handleStartHopping, this, std::placeholders::_1);
-    c_handlers["resetProcess"] = std::bind(&PRWorkerThread::handleResetProcess, this, std::placeholders::_1);
-    c_handlers["getVolume"] = std::bind(&PRWorkerThread::handleGetVolume, this, std::placeholders::_1);
-    c_handlers["setVolume"] = std::bind(&PRWorkerThread::handleSetVolume, this, std::placeholders::_1);
-    c_handlers["getTempHistory"] = std::bind(&PRWorkerThread::handleGetTempHistory, this, std::placeholders::_1);
-    c_handlers["startMaintenance"] = std::bind(&PRWorkerThread::handleStartMaintenance, this, std::placeholders::_1);
-    c_handlers["stopMaintenance"] = std::bind(&PRWorkerThread::handleStopMaintenance, this, std::placeholders::_1);
-    c_handlers["setMaintenance"] = std::bind(&PRWorkerThread::handleSetMaintenance, this, std::placeholders::_1);
-    c_handlers["override"] = std::bind(&PRWorkerThread::handleOverride, this, std::placeholders::_1);
-    c_handlers["getConfig"] = std::bind(&PRWorkerThread::handleGetConfig, this, std::placeholders::_1);
-    c_handlers["setConfig"] = std::bind(&PRWorkerThread::handleSetConfig, this, std::placeholders::_1);
-    c_handlers["setCoolTemp"] = std::bind(&PRWorkerThread::handleSetCoolTemp, this, std::placeholders::_1);
-
+  PRWorkerThread::PRWorkerThread(std::string _name, bool _embedded): c_name(_name),
+								     c_mq_prw(ZMQ::SocketType::REP),
+								     c_mq_iocmd(ZMQ::SocketType::PUB),
+								     c_batchsnap(nullptr),
+								     c_log("PRWorkerThread") {
     // connect the IO socket
     c_mq_iocmd.connect("inproc://iocmd");
 
+    if ( _embedded ) return;
+
     // connect the worker socket
     c_mq_prw.connect("inproc://prworkers");
 
@@ -122,8 +108,8 @@ namespace aegir {
 	    }
 	    // Handling the JSON message
 	    auto jsonmsg = std::static_pointer_cast<JSONMessage>(msg);
-	    auto reply = handleJSONMessage(jsonmsg->getJSON());
-	    c_mq_prw.send(JSONMessage(*reply));
+	    handleJSONMessage(jsonmsg->getJSON(), c_rawreply);
+	    c_mq_prw.send(c_rawreply);
 	  }
 	  catch (Exception &e) {
 	    c_log.error("PRWorkerThread: Exception while handling zmq message: %s",
@@ -179,105 +165,219 @@ namespace aegir {
     c_mq_prw.close();
   }
 
-  std::shared_ptr<Json::Value> PRWorkerThread::handleJSONMessage(const Json::Value &_msg) {
+  /*
+   * The command table is a perfect hash built at compile time.
+   * Commands fill in the reused c_reply. Those with a raw handler write
+   * their already serialized reply directly when called on their own,
+   * the regular handler is used inside a batch
+   */
+  const PRWorkerThread::Command *PRWorkerThread::findCommand(std::string_view _name) {
+    static constexpr PerfectHash<Command, 25> commands({
+	{"loadProgram",      {&PRWorkerThread::handleLoadProgram, nullptr}},
+	{"getProgram",       {&PRWorkerThread::handleGetLoadedProgram, nullptr}},
+	{"getState",         {&PRWorkerThread::handleGetStateJSON, &PRWorkerThread::handleGetState}},
+	{"setState",         {&PRWorkerThread::handleSetState, nullptr}},
+	{"buzzer",           {&PRWorkerThread::handleBuzzer, nullptr}},
+	{"hasMalt",          {&PRWorkerThread::handleHasMalt, nullptr}},
+	{"spargeDone",       {&PRWorkerThread::handleSpargeDone, nullptr}},
+	{"coolingDone",      {&PRWorkerThread::handleCoolingDone, nullptr}},
+	{"transferDone",     {&PRWorkerThread::handleTransferDone, nullptr}},
+	{"startHopping",     {&PRWorkerThread::handleStartHopping, nullptr}},
+	{"resetProcess",     {&PRWorkerThread::handleResetProcess, nullptr}},
+	{"getVolume",        {&PRWorkerThread::handleGetVolume, nullptr}},
+	{"setVolume",        {&PRWorkerThread::handleSetVolume, nullptr}},
+	{"getTempHistory",   {&PRWorkerThread::handleGetTempHistory, nullptr}},
+	{"startMaintenance", {&PRWorkerThread::handleStartMaintenance, nullptr}},
+	{"stopMaintenance",  {&PRWorkerThread::handleStopMaintenance, nullptr}},
+	{"setMaintenance",   {&PRWorkerThread::handleSetMaintenance, nullptr}},
+	{"override",         {&PRWorkerThread::handleOverride, nullptr}},
+	{"getConfig",        {&PRWorkerThread::handleGetConfig, nullptr}},
+	{"getMetrics",       {&PRWorkerThread::handleGetMetrics, nullptr}},
+	{"getLoop",          {&PRWorkerThread::handleGetLoop, nullptr}},
+	{"dumpTrace",        {&PRWorkerThread::handleDumpTrace, nullptr}},
+	{"setConfig",        {&PRWorkerThread::handleSetConfig, nullptr}},
+	{"setCoolTemp",      {&PRWorkerThread::handleSetCoolTemp, nullptr}},
+	{"batch",            {&PRWorkerThread::handleBatch, nullptr}},
+      });
+
+    return commands.find(_name);
+  }
+
+  void PRWorkerThread::setError(Json::Value &_reply, const std::string &_message) {
+    _reply.clear();
+    _reply["status"] = "error";
+    _reply["message"] = _message;
+  }
+
+  void PRWorkerThread::serializeReply(std::string &_out) {
+    getJSONCodec().write(c_reply, _out);
+  }
 
+  /*
+   * Validates the request envelope and looks up its command
+   * Returns nullptr and sets _error if the request is not valid
+   */
+  const PRWorkerThread::Command *PRWorkerThread::parseRequest(const Json::Value &_msg,
+							      const Json::Value *&_data,
+							      std::string &_error) {
     if ( _msg.type() != Json::ValueType::objectValue ) {
-      std::string typestr("unknown");
-      switch(_msg.type()) {
-      case Json::ValueType::nullValue:
-	typestr = "null";
-	break;
-      case Json::ValueType::intValue:
-	typestr = "int";
-	break;
-      case Json::ValueType::uintValue:
-	typestr = "uint";
-	break;
-      case Json::ValueType::realValue:
-	typestr = "real";
-	break;
-      case Json::ValueType::stringValue:
-	typestr = "string";
-	break;
-      case Json::ValueType::booleanValue:
-	typestr = "boolean";
-	break;
-      case Json::ValueType::arrayValue:
-	typestr = "array";
-	break;
-      case Json::ValueType::objectValue:
-	typestr = "object";
-	break;
-      }
-      Json::Value root;
-      root["status"] = "error";
-      root["message"] = std::string("Input's type must be an object, and not a ") + typestr;
-      return std::make_shared<Json::Value>(root);
+      _error = std::string("Input's type must be an object, and not ") + jsvt2str(_msg.type());
+      return nullptr;
     }
 
     // check whether we have the "command" defined
-    if ( !_msg.isMember("command") ) {
-      //printf("PRWorkerThread::handleJSONMessage(): command is not defined\n");
-      Json::Value root;
-      root["status"] = "error";
-      root["message"] = "command not supplied";
-      return std::make_shared<Json::Value>(root);
+    const Json::Value *cmd = _msg.find("command", "command"+7);
+    if ( !cmd ) {
+      _error = "command not supplied";
+      return nullptr;
     }
 
     // check whether command is a string
-    auto cmd = _msg["command"];
-    if ( !cmd.isString() ) {
-      Json::Value root;
-      root["status"] = "error";
-      root["message"] = "command not a string";
-      return std::make_shared<Json::Value>(root);
+    const char *cmdbegin, *cmdend;
+    if ( !cmd->isString() || !cmd->getString(&cmdbegin, &cmdend) ) {
+      _error = "command not a string";
+      return nullptr;
     }
-    // fetch the command
-    std::string cmdstr = cmd.asString();
 
     // now check whether we have data
-    if ( !_msg.isMember("data") ) {
-      Json::Value root;
-      root["status"] = "error";
-      root["message"] = "data is not supplied";
-      return std::make_shared<Json::Value>(root);
+    _data = _msg.find("data", "data"+4);
+    if ( !_data ) {
+      _error = "data is not supplied";
+      return nullptr;
     }
 
     // Check whether the handler for the command is defined
-    auto cmdit = c_handlers.find(cmdstr);
-    if ( cmdit == c_handlers.end() ) {
-      Json::Value root;
-      root["status"] = "error";
-      root["message"] = "Unknown command";
-      return std::make_shared<Json::Value>(root);
+    const Command *command = findCommand(std::string_view(cmdbegin, cmdend-cmdbegin));
+    if ( !command ) {
+      _error = "Unknown command";
+      return nullptr;
     }
 
+    return command;
+  }
+
+  /*
+   * Runs a command, exceptions are turned into error replies
+   * If _raw is given and the command has a raw handler, the reply is
+   * written there and true is returned
+   */
+  bool PRWorkerThread::runCommand(const Command &_command, const Json::Value &_data,
+				  Json::Value &_reply, std::string *_raw) {
     try {
-      //ElapsedTime t("PRWorkerThread handle "+cmdstr);
-      return cmdit->second(_msg["data"]);
+      if ( _raw && _command.rawhandler ) {
+	(this->*_command.rawhandler)(_data, *_raw);
+	return true;
+      }
+      (this->*_command.handler)(_data, _reply);
     }
     catch (Exception &e) {
-      Json::Value root;
-      root["status"] = "error";
-      root["message"] = std::string("Exception: ") + std::string(e.what());
-      return std::make_shared<Json::Value>(root);
+      setError(_reply, std::string("Exception: ") + std::string(e.what()));
     }
     catch (std::exception &e) {
-      Json::Value root;
-      root["status"] = "error";
-      root["message"] = std::string("std::exception: ") + std::string(e.what());
-      return std::make_shared<Json::Value>(root);
+      setError(_reply, std::string("std::exception: ") + std::string(e.what()));
     }
     catch (...) {
-      Json::Value root;
-      root["status"] = "error";
-      root["message"] = "Unknown error";
-      return std::make_shared<Json::Value>(root);
+      setError(_reply, "Unknown error");
+    }
+    return false;
+  }
+
+  void PRWorkerThread::handleJSONMessage(const Json::Value &_msg, std::string &_out) {
+    const Json::Value *data;
+    std::string error;
+
+    c_reply.clear();
+
+    const Command *command = parseRequest(_msg, data, error);
+    if ( !command ) {
+      setError(c_reply, error);
+      serializeReply(_out);
+      return;
+    }
+
+    auto trace = TraceRecorder::getInstance();
+    if ( trace->isRecording() && !isReadOnly(*command) )
+      trace->record(Trace::RecordType::Command, JSONMessage(_msg).serialize());
+
+    AEGIR_TRACE_SPAN("pr.request");
+    Metrics::Timer timer(commandMetric(*command, _msg));
+    if ( runCommand(*command, *data, c_reply, &_out) ) return;
+    serializeReply(_out);
+  }
+
+  Metrics::Histogram &PRWorkerThread::commandMetric(const Command &_command, const Json::Value &_msg) {
+    auto it = c_cmdmetrics.find(&_command);
+    if ( it != c_cmdmetrics.end() ) return *it->second;
+
+    // the name is a known one, it was found in the command table
+    Metrics::Histogram &hist = Metrics::getInstance()
+      .histogram("aegir_pr_request_seconds", "The PR commands' handling time",
+		 "command=\"" + _msg["command"].asString() + "\"");
+    c_cmdmetrics[&_command] = &hist;
+    return hist;
+  }
+
+  /*
+   * The commands only reading the state are left out of the traces
+   */
+  bool PRWorkerThread::isReadOnly(const Command &_command) {
+    return _command.handler == &PRWorkerThread::handleGetLoadedProgram ||
+      _command.handler == &PRWorkerThread::handleGetStateJSON ||
+      _command.handler == &PRWorkerThread::handleGetVolume ||
+      _command.handler == &PRWorkerThread::handleGetTempHistory ||
+      _command.handler == &PRWorkerThread::handleGetConfig ||
+      _command.handler == &PRWorkerThread::handleGetMetrics ||
+      _command.handler == &PRWorkerThread::handleGetLoop ||
+      _command.handler == &PRWorkerThread::handleDumpTrace;
+  }
+
+  /*
+    Runs several commands in one round-trip. The reading ones are served
+    from one published state snapshot, getState returns it and
+    getTempHistory stops at the readings it saw, without locking the
+    Controller. The other commands take their own locks.
+    required: commands, an array of {"command": ..., "data": ...}
+    The replies are returned in the same order, each with its own status
+   */
+  void PRWorkerThread::handleBatch(const Json::Value &_data, Json::Value &_reply) {
+    if ( !_data.isObject() || !_data.isMember("commands") || !_data["commands"].isArray() )
+      throw Exception("data.commands must be an array");
+
+    const Json::Value &commands = _data["commands"];
+    if ( commands.size() > c_maxbatch )
+      throw Exception("Too many commands in a batch, at most %u are allowed", c_maxbatch);
+
+    _reply["status"] = "success";
+    Json::Value &replies = (_reply["data"] = Json::Value(Json::ValueType::arrayValue));
+
+    // pinned for the whole batch
+    StateSnapshot::Reader snap(ProcessState::getInstance().getSnapshot());
+    struct BatchSnap {
+      const StateSnapshot::Reader *&ptr;
+      ~BatchSnap() { ptr = nullptr; };
+    } batchsnap{c_batchsnap};
+    c_batchsnap = &snap;
+
+    for (auto &it: commands) {
+      Json::Value &reply = replies.append(Json::Value(Json::ValueType::objectValue));
+      const Json::Value *data;
+      std::string error;
+
+      const Command *command = parseRequest(it, data, error);
+      if ( !command ) {
+	setError(reply, error);
+	continue;
+      }
+      if ( command->handler == &PRWorkerThread::handleBatch ) {
+	setError(reply, "batch cannot be nested");
+	continue;
+      }
+
+      runCommand(*command, *data, reply, nullptr);
     }
-    // clang nicely realizes that we won't reach this point, ever
   }
 
-  std::shared_ptr<Json::Value> PRWorkerThread::handleLoadProgram(const Json::Value &_data) {
+  void PRWorkerThread::handleLoadProgram(const Json::Value &_data, Json::Value &_reply) {
     ProcessState &ps(ProcessState::getInstance());
 
     // during maintenance program loading is disabled
@@ -311,7 +411,7 @@ namespace aegir {
     //printf("Startat:%u Volume:%u\n", startat, volume);
 
     //verify the time
-    time_t now = time(0);
+    time_t now = Clock::now();
     time_t minbefore = now - 600;
     time_t maxahead = now + 3600*168;
     if ( startat && startat < minbefore )
@@ -432,141 +532,95 @@ namespace aegir {
       .setCoolTemp(cfg->getCoolTemp());
 
     // the success reply
-    Json::Value resp;
-    resp["status"] = "success";
-    resp["message"] = "Command Loaded";
-    return std::make_shared<Json::Value>(resp);
+    _reply["status"] = "success";
+    _reply["message"] = "Command Loaded";
   }
 
-  std::shared_ptr<Json::Value> PRWorkerThread::handleGetLoadedProgram(const Json::Value &_data) {
+  void PRWorkerThread::handleGetLoadedProgram(const Json::Value &_data, Json::Value &_reply) {
     try {
       std::shared_ptr<Program> prog = ProcessState::getInstance().getProgram();
       if ( prog == nullptr ) {
 	throw Exception("No program loaded");
       }
-      Json::Value resp;
-      resp["status"] = "success";
-      resp["data"] = Json::Value();
-      resp["data"]["progid"] = prog->getId();
-      return std::make_shared<Json::Value>(resp);
+      _reply["status"] = "success";
+      _reply["data"] = Json::Value();
+      _reply["data"]["progid"] = prog->getId();
     }
     catch (Exception &e) {
-      Json::Value resp;
-      resp["status"] = "error";
-      resp["message"] = e.what();
-      return std::make_shared<Json::Value>(resp);
+      _reply["status"] = "error";
+      _reply["message"] = e.what();
     }
     catch (std::exception &e) {
-      Json::Value resp;
-      resp["status"] = "error";
-      resp["message"] = e.what();
-      return std::make_shared<Json::Value>(resp);
+      _reply["status"] = "error";
+      _reply["message"] = e.what();
     }
     catch (...) {
-      Json::Value resp;
-      resp["status"] = "error";
-      resp["message"] = "Unknown error";
-      return std::make_shared<Json::Value>(resp);
+      _reply["status"] = "error";
+      _reply["message"] = "Unknown error";
     }
-    // shouldn't be reached
   }
 
-  std::shared_ptr<Json::Value> PRWorkerThread::handleGetState(const Json::Value &_data) {
-    // do these initializations ahead of the mutex lock to avoid wasting mutex time
-    Json::Value retval;
-    retval["status"] = "success";
-    retval["data"] = Json::Value();
-
-    Json::Value data, jsval;
-    std::set<std::string> tcs;
-
-    ProcessState &ps(ProcessState::getInstance());
-
-    ProcessState::Guard guard_ps(ps);
-
-    try {
-      auto env = Environment::getInstance();
-      // first get the current state
-      data["state"] = ps.getStringState();
-
-      // TC readings
-      data["currtemp"]["MT"] = env->getTempMT();
-      data["currtemp"]["RIMS"] = env->getTempRIMS();
-      data["currtemp"]["BK"] = env->getTempBK();
-      data["currtemp"]["HLT"] = env->getTempHLT();
-
-      // Add the current target temperature
-      data["targettemp"] = ps.getTargetTemp();
+  /*
+    Serves the snapshot published by the Controller
+    optional: since, the version the client already has
+   */
+  void PRWorkerThread::handleGetState(const Json::Value &_data, std::string &_reply) {
+    uint64_t since = 0;
 
-      // water level sensor
-      data["levelerror"] = ps.getLevelError();
+    if ( _data.isObject() && _data.isMember("since") ) {
+      if ( !_data["since"].isConvertibleTo(Json::ValueType::uintValue) )
+	throw Exception("since must be an unsigned integer");
+      since = _data["since"].asUInt64();
+    }
 
-      // If we have a loaded program, return its id
-      if ( ps.getState() >= ProcessState::States::Loaded ) {
-	data["programid"] = ps.getProgram()->getId();
-      }
+    StateSnapshot::Reader snap(ProcessState::getInstance().getSnapshot());
 
-      // If we're mashing, then display the current step
-      if ( ps.getState() == ProcessState::States::Mashing ) {
-	Json::Value jms;
-	time_t now = time(0);
-	int8_t step = ps.getMashStep();
-	time_t start = ps.getMashStepStart();
-	time_t diff = now - start;
-
-	jms["orderno"] = step;
-	jms["time"] = diff<0 ? 0 : diff;
-	data["mashstep"] = jms;
-      }
+    if ( snap.version() == 0 )
+      throw Exception("State is not available yet");
 
-      // during cooling let the UI know whether we're good to finish
-      if ( ps.getState() == ProcessState::States::Cooling ) {
-	Json::Value cooling;
-	float bktemp =  ps.getSensorTemp("BK");
-	float cooltemp = ps.getCoolTemp();
+    _reply = "{\"status\":\"success\",\"version\":";
+    _reply += std::to_string(snap.version());
+    if ( since == snap.version() ) {
+      _reply += ",\"unchanged\":true}";
+      return;
+    }
+    _reply += ",\"data\":";
+    _reply += snap.json();
+    _reply += "}";
+  }
 
-	cooling["ready"] = (bktemp < cooltemp);
-	cooling["cooltemp"] = cooltemp;
+  /*
+    The same as getState, but as a Json::Value for batches, from the
+    batch's snapshot
+   */
+  void PRWorkerThread::handleGetStateJSON(const Json::Value &_data, Json::Value &_reply) {
+    uint64_t since = 0;
 
-	data["cooling"] = cooling;
-      }
+    if ( _data.isObject() && _data.isMember("since") ) {
+      if ( !_data["since"].isConvertibleTo(Json::ValueType::uintValue) )
+	throw Exception("since must be an unsigned integer");
+      since = _data["since"].asUInt64();
+    }
 
-      // During hopping, we publicate the hoptime for the UI
-      if ( ps.getState() == ProcessState::States::Hopping ) {
-	Json::Value hopdata;
+    std::optional<StateSnapshot::Reader> own;
+    const StateSnapshot::Reader &snap(c_batchsnap ? *c_batchsnap
+				      : own.emplace(ProcessState::getInstance().getSnapshot()));
 
-	hopdata["hoptime"] = ps.getHopTime();
+    if ( snap.version() == 0 )
+      throw Exception("State is not available yet");
 
-	data["hopping"] = hopdata;
-      }
-    }
-    catch (Exception &e) {
-      Json::Value resp;
-      resp["status"] = "error";
-      resp["message"] = e.what();
-      return std::make_shared<Json::Value>(resp);
+    _reply["status"] = "success";
+    _reply["version"] = (Json::UInt64)snap.version();
+    if ( since == snap.version() ) {
+      _reply["unchanged"] = true;
+      return;
     }
-    catch (std::exception &e) {
-      Json::Value resp;
-      resp["status"] = "error";
-      resp["message"] = e.what();
-      return std::make_shared<Json::Value>(resp);
-    }
-    catch (...) {
-      Json::Value resp;
-      resp["status"] = "error";
-      resp["message"] = "Unknown error";
-      return std::make_shared<Json::Value>(resp);
-    }
-    retval["data"] = data;
-
-    return std::make_shared<Json::Value>(retval);
+    _reply["data"] = snap.data();
   }
 
-  std::shared_ptr<Json::Value> PRWorkerThread::handleSetState(const Json::Value &_data) {
-    Json::Value retval;
-    retval["status"] = "success";
-    retval["data"] = Json::Value();
+  void PRWorkerThread::handleSetState(const Json::Value &_data, Json::Value &_reply) {
+    _reply["status"] = "success";
+    _reply["data"] = Json::Value();
     ProcessState &ps(ProcessState::getInstance());
     std::set<ProcessState::States> empties{ProcessState::States::Empty,
 					   ProcessState::States::Finished};
@@ -599,18 +653,14 @@ namespace aegir {
 
       ps.setState(newstate);
     }
-
-
-    return std::make_shared<Json::Value>(retval);
   }
   /*
     required: state
     if state==pulsate: cycletime, onratio
    */
-  std::shared_ptr<Json::Value> PRWorkerThread::handleBuzzer(const Json::Value &_data) {
-    Json::Value retval;
-    retval["status"] = "success";
-    retval["data"] = Json::Value();
+  void PRWorkerThread::handleBuzzer(const Json::Value &_data, Json::Value &_reply) {
+    _reply["status"] = "success";
+    _reply["data"] = Json::Value();
 
     if ( _data.type() != Json::ValueType::objectValue )
       throw Exception("Data type should be an objectvalue");
@@ -662,14 +712,11 @@ namespace aegir {
     }
 
     c_mq_iocmd.send(PinStateMessage("buzzer", state, cycletime, onratio));
-
-    return std::make_shared<Json::Value>(retval);
   }
 
-  std::shared_ptr<Json::Value> PRWorkerThread::handleHasMalt(const Json::Value &_data) {
-    Json::Value retval;
-    retval["status"] = "success";
-    retval["data"] = Json::Value();
+  void PRWorkerThread::handleHasMalt(const Json::Value &_data, Json::Value &_reply) {
+    _reply["status"] = "success";
+    _reply["data"] = Json::Value();
 
     ProcessState &ps(ProcessState::getInstance());
     if ( ps.getState() != ProcessState::States::NeedMalt ) {
@@ -677,14 +724,11 @@ namespace aegir {
     }
 
     ps.setState(ProcessState::States::Mashing);
-
-    return std::make_shared<Json::Value>(retval);
   }
 
-  std::shared_ptr<Json::Value> PRWorkerThread::handleSpargeDone(const Json::Value &_data) {
-    Json::Value retval;
-    retval["status"] = "success";
-    retval["data"] = Json::Value();
+  void PRWorkerThread::handleSpargeDone(const Json::Value &_data, Json::Value &_reply) {
+    _reply["status"] = "success";
+    _reply["data"] = Json::Value();
 
     ProcessState &ps(ProcessState::getInstance());
     if ( ps.getState() != ProcessState::States::Sparging ) {
@@ -697,11 +741,9 @@ namespace aegir {
     } else {
       ps.setState(ProcessState::States::PreBoil);
     }
-
-    return std::make_shared<Json::Value>(retval);
   }
 
-  std::shared_ptr<Json::Value> PRWorkerThread::handleCoolingDone(const Json::Value &_data) {
+  void PRWorkerThread::handleCoolingDone(const Json::Value &_data, Json::Value &_reply) {
     ProcessState &ps(ProcessState::getInstance());
 
     // only valid during cooling
@@ -717,14 +759,11 @@ namespace aegir {
     ps.setState(ProcessState::States::Transfer);
 
     // return success
-    Json::Value retval;
-    retval["status"] = "success";
-    retval["data"] = Json::Value(Json::ValueType::nullValue);
-
-    return std::make_shared<Json::Value>(retval);
+    _reply["status"] = "success";
+    _reply["data"] = Json::Value(Json::ValueType::nullValue);
   }
 
-  std::shared_ptr<Json::Value> PRWorkerThread::handleTransferDone(const Json::Value &_data) {
+  void PRWorkerThread::handleTransferDone(const Json::Value &_data, Json::Value &_reply) {
     ProcessState &ps(ProcessState::getInstance());
 
     // only valid during cooling
@@ -735,17 +774,13 @@ namespace aegir {
     ps.setState(ProcessState::States::Finished);
 
     // return success
-    Json::Value retval;
-    retval["status"] = "success";
-    retval["data"] = Json::Value(Json::ValueType::nullValue);
-
-    return std::make_shared<Json::Value>(retval);
+    _reply["status"] = "success";
+    _reply["data"] = Json::Value(Json::ValueType::nullValue);
   }
 
-  std::shared_ptr<Json::Value> PRWorkerThread::handleStartHopping(const Json::Value &_data) {
-    Json::Value retval;
-    retval["status"] = "success";
-    retval["data"] = Json::Value();
+  void PRWorkerThread::handleStartHopping(const Json::Value &_data, Json::Value &_reply) {
+    _reply["status"] = "success";
+    _reply["data"] = Json::Value();
 
     ProcessState &ps(ProcessState::getInstance());
     // check the state
@@ -761,14 +796,11 @@ namespace aegir {
     }
 
     ps.setState(ProcessState::States::Hopping);
-
-    return std::make_shared<Json::Value>(retval);
   }
 
-  std::shared_ptr<Json::Value> PRWorkerThread::handleResetProcess(const Json::Value &_data) {
-    Json::Value retval;
-    retval["status"] = "success";
-    retval["data"] = Json::Value();
+  void PRWorkerThread::handleResetProcess(const Json::Value &_data, Json::Value &_reply) {
+    _reply["status"] = "success";
+    _reply["data"] = Json::Value();
 
     ProcessState &ps(ProcessState::getInstance());
     if ( ps.getState() == ProcessState::States::Empty) {
@@ -776,26 +808,21 @@ namespace aegir {
     }
 
     ps.reset();
-
-    return std::make_shared<Json::Value>(retval);
   }
 
-  std::shared_ptr<Json::Value> PRWorkerThread::handleGetVolume(const Json::Value &_data) {
+  void PRWorkerThread::handleGetVolume(const Json::Value &_data, Json::Value &_reply) {
     ProcessState &ps(ProcessState::getInstance());
 
     // we cannot get the volume while there's no program loaded
     if ( ps.getState() == ProcessState::States::Empty ) {
       throw Exception("Cannot get volume while Empty");
     }
-    Json::Value retval;
-    retval["status"] = "success";
-    retval["data"] = Json::Value(Json::ValueType::objectValue);
-    retval["data"]["volume"] = ps.getVolume();
-
-    return std::make_shared<Json::Value>(retval);
+    _reply["status"] = "success";
+    _reply["data"] = Json::Value(Json::ValueType::objectValue);
+    _reply["data"]["volume"] = ps.getVolume();
   }
 
-  std::shared_ptr<Json::Value> PRWorkerThread::handleSetVolume(const Json::Value &_data) {
+  void PRWorkerThread::handleSetVolume(const Json::Value &_data, Json::Value &_reply) {
     ProcessState &ps(ProcessState::getInstance());
 
     // cannot set the volume when there's no program loaded
@@ -822,19 +849,25 @@ namespace aegir {
     ps.setVolume(volume);
 
     // return success
-    Json::Value retval;
-    retval["status"] = "success";
-    retval["data"] = Json::Value(Json::ValueType::nullValue);
-
-    return std::make_shared<Json::Value>(retval);
+    _reply["status"] = "success";
+    _reply["data"] = Json::Value(Json::ValueType::nullValue);
   }
 
-  std::shared_ptr<Json::Value> PRWorkerThread::handleGetTempHistory(const Json::Value &_data) {
+  void PRWorkerThread::handleGetTempHistory(const Json::Value &_data, Json::Value &_reply) {
     ProcessState &ps(ProcessState::getInstance());
+    auto& db = ps.getThermoReadings();
+    // the readings the reply may see, a batch stops at its snapshot's
+    uint32_t size;
 
     // only valid from mashing
-    if ( ps.getState() < ProcessState::States::Mashing ) {
-      throw Exception("Cannot be used before Mashing");
+    if ( c_batchsnap ) {
+      if ( !c_batchsnap->data().isMember("readings") )
+	throw Exception("Cannot be used before Mashing");
+      size = c_batchsnap->data()["readings"].asUInt();
+    } else {
+      if ( ps.getState() < ProcessState::States::Mashing )
+	throw Exception("Cannot be used before Mashing");
+      size = db.size();
     }
 
     // verify the input
@@ -848,27 +881,21 @@ namespace aegir {
       from = jsonvalue.asUInt();
     }
 
-    Json::Value retval, tcdata;
+    Json::Value tcdata;
     tcdata["dt"] = Json::Value(Json::ValueType::arrayValue);
     tcdata["rims"] = Json::Value(Json::ValueType::arrayValue);
     tcdata["mt"] = Json::Value(Json::ValueType::arrayValue);
 
     // fetch the values
-    // ProcesState is only locked during this
+    // the TSDB has its own lock, the ProcessState isn't locked
     static thread_local TSDB::entry tcvals[512];
     uint32_t entries;
-    {
-      std::set<std::string> tcs;
-
-      ProcessState::Guard guard_ps(ps);
-      auto& db = ps.getThermoReadings();
 
-      // if from would throw an exception, just error out
-      if ( !(from < db.size()) )
-	throw Exception("Not a fortune teller");
+    // if from would throw an exception, just error out
+    if ( !(from < size) )
+      throw Exception("Not a fortune teller");
 
-      entries = db.from(from, tcvals, 512);
-    }
+    entries = db.from(from, tcvals, std::min<uint32_t>(512, size - from));
 
     for (uint32_t i=0; i < entries; ++i) {
       tcdata["dt"].append(tcvals[i].dt);
@@ -882,13 +909,11 @@ namespace aegir {
     // now we can assemble the output
 
     // return success
-    retval["status"] = "success";
-    retval["data"] = tcdata;
-
-    return std::make_shared<Json::Value>(retval);
+    _reply["status"] = "success";
+    _reply["data"] = tcdata;
   }
 
-  std::shared_ptr<Json::Value> PRWorkerThread::handleStartMaintenance(const Json::Value &_data) {
+  void PRWorkerThread::handleStartMaintenance(const Json::Value &_data, Json::Value &_reply) {
     ProcessState &ps(ProcessState::getInstance());
 
     // to start maintenance, we need to be in empty or finised state
@@ -901,14 +926,11 @@ namespace aegir {
     ps.setState(ProcessState::States::Maintenance);
 
     // return success
-    Json::Value retval;
-    retval["status"] = "success";
-    retval["data"] = Json::Value(Json::ValueType::nullValue);
-
-    return std::make_shared<Json::Value>(retval);
+    _reply["status"] = "success";
+    _reply["data"] = Json::Value(Json::ValueType::nullValue);
   }
 
-  std::shared_ptr<Json::Value> PRWorkerThread::handleStopMaintenance(const Json::Value &_data) {
+  void PRWorkerThread::handleStopMaintenance(const Json::Value &_data, Json::Value &_reply) {
     ProcessState &ps(ProcessState::getInstance());
 
     // we cannot stop maintenance if we're not in maintmode
@@ -919,14 +941,11 @@ namespace aegir {
     ps.setState(ProcessState::States::Empty);
 
     // return success
-    Json::Value retval;
-    retval["status"] = "success";
-    retval["data"] = Json::Value(Json::ValueType::nullValue);
-
-    return std::make_shared<Json::Value>(retval);
+    _reply["status"] = "success";
+    _reply["data"] = Json::Value(Json::ValueType::nullValue);
   }
 
-  std::shared_ptr<Json::Value> PRWorkerThread::handleSetMaintenance(const Json::Value &_data) {
+  void PRWorkerThread::handleSetMaintenance(const Json::Value &_data, Json::Value &_reply) {
     ProcessState &ps(ProcessState::getInstance());
 #if 0
     Json::StreamWriterBuilder swb;
@@ -942,6 +961,7 @@ namespace aegir {
     bool mtpump(false), heat(false), hasbkpump(false);
     float temp(37);
     bool haspump(false), hasheat(false), hastemp(false), bkpump(false);
+    bool autotune(false), hasautotune(false);
     Json::Value jsonvalue;
 
     // verify the input
@@ -973,8 +993,15 @@ namespace aegir {
 	throw Exception("temp must be a numeric type");
       temp = jsonvalue.asFloat();
     }
+    if ( _data.isMember("autotune") ) {
+      hasautotune = true;
+      jsonvalue = _data["autotune"];
+      if ( !jsonvalue.isBool() )
+	throw Exception("autotune must be of the type bool");
+      autotune = jsonvalue.asBool();
+    }
 
-    if ( !haspump && !hasheat && !hastemp )
+    if ( !haspump && !hasheat && !hastemp && !hasautotune )
       throw Exception("At least one of the fields must be supplied");
 
 #if 0
@@ -1006,16 +1033,15 @@ namespace aegir {
     }
     if ( hasbkpump ) ps.setMaintBKPump(bkpump);
     if ( hastemp ) ps.setMaintTemp(temp);
+    // the auto-tuning drives the pump and the heating on its own
+    if ( hasautotune ) ps.setMaintAutoTune(autotune);
 
     // return success
-    Json::Value retval;
-    retval["status"] = "success";
-    retval["data"] = Json::Value(Json::ValueType::nullValue);
-
-    return std::make_shared<Json::Value>(retval);
+    _reply["status"] = "success";
+    _reply["data"] = Json::Value(Json::ValueType::nullValue);
   }
 
-  std::shared_ptr<Json::Value> PRWorkerThread::handleOverride(const Json::Value &_data) {
+  void PRWorkerThread::handleOverride(const Json::Value &_data, Json::Value &_reply) {
 
 
     ProcessState &ps(ProcessState::getInstance());
@@ -1044,11 +1070,8 @@ namespace aegir {
     }
 
     // return success
-    Json::Value retval;
-    retval["status"] = "success";
-    retval["data"] = Json::Value(Json::ValueType::nullValue);
-
-    return std::make_shared<Json::Value>(retval);
+    _reply["status"] = "success";
+    _reply["data"] = Json::Value(Json::ValueType::nullValue);
   }
 
   /*
@@ -1056,8 +1079,10 @@ namespace aegir {
     tempaccuracy
     cooltemp
     heatoverhead
+    hecycletime, maxcorrection: read-only, set by the auto-tuning
+    controlstrategy
    */
-  std::shared_ptr<Json::Value> PRWorkerThread::handleGetConfig(const Json::Value &_data) {
+  void PRWorkerThread::handleGetConfig(const Json::Value &_data, Json::Value &_reply) {
     auto cfg = Config::getInstance();
 
     Json::Value data;
@@ -1065,18 +1090,56 @@ namespace aegir {
     data["tempaccuracy"] = cfg->getTempAccuracy();
     data["cooltemp"] = cfg->getCoolTemp();
     data["heatoverhead"] = cfg->getHeatOverhead();
+    data["hecycletime"] = cfg->getHECycleTime();
+    data["maxcorrection"] = cfg->getMaxCorrectionFactor();
     data["hedelay"] = cfg->getHEDelay();
     data["loglevel"] = logging::str(cfg->getLogLevel());
+    data["controlstrategy"] = cfg->getControlStrategyName();
 
     // return success
-    Json::Value retval;
-    retval["status"] = "success";
-    retval["data"] = data;
+    _reply["status"] = "success";
+    _reply["data"] = data;
+  }
+
+  /*
+    The runtime metrics, see Metrics::toJSON()
+   */
+  void PRWorkerThread::handleGetMetrics(const Json::Value &_data, Json::Value &_reply) {
+    _reply["status"] = "success";
+    Metrics::getInstance().toJSON(_reply["data"]);
+  }
+
+  /*
+    The control loop's counters, its last and worst cycles' timings and its
+    alert, see LoopMonitor::toJSON()
+   */
+  void PRWorkerThread::handleGetLoop(const Json::Value &_data, Json::Value &_reply) {
+    StateSnapshot::Reader snap(ProcessState::getInstance().getLoopSnapshot());
 
-    return std::make_shared<Json::Value>(retval);
+    if ( snap.version() == 0 )
+      throw Exception("The loop's timing is not available yet");
+
+    _reply["status"] = "success";
+    _reply["data"] = snap.data();
+  }
+
+  /*
+    Writes the span tracer's rings into the --tracedump Chrome trace file,
+    the clients can't choose the file
+   */
+  void PRWorkerThread::handleDumpTrace(const Json::Value &_data, Json::Value &_reply) {
+    if ( !SpanTracer::c_compiled )
+      throw Exception("The span tracer is not compiled in, build with AEGIR_TRACE");
+
+    auto &tracer = SpanTracer::getInstance();
+    std::string file = tracer.getDumpFile();
+    uint32_t events = tracer.dump(file);
+    _reply["status"] = "success";
+    _reply["data"]["file"] = file;
+    _reply["data"]["events"] = events;
   }
 
-  std::shared_ptr<Json::Value> PRWorkerThread::handleSetConfig(const Json::Value &_data) {
+  void PRWorkerThread::handleSetConfig(const Json::Value &_data, Json::Value &_reply) {
     ProcessState &ps(ProcessState::getInstance());
 
     // we cannot set maintenance options if we're not in maintmode
@@ -1088,7 +1151,7 @@ namespace aegir {
     Json::Value jsonvalue;
     uint32_t hepwr, hedelay;
     float tempaccuracy, heatoverhead, cooltemp;
-    std::string loglevel;
+    std::string loglevel, controlstrategy;
 
     hepwr = cfg->getHEPower();
     tempaccuracy = cfg->getTempAccuracy();
@@ -1096,6 +1159,7 @@ namespace aegir {
     cooltemp = cfg->getCoolTemp();
     hedelay = cfg->getHEDelay();
     loglevel = logging::str(cfg->getLogLevel());
+    controlstrategy = cfg->getControlStrategyName();
 
     // he power
     if ( _data.isMember("hepower") ) {
@@ -1157,23 +1221,31 @@ namespace aegir {
       loglevel = _data["loglevel"].asString();
     }
 
-    cfg->setHEPower(hepwr).
-      setTempAccuracy(tempaccuracy).
-      setHeatOverhead(heatoverhead).
-      setCoolTemp(cooltemp).
-      setHEDelay(hedelay).
-      setLogLevel(loglevel).
-      save();
+    // temperature control strategy
+    if ( _data.isMember("controlstrategy") ) {
+      if ( !_data["controlstrategy"].isConvertibleTo(Json::ValueType::stringValue) )
+	throw Exception("controlstrategy must be a string");
 
-    // return success
-    Json::Value retval;
-    retval["status"] = "success";
-    retval["data"] = Json::Value(Json::ValueType::nullValue);
+      controlstrategy = _data["controlstrategy"].asString();
+    }
+
+    // a bad value throws before the new snapshot is published
+    Config::update([&](Config &_cfg) {
+      _cfg.setHEPower(hepwr).
+	setTempAccuracy(tempaccuracy).
+	setHeatOverhead(heatoverhead).
+	setCoolTemp(cooltemp).
+	setHEDelay(hedelay).
+	setLogLevel(loglevel).
+	setControlStrategy(controlstrategy);
+    });
 
-    return std::make_shared<Json::Value>(retval);
+    // return success
+    _reply["status"] = "success";
+    _reply["data"] = Json::Value(Json::ValueType::nullValue);
   }
 
-  std::shared_ptr<Json::Value> PRWorkerThread::handleSetCoolTemp(const Json::Value &_data) {
+  void PRWorkerThread::handleSetCoolTemp(const Json::Value &_data, Json::Value &_reply) {
     ProcessState &ps(ProcessState::getInstance());
 
     // we cannot set maintenance options if we're not in maintmode
@@ -1193,11 +1265,7 @@ namespace aegir {
 	throw Exception("cooltemp is out of range");
     }
 
-    Json::Value retval;
-
     ps.setCoolTemp(cooltemp);
-    retval["status"] = "success";
-
-    return std::make_shared<Json::Value>(retval);
+    _reply["status"] = "success";
   }
 }
@@ -7,14 +7,16 @@
 #define AEGIR_PRWORKERTHREAD_H
 
 #include <json/json.h>
-#include <memory>
-#include <functional>
 #include <map>
+#include <memory>
 #include <string>
+#include <string_view>
 
 #include "ThreadManager.hh"
 #include "ZMQ.hh"
 #include "LogChannel.hh"
+#include "Metrics.hh"
+#include "StateSnapshot.hh"
 
 namespace aegir {
 
@@ -25,41 +27,76 @@ namespace aegir {
     PRWorkerThread &operator=(PRWorkerThread &&) = delete;
     PRWorkerThread &operator=(const PRWorkerThread &) = delete;
   public:
-    PRWorkerThread(std::string _name);
+    // embedded workers are not started as a thread, only their handlers
+    // are used through handleRequest(), e.g. by the HTTP thread
+    PRWorkerThread(std::string _name, bool _embedded=false);
     virtual ~PRWorkerThread();
 
   public:
     virtual void run();
+    // handles a command envelope, the serialized reply is placed into _out
+    inline void handleRequest(const Json::Value &_msg, std::string &_out) {
+      handleJSONMessage(_msg, _out);
+    };
 
   private:
     std::string c_name;
     ZMQ::Socket c_mq_prw, c_mq_iocmd;
-    std::map<std::string, std::function<std::shared_ptr<Json::Value> (const Json::Value&) > > c_handlers;
+    // reused between the requests
+    Json::Value c_reply;
+    std::string c_rawreply;
+    // the state snapshot a batch's commands read, null outside of batches
+    const StateSnapshot::Reader *c_batchsnap;
     LogChannel c_log;
 
+    // the max number of commands in a batch
+    static constexpr uint32_t c_maxbatch = 16;
+
+    // an entry in the command table, the raw handler is optional
+    struct Command {
+      void (PRWorkerThread::*handler)(const Json::Value &, Json::Value &);
+      void (PRWorkerThread::*rawhandler)(const Json::Value &, std::string &);
+    };
+    // the commands' latencies, cached by every worker
+    std::map<const Command*, Metrics::Histogram*> c_cmdmetrics;
+
   private:
-    std::shared_ptr<Json::Value> handleJSONMessage(const Json::Value &_msg);
-    std::shared_ptr<Json::Value> handleLoadProgram(const Json::Value &_data);
-    std::shared_ptr<Json::Value> handleGetLoadedProgram(const Json::Value &_data);
-    std::shared_ptr<Json::Value> handleGetState(const Json::Value &_data);
-    std::shared_ptr<Json::Value> handleSetState(const Json::Value &_data);
-    std::shared_ptr<Json::Value> handleBuzzer(const Json::Value &_data);
-    std::shared_ptr<Json::Value> handleHasMalt(const Json::Value &_data);
-    std::shared_ptr<Json::Value> handleSpargeDone(const Json::Value &_data);
-    std::shared_ptr<Json::Value> handleCoolingDone(const Json::Value &_data);
-    std::shared_ptr<Json::Value> handleTransferDone(const Json::Value &_data);
-    std::shared_ptr<Json::Value> handleStartHopping(const Json::Value &_data);
-    std::shared_ptr<Json::Value> handleResetProcess(const Json::Value &_data);
-    std::shared_ptr<Json::Value> handleGetVolume(const Json::Value &_data);
-    std::shared_ptr<Json::Value> handleSetVolume(const Json::Value &_data);
-    std::shared_ptr<Json::Value> handleGetTempHistory(const Json::Value &_data);
-    std::shared_ptr<Json::Value> handleStartMaintenance(const Json::Value &_data);
-    std::shared_ptr<Json::Value> handleStopMaintenance(const Json::Value &_data);
-    std::shared_ptr<Json::Value> handleSetMaintenance(const Json::Value &_data);
-    std::shared_ptr<Json::Value> handleOverride(const Json::Value &_data);
-    std::shared_ptr<Json::Value> handleGetConfig(const Json::Value &_data);
-    std::shared_ptr<Json::Value> handleSetConfig(const Json::Value &_data);
-    std::shared_ptr<Json::Value> handleSetCoolTemp(const Json::Value &_data);
+    static const Command *findCommand(std::string_view _name);
+    static const Command *parseRequest(const Json::Value &_msg, const Json::Value *&_data,
+				       std::string &_error);
+    static void setError(Json::Value &_reply, const std::string &_message);
+    static bool isReadOnly(const Command &_command);
+    Metrics::Histogram &commandMetric(const Command &_command, const Json::Value &_msg);
+    bool runCommand(const Command &_command, const Json::Value &_data,
+		    Json::Value &_reply, std::string *_raw);
+    void serializeReply(std::string &_out);
+    void handleJSONMessage(const Json::Value &_msg, std::string &_out);
+    void handleBatch(const Json::Value &_data, Json::Value &_reply);
+    void handleLoadProgram(const Json::Value &_data, Json::Value &_reply);
+    void handleGetLoadedProgram(const Json::Value &_data, Json::Value &_reply);
+    void handleGetState(const Json::Value &_data, std::string &_reply);
+    void handleGetStateJSON(const Json::Value &_data, Json::Value &_reply);
+    void handleSetState(const Json::Value &_data, Json::Value &_reply);
+    void handleBuzzer(const Json::Value &_data, Json::Value &_reply);
+    void handleHasMalt(const Json::Value &_data, Json::Value &_reply);
+    void handleSpargeDone(const Json::Value &_data, Json::Value &_reply);
+    void handleCoolingDone(const Json::Value &_data, Json::Value &_reply);
+    void handleTransferDone(const Json::Value &_data, Json::Value &_reply);
+    void handleStartHopping(const Json::Value &_data, Json::Value &_reply);
+    void handleResetProcess(const Json::Value &_data, Json::Value &_reply);
+    void handleGetVolume(const Json::Value &_data, Json::Value &_reply);
+    void handleSetVolume(const Json::Value &_data, Json::Value &_reply);
+    void handleGetTempHistory(const Json::Value &_data, Json::Value &_reply);
+    void handleStartMaintenance(const Json::Value &_data, Json::Value &_reply);
+    void handleStopMaintenance(const Json::Value &_data, Json::Value &_reply);
+    void handleSetMaintenance(const Json::Value &_data, Json::Value &_reply);
+    void handleOverride(const Json::Value &_data, Json::Value &_reply);
+    void handleGetConfig(const Json::Value &_data, Json::Value &_reply);
+    void handleGetMetrics(const Json::Value &_data, Json::Value &_reply);
+    void handleGetLoop(const Json::Value &_data, Json::Value &_reply);
+    void handleDumpTrace(const Json::Value &_data, Json::Value &_reply);
+    void handleSetConfig(const Json::Value &_data, Json::Value &_reply);
+    void handleSetCoolTemp(const Json::Value &_data, Json::Value &_reply);
   };
 }
 
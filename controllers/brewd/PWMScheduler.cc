@@ -0,0 +1,104 @@
+
+#include "PWMScheduler.hh"
+#include "Exception.hh"
+
+#include <cmath>
+#include <algorithm>
+
+namespace aegir {
+
+  PWMScheduler::PWMScheduler(uint32_t _minpulse): c_minpulse(_minpulse) {
+  }
+
+  PWMScheduler::~PWMScheduler() {
+  }
+
+  bool PWMScheduler::set(int _id, uint32_t _cycletime, float _ratio, uint64_t _acquired) {
+    _ratio = std::clamp(_ratio, 0.0f, 1.0f);
+    _cycletime = std::max(_cycletime, 2*c_minpulse);
+
+    auto it = c_channels.find(_id);
+    if ( it != c_channels.end() ) {
+      // applied on the next cycle boundary
+      it->second.newcycletime = _cycletime;
+      it->second.newratio = _ratio;
+      if ( _acquired ) it->second.acquired = _acquired;
+      return false;
+    }
+
+    c_channels[_id] = {_cycletime, _cycletime, _ratio, _ratio, 0, 0, 0, _acquired, {0, 0, 0, 0}};
+    return true;
+  }
+
+  void PWMScheduler::clear(int _id) {
+    c_channels.erase(_id);
+  }
+
+  PWMScheduler::Cycle PWMScheduler::nextCycle(int _id, uint64_t _now) {
+    auto it = c_channels.find(_id);
+    if ( it == c_channels.end() )
+      throw Exception("PWMScheduler::nextCycle(): no such channel: %i", _id);
+
+    Channel &ch(it->second);
+
+    // the finished cycle, a late boundary is not more energy
+    if ( ch.cyclestart && _now > ch.cyclestart ) {
+      uint64_t elapsed = _now - ch.cyclestart;
+      uint64_t ontime = std::min<uint64_t>(ch.ontime, elapsed);
+
+      ch.delivered.ratio = (1.0f * ontime) / elapsed;
+      ch.delivered.ontime += ontime;
+      ch.delivered.elapsed += elapsed;
+      ++ch.delivered.cycles;
+    }
+
+    bool rearm = ch.cycletime != ch.newcycletime;
+    uint64_t acquired = ch.acquired;
+    ch.cycletime = ch.newcycletime;
+    ch.ratio = ch.newratio;
+    ch.cyclestart = _now;
+    ch.acquired = 0;
+
+    // the sigma-delta: the pulses shorter than the output can switch
+    // are carried over, as are the too short off times
+    float want = ch.ratio * ch.cycletime + ch.error;
+    if ( ch.ratio <= 0 ) {
+      ch.ontime = 0;
+      ch.error = 0;
+    } else if ( ch.ratio >= 1 ) {
+      ch.ontime = ch.cycletime;
+      ch.error = 0;
+    } else {
+      if ( want < c_minpulse ) {
+	ch.ontime = 0;
+      } else if ( want > ch.cycletime - c_minpulse ) {
+	ch.ontime = ch.cycletime;
+      } else {
+	ch.ontime = std::lround(want);
+      }
+      ch.error = std::clamp(want - ch.ontime, -1.0f*ch.cycletime, 1.0f*ch.cycletime);
+    }
+
+    return {ch.cycletime, ch.ontime, rearm, acquired};
+  }
+
+  void PWMScheduler::shorten(int _id, uint32_t _ontime) {
+    auto it = c_channels.find(_id);
+    if ( it == c_channels.end() )
+      throw Exception("PWMScheduler::shorten(): no such channel: %i", _id);
+
+    Channel &ch(it->second);
+    if ( _ontime >= ch.ontime ) return;
+
+    ch.error = std::min(ch.error + (ch.ontime - _ontime), 1.0f*ch.cycletime);
+    ch.ontime = _ontime;
+  }
+
+  const PWMScheduler::Delivered &PWMScheduler::getDelivered(int _id) const {
+    auto it = c_channels.find(_id);
+    if ( it == c_channels.end() )
+      throw Exception("PWMScheduler::getDelivered(): no such channel: %i", _id);
+
+    return it->second.delivered;
+  }
+}
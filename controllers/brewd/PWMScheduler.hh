@@ -0,0 +1,90 @@
+/*
+ * Pulse-width modulation of the output pins
+ * Every pulsating pin runs on its own fixed cycle, and a new on-ratio or
+ * cycle time only takes effect at the next cycle boundary, so frequent
+ * ratio updates don't reset the phase and don't distort the delivered power.
+ * The on-time of a cycle is modulated with a first-order sigma-delta: the
+ * difference between the requested and the realised on-time is carried over
+ * to the next cycles. This way the ratios below the shortest pulse the
+ * output can switch are delivered as occasional minimal pulses instead of
+ * being rounded to nothing.
+ * The scheduler only does the bookkeeping, the timers are the caller's.
+ * A change carries the stamp of the input it was decided on, and the cycle
+ * applying it returns it, so the actuation latency is measured up to the
+ * output's edge.
+ */
+
+#ifndef AEGIR_PWMSCHEDULER_H
+#define AEGIR_PWMSCHEDULER_H
+
+#include <cstdint>
+#include <map>
+
+namespace aegir {
+
+  class PWMScheduler {
+    PWMScheduler(PWMScheduler&&) = delete;
+    PWMScheduler(const PWMScheduler &) = delete;
+    PWMScheduler &operator=(PWMScheduler &&) = delete;
+    PWMScheduler &operator=(const PWMScheduler &) = delete;
+  public:
+    // a cycle to run, msecs
+    struct Cycle {
+      uint32_t cycletime;
+      uint32_t ontime;
+      // the cycle time changed, the cycle timer has to be re-armed
+      bool rearm;
+      // the stamp of the change applied by this cycle, 0 if none
+      uint64_t acquired;
+    };
+    // the energy actually delivered
+    struct Delivered {
+      // the on-ratio of the last finished cycle
+      float ratio;
+      // the total on and elapsed time of the finished cycles, msecs
+      uint64_t ontime;
+      uint64_t elapsed;
+      uint32_t cycles;
+    };
+
+  public:
+    // _minpulse is the shortest on or off time the output switches, msecs
+    explicit PWMScheduler(uint32_t _minpulse);
+    ~PWMScheduler();
+
+    // sets the parameters of a channel, returns true when it's a new one,
+    // and its first cycle has to be started. _acquired is the input's
+    // stamp the change was decided on, a change without one keeps the
+    // pending stamp
+    bool set(int _id, uint32_t _cycletime, float _ratio, uint64_t _acquired = 0);
+    void clear(int _id);
+    inline bool isActive(int _id) const { return c_channels.find(_id) != c_channels.end(); };
+
+    // a cycle boundary of the channel at _now (msecs, monotonic):
+    // the previous cycle is accounted and the next one is scheduled
+    Cycle nextCycle(int _id, uint64_t _now);
+    // the current cycle only got _ontime, the rest is carried over
+    void shorten(int _id, uint32_t _ontime);
+    const Delivered &getDelivered(int _id) const;
+
+  private:
+    struct Channel {
+      uint32_t cycletime, newcycletime;
+      float ratio, newratio;
+      // the sigma-delta's accumulated on-time error, msecs
+      float error;
+      // the current cycle, its start is 0 before the first one
+      uint32_t ontime;
+      uint64_t cyclestart;
+      // the pending change's stamp
+      uint64_t acquired;
+      Delivered delivered;
+    };
+
+  private:
+    uint32_t c_minpulse;
+    std::map<int, Channel> c_channels;
+  };
+}
+
+#endif
@@ -0,0 +1,94 @@
+/*
+ * Compile-time perfect hash table for a fixed set of string keys
+ * The seed of the FNV-1a hash is searched at compile time, so that every
+ * key lands in its own slot. A lookup is a single hash and one compare.
+ */
+
+#ifndef AEGIR_PERFECTHASH_H
+#define AEGIR_PERFECTHASH_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string_view>
+
+namespace aegir {
+
+  constexpr uint32_t fnv1a(std::string_view _str, uint32_t _seed) {
+    uint32_t hash = 2166136261u ^ _seed;
+    for (char c: _str) {
+      hash ^= static_cast<uint8_t>(c);
+      hash *= 16777619u;
+    }
+    return hash;
+  }
+
+  template<typename T, std::size_t N>
+  class PerfectHash {
+    static_assert(N > 0 && N < 255, "PerfectHash supports 1..254 keys");
+
+  public:
+    // the table is kept sparse, so that a seed is found quickly
+    static constexpr std::size_t c_size = [] {
+      std::size_t s = 1;
+      while ( s < N*2 ) s <<= 1;
+      return s;
+    }();
+    // the low bits of FNV-1a only depend on the low bits of the seed,
+    // so the slot is taken from the top bits
+    static constexpr uint32_t c_shift = [] {
+      uint32_t shift = 32;
+      for (std::size_t s = c_size; s > 1; s >>= 1) --shift;
+      return shift;
+    }();
+    static constexpr uint8_t c_empty = 0xff;
+    static constexpr uint32_t c_maxseed = 1u<<16;
+
+    struct entry {
+      std::string_view name;
+      T value;
+    };
+
+  public:
+    consteval PerfectHash(const entry (&_entries)[N]): c_seed(0) {
+      for (std::size_t i=0; i<N; ++i) c_entries[i] = _entries[i];
+
+      for (c_seed=0; c_seed < c_maxseed; ++c_seed) {
+	if ( tryseed() ) return;
+      }
+      // throwing in a consteval function fails the compilation
+      throw "PerfectHash: no collision-free seed found";
+    }
+
+    constexpr const T *find(std::string_view _key) const {
+      uint8_t idx = c_slots[slotof(_key)];
+      if ( idx == c_empty || c_entries[idx].name != _key )
+	return nullptr;
+      return &c_entries[idx].value;
+    }
+
+    constexpr uint32_t seed() const { return c_seed; };
+    constexpr std::size_t size() const { return N; };
+
+  private:
+    entry c_entries[N]{};
+    uint8_t c_slots[c_size]{};
+    uint32_t c_seed;
+
+    constexpr uint32_t slotof(std::string_view _key) const {
+      return fnv1a(_key, c_seed) >> c_shift;
+    }
+
+    constexpr bool tryseed() {
+      for (std::size_t i=0; i<c_size; ++i) c_slots[i] = c_empty;
+
+      for (std::size_t i=0; i<N; ++i) {
+	uint32_t slot = slotof(c_entries[i].name);
+	if ( c_slots[slot] != c_empty ) return false;
+	c_slots[slot] = i;
+      }
+      return true;
+    }
+  };
+}
+
+#endif
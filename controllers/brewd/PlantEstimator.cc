@@ -0,0 +1,100 @@
+
+#include "PlantEstimator.hh"
+
+#include <algorithm>
+
+namespace aegir {
+
+  static constexpr double c_ambient = 20.0;
+  // forgetting factor, ~80 minutes of memory
+  static constexpr double c_lambda = 0.9998;
+  // the estimates are trusted after this many samples
+  static constexpr uint32_t c_minsamples = 600;
+  // the flow is only observable while the tube is heating
+  static constexpr double c_minrimsdiff = 0.5;
+
+  PlantEstimator::PlantEstimator(): c_heat(c_lambda, 1e3), c_flow(c_lambda, 1e2),
+				    c_ring(c_window + c_lag + 1) {
+    reset(0);
+  }
+
+  PlantEstimator::~PlantEstimator() {
+  }
+
+  void PlantEstimator::reset(float _hepower) {
+    c_hepower = _hepower;
+    c_next = 0;
+    c_heidx = 0;
+    c_nsamples = 0;
+    c_summt = c_sumx = c_sumu = 0;
+    c_heat.reset({_hepower, 0});
+    c_flow.reset({0});
+    c_estimates = {_hepower, 0, 0, 0, false};
+  }
+
+  void PlantEstimator::update(const TSDB &_db, const HERatioDB &_heratios, float _volume) {
+    uint32_t size = _db.size();
+
+    // the TSDB was cleared, it's a new brew
+    if ( size < c_next ) reset(c_hepower);
+    if ( c_heidx > _heratios.size() ) c_heidx = 0;
+
+    for (; c_next < size; ++c_next) {
+      TSDB::entry e = _db.at(c_next);
+
+      // the on-ratio in effect, the history is in time order as well
+      while ( c_heidx < _heratios.size() && _heratios[c_heidx].time <= e.time ) ++c_heidx;
+      float u = c_heidx ? _heratios[c_heidx-1].ratio : 0;
+
+      addSample(e, u, _volume);
+    }
+  }
+
+  void PlantEstimator::addSample(const TSDB::entry &_entry, float _u, float _volume) {
+    const uint32_t ringsize = c_ring.size();
+    uint32_t n = c_nsamples++;
+    sample &s = c_ring[n % ringsize];
+
+    s.time = _entry.time;
+    s.mt = _entry[ThermoCouple::MT];
+    s.x = _entry[ThermoCouple::RIMS] - s.mt;
+    s.u = _u;
+
+    // the window of the temperatures is (n-c_window, n], the on-ratios'
+    // is the same, c_lag earlier
+    c_summt += s.mt;
+    c_sumx += s.x;
+    if ( n >= c_window ) {
+      const sample &old = c_ring[(n - c_window) % ringsize];
+      c_summt -= old.mt;
+      c_sumx -= old.x;
+    }
+    if ( n >= c_lag ) c_sumu += c_ring[(n - c_lag) % ringsize].u;
+    if ( n >= c_lag + c_window ) c_sumu -= c_ring[(n - c_lag - c_window) % ringsize].u;
+
+    if ( n < c_lag + c_window || _volume <= 0 ) return;
+
+    const sample &first = c_ring[(n - c_window) % ringsize];
+    double dt = s.time - first.time;
+    if ( dt <= 0 ) return;
+
+    double mt = c_summt / c_window;
+    double x = c_sumx / c_window;
+    double u = c_sumu / c_window;
+    // the power going into the mash, kW
+    double heat = 4.2 * _volume * (s.mt - first.mt) / dt;
+
+    c_heat.update({u, -(mt - c_ambient)}, heat);
+    double loss = std::max(0.0, c_heat.getTheta(1));
+
+    if ( x > c_minrimsdiff )
+      c_flow.update({4.2 * x}, heat + loss * (mt - c_ambient));
+
+    c_estimates.hepower = c_heat.getTheta(0);
+    c_estimates.loss = loss;
+    c_estimates.flow = c_flow.getTheta(0);
+    c_estimates.samples = n + 1 - (c_lag + c_window);
+    c_estimates.valid = c_estimates.samples >= c_minsamples &&
+      c_estimates.hepower > 0 && c_estimates.flow > 0;
+  }
+}
@@ -0,0 +1,132 @@
+/*
+ * Online plant identification
+ * Recursive least squares estimators running on every new TSDB entry:
+ *  - the heat balance of the mash:
+ *      4.2 * V * dT_mt/dt = P * u - k * (T_mt - T_ambient)
+ *    gives the effective heating element power P and the heat loss k
+ *  - the heat carried over by the recirculation:
+ *      4.2 * V * dT_mt/dt + k * (T_mt - T_ambient) = 4.2 * F * (T_rims - T_mt)
+ *    gives the flow rate F
+ * The derivatives and the regressors are averaged over a sliding window with
+ * running sums, so the RIMS tube's and the sensors' lag is smoothed out and an
+ * update is O(1). The on-ratio is taken c_lag earlier, that's roughly how
+ * long the heat takes to reach the mash tun's sensor. The old data is
+ * forgotten exponentially, the estimates are for the current brew.
+ */
+
+#ifndef AEGIR_PLANTESTIMATOR_H
+#define AEGIR_PLANTESTIMATOR_H
+
+#include <cstdint>
+#include <cstddef>
+#include <array>
+#include <vector>
+
+#include "TSDB.hh"
+#include "HERatioDB.hh"
+
+namespace aegir {
+
+  /*
+   * Recursive least squares with exponential forgetting
+   */
+  template<std::size_t N>
+  class RLS {
+  public:
+    typedef std::array<double, N> vector_t;
+
+    RLS(double _lambda, double _p0): c_lambda(_lambda), c_p0(_p0) {
+      reset(vector_t{});
+    }
+
+    void reset(const vector_t &_theta) {
+      c_theta = _theta;
+      for (std::size_t i=0; i<N; ++i)
+	for (std::size_t j=0; j<N; ++j)
+	  c_p[i][j] = i == j ? c_p0 : 0;
+    }
+
+    void update(const vector_t &_phi, double _y) {
+      vector_t pphi{};
+      double denom = c_lambda;
+
+      for (std::size_t i=0; i<N; ++i) {
+	for (std::size_t j=0; j<N; ++j) pphi[i] += c_p[i][j] * _phi[j];
+	denom += _phi[i] * pphi[i];
+      }
+
+      double err = _y;
+      for (std::size_t i=0; i<N; ++i) err -= _phi[i] * c_theta[i];
+
+      // gain, parameters, then the covariance
+      for (std::size_t i=0; i<N; ++i) c_theta[i] += pphi[i] / denom * err;
+      for (std::size_t i=0; i<N; ++i)
+	for (std::size_t j=0; j<N; ++j)
+	  c_p[i][j] = (c_p[i][j] - pphi[i] * pphi[j] / denom) / c_lambda;
+    }
+
+    inline const vector_t &getTheta() const { return c_theta; };
+    inline double getTheta(std::size_t _i) const { return c_theta[_i]; };
+
+  private:
+    double c_lambda, c_p0;
+    vector_t c_theta;
+    std::array<vector_t, N> c_p;
+  };
+
+  class PlantEstimator {
+    PlantEstimator(PlantEstimator&&) = delete;
+    PlantEstimator(const PlantEstimator &) = delete;
+    PlantEstimator &operator=(PlantEstimator &&) = delete;
+    PlantEstimator &operator=(const PlantEstimator &) = delete;
+  public:
+    struct Estimates {
+      // effective heating element power, kW
+      float hepower;
+      // heat loss, kW/C
+      float loss;
+      // recirculation flow rate, l/s
+      float flow;
+      uint32_t samples;
+      // whether there's enough data to trust the estimates
+      bool valid;
+    };
+
+    // the averaging window, secs
+    static constexpr uint32_t c_window = 60;
+    // the heating element to the MT sensor, secs
+    static constexpr uint32_t c_lag = 20;
+
+  public:
+    PlantEstimator();
+    ~PlantEstimator();
+
+    // starts over with the nominal element power
+    void reset(float _hepower);
+    // processes the TSDB entries added since the last update
+    void update(const TSDB &_db, const HERatioDB &_heratios, float _volume);
+
+    inline const Estimates &getEstimates() const { return c_estimates; };
+
+  private:
+    struct sample {
+      time_t time;
+      float mt, x, u;
+    };
+    void addSample(const TSDB::entry &_entry, float _u, float _volume);
+
+  private:
+    RLS<2> c_heat;
+    RLS<1> c_flow;
+    float c_hepower;
+    uint32_t c_next;
+    uint32_t c_heidx;
+    // the last samples, and the running sums of the window
+    std::vector<sample> c_ring;
+    uint32_t c_nsamples;
+    double c_summt, c_sumx, c_sumu;
+    Estimates c_estimates;
+  };
+}
+
+#endif
@@ -0,0 +1,72 @@
+
+#include "PowerBudget.hh"
+
+#include <algorithm>
+
+namespace aegir {
+
+  PowerBudget::PowerBudget(uint32_t _maxpower): c_maxpower(_maxpower) {
+  }
+
+  PowerBudget::~PowerBudget() {
+  }
+
+  void PowerBudget::addElement(int _id, uint32_t _power) {
+    c_elements.push_back({_id, _power});
+  }
+
+  void PowerBudget::clear() {
+    c_elements.clear();
+  }
+
+  PowerBudget::Slots PowerBudget::allocate(uint32_t _window, const std::map<int, uint32_t> &_ontimes) const {
+    Slots slots;
+    // the load of the circuit: from every breakpoint until the next one
+    std::map<uint32_t, uint32_t> load{{0, 0}, {_window, 0}};
+
+    for (auto &[id, power]: c_elements) {
+      auto it = _ontimes.find(id);
+      if ( it == _ontimes.end() ) continue;
+
+      uint32_t want = std::min(it->second, _window);
+      if ( !want ) {
+	slots[id] = {0, 0};
+	continue;
+      }
+
+      // an element alone is always allowed, even when it's over the limit
+      auto fits = [&](uint32_t _load) {
+	return !c_maxpower || !_load || _load + power <= c_maxpower;
+      };
+
+      // the first gap that's long enough, or the longest one
+      uint32_t beststart(0), bestlen(0);
+      for (auto start = load.begin(); start->first < _window; ++start) {
+	if ( !fits(start->second) ) continue;
+
+	auto end = start;
+	while ( end->first < _window && fits(end->second) ) ++end;
+
+	uint32_t len = end->first - start->first;
+	if ( len > bestlen ) {
+	  beststart = start->first;
+	  bestlen = len;
+	}
+	if ( bestlen >= want ) break;
+      }
+
+      Slot slot{beststart, std::min(want, bestlen)};
+      slots[id] = slot;
+      if ( !slot.ontime ) continue;
+
+      // add it to the load, splitting at its ends
+      uint32_t slotend = slot.offset + slot.ontime;
+      load.emplace(slot.offset, std::prev(load.upper_bound(slot.offset))->second);
+      load.emplace(slotend, std::prev(load.upper_bound(slotend))->second);
+      for (auto lt = load.find(slot.offset); lt->first < slotend; ++lt)
+	lt->second += power;
+    }
+
+    return slots;
+  }
+}
@@ -0,0 +1,56 @@
+/*
+ * Power budget of the heating elements
+ * On a single circuit the heating elements can't all be on at once, so the
+ * elements share a common PWM window, and every element's on-time is placed
+ * into the window where the circuit still has room for it. The elements are
+ * placed in priority order, the first one at the start of the window, the
+ * rest in the gaps left, so e.g. the HLT heats while the RIMS element is
+ * idle during the mash holds. An element that doesn't fit gets the longest
+ * gap there is.
+ */
+
+#ifndef AEGIR_POWERBUDGET_H
+#define AEGIR_POWERBUDGET_H
+
+#include <cstdint>
+#include <map>
+#include <vector>
+
+namespace aegir {
+
+  class PowerBudget {
+    PowerBudget(PowerBudget&&) = delete;
+    PowerBudget(const PowerBudget &) = delete;
+    PowerBudget &operator=(PowerBudget &&) = delete;
+    PowerBudget &operator=(const PowerBudget &) = delete;
+  public:
+    // an element's place in the window, msecs
+    struct Slot {
+      uint32_t offset;
+      uint32_t ontime;
+    };
+    typedef std::map<int, Slot> Slots;
+
+  public:
+    // _maxpower is the circuit's limit in W, 0 is unlimited
+    explicit PowerBudget(uint32_t _maxpower = 0);
+    ~PowerBudget();
+
+    // the elements are added in priority order
+    void addElement(int _id, uint32_t _power);
+    void clear();
+    inline void setMaxPower(uint32_t _maxpower) { c_maxpower = _maxpower; };
+    inline uint32_t getMaxPower() const { return c_maxpower; };
+    inline const std::vector<std::pair<int, uint32_t>> &getElements() const { return c_elements; };
+
+    // places the requested on-times (by element) in a window of _window msecs
+    Slots allocate(uint32_t _window, const std::map<int, uint32_t> &_ontimes) const;
+
+  private:
+    uint32_t c_maxpower;
+    // id, power
+    std::vector<std::pair<int, uint32_t>> c_elements;
+  };
+}
+
+#endif
@@ -2,6 +2,7 @@
 #include "ProcessState.hh"
 #include "Exception.hh"
 #include "Config.hh"
+#include "Clock.hh"
 
 #include <time.h>
 
@@ -103,10 +104,10 @@ namespace aegir {
     // once we need to start keeping track of the time,
     // the reference time is noted
     if ( c_state < States::Mashing && _st >= States::Mashing )
-      c_startedat = time(0);
+      c_startedat = Clock::now();
 
     if ( c_state <= States::Sparging && _st > States::Sparging )
-      c_t_endsparge = time(0);
+      c_t_endsparge = Clock::now();
 
     // and finally set the state
     States old(c_state);
@@ -140,6 +141,7 @@ namespace aegir {
     c_maint_bkpump = false;
     c_levelerror = false;
     c_maint_temp = 37;
+    c_maint_autotune = false;
     c_t_hopstart = 0;
     c_hopid = 0;
 
@@ -155,6 +157,10 @@ namespace aegir {
     return g_strstates[c_state];
   }
 
+  std::string ProcessState::getStringState(States _state) {
+    return g_strstates[_state];
+  }
+
   ProcessState::States ProcessState::byString(const std::string &_state) const {
     States st;
 
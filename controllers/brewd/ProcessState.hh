@@ -21,6 +21,7 @@
 
 #include "Program.hh"
 #include "TSDB.hh"
+#include "StateSnapshot.hh"
 
 namespace aegir {
 
@@ -72,6 +73,7 @@ namespace aegir {
     std::shared_ptr<Program> getProgram();
     inline States getState() const { return c_state; };
     std::string getStringState() const;
+    static std::string getStringState(States _state);
     States byString(const std::string &_state) const;
     ProcessState &setState(States _st);
     ProcessState &reset();
@@ -103,6 +105,8 @@ namespace aegir {
     inline bool getMaintHeat() {return c_maint_heat; };
     inline ProcessState &setMaintTemp(float _val) {c_maint_temp = _val; return *this; };
     inline float getMaintTemp() {return c_maint_temp; };
+    inline ProcessState &setMaintAutoTune(bool _val) {c_maint_autotune = _val; return *this; };
+    inline bool getMaintAutoTune() {return c_maint_autotune; };
     inline ProcessState &setHoppingStart(uint32_t _val) {c_t_hopstart = _val; return *this; };
     inline uint32_t getHoppingStart() { return c_t_hopstart; };
     inline ProcessState &setHopId(uint32_t _val) { c_hopid = _val; return *this; };
@@ -119,6 +123,10 @@ namespace aegir {
     inline bool getBKPump() { return c_bkpump; };
     inline ProcessState &setCoolTemp(float _val) { c_cooltemp = _val; return *this; };
     inline float getCoolTemp() { return c_cooltemp; };
+    // the published state for the PR side
+    inline StateSnapshot &getSnapshot() { return c_snapshot; };
+    // the control loop's counters and timings, published by the Controller
+    inline StateSnapshot &getLoopSnapshot() { return c_loopsnapshot; };
 
   protected:
     std::recursive_mutex c_mtx_state;
@@ -150,6 +158,7 @@ namespace aegir {
     std::atomic<bool> c_maint_bkpump;
     std::atomic<bool> c_maint_heat;
     std::atomic<float> c_maint_temp;
+    std::atomic<bool> c_maint_autotune;
     // sparge/boil/cool forcings
     std::atomic<bool> c_force_mtpump;
     std::atomic<bool> c_block_heat;
@@ -158,6 +167,9 @@ namespace aegir {
     std::atomic<bool> c_levelerror;
     // cooling temperature
     std::atomic<float> c_cooltemp;
+    // pre-serialized state, published by the Controller
+    StateSnapshot c_snapshot;
+    StateSnapshot c_loopsnapshot;
   };
 }
 
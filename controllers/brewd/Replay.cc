@@ -0,0 +1,142 @@
+
+#include "Replay.hh"
+
+#include <cstdio>
+#include <chrono>
+#include <thread>
+
+#include "Trace.hh"
+#include "Clock.hh"
+#include "Environment.hh"
+#include "JSONMessage.hh"
+#include "PRWorkerThread.hh"
+#include "Exception.hh"
+
+namespace aegir {
+
+  Replay::Replay(const std::string &_file): c_file(_file),
+					    c_ctrl(Controller::getInstance()) {
+  }
+
+  Replay::~Replay() {
+  }
+
+  Replay::Report Replay::run() {
+    TraceReader reader(c_file);
+    auto env = Environment::getInstance();
+    // the PR commands are run by an embedded worker
+    PRWorkerThread prw("Replay", true);
+    Report report{};
+    Trace::Record rec;
+    std::string reply;
+    uint32_t cycletime = 0;
+    int nexttempcontrol = 1;
+
+    c_recorded.clear();
+    c_ctrl->c_replayinputs.clear();
+    c_ctrl->c_replayoutputs.clear();
+    c_ctrl->c_replaying = true;
+
+    try {
+      while ( reader.next(rec) ) {
+	Clock::setReplay(rec.time);
+
+	switch (rec.type) {
+	case Trace::RecordType::Input: {
+	  auto msg = MessageFactory::getInstance().create(rec.data);
+	  // the IOHandler publishes the readings to the Environment as well
+	  if ( msg->type() == MessageType::THERMOREADING ) {
+	    ThermoReadings tr = std::static_pointer_cast<ThermoReadingMessage>(msg)->getTemps();
+	    env->setThermoReadings(tr);
+	  }
+	  c_ctrl->c_replayinputs.push_back(msg);
+	  ++report.inputs;
+	  break;
+	}
+
+	case Trace::RecordType::Command: {
+	  JSONMessage msg(rec.data);
+	  prw.handleRequest(msg.getJSON(), reply);
+	  ++report.commands;
+	  break;
+	}
+
+	case Trace::RecordType::Cycle: {
+	  if ( rec.data.length() != 1 )
+	    throw Exception("Invalid cycle record at %u", rec.time);
+	  // the decisions of the previous cycle are all recorded by now
+	  if ( report.cycles ) compare(report, cycletime);
+
+	  // the state changes from the commands are queued like in the daemon
+	  c_ctrl->c_mythread = std::this_thread::get_id();
+	  auto start = std::chrono::steady_clock::now();
+	  c_ctrl->cycle(rec.data[0] & Trace::Control, rec.data[0] & Trace::TempControl,
+			nexttempcontrol);
+	  report.cycletime += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	  c_ctrl->c_mythread = std::thread::id();
+
+	  cycletime = rec.time;
+	  ++report.cycles;
+	  break;
+	}
+
+	case Trace::RecordType::Output:
+	  c_recorded.push_back(rec.data);
+	  ++report.outputs;
+	  break;
+
+	default:
+	  throw Exception("Unknown trace record type %i", (int)rec.type);
+	}
+      }
+      if ( report.cycles ) compare(report, cycletime);
+    }
+    catch (...) {
+      c_ctrl->c_replaying = false;
+      Clock::setReplay(0);
+      throw;
+    }
+
+    c_ctrl->c_replaying = false;
+    Clock::setReplay(0);
+    return report;
+  }
+
+  void Replay::compare(Report &_report, uint32_t _time) {
+    auto &replayed = c_ctrl->c_replayoutputs;
+
+    if ( replayed != c_recorded ) {
+      ++_report.differing;
+      if ( _report.differences.size() < c_maxdifferences ) {
+	Difference diff{_time, _report.cycles};
+	for (auto &it: c_recorded) diff.recorded.push_back(describe(it));
+	for (auto &it: replayed) diff.replayed.push_back(describe(it));
+	_report.differences.push_back(std::move(diff));
+      }
+    }
+
+    replayed.clear();
+    c_recorded.clear();
+  }
+
+  std::string Replay::describe(const msgstring &_msg) {
+    PinStateMessage msg(_msg);
+    char buff[128];
+
+    switch (msg.getState()) {
+    case PINState::Off:
+      snprintf(buff, sizeof(buff), "%s:Off", msg.getName().c_str());
+      break;
+    case PINState::On:
+      snprintf(buff, sizeof(buff), "%s:On", msg.getName().c_str());
+      break;
+    case PINState::Pulsate:
+      snprintf(buff, sizeof(buff), "%s:Pulsate(%.2fs, %.3f)", msg.getName().c_str(),
+	       msg.getCycletime(), msg.getOnratio());
+      break;
+    default:
+      snprintf(buff, sizeof(buff), "%s:Unknown", msg.getName().c_str());
+    }
+    return buff;
+  }
+}
@@ -0,0 +1,72 @@
+/*
+ * Replays a recorded trace through the Controller
+ * The inputs and the PR commands of the trace are fed back into the
+ * Controller at full speed, with the Clock following the trace, and the
+ * pin decisions of every cycle are compared to the recorded ones. This
+ * way a change of the control logic can be evaluated on past brews, and
+ * the runtime of the cycles benchmarks the control logic.
+ * The Controller is driven directly, the IOHandler and the PR threads
+ * mustn't be running.
+ */
+
+#ifndef AEGIR_REPLAY_H
+#define AEGIR_REPLAY_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+
+#include "Controller.hh"
+#include "Message.hh"
+
+namespace aegir {
+
+  class Replay {
+    Replay() = delete;
+    Replay(Replay&&) = delete;
+    Replay(const Replay &) = delete;
+    Replay &operator=(Replay &&) = delete;
+    Replay &operator=(const Replay &) = delete;
+  public:
+    // a cycle where the decisions differ
+    struct Difference {
+      uint32_t time;
+      uint32_t cycle;
+      std::vector<std::string> recorded;
+      std::vector<std::string> replayed;
+    };
+    struct Report {
+      uint32_t cycles;
+      uint32_t inputs;
+      uint32_t commands;
+      uint32_t outputs;
+      // the number of the cycles with different decisions
+      uint32_t differing;
+      // the first c_maxdifferences of them
+      std::vector<Difference> differences;
+      // the total runtime of the cycles, secs
+      double cycletime;
+    };
+
+  public:
+    explicit Replay(const std::string &_file);
+    ~Replay();
+
+    Report run();
+    // a pin decision, human readable
+    static std::string describe(const msgstring &_msg);
+
+  private:
+    void compare(Report &_report, uint32_t _time);
+
+  private:
+    static constexpr uint32_t c_maxdifferences = 32;
+    std::string c_file;
+    std::shared_ptr<Controller> c_ctrl;
+    // the recorded decisions of the last cycle
+    std::vector<msgstring> c_recorded;
+  };
+}
+
+#endif
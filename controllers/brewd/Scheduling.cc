@@ -0,0 +1,89 @@
+#include "Scheduling.hh"
+
+#include <cerrno>
+#include <cstring>
+#include <sys/param.h>
+#include <sys/cpuset.h>
+#include <sys/mman.h>
+#include <pthread.h>
+#include <pthread_np.h>
+#include <sched.h>
+
+#include "Exception.hh"
+
+namespace aegir {
+
+  void Scheduling::apply(const ThreadSchedConfig &_config) {
+    int err;
+
+    if ( _config.cpus.size() ) {
+      cpuset_t cpus;
+
+      CPU_ZERO(&cpus);
+      for (auto cpu: _config.cpus) {
+	if ( cpu >= CPU_SETSIZE )
+	  throw Exception("CPU %u is out of range", cpu);
+	CPU_SET(cpu, &cpus);
+      }
+      if ( (err = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus)) != 0 )
+	throw Exception("Unable to set the CPU affinity: %s", strerror(err));
+    }
+
+    struct sched_param sp;
+    int policy = SCHED_OTHER;
+
+    memset(&sp, 0, sizeof(sp));
+    if ( _config.policy == SchedPolicies::FIFO ) policy = SCHED_FIFO;
+    else if ( _config.policy == SchedPolicies::RR ) policy = SCHED_RR;
+    if ( policy != SCHED_OTHER ) sp.sched_priority = _config.priority;
+
+    if ( (err = pthread_setschedparam(pthread_self(), policy, &sp)) != 0 )
+      throw Exception("Unable to set the scheduling policy: %s", strerror(err));
+  }
+
+  std::string Scheduling::describe() {
+    struct sched_param sp;
+    int policy;
+    std::string out;
+
+    if ( pthread_getschedparam(pthread_self(), &policy, &sp) != 0 )
+      return "unknown";
+
+    if ( policy == SCHED_FIFO ) out = "fifo/" + std::to_string(sp.sched_priority);
+    else if ( policy == SCHED_RR ) out = "rr/" + std::to_string(sp.sched_priority);
+    else out = "other";
+
+    cpuset_t cpus;
+    CPU_ZERO(&cpus);
+    if ( pthread_getaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0 ) {
+      const char *sep = " cpus ";
+      for (int i=0; i < CPU_SETSIZE; ++i) {
+	if ( !CPU_ISSET(i, &cpus) ) continue;
+	out += sep + std::to_string(i);
+	sep = ",";
+      }
+    }
+    return out;
+  }
+
+  void Scheduling::lockMemory() {
+    if ( mlockall(MCL_CURRENT|MCL_FUTURE) != 0 )
+      throw Exception("Unable to lock the memory: %s", strerror(errno));
+  }
+
+  /*
+   * Every frame touches a page worth of its own, the compiler can't
+   * optimize the volatile writes nor the recursion away
+   */
+  static void __attribute__((noinline)) touchStack(uint32_t _pages) {
+    volatile char page[4096];
+
+    for (uint32_t i=0; i < sizeof(page); i += 256) page[i] = 0;
+    if ( _pages > 1 ) touchStack(_pages - 1);
+    page[0] = page[sizeof(page)-1];
+  }
+
+  void Scheduling::prefaultStack(uint32_t _bytes) {
+    if ( _bytes ) touchStack((_bytes + 4095) / 4096);
+  }
+}
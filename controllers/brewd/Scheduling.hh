@@ -0,0 +1,40 @@
+/*
+ * Real-time scheduling of the threads
+ * A thread can be pinned to a set of CPUs and run with the SCHED_FIFO or
+ * SCHED_RR policies, so the IOHandler's pulses and the Controller's cycles
+ * aren't delayed behind the HTTP and the PR threads. The whole process can
+ * be locked into memory, and the threads' stacks pre-faulted, so no page
+ * fault happens on the timing critical paths.
+ * The real-time policies need root, or the realtime group with FreeBSD's
+ * mac_priority(4); mlockall() needs a large enough RLIMIT_MEMLOCK.
+ */
+
+#ifndef AEGIR_SCHEDULING_H
+#define AEGIR_SCHEDULING_H
+
+#include <cstdint>
+#include <string>
+
+#include "Config.hh"
+
+namespace aegir {
+
+  class Scheduling {
+    Scheduling() = delete;
+    Scheduling(Scheduling&&) = delete;
+    Scheduling(const Scheduling &) = delete;
+    Scheduling &operator=(Scheduling &&) = delete;
+    Scheduling &operator=(const Scheduling &) = delete;
+  public:
+    // applies _config to the calling thread, throws on failure
+    static void apply(const ThreadSchedConfig &_config);
+    // the calling thread's scheduling, as "fifo/50 cpus 0,1"
+    static std::string describe();
+    // locks the process' current and future pages into memory
+    static void lockMemory();
+    // touches the _bytes below the calling frame
+    static void prefaultStack(uint32_t _bytes);
+  };
+}
+
+#endif
@@ -0,0 +1,74 @@
+/*
+ * An atomically swapped pointer to immutable snapshots
+ * The readers never lock: they announce themselves in the current epoch's
+ * reader count, copy the shared_ptr, and leave. The writer swaps the
+ * pointer, moves to the next epoch, and waits for the previous epoch's
+ * readers to leave, only those might still see the old holder, before it
+ * frees it. The readers' window is a single refcount increment, so the
+ * writer's wait is short, and the snapshot itself lives on as long as any
+ * reader holds a copy.
+ * The writers have to be serialized by the caller.
+ */
+
+#ifndef AEGIR_SNAPSHOT_H
+#define AEGIR_SNAPSHOT_H
+
+#include <cstdint>
+#include <atomic>
+#include <memory>
+#include <thread>
+
+namespace aegir {
+
+  template<typename T>
+  class Snapshot {
+    Snapshot() = delete;
+    Snapshot(Snapshot&&) = delete;
+    Snapshot(const Snapshot &) = delete;
+    Snapshot &operator=(Snapshot &&) = delete;
+    Snapshot &operator=(const Snapshot &) = delete;
+  public:
+    explicit Snapshot(std::shared_ptr<const T> _initial):
+      c_current(new std::shared_ptr<const T>(std::move(_initial))), c_epoch(0), c_readers{0, 0} {};
+    ~Snapshot() {
+      delete c_current.load();
+    };
+
+    std::shared_ptr<const T> load() const {
+      while ( true ) {
+	uint64_t epoch = c_epoch.load();
+	std::atomic<uint32_t> &readers = c_readers[epoch & 1];
+
+	readers.fetch_add(1);
+	// the writer moved on meanwhile, it might not wait for us
+	if ( c_epoch.load() != epoch ) {
+	  readers.fetch_sub(1);
+	  continue;
+	}
+	std::shared_ptr<const T> ret(*c_current.load());
+	readers.fetch_sub(1);
+	return ret;
+      }
+    };
+
+    // returns the previous one
+    std::shared_ptr<const T> store(std::shared_ptr<const T> _next) {
+      auto *old = c_current.exchange(new std::shared_ptr<const T>(std::move(_next)));
+      uint64_t epoch = c_epoch.fetch_add(1);
+
+      while ( c_readers[epoch & 1].load() ) std::this_thread::yield();
+      std::shared_ptr<const T> ret(std::move(*old));
+      delete old;
+      return ret;
+    };
+
+    inline uint64_t getEpoch() const { return c_epoch.load(std::memory_order_relaxed); };
+
+  private:
+    std::atomic<std::shared_ptr<const T>*> c_current;
+    std::atomic<uint64_t> c_epoch;
+    mutable std::atomic<uint32_t> c_readers[2];
+  };
+}
+
+#endif
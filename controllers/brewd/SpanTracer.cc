@@ -0,0 +1,213 @@
+#include "SpanTracer.hh"
+
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <fstream>
+#include <unistd.h>
+
+#include "Exception.hh"
+
+namespace aegir {
+
+  static_assert((SpanTracer::c_ringsize & (SpanTracer::c_ringsize - 1)) == 0,
+		"The ring's size has to be a power of 2");
+
+  // a JSON string, the names are interned from anywhere
+  static void writeString(std::ostream &_out, const char *_str) {
+    char esc[8];
+
+    _out << '"';
+    for (const char *c = _str; *c; ++c) {
+      if ( *c == '"' || *c == '\\' ) {
+	_out << '\\' << *c;
+      } else if ( (unsigned char)*c < 0x20 ) {
+	std::snprintf(esc, sizeof(esc), "\\u%04x", (unsigned)*c);
+	_out << esc;
+      } else {
+	_out << *c;
+      }
+    }
+    _out << '"';
+  }
+
+  // the nsecs in the trace's usecs
+  static void writeUsecs(std::ostream &_out, uint64_t _nsecs) {
+    char buff[32];
+
+    std::snprintf(buff, sizeof(buff), "%.3f", _nsecs / 1000.0);
+    _out << buff;
+  }
+
+  SpanTracer::Ring::Ring(uint32_t _tid): tid(_tid), slots(std::make_unique<Slot[]>(c_ringsize)), head(0) {
+  }
+
+  SpanTracer::SpanTracer(): c_flowid(0), c_dumpfile("/var/tmp/aegir-brewd.trace.json") {
+  }
+
+  SpanTracer::~SpanTracer() {
+  }
+
+  SpanTracer &SpanTracer::getInstance() {
+    // never destroyed, the threads might still trace during the exit
+    static SpanTracer *instance = new SpanTracer();
+    return *instance;
+  }
+
+  SpanTracer::Ring &SpanTracer::threadRing() {
+    static thread_local std::shared_ptr<Ring> ring;
+
+    if ( !ring ) {
+      std::lock_guard<std::mutex> g(c_mtx);
+      ring = std::make_shared<Ring>(c_rings.size() + 1);
+      c_rings.push_back(ring);
+    }
+    return *ring;
+  }
+
+  void SpanTracer::setThreadName(const std::string &_name) {
+    Ring &r = threadRing();
+    std::lock_guard<std::mutex> g(c_mtx);
+    r.name = _name;
+  }
+
+  /*
+   * Every slot is a tiny seqlock: the dump running on another thread
+   * skips the slots overwritten while it was reading them
+   */
+  void SpanTracer::push(const Event &_event) {
+    Ring &r = threadRing();
+    uint64_t idx = r.head.load(std::memory_order_relaxed);
+    Slot &s = r.slots[idx & (c_ringsize-1)];
+
+    s.seq.store(2*idx + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    s.name.store(_event.name, std::memory_order_relaxed);
+    s.cat.store(_event.cat, std::memory_order_relaxed);
+    s.ts.store(_event.ts, std::memory_order_relaxed);
+    s.dur.store(_event.dur, std::memory_order_relaxed);
+    s.id.store(_event.id, std::memory_order_relaxed);
+    s.phase.store(_event.phase, std::memory_order_relaxed);
+    s.seq.store(2*idx + 2, std::memory_order_release);
+    r.head.store(idx + 1, std::memory_order_release);
+  }
+
+  void SpanTracer::collect(const Ring &_ring, std::vector<Event> &_out) {
+    uint64_t head = _ring.head.load(std::memory_order_acquire);
+    uint64_t idx = head > c_ringsize ? head - c_ringsize : 0;
+
+    for (; idx < head; ++idx) {
+      const Slot &s = _ring.slots[idx & (c_ringsize-1)];
+      uint64_t seq = s.seq.load(std::memory_order_acquire);
+      Event e{s.name.load(std::memory_order_relaxed), s.cat.load(std::memory_order_relaxed),
+	      s.ts.load(std::memory_order_relaxed), s.dur.load(std::memory_order_relaxed),
+	      s.id.load(std::memory_order_relaxed), s.phase.load(std::memory_order_relaxed)};
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if ( seq != 2*idx + 2 || s.seq.load(std::memory_order_relaxed) != seq ) continue;
+      _out.push_back(e);
+    }
+  }
+
+  void SpanTracer::complete(const char *_name, const char *_cat, uint64_t _start, uint64_t _end) {
+    push(Event{_name, _cat, _start, _end - _start, 0, Phase::Complete});
+  }
+
+  void SpanTracer::instant(const char *_name, const char *_cat) {
+    push(Event{_name, _cat, now(), 0, 0, Phase::Instant});
+  }
+
+  uint64_t SpanTracer::flowStart(const char *_name) {
+    uint64_t id = c_flowid.fetch_add(1, std::memory_order_relaxed) + 1;
+
+    push(Event{_name, "flow", now(), 0, id, Phase::FlowStart});
+    return id;
+  }
+
+  void SpanTracer::flowEnd(const char *_name, uint64_t _id) {
+    push(Event{_name, "flow", now(), 0, _id, Phase::FlowEnd});
+  }
+
+  const char *SpanTracer::intern(const std::string &_str) {
+    std::lock_guard<std::mutex> g(c_mtx);
+    return c_strings.insert(_str).first->c_str();
+  }
+
+  std::vector<SpanTracer::Event> SpanTracer::threadEvents() {
+    std::vector<Event> events;
+
+    collect(threadRing(), events);
+    return events;
+  }
+
+  uint32_t SpanTracer::dump(std::ostream &_out) {
+    std::vector<std::pair<std::shared_ptr<Ring>, std::string>> rings;
+    {
+      std::lock_guard<std::mutex> g(c_mtx);
+      for (auto &it: c_rings) rings.emplace_back(it, it->name);
+    }
+
+    pid_t pid = getpid();
+    uint32_t n = 0;
+    std::vector<Event> events;
+    const char *sep = "\n";
+
+    // streamed field by field, the names aren't bounded
+    _out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    for (auto &[ring, name]: rings) {
+      if ( !name.empty() ) {
+	_out << sep << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":" << (int)pid
+	     << ",\"tid\":" << ring->tid << ",\"args\":{\"name\":";
+	writeString(_out, name.c_str());
+	_out << "}}";
+	sep = ",\n";
+      }
+
+      events.clear();
+      collect(*ring, events);
+      for (auto &e: events) {
+	_out << sep << "{\"ph\":\"" << (char)e.phase << "\",\"name\":";
+	writeString(_out, e.name);
+	_out << ",\"cat\":";
+	writeString(_out, e.cat);
+	_out << ",\"pid\":" << (int)pid << ",\"tid\":" << ring->tid << ",\"ts\":";
+	writeUsecs(_out, e.ts);
+	if ( e.phase == Phase::Complete ) {
+	  _out << ",\"dur\":";
+	  writeUsecs(_out, e.dur);
+	  _out << '}';
+	} else if ( e.phase == Phase::Instant ) {
+	  _out << ",\"s\":\"t\"}";
+	} else {
+	  _out << ",\"id\":" << (unsigned long long)e.id << ",\"bp\":\"e\"}";
+	}
+	sep = ",\n";
+	++n;
+      }
+    }
+    _out << "\n]}\n";
+    return n;
+  }
+
+  uint32_t SpanTracer::dump(const std::string &_file) {
+    std::ofstream out(_file, std::ios::out | std::ios::trunc);
+
+    if ( !out.is_open() )
+      throw Exception("Unable to open the trace dump %s: %s", _file.c_str(), strerror(errno));
+
+    uint32_t n = dump(out);
+    out.close();
+    if ( out.fail() )
+      throw Exception("Unable to write the trace dump %s", _file.c_str());
+    return n;
+  }
+
+  void SpanTracer::setDumpFile(const std::string &_file) {
+    std::lock_guard<std::mutex> g(c_mtx);
+    c_dumpfile = _file;
+  }
+
+  std::string SpanTracer::getDumpFile() {
+    std::lock_guard<std::mutex> g(c_mtx);
+    return c_dumpfile;
+  }
+}
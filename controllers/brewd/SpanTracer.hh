@@ -0,0 +1,151 @@
+/*
+ * Scoped-span tracer
+ * The spans and the message hops are recorded into a fixed ring of the
+ * calling thread, overwriting the oldest events, so the recent past of
+ * every thread is always at hand. A dump writes them out in the Chrome
+ * trace event format, to be opened in chrome://tracing or Perfetto.
+ * The ZMQ messages on the inproc PUB/SUB sockets carry a flow id, so a
+ * reading's way from the IOHandler through the Controller back to the
+ * heater's pin shows up as arrows on the timeline.
+ * The macros are only compiled in with AEGIR_TRACE, otherwise they're
+ * no-ops. The names have to be string literals, or interned.
+ */
+
+#ifndef AEGIR_SPANTRACER_H
+#define AEGIR_SPANTRACER_H
+
+#include <cstdint>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <set>
+#include <string>
+#include <vector>
+
+#ifdef AEGIR_TRACE
+#define AEGIR_TRACE_CONCAT2(_a, _b) _a##_b
+#define AEGIR_TRACE_CONCAT(_a, _b) AEGIR_TRACE_CONCAT2(_a, _b)
+#define AEGIR_TRACE_SPAN(_name) ::aegir::SpanTracer::Span AEGIR_TRACE_CONCAT(aegir_span_, __LINE__)(_name)
+#define AEGIR_TRACE_THREAD(_name) ::aegir::SpanTracer::getInstance().setThreadName(_name)
+#else
+#define AEGIR_TRACE_SPAN(_name) do {} while (0)
+#define AEGIR_TRACE_THREAD(_name) do {} while (0)
+#endif
+
+namespace aegir {
+
+  class SpanTracer {
+    SpanTracer();
+    SpanTracer(SpanTracer&&) = delete;
+    SpanTracer(const SpanTracer &) = delete;
+    SpanTracer &operator=(SpanTracer &&) = delete;
+    SpanTracer &operator=(const SpanTracer &) = delete;
+  public:
+#ifdef AEGIR_TRACE
+    static constexpr bool c_compiled = true;
+#else
+    static constexpr bool c_compiled = false;
+#endif
+    // the events kept of every thread
+    static constexpr uint32_t c_ringsize = 8192;
+
+    // the Chrome trace event phases
+    enum class Phase: char {
+      Complete = 'X',
+      Instant = 'i',
+      FlowStart = 's',
+      FlowEnd = 'f'
+    };
+
+    struct Event {
+      const char *name;
+      const char *cat;
+      // nsecs
+      uint64_t ts;
+      uint64_t dur;
+      // the flow's id
+      uint64_t id;
+      Phase phase;
+    };
+
+    // records its lifetime as a complete event
+    class Span {
+      Span() = delete;
+      Span(Span&&) = delete;
+      Span(const Span &) = delete;
+      Span &operator=(Span &&) = delete;
+      Span &operator=(const Span &) = delete;
+    public:
+      explicit Span(const char *_name, const char *_cat = "aegir"): c_name(_name), c_cat(_cat),
+								  c_start(SpanTracer::now()) {};
+      ~Span() {
+	SpanTracer::getInstance().complete(c_name, c_cat, c_start, SpanTracer::now());
+      };
+
+    private:
+      const char *c_name, *c_cat;
+      uint64_t c_start;
+    };
+
+  public:
+    ~SpanTracer();
+    static SpanTracer &getInstance();
+
+    static inline uint64_t now() {
+      return std::chrono::duration_cast<std::chrono::nanoseconds>
+	(std::chrono::steady_clock::now().time_since_epoch()).count();
+    };
+
+    // the calling thread's name on the timeline
+    void setThreadName(const std::string &_name);
+    void complete(const char *_name, const char *_cat, uint64_t _start, uint64_t _end);
+    void instant(const char *_name, const char *_cat = "aegir");
+    // a message leaving, returns its flow's id
+    uint64_t flowStart(const char *_name);
+    // and arriving, it's bound to the span around it
+    void flowEnd(const char *_name, uint64_t _id);
+    // a copy of _str living as long as the process
+    const char *intern(const std::string &_str);
+
+    // the events of the calling thread, the oldest first
+    std::vector<Event> threadEvents();
+    // the Chrome trace JSON, returns the number of events
+    uint32_t dump(std::ostream &_out);
+    uint32_t dump(const std::string &_file);
+    // where SIGUSR1 dumps the trace
+    void setDumpFile(const std::string &_file);
+    std::string getDumpFile();
+
+  private:
+    struct Slot {
+      // odd while it's being written
+      std::atomic<uint64_t> seq;
+      std::atomic<const char*> name, cat;
+      std::atomic<uint64_t> ts, dur, id;
+      std::atomic<Phase> phase;
+    };
+    struct Ring {
+      explicit Ring(uint32_t _tid);
+      uint32_t tid;
+      std::string name;
+      std::unique_ptr<Slot[]> slots;
+      std::atomic<uint64_t> head;
+    };
+    // the calling thread's ring, registered on first use
+    Ring &threadRing();
+    void push(const Event &_event);
+    // the events of a ring still there, the oldest first
+    static void collect(const Ring &_ring, std::vector<Event> &_out);
+
+  private:
+    std::mutex c_mtx;
+    std::vector<std::shared_ptr<Ring>> c_rings;
+    std::set<std::string> c_strings;
+    std::atomic<uint64_t> c_flowid;
+    std::string c_dumpfile;
+  };
+}
+
+#endif
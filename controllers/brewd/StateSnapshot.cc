@@ -0,0 +1,77 @@
+
+#include "StateSnapshot.hh"
+
+#include "Exception.hh"
+#include "JSONCodec.hh"
+
+namespace aegir {
+
+  /*
+   * StateSnapshot::Reader
+   * The refcount is taken first, then the slot is verified to be still
+   * the published one. The writer never touches a slot with readers,
+   * nor the currently published one.
+   */
+  StateSnapshot::Reader::Reader(const StateSnapshot &_snap) {
+    uint32_t idx;
+    while ( true ) {
+      idx = _snap.c_current.load();
+      _snap.c_slots[idx].readers.fetch_add(1);
+      if ( _snap.c_current.load() == idx ) break;
+      _snap.c_slots[idx].readers.fetch_sub(1);
+    }
+    c_slot = &_snap.c_slots[idx];
+  }
+
+  StateSnapshot::Reader::~Reader() {
+    c_slot->readers.fetch_sub(1);
+  }
+
+  /*
+   * StateSnapshot
+   */
+  StateSnapshot::StateSnapshot(): c_current(0), c_pubversion(0) {
+    for (uint32_t i=0; i<c_nslots; ++i) {
+      c_slots[i].readers = 0;
+      c_slots[i].version = 0;
+      c_slots[i].data = Json::Value(Json::ValueType::objectValue);
+      c_slots[i].json = "{}";
+    }
+  }
+
+  StateSnapshot::~StateSnapshot() {
+  }
+
+  uint64_t StateSnapshot::publish(const Json::Value &_data) {
+    uint32_t curr = c_current.load();
+    std::string json;
+
+    getJSONCodec().write(_data, json);
+
+    // unchanged, the current version stays valid
+    if ( c_slots[curr].version && c_slots[curr].json == json )
+      return c_slots[curr].version;
+
+    // find a free slot
+    uint32_t next = curr;
+    for (uint32_t i=1; i<c_nslots; ++i) {
+      uint32_t idx = (curr+i) % c_nslots;
+      if ( c_slots[idx].readers.load() == 0 ) {
+	next = idx;
+	break;
+      }
+    }
+    if ( next == curr )
+      throw Exception("StateSnapshot: no free slot to publish into");
+
+    slot &s(c_slots[next]);
+    s.version = c_slots[curr].version + 1;
+    s.data = _data;
+    s.json.swap(json);
+
+    c_current.store(next);
+    c_pubversion = s.version;
+
+    return s.version;
+  }
+}
@@ -0,0 +1,71 @@
+/*
+ * Pre-serialized, immutable process state snapshots
+ * The Controller publishes one per control cycle, the PR workers
+ * read them without locking
+ */
+
+#ifndef AEGIR_STATESNAPSHOT_H
+#define AEGIR_STATESNAPSHOT_H
+
+#include <json/json.h>
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace aegir {
+
+  class StateSnapshot {
+  public:
+    // more slots than concurrent readers, so the writer always finds a free one
+    static constexpr uint32_t c_nslots = 8;
+
+  private:
+    struct slot {
+      std::atomic<uint32_t> readers;
+      uint64_t version;
+      Json::Value data;
+      std::string json;
+    };
+
+  public:
+    // Pins the currently published slot while it's being read
+    class Reader {
+    public:
+      Reader() = delete;
+      Reader(Reader&&) = delete;
+      Reader(const Reader&) = delete;
+      Reader &operator=(Reader&&) = delete;
+      Reader &operator=(const Reader&) = delete;
+      Reader(const StateSnapshot &_snap);
+      ~Reader();
+
+      inline uint64_t version() const { return c_slot->version; };
+      inline const std::string &json() const { return c_slot->json; };
+      inline const Json::Value &data() const { return c_slot->data; };
+
+    private:
+      slot *c_slot;
+    };
+    friend Reader;
+
+  public:
+    StateSnapshot();
+    StateSnapshot(StateSnapshot&&) = delete;
+    StateSnapshot(const StateSnapshot&) = delete;
+    StateSnapshot &operator=(StateSnapshot&&) = delete;
+    StateSnapshot &operator=(const StateSnapshot&) = delete;
+    ~StateSnapshot();
+
+    // single writer only. The version is bumped only if the content changed
+    uint64_t publish(const Json::Value &_data);
+    inline uint64_t getVersion() const { return c_pubversion; };
+
+  private:
+    mutable slot c_slots[c_nslots];
+    std::atomic<uint32_t> c_current;
+    std::atomic<uint64_t> c_pubversion;
+  };
+}
+
+#endif
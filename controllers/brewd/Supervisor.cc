@@ -0,0 +1,186 @@
+#include "Supervisor.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <thread>
+#include <vector>
+
+#include "Clock.hh"
+#include "Exception.hh"
+#include "ThreadBase.hh"
+
+namespace aegir {
+
+  static const char *g_statenames[] = {
+    "starting",
+    "running",
+    "stalled",
+    "restarting",
+    "stopped",
+    "failed"
+  };
+
+  Supervisor::Watched::Watched(ThreadBase &_thread, const SupervisorConfig &_config, const std::string &_name):
+    thread(_thread), config(_config), state(States::Starting), restarts(0),
+    m_restarts(Metrics::getInstance().counter("aegir_thread_restarts_total",
+					      "The threads restarted after a failure",
+					      "thread=\"" + _name + "\"")),
+    m_stalls(Metrics::getInstance().counter("aegir_thread_stalls_total",
+					    "The threads missing their heartbeats",
+					    "thread=\"" + _name + "\"")) {
+  }
+
+  Supervisor::Supervisor(): c_log("Supervisor") {
+  }
+
+  Supervisor::~Supervisor() {
+  }
+
+  const char *Supervisor::stateName(States _state) {
+    return g_statenames[(uint8_t)_state];
+  }
+
+  void Supervisor::add(const std::string &_name, ThreadBase &_thread, const SupervisorConfig &_config) {
+    std::lock_guard<std::mutex> g(c_mtx);
+    c_threads[_name] = std::make_unique<Watched>(_thread, _config, _name);
+  }
+
+  Supervisor::Watched &Supervisor::find(const std::string &_name) const {
+    std::lock_guard<std::mutex> g(c_mtx);
+    auto it = c_threads.find(_name);
+
+    if ( it == c_threads.end() )
+      throw Exception("Unknown thread: %s", _name.c_str());
+    return *it->second;
+  }
+
+  void Supervisor::failsafe(const std::string &_name, Watched &_w) {
+    std::lock_guard<std::mutex> g(c_failsafemtx);
+
+    try {
+      _w.thread.failsafe();
+    }
+    catch (std::exception &e) {
+      c_log.error("Fail-safe of thread %s failed: %s", _name.c_str(), e.what());
+    }
+  }
+
+  void Supervisor::execute(const std::string &_name) {
+    Watched &w = find(_name);
+    ThreadBase &thread = w.thread;
+
+    while ( true ) {
+      std::string error;
+
+      thread.heartbeat();
+      w.state = States::Running;
+      try {
+	thread.run();
+	w.state = States::Stopped;
+	return;
+      }
+      catch (std::exception &e) {
+	error = e.what();
+      }
+      catch (...) {
+	error = "unknown exception";
+      }
+
+      // the heartbeats aren't checked from now on
+      w.state = States::Restarting;
+      AEGIR_LOG_EVENT(c_log, error, "thread.failed", {"thread", _name}, {"error", error});
+      failsafe(_name, w);
+
+      if ( !thread.c_run ) {
+	w.state = States::Stopped;
+	return;
+      }
+
+      // the restarts within the window
+      uint64_t now = Clock::monotonic();
+      while ( !w.restarttimes.empty() && now - w.restarttimes.front() >= c_restartwindow * 1000000ull )
+	w.restarttimes.pop_front();
+
+      if ( w.config.restart == RestartPolicies::Never ||
+	   w.restarttimes.size() >= w.config.maxrestarts ) {
+	w.state = States::Failed;
+	AEGIR_LOG_EVENT(c_log, fatal, "thread.gaveup", {"thread", _name},
+			{"restarts", w.restarts.load()});
+	return;
+      }
+
+      // waiting out the backoff, but not a stop
+      uint64_t backoff = std::min<uint64_t>((uint64_t)w.config.backoff << std::min<size_t>(w.restarttimes.size(), 16),
+					    c_maxbackoff);
+      auto until = std::chrono::steady_clock::now() + std::chrono::milliseconds(backoff);
+      w.restarttimes.push_back(now);
+      while ( thread.c_run && std::chrono::steady_clock::now() < until )
+	std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>
+				    (std::chrono::milliseconds(100), until - std::chrono::steady_clock::now()));
+      if ( !thread.c_run ) {
+	w.state = States::Stopped;
+	return;
+      }
+
+      ++w.restarts;
+      w.m_restarts.inc();
+      AEGIR_LOG_EVENT(c_log, warning, "thread.restart", {"thread", _name},
+		      {"restarts", w.restarts.load()}, {"backoff", backoff});
+    }
+  }
+
+  uint32_t Supervisor::check(uint64_t _now) {
+    std::vector<std::pair<std::string, Watched*>> threads;
+    uint32_t stalled = 0;
+    {
+      std::lock_guard<std::mutex> g(c_mtx);
+      for (auto &it: c_threads) threads.emplace_back(it.first, it.second.get());
+    }
+
+    for (auto &[name, w]: threads) {
+      if ( !w->config.timeout ) continue;
+
+      uint64_t heartbeat = w->thread.c_heartbeat.load(std::memory_order_relaxed);
+      uint64_t age = _now > heartbeat ? _now - heartbeat : 0;
+      bool late = age > w->config.timeout * 1000ull;
+      States state = w->state.load();
+
+      if ( state == States::Running && late ) {
+	// only once, a racing failure or restart owns the thread
+	if ( !w->state.compare_exchange_strong(state, States::Stalled) ) continue;
+	w->m_stalls.inc();
+	AEGIR_LOG_EVENT(c_log, error, "thread.stalled", {"thread", name}, {"age", age / 1e6});
+	failsafe(name, *w);
+      } else if ( state == States::Stalled && !late ) {
+	if ( !w->state.compare_exchange_strong(state, States::Running) ) continue;
+	AEGIR_LOG_EVENT(c_log, warning, "thread.recovered", {"thread", name}, {"age", age / 1e6});
+      }
+      if ( w->state.load() == States::Stalled ) ++stalled;
+    }
+    return stalled;
+  }
+
+  Supervisor::States Supervisor::getState(const std::string &_name) const {
+    return find(_name).state.load();
+  }
+
+  uint32_t Supervisor::getRestarts(const std::string &_name) const {
+    return find(_name).restarts.load();
+  }
+
+  void Supervisor::toJSON(Json::Value &_out, uint64_t _now) const {
+    std::lock_guard<std::mutex> g(c_mtx);
+
+    _out = Json::objectValue;
+    for (auto &it: c_threads) {
+      Json::Value &thr = _out[it.first];
+      uint64_t heartbeat = it.second->thread.c_heartbeat.load(std::memory_order_relaxed);
+
+      thr["state"] = stateName(it.second->state.load());
+      thr["restarts"] = it.second->restarts.load();
+      if ( it.second->config.timeout )
+	thr["heartbeat"] = _now > heartbeat ? (_now - heartbeat) / 1e6 : 0.0;
+    }
+  }
+}
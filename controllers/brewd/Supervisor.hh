@@ -0,0 +1,91 @@
+/*
+ * Supervision of the threads
+ * Every thread's run() is executed by the supervisor: an exception thrown
+ * out of it engages the thread's fail-safe, and the thread is restarted
+ * by its restart policy, with an exponential backoff. The restart runs
+ * run() again on the same object, so the ProcessState, the TSDB and the
+ * rest of the thread's state are kept.
+ * The threads with a heartbeat timeout are watched: a thread not beating
+ * for that long is stalled, its fail-safe is engaged (e.g. the Controller
+ * turns the heating elements off), until it's beating again. A stalled
+ * thread can't be restarted, it might be holding its resources.
+ */
+
+#ifndef AEGIR_SUPERVISOR_H
+#define AEGIR_SUPERVISOR_H
+
+#include <cstdint>
+#include <atomic>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <json/json.h>
+
+#include "Config.hh"
+#include "LogChannel.hh"
+#include "Metrics.hh"
+
+namespace aegir {
+
+  class ThreadBase;
+
+  class Supervisor {
+    Supervisor(Supervisor&&) = delete;
+    Supervisor(const Supervisor &) = delete;
+    Supervisor &operator=(Supervisor &&) = delete;
+    Supervisor &operator=(const Supervisor &) = delete;
+  public:
+    enum class States: uint8_t {
+      Starting,
+      Running,
+      Stalled,
+      Restarting,
+      Stopped,
+      Failed
+    };
+    // the maxrestarts are counted within this window, secs
+    static constexpr uint32_t c_restartwindow = 3600;
+    // the backoff doesn't grow over this, msecs
+    static constexpr uint32_t c_maxbackoff = 60000;
+
+  public:
+    Supervisor();
+    ~Supervisor();
+    void add(const std::string &_name, ThreadBase &_thread, const SupervisorConfig &_config);
+    // runs the thread's run() on the calling thread, restarting it on failures
+    void execute(const std::string &_name);
+    // checks the heartbeats, returns the number of the stalled threads
+    uint32_t check(uint64_t _now);
+    States getState(const std::string &_name) const;
+    uint32_t getRestarts(const std::string &_name) const;
+    void toJSON(Json::Value &_out, uint64_t _now) const;
+    static const char *stateName(States _state);
+
+  private:
+    struct Watched {
+      Watched(ThreadBase &_thread, const SupervisorConfig &_config, const std::string &_name);
+      ThreadBase &thread;
+      SupervisorConfig config;
+      std::atomic<States> state;
+      std::atomic<uint32_t> restarts;
+      // the restarts within the window, only touched by the thread itself
+      std::deque<uint64_t> restarttimes;
+      Metrics::Counter &m_restarts;
+      Metrics::Counter &m_stalls;
+    };
+    Watched &find(const std::string &_name) const;
+    // the fail-safe of a thread, never run concurrently
+    void failsafe(const std::string &_name, Watched &_w);
+
+  private:
+    mutable std::mutex c_mtx;
+    std::map<std::string, std::unique_ptr<Watched>> c_threads;
+    std::mutex c_failsafemtx;
+    LogChannel c_log;
+  };
+}
+
+#endif
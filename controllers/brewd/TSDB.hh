@@ -3,6 +3,9 @@
   Storing temperature readings across sensors
  */
 
+#ifndef AEGIR_TSDB_H
+#define AEGIR_TSDB_H
+
 #include <sys/time.h>
 #include <cstdint>
 #include <atomic>
@@ -87,3 +90,5 @@ namespace aegir {
   };
 
 }
+
+#endif
@@ -0,0 +1,16 @@
+#include "ThreadBase.hh"
+
+namespace aegir {
+
+  ThreadBase::ThreadBase(): c_run(true), c_heartbeat(0) {
+  }
+
+  ThreadBase::~ThreadBase() = default;
+
+  void ThreadBase::stop() noexcept {
+    c_run = false;
+  }
+
+  void ThreadBase::failsafe() {
+  }
+}
@@ -0,0 +1,42 @@
+/*
+  The base of the threads run by the ThreadManager
+ */
+
+#ifndef AEGIR_THREADBASE_H
+#define AEGIR_THREADBASE_H
+
+#include <cstdint>
+#include <atomic>
+
+#include "Clock.hh"
+
+namespace aegir {
+
+  class ThreadManager;
+  class Supervisor;
+
+  class ThreadBase {
+    friend class ThreadManager;
+    friend class Supervisor;
+  public:
+    ThreadBase();
+    virtual ~ThreadBase() = 0;
+
+    std::atomic<bool> c_run;
+    // the last sign of life, Clock::monotonic()
+    std::atomic<uint64_t> c_heartbeat;
+
+  protected:
+    virtual void stop() noexcept;
+    virtual void run() = 0;
+    // the thread is alive, called by its loop
+    inline void heartbeat() noexcept {
+      c_heartbeat.store(Clock::monotonic(), std::memory_order_relaxed);
+    };
+    // drives the thread's outputs into a safe state when it failed or
+    // stalled, called on the supervisor's thread
+    virtual void failsafe();
+  };
+}
+
+#endif
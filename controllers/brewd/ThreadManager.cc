@@ -11,7 +11,11 @@
 #include <chrono>
 
 #include "GPIO.hh"
+#include "Exception.hh"
 #include "ZMQ.hh"
+#include "SpanTracer.hh"
+#include "Config.hh"
+#include "Scheduling.hh"
 
 namespace aegir {
 
@@ -39,18 +43,6 @@ namespace aegir {
     SIGUSR2
   };
 
-  /*
-   * ThreadBase definition
-   */
-  ThreadBase::ThreadBase(): c_run(true) {
-  }
-
-  ThreadBase::~ThreadBase() = default;
-
-  void ThreadBase::stop() noexcept {
-    c_run = false;
-  }
-
   /*
    * ThreadManager definition
    */
@@ -74,12 +66,13 @@ namespace aegir {
 
   ThreadManager &ThreadManager::addThread(const std::string &_name, ThreadBase &_thread) {
     c_threads.emplace(std::make_pair(_name, thread(_name, _thread)));
+    c_supervisor.add(_name, _thread, Config::getInstance()->getSupervisor(_name));
 
     // if threads are already started, then late-start it
     if ( c_started ) {
       auto it = c_threads.find(_name);
       c_log.info("Late-starting thread named %s", it->first.c_str());
-      std::function<void()> f = std::bind(&ThreadManager::wrapper, this, &it->second.base);
+      std::function<void()> f = std::bind(&ThreadManager::wrapper, this, &it->second.base, it->first);
       it->second.thr = std::thread(f);
     }
     return *this;
@@ -110,15 +103,15 @@ namespace aegir {
     sa.sa_flags = SA_RESTART;
     for (int i=0; i<sizeof(signals)/sizeof(int); ++i) {
       if ( sigaction(signals[i], &sa, 0) != 0 ) {
- 	c_log.error("sigaction(%i) failed: %s", signals[i], strerror(errno));
- 	fprintf(stderr, "sigaction(%i) failed: %s\n", signals[i], strerror(errno));
+	c_log.error("sigaction(%i) failed: %s", signals[i], strerror(errno));
+	fprintf(stderr, "sigaction(%i) failed: %s\n", signals[i], strerror(errno));
       }
     }
 
     // start the threads
     for (auto &it: c_threads) {
       c_log.info("Starting thread named %s", it.first.c_str());
-      std::function<void()> f = std::bind(&ThreadManager::wrapper, this, &it.second.base);
+      std::function<void()> f = std::bind(&ThreadManager::wrapper, this, &it.second.base, it.first);
       it.second.thr = std::thread(f);
     }
     c_started = true;
@@ -134,8 +127,14 @@ namespace aegir {
     int n;
     EV_SET(&evlist[0], SIGINT, EVFILT_SIGNAL, EV_ADD|EV_CLEAR|EV_ENABLE, 0, 0, 0);
     EV_SET(&evlist[1], SIGKILL, EVFILT_SIGNAL, EV_ADD|EV_CLEAR|EV_ENABLE, 0, 0, 0);
-    n = kevent(kq, evlist, 2, 0, 0, 0);
-    c_log.trace("Starting loop");
+    // dumps the span tracer's rings
+    EV_SET(&evlist[2], SIGUSR1, EVFILT_SIGNAL, EV_ADD|EV_CLEAR|EV_ENABLE, 0, 0, 0);
+    // the threads' heartbeats
+    EV_SET(&evlist[3], 0, EVFILT_TIMER, EV_ADD|EV_ENABLE, NOTE_MSECONDS, c_superviseival, 0);
+    // reloads the config file
+    EV_SET(&evlist[4], SIGHUP, EVFILT_SIGNAL, EV_ADD|EV_CLEAR|EV_ENABLE, 0, 0, 0);
+    n = kevent(kq, evlist, 5, 0, 0, 0);
+    AEGIR_LOG_TRACE(c_log, "Starting loop");
     while (run) {
       n = kevent(kq, 0, 0, evlist, 16, 0);
       if ( n < 0 ) continue;
@@ -145,7 +144,13 @@ namespace aegir {
 	  c_log.info("Received signal %i", evlist[i].ident);
 	  if ( evlist[i].ident == SIGINT || evlist[i].ident == SIGKILL ) {
 	    run = 0;
+	  } else if ( evlist[i].ident == SIGUSR1 ) {
+	    dumpTrace();
+	  } else if ( evlist[i].ident == SIGHUP ) {
+	    reloadConfig();
 	  }
+	} else if ( evlist[i].filter == EVFILT_TIMER ) {
+	  c_supervisor.check(Clock::monotonic());
 	} // EVFILT_SIGNAL
       } // evlist check
     }
@@ -167,7 +172,35 @@ namespace aegir {
     return *this;
   }
 
-  void ThreadManager::wrapper(ThreadBase *_b) {
+  void ThreadManager::dumpTrace() {
+    if ( !SpanTracer::c_compiled ) {
+      c_log.warn("The span tracer is not compiled in, build with AEGIR_TRACE");
+      return;
+    }
+
+    auto &tracer = SpanTracer::getInstance();
+    std::string file = tracer.getDumpFile();
+    try {
+      uint32_t events = tracer.dump(file);
+      c_log.info("Dumped %u trace events into %s", events, file.c_str());
+    }
+    catch (Exception &e) {
+      c_log.error("Trace dump failed: %s", e.what());
+    }
+  }
+
+  void ThreadManager::reloadConfig() {
+    // parsed here, the threads pick the new snapshot up on their next cycle
+    try {
+      auto cfg = Config::reload();
+      AEGIR_LOG_EVENT(c_log, info, "config.reload", {"version", cfg->getVersion()});
+    }
+    catch (Exception &e) {
+      c_log.error("Config reload failed, keeping the current one: %s", e.what());
+    }
+  }
+
+  void ThreadManager::wrapper(ThreadBase *_b, const std::string &_name) {
     sigset_t ss;
     sigemptyset(&ss);
 
@@ -177,6 +210,21 @@ namespace aegir {
     if (int err = pthread_sigmask(SIG_SETMASK, &ss, 0); err != 0 ) {
       c_log.error("pthread_sigmask failed: %s", strerror(err));
     }
-    _b->run();
+    AEGIR_TRACE_THREAD(_name);
+
+    // the stack and the scheduling, before the thread starts its work
+    auto cfg = Config::getInstance();
+    Scheduling::prefaultStack(cfg->getStackPrefault() * 1024);
+    if ( auto it = cfg->getThreadSched().find(_name); it != cfg->getThreadSched().end() ) {
+      try {
+	Scheduling::apply(it->second);
+	c_log.info("Thread %s is scheduled as %s", _name.c_str(), Scheduling::describe().c_str());
+      }
+      catch (Exception &e) {
+	c_log.error("Unable to schedule thread %s: %s", _name.c_str(), e.what());
+      }
+    }
+    cfg.reset();
+    c_supervisor.execute(_name);
   }
 }
@@ -11,24 +11,11 @@
 #include <atomic>
 
 #include "LogChannel.hh"
+#include "ThreadBase.hh"
+#include "Supervisor.hh"
 
 namespace aegir {
 
-  class ThreadManager;
-
-  class ThreadBase {
-    friend class ThreadManager;
-  public:
-    ThreadBase();
-    virtual ~ThreadBase() = 0;
-
-    std::atomic<bool> c_run;
-
-  protected:
-    virtual void stop() noexcept;
-    virtual void run() = 0;
-  };
-
   // A singleton threadmanager
   class ThreadManager {
     ThreadManager(const ThreadManager &) = delete;
@@ -47,6 +34,7 @@ namespace aegir {
   private:
     std::atomic<bool> c_started;
     std::map<std::string, thread> c_threads;
+    Supervisor c_supervisor;
     LogChannel c_log;
 
   private:
@@ -58,9 +46,16 @@ namespace aegir {
     static ThreadManager *getInstance();
     ThreadManager &addThread(const std::string &_name, ThreadBase &_thread);
     ThreadManager &start();
+    inline const Supervisor &getSupervisor() const { return c_supervisor; };
 
   private:
-    void wrapper(ThreadBase *_b);
+    void wrapper(ThreadBase *_b, const std::string &_name);
+    // the supervisor's heartbeat checks, msecs
+    static constexpr uint32_t c_superviseival = 250;
+    // writes the span tracer's rings into its dump file
+    void dumpTrace();
+    // SIGHUP, a broken file leaves the current config in place
+    void reloadConfig();
   };
 }
 
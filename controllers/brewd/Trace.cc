@@ -0,0 +1,105 @@
+
+#include "Trace.hh"
+
+#include <cstring>
+#include <cerrno>
+
+#include "Clock.hh"
+#include "Exception.hh"
+
+namespace aegir {
+
+  // the header of a record: type, time, length
+  static constexpr std::size_t c_recheader = 1 + 2*sizeof(uint32_t);
+
+  /*
+   * TraceRecorder
+   */
+  TraceRecorder::TraceRecorder(): c_recording(false) {
+  }
+
+  TraceRecorder::~TraceRecorder() {
+    close();
+  }
+
+  std::shared_ptr<TraceRecorder> TraceRecorder::getInstance() {
+    static std::shared_ptr<TraceRecorder> instance{new TraceRecorder()};
+    return instance;
+  }
+
+  void TraceRecorder::open(const std::string &_file) {
+    std::lock_guard<std::mutex> g(c_mtx);
+
+    if ( c_recording ) throw Exception("Already recording a trace");
+
+    c_out.open(_file, std::ios::out | std::ios::trunc | std::ios::binary);
+    if ( !c_out.is_open() )
+      throw Exception("Unable to open trace file %s: %s", _file.c_str(), strerror(errno));
+    c_out.write(Trace::c_magic, sizeof(Trace::c_magic));
+    c_recording = true;
+  }
+
+  void TraceRecorder::close() {
+    std::lock_guard<std::mutex> g(c_mtx);
+
+    if ( !c_recording ) return;
+    c_recording = false;
+    c_out.close();
+  }
+
+  void TraceRecorder::record(Trace::RecordType _type, const msgstring &_data) {
+    if ( !c_recording ) return;
+
+    char header[c_recheader];
+    uint32_t time = Clock::now();
+    uint32_t len = _data.length();
+    header[0] = (char)_type;
+    std::memcpy(header+1, &time, sizeof(time));
+    std::memcpy(header+1+sizeof(time), &len, sizeof(len));
+
+    std::lock_guard<std::mutex> g(c_mtx);
+    if ( !c_recording ) return;
+    c_out.write(header, sizeof(header));
+    c_out.write((const char*)_data.data(), len);
+    // a cycle is a consistent point of the trace
+    if ( _type == Trace::RecordType::Cycle ) c_out.flush();
+  }
+
+  /*
+   * TraceReader
+   */
+  TraceReader::TraceReader(const std::string &_file) {
+    char magic[sizeof(Trace::c_magic)];
+
+    c_in.open(_file, std::ios::in | std::ios::binary);
+    if ( !c_in.is_open() )
+      throw Exception("Unable to open trace file %s: %s", _file.c_str(), strerror(errno));
+
+    if ( !c_in.read(magic, sizeof(magic)) ||
+	 std::memcmp(magic, Trace::c_magic, sizeof(magic)) != 0 )
+      throw Exception("Not a trace file: %s", _file.c_str());
+  }
+
+  TraceReader::~TraceReader() {
+  }
+
+  bool TraceReader::next(Trace::Record &_rec) {
+    char header[c_recheader];
+    uint32_t len;
+
+    if ( !c_in.read(header, sizeof(header)) ) {
+      // a partial header is a trace cut off while recording
+      if ( c_in.gcount() ) throw Exception("Truncated trace record header");
+      return false;
+    }
+
+    _rec.type = (Trace::RecordType)header[0];
+    std::memcpy(&_rec.time, header+1, sizeof(_rec.time));
+    std::memcpy(&len, header+1+sizeof(_rec.time), sizeof(len));
+
+    _rec.data.resize(len);
+    if ( len && !c_in.read((char*)_rec.data.data(), len) )
+      throw Exception("Truncated trace record, %u bytes are missing", len - c_in.gcount());
+    return true;
+  }
+}
@@ -0,0 +1,91 @@
+/*
+ * Recording of the Controller's traffic
+ * A trace holds everything the Controller takes in: the readings and pin
+ * changes from the IOHandler and the PR commands changing the process,
+ * and the pin decisions it sends out, in the order they happened. The
+ * Replay feeds it back into the Controller to evaluate the changes of the
+ * control logic against past brews.
+ * The file starts with a magic, followed by the records:
+ * Type: 1 byte
+ * Time: 4 byte, uint32_t, the Clock
+ * Length: 4 byte, uint32_t
+ * Data: Length bytes, the serialized message, the events of a Cycle
+ */
+
+#ifndef AEGIR_TRACE_H
+#define AEGIR_TRACE_H
+
+#include <cstdint>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <fstream>
+
+#include "Message.hh"
+
+namespace aegir {
+
+  class Trace {
+    Trace() = delete;
+  public:
+    enum class RecordType: uint8_t {
+      Input=1, // from inproc://iopub
+      Command=2, // a PR request, as a JSON message
+      Cycle=3, // a control cycle ran on the inputs before it
+      Output=4 // a pin change to inproc://iocmd
+    };
+    // the events firing a cycle, the data of a Cycle record
+    enum CycleEvents: uint8_t {
+      Control=1,
+      TempControl=2
+    };
+    struct Record {
+      RecordType type;
+      uint32_t time;
+      msgstring data;
+    };
+    static constexpr char c_magic[8] = {'A', 'E', 'G', 'I', 'R', 'T', 'R', '1'};
+  };
+
+  class TraceRecorder {
+    TraceRecorder();
+    TraceRecorder(TraceRecorder&&) = delete;
+    TraceRecorder(const TraceRecorder &) = delete;
+    TraceRecorder &operator=(TraceRecorder &&) = delete;
+    TraceRecorder &operator=(const TraceRecorder &) = delete;
+  public:
+    ~TraceRecorder();
+    static std::shared_ptr<TraceRecorder> getInstance();
+
+    void open(const std::string &_file);
+    void close();
+    inline bool isRecording() const { return c_recording; };
+    // thread-safe, a no-op when not recording
+    void record(Trace::RecordType _type, const msgstring &_data);
+
+  private:
+    std::mutex c_mtx;
+    std::ofstream c_out;
+    std::atomic<bool> c_recording;
+  };
+
+  class TraceReader {
+    TraceReader() = delete;
+    TraceReader(TraceReader&&) = delete;
+    TraceReader(const TraceReader &) = delete;
+    TraceReader &operator=(TraceReader &&) = delete;
+    TraceReader &operator=(const TraceReader &) = delete;
+  public:
+    explicit TraceReader(const std::string &_file);
+    ~TraceReader();
+
+    // the next record, false at the end of the trace
+    bool next(Trace::Record &_rec);
+
+  private:
+    std::ifstream c_in;
+  };
+}
+
+#endif
@@ -0,0 +1,137 @@
+#include "Watchdog.hh"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <regex>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Exception.hh"
+
+namespace aegir {
+
+  Watchdog::Watchdog(uint32_t _timeout): c_timeout(_timeout), c_fed(0), c_latched(false), c_trips(0),
+					 c_fd(-1), c_regular(false), c_petted(0),
+					 c_m_trips(Metrics::getInstance().counter("aegir_watchdog_trips_total",
+										  "The outputs latched by the watchdog")),
+					 c_m_feeds(Metrics::getInstance().histogram("aegir_watchdog_feed_seconds",
+										    "The time between the watchdog's feeds")),
+					 c_m_fedage(Metrics::getInstance().gauge("aegir_watchdog_fed_age_seconds",
+										 "The time since the watchdog's last feed, at the last check")) {
+  }
+
+  Watchdog::~Watchdog() {
+    closeDevice(true);
+  }
+
+  Watchdog &Watchdog::getInstance() {
+    static Watchdog instance(0);
+    return instance;
+  }
+
+  void Watchdog::setTimeout(uint32_t _timeout) {
+    c_timeout.store(_timeout, std::memory_order_relaxed);
+  }
+
+  bool Watchdog::feed(uint64_t _now) {
+    uint64_t last = c_fed.exchange(_now);
+
+    if ( last && _now > last ) c_m_feeds.record(_now - last);
+    return c_latched.exchange(false);
+  }
+
+  bool Watchdog::check(uint64_t _now) {
+    uint32_t timeout = c_timeout.load(std::memory_order_relaxed);
+
+    uint64_t fed = c_fed.load();
+
+    if ( fed ) c_m_fedage.set(_now > fed ? (_now - fed) / 1e6 : 0.0);
+    if ( !timeout || c_latched.load() ) return false;
+
+    if ( !fed || _now <= fed || _now - fed <= timeout * 1000ull ) return false;
+
+    bool expected = false;
+    if ( !c_latched.compare_exchange_strong(expected, true) ) return false;
+    c_trips.fetch_add(1, std::memory_order_relaxed);
+    c_m_trips.inc();
+    return true;
+  }
+
+  std::map<std::string, PINState> Watchdog::latchedStates(const pinconfig_t &_pins) {
+    std::map<std::string, PINState> states;
+    std::regex re_cs("^cs[0-9]$");
+
+    for (auto &it: _pins) {
+      if ( it.second.mode != PinMode::OUT || std::regex_match(it.first, re_cs) ) continue;
+      states[it.first] = it.second.defval ? PINState::On : PINState::Off;
+    }
+    return states;
+  }
+
+  void Watchdog::openDevice(const std::string &_path, bool _standin) {
+    std::lock_guard<std::mutex> g(c_mtx);
+    struct stat st;
+    int fd;
+
+    if ( c_fd >= 0 ) ::close(c_fd);
+    c_fd = -1;
+
+    // the stand-in is created, a device has to exist
+    if ( _standin ) {
+      if ( stat(_path.c_str(), &st) == 0 && !S_ISREG(st.st_mode) )
+	throw Exception("The watchdog stand-in %s isn't a regular file", _path.c_str());
+      fd = ::open(_path.c_str(), O_WRONLY|O_CREAT|O_CLOEXEC, 0644);
+    } else {
+      if ( stat(_path.c_str(), &st) < 0 )
+	throw Exception("Unable to open the watchdog %s: %s", _path.c_str(), strerror(errno));
+      if ( !S_ISCHR(st.st_mode) )
+	throw Exception("The watchdog %s isn't a device", _path.c_str());
+      fd = ::open(_path.c_str(), O_WRONLY|O_CLOEXEC);
+    }
+    c_regular = _standin;
+    if ( fd < 0 )
+      throw Exception("Unable to open the watchdog %s: %s", _path.c_str(), strerror(errno));
+
+    c_fd = fd;
+    c_device = _path;
+    c_petted = 0;
+  }
+
+  void Watchdog::pet(uint64_t _now) {
+    std::lock_guard<std::mutex> g(c_mtx);
+
+    if ( c_fd < 0 || c_latched.load() ) return;
+    if ( c_petted && _now - c_petted < c_petival ) return;
+
+    ssize_t ret;
+    if ( c_regular ) {
+      char buff[32];
+      int len = snprintf(buff, sizeof(buff), "%llu\n", (unsigned long long)_now);
+      if ( (ret = pwrite(c_fd, buff, len, 0)) == len ) ftruncate(c_fd, len);
+    } else {
+      ret = write(c_fd, "1", 1);
+    }
+    // a failing one is retried on the next period
+    c_petted = _now;
+    if ( ret < 0 )
+      throw Exception("Unable to pet the watchdog %s: %s", c_device.c_str(), strerror(errno));
+  }
+
+  void Watchdog::closeDevice(bool _disarm) {
+    std::lock_guard<std::mutex> g(c_mtx);
+
+    if ( c_fd < 0 ) return;
+    // the magic close
+    if ( _disarm && !c_regular ) write(c_fd, "V", 1);
+    ::close(c_fd);
+    c_fd = -1;
+  }
+
+  void Watchdog::toJSON(Json::Value &_out) const {
+    _out["timeout"] = c_timeout.load(std::memory_order_relaxed) / 1e3;
+    _out["latched"] = c_latched.load();
+    _out["trips"] = (Json::UInt64)c_trips.load(std::memory_order_relaxed);
+  }
+}
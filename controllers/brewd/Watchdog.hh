@@ -0,0 +1,97 @@
+/*
+ * The Controller's watchdog and the fail-safe output latch
+ * The Controller feeds the watchdog on every cycle of its loop. The
+ * IOHandler checks it on every pin poll, and when the Controller didn't
+ * feed it within the timeout, it latches: the outputs are forced to their
+ * defval from the PinConfig, the pulses are stopped and the pin commands
+ * are dropped until the Controller feeds it again, then it resends the
+ * outputs' state. It's armed by the first feed, so the startup isn't
+ * latched.
+ * The IOHandler pets the optional hardware watchdog as long as the latch
+ * is open, so a hung IOHandler, or a Controller not recovering, gets the
+ * board reset. The device is a /dev/watchdog-style one: any write pets it,
+ * and a "V" before the close disarms it. It has to exist, only an explicit
+ * stand-in may be a regular file, that gets the monotonic time of the last
+ * pet.
+ */
+
+#ifndef AEGIR_WATCHDOG_H
+#define AEGIR_WATCHDOG_H
+
+#include <cstdint>
+#include <atomic>
+#include <mutex>
+#include <map>
+#include <string>
+
+#include <json/json.h>
+
+#include "Metrics.hh"
+#include "Message.hh"
+#include "Config.hh"
+
+namespace aegir {
+
+  class Watchdog {
+    Watchdog() = delete;
+    Watchdog(Watchdog&&) = delete;
+    Watchdog(const Watchdog &) = delete;
+    Watchdog &operator=(Watchdog &&) = delete;
+    Watchdog &operator=(const Watchdog &) = delete;
+  public:
+    // the hardware watchdog isn't written more often, usecs
+    static constexpr uint64_t c_petival = 1000000;
+
+  public:
+    // _timeout in msecs, 0 disables it
+    explicit Watchdog(uint32_t _timeout);
+    ~Watchdog();
+    static Watchdog &getInstance();
+
+    void setTimeout(uint32_t _timeout);
+    inline uint32_t getTimeout() const { return c_timeout.load(std::memory_order_relaxed); };
+    // the Controller is alive, returns whether it released the latch
+    bool feed(uint64_t _now);
+    // whether it has just latched
+    bool check(uint64_t _now);
+    inline bool isLatched() const { return c_latched.load(); };
+    // whether a message from the Controller is applied, the pin commands
+    // are dropped while it's latched
+    inline bool admits(MessageType _type) const { return _type != MessageType::PINSTATE || !c_latched.load(); };
+    // the latched outputs' state, their defval; the chip selects belong to
+    // the SPI, they're left alone
+    static std::map<std::string, PINState> latchedStates(const pinconfig_t &_pins);
+    inline uint64_t getTrips() const { return c_trips.load(std::memory_order_relaxed); };
+
+    // the hardware watchdog, or its regular file stand-in when _standin is
+    // set, throws when it can't be opened
+    void openDevice(const std::string &_path, bool _standin = false);
+    // pets the device at most every c_petival, unless it's latched
+    void pet(uint64_t _now);
+    // disarms it when _disarm is set, otherwise the board is reset
+    void closeDevice(bool _disarm);
+    inline bool hasDevice() const { return c_fd >= 0; };
+
+    // the getState section, the feed's age is only a metric as it changes
+    // on every cycle
+    void toJSON(Json::Value &_out) const;
+
+  private:
+    std::atomic<uint32_t> c_timeout;
+    // the last feed, 0 until it's armed
+    std::atomic<uint64_t> c_fed;
+    std::atomic<bool> c_latched;
+    std::atomic<uint64_t> c_trips;
+    // the device's, only used by the IOHandler
+    std::mutex c_mtx;
+    int c_fd;
+    bool c_regular;
+    std::string c_device;
+    uint64_t c_petted;
+    Metrics::Counter &c_m_trips;
+    Metrics::Histogram &c_m_feeds;
+    Metrics::Gauge &c_m_fedage;
+  };
+}
+
+#endif
@@ -0,0 +1,180 @@
+
+#include "WebSocket.hh"
+
+#include <cstring>
+
+#include "Exception.hh"
+
+namespace aegir {
+
+  namespace WebSocket {
+    static const char *c_guid = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+    static inline uint32_t rol(uint32_t _v, int _bits) {
+      return (_v << _bits) | (_v >> (32 - _bits));
+    }
+
+    std::string sha1(const std::string &_data) {
+      uint32_t h[5] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0};
+
+      // padding: 0x80, zeroes, then the bit length as big endian
+      std::string msg(_data);
+      uint64_t bitlen = (uint64_t)_data.size() * 8;
+      msg.push_back((char)0x80);
+      while ( msg.size() % 64 != 56 ) msg.push_back(0);
+      for (int i=7; i>=0; --i) msg.push_back((char)(bitlen >> (i*8)));
+
+      for (std::size_t chunk=0; chunk < msg.size(); chunk += 64) {
+	uint32_t w[80];
+	const uint8_t *p = (const uint8_t*)msg.data() + chunk;
+
+	for (int i=0; i<16; ++i)
+	  w[i] = (p[i*4] << 24) | (p[i*4+1] << 16) | (p[i*4+2] << 8) | p[i*4+3];
+	for (int i=16; i<80; ++i)
+	  w[i] = rol(w[i-3] ^ w[i-8] ^ w[i-14] ^ w[i-16], 1);
+
+	uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+	for (int i=0; i<80; ++i) {
+	  uint32_t f, k;
+	  if ( i < 20 ) {
+	    f = (b & c) | (~b & d);
+	    k = 0x5a827999;
+	  } else if ( i < 40 ) {
+	    f = b ^ c ^ d;
+	    k = 0x6ed9eba1;
+	  } else if ( i < 60 ) {
+	    f = (b & c) | (b & d) | (c & d);
+	    k = 0x8f1bbcdc;
+	  } else {
+	    f = b ^ c ^ d;
+	    k = 0xca62c1d6;
+	  }
+	  uint32_t tmp = rol(a, 5) + f + e + k + w[i];
+	  e = d;
+	  d = c;
+	  c = rol(b, 30);
+	  b = a;
+	  a = tmp;
+	}
+	h[0] += a;
+	h[1] += b;
+	h[2] += c;
+	h[3] += d;
+	h[4] += e;
+      }
+
+      std::string digest(20, 0);
+      for (int i=0; i<5; ++i) {
+	digest[i*4+0] = (char)(h[i] >> 24);
+	digest[i*4+1] = (char)(h[i] >> 16);
+	digest[i*4+2] = (char)(h[i] >> 8);
+	digest[i*4+3] = (char)h[i];
+      }
+      return digest;
+    }
+
+    std::string base64(const std::string &_data) {
+      static const char table[] =
+	"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+      std::string out;
+      const uint8_t *p = (const uint8_t*)_data.data();
+      std::size_t size = _data.size();
+
+      out.reserve((size + 2) / 3 * 4);
+      for (std::size_t i=0; i < size; i += 3) {
+	uint32_t v = p[i] << 16;
+	if ( i+1 < size ) v |= p[i+1] << 8;
+	if ( i+2 < size ) v |= p[i+2];
+
+	out.push_back(table[(v >> 18) & 0x3f]);
+	out.push_back(table[(v >> 12) & 0x3f]);
+	out.push_back(i+1 < size ? table[(v >> 6) & 0x3f] : '=');
+	out.push_back(i+2 < size ? table[v & 0x3f] : '=');
+      }
+      return out;
+    }
+
+    std::string acceptKey(const std::string &_key) {
+      return base64(sha1(_key + c_guid));
+    }
+
+    static void encodeHeader(Opcode _opcode, std::size_t _size, bool _masked, std::string &_out) {
+      uint8_t maskbit = _masked ? 0x80 : 0;
+
+      _out.push_back((char)(0x80 | (uint8_t)_opcode));
+      if ( _size < 126 ) {
+	_out.push_back((char)(maskbit | _size));
+      } else if ( _size < 65536 ) {
+	_out.push_back((char)(maskbit | 126));
+	_out.push_back((char)(_size >> 8));
+	_out.push_back((char)_size);
+      } else {
+	_out.push_back((char)(maskbit | 127));
+	for (int i=7; i>=0; --i) _out.push_back((char)((uint64_t)_size >> (i*8)));
+      }
+    }
+
+    void encodeFrame(Opcode _opcode, const char *_data, std::size_t _size, std::string &_out) {
+      encodeHeader(_opcode, _size, false, _out);
+      _out.append(_data, _size);
+    }
+
+    void encodeMaskedFrame(Opcode _opcode, const char *_data, std::size_t _size,
+			   uint32_t _mask, std::string &_out) {
+      uint8_t mask[4] = {(uint8_t)(_mask >> 24), (uint8_t)(_mask >> 16),
+			 (uint8_t)(_mask >> 8), (uint8_t)_mask};
+
+      encodeHeader(_opcode, _size, true, _out);
+      _out.append((const char*)mask, 4);
+      for (std::size_t i=0; i < _size; ++i)
+	_out.push_back((char)(_data[i] ^ mask[i & 3]));
+    }
+
+    std::size_t decodeFrame(const char *_data, std::size_t _size, bool _requiremask, Frame &_frame) {
+      const uint8_t *p = (const uint8_t*)_data;
+      std::size_t pos = 2;
+
+      if ( _size < 2 ) return 0;
+
+      if ( p[0] & 0x70 )
+	throw Exception("WebSocket: reserved bits are set");
+
+      _frame.fin = p[0] & 0x80;
+      _frame.opcode = (Opcode)(p[0] & 0x0f);
+      bool masked = p[1] & 0x80;
+      uint64_t len = p[1] & 0x7f;
+
+      if ( _requiremask && !masked )
+	throw Exception("WebSocket: client frames must be masked");
+
+      if ( len == 126 ) {
+	if ( _size < pos + 2 ) return 0;
+	len = (p[2] << 8) | p[3];
+	pos += 2;
+      } else if ( len == 127 ) {
+	if ( _size < pos + 8 ) return 0;
+	len = 0;
+	for (int i=0; i<8; ++i) len = (len << 8) | p[2+i];
+	pos += 8;
+      }
+
+      if ( len > c_maxpayload )
+	throw Exception("WebSocket: frame too large: %lu", (unsigned long)len);
+
+      uint8_t mask[4] = {0, 0, 0, 0};
+      if ( masked ) {
+	if ( _size < pos + 4 ) return 0;
+	memcpy(mask, p + pos, 4);
+	pos += 4;
+      }
+
+      if ( _size < pos + len ) return 0;
+
+      _frame.payload.resize(len);
+      for (uint64_t i=0; i < len; ++i)
+	_frame.payload[i] = (char)(p[pos+i] ^ mask[i & 3]);
+
+      return pos + len;
+    }
+  }
+}
@@ -0,0 +1,51 @@
+/*
+ * Minimal WebSocket (RFC 6455) helpers for the embedded HTTP server
+ * Handshake key calculation and frame encoding/decoding
+ */
+
+#ifndef AEGIR_WEBSOCKET_H
+#define AEGIR_WEBSOCKET_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+namespace aegir {
+
+  namespace WebSocket {
+    enum class Opcode: uint8_t {
+      Continuation = 0x0,
+      Text = 0x1,
+      Binary = 0x2,
+      Close = 0x8,
+      Ping = 0x9,
+      Pong = 0xa
+    };
+
+    // frames larger than this are refused
+    constexpr uint64_t c_maxpayload = 65536;
+
+    struct Frame {
+      bool fin;
+      Opcode opcode;
+      // unmasked payload
+      std::string payload;
+    };
+
+    std::string sha1(const std::string &_data);
+    std::string base64(const std::string &_data);
+    // the Sec-WebSocket-Accept value for a Sec-WebSocket-Key
+    std::string acceptKey(const std::string &_key);
+
+    // Appends an unmasked (server) frame to _out
+    void encodeFrame(Opcode _opcode, const char *_data, std::size_t _size, std::string &_out);
+    // Appends a masked (client) frame to _out, used by the tests
+    void encodeMaskedFrame(Opcode _opcode, const char *_data, std::size_t _size,
+			   uint32_t _mask, std::string &_out);
+    // Decodes a frame from the buffer, returns the number of bytes consumed,
+    // or 0 when the frame is incomplete. Throws Exception on protocol errors
+    std::size_t decodeFrame(const char *_data, std::size_t _size, bool _requiremask, Frame &_frame);
+  }
+}
+
+#endif
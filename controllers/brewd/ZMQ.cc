@@ -8,6 +8,7 @@
 
 #include "Exception.hh"
 #include "JSONMessage.hh"
+#include "SpanTracer.hh"
 
 namespace aegir {
   static void zmqfree(void *_data, void*) {
@@ -17,7 +18,8 @@ namespace aegir {
    * ZMQ::Socket
    */
 
-  ZMQ::Socket::Socket(SocketType _type): c_type(_type), c_sock(0), c_closed(false) {
+  ZMQ::Socket::Socket(SocketType _type): c_type(_type), c_sock(0), c_closed(false),
+							 c_tracename("zmq") {
     void *ctx = ZMQ::getInstance().getContext();
     c_sock = zmq_socket(ctx, (int)c_type);
 #if 0
@@ -35,6 +37,9 @@ namespace aegir {
     int rc = zmq_bind(c_sock, _addr.c_str());
     if ( rc != 0 )
       throw Exception("zmq_bind(%p, %s):%i failed: %i/%s", c_sock, _addr.c_str(), rc, errno, strerror(errno));
+#ifdef AEGIR_TRACE
+    c_tracename = SpanTracer::getInstance().intern(_addr);
+#endif
     return *this;
   }
 
@@ -42,6 +47,9 @@ namespace aegir {
     int rc = zmq_connect(c_sock, _addr.c_str());
     if ( rc != 0 )
       throw Exception("zmq_connect(%p, %s):%i failed: %i/%s", c_sock, _addr.c_str(), rc, errno, strerror(errno));
+#ifdef AEGIR_TRACE
+    c_tracename = SpanTracer::getInstance().intern(_addr);
+#endif
     return *this;
   }
 
@@ -71,8 +79,21 @@ namespace aegir {
 
     int flags = 0;
     if ( _more ) flags |= ZMQ_SNDMORE;
+#ifdef AEGIR_TRACE
+    AEGIR_TRACE_SPAN("zmq.send");
+    bool traced = c_type == SocketType::PUB && !_more;
+    if ( traced ) flags |= ZMQ_SNDMORE;
+#endif
     if ( zmq_send(c_sock, msg.data(), msg.size(), flags) < 0)
       throw Exception("zmq_send(%p) failed: %i/%s", c_sock, errno, strerror(errno));
+#ifdef AEGIR_TRACE
+    // the flow id frame
+    if ( traced ) {
+      uint64_t id = SpanTracer::getInstance().flowStart(c_tracename);
+      if ( zmq_send(c_sock, &id, sizeof(id), 0) < 0)
+	throw Exception("zmq_send(%p) failed: %i/%s", c_sock, errno, strerror(errno));
+    }
+#endif
 
     return *this;
   }
@@ -87,6 +108,16 @@ namespace aegir {
     }
 
     msgstring msg((uint8_t*)zmq_msg_data(&zmsg), zmq_msg_size(&zmsg));
+#ifdef AEGIR_TRACE
+    // the flow id frame of the published Messages
+    if ( c_type == SocketType::SUB && _mf == MessageFormat::INTERNAL && zmq_msg_more(&zmsg) ) {
+      if ( zmq_msg_recv(&zmsg, c_sock, ZMQ_DONTWAIT) == sizeof(uint64_t) ) {
+	uint64_t id;
+	memcpy(&id, zmq_msg_data(&zmsg), sizeof(id));
+	SpanTracer::getInstance().flowEnd(c_tracename, id);
+      }
+    }
+#endif
     zmq_msg_close(&zmsg);
 #ifdef AEGIR_DEBUG
     printf("ZMQ::Socket::recv(): %s\n", hexdump(msg).c_str());
@@ -1,5 +1,8 @@
 /*
  * High-level zeromq wrapper class for internal use
+ * With AEGIR_TRACE the Messages published on the PUB sockets carry their
+ * flow id in a second frame, which the SUB sockets strip off, so the
+ * hops between the threads are linked on the span tracer's timeline.
  */
 
 #ifndef AEGIR_ZMQ_H
@@ -52,6 +55,8 @@ namespace aegir {
       SocketType c_type;
       void *c_sock;
       bool c_closed;
+      // the address on the timeline
+      const char *c_tracename;
     };
 
   private:
@@ -25,8 +25,8 @@
 #error "BOOST_LOG_USE_NATIVE_SYSLOG is unset"
 #endif
 
-#include "Config.hh"
 #include "Exception.hh"
+#include "AsyncLog.hh"
 
 namespace bl = ::boost::log;
 namespace blt = ::boost::log::trivial;
@@ -40,6 +40,8 @@ namespace aegir {
 
     typedef bls::synchronous_sink<bls::syslog_backend> syslog_sink_t;
 
+    std::atomic<blt::severity_level> g_level(blt::severity_level::info);
+
     static bool filter(const boost::log::attribute_value_set&);
 
     void init() {
@@ -71,6 +73,13 @@ namespace aegir {
 
 	blcore->add_sink(frontend);
       }
+
+      // the records are written to syslog by a background thread
+      AsyncLog::getInstance().start();
+    }
+
+    void shutdown() {
+      AsyncLog::getInstance().stop();
     }
 
     std::string str(blt::severity_level _level) {
@@ -91,7 +100,8 @@ namespace aegir {
     }
 
     bool filter(const boost::log::attribute_value_set& attr_set) {
-      return attr_set["Severity"].extract<blt::severity_level>() >= Config::getInstance()->getLogLevel();
+      auto severity = attr_set["Severity"].extract<blt::severity_level>();
+      return severity && isEnabled(severity.get());
     }
   } // ns lggoging
 } // ns aegir
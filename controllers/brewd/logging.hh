@@ -6,6 +6,9 @@
 #define AEGIR_LOGGING_H
 
 #include <string>
+#include <atomic>
+#include <cstdint>
+#include <concepts>
 
 #include <boost/log/trivial.hpp>
 namespace blt = ::boost::log::trivial;
@@ -14,7 +17,48 @@ namespace aegir {
   namespace logging {
 
     void init();
+    // writes out the pending records, and stops the background logging
+    void shutdown();
     std::string str(blt::severity_level _level);
+
+    // the lowest severity logged, checked before anything's formatted
+    extern std::atomic<blt::severity_level> g_level;
+    inline void setLevel(blt::severity_level _level) { g_level = _level; };
+    inline bool isEnabled(blt::severity_level _level) {
+      return _level >= g_level.load(std::memory_order_relaxed);
+    };
+
+    // a key=value field of a structured record
+    struct Field {
+      enum class Type: uint8_t {
+	Int,
+	UInt,
+	Double,
+	Bool,
+	String
+      };
+
+      Field(const char *_key, bool _value): key(_key), type(Type::Bool), b(_value) {};
+      Field(const char *_key, const char *_value): key(_key), type(Type::String), s(_value) {};
+      // the string has to outlive the log call
+      Field(const char *_key, const std::string &_value): key(_key), type(Type::String), s(_value.c_str()) {};
+      template<std::signed_integral T>
+      Field(const char *_key, T _value): key(_key), type(Type::Int), i(_value) {};
+      template<std::unsigned_integral T>
+      Field(const char *_key, T _value): key(_key), type(Type::UInt), u(_value) {};
+      template<std::floating_point T>
+      Field(const char *_key, T _value): key(_key), type(Type::Double), d(_value) {};
+
+      const char *key;
+      Type type;
+      union {
+	int64_t i;
+	uint64_t u;
+	double d;
+	bool b;
+	const char *s;
+      };
+    };
   }
 }
 
@@ -8,6 +8,7 @@
 
 #include <string>
 #include <sstream>
+#include <memory>
 
 #include <boost/program_options.hpp>
 
@@ -22,14 +23,20 @@
 #include "SPI.hh"
 #include "DirectSelect.hh"
 #include "PRThread.hh"
+#include "HTTPThread.hh"
+#include "Trace.hh"
+#include "SpanTracer.hh"
+#include "Scheduling.hh"
+#include "Replay.hh"
 
 namespace po = boost::program_options;
 
 static uid_t getuser(const std::string &_name);
 static uid_t getgroup(const std::string &_name);
+static int replay(const std::string &_cfgfile, const std::string &_trace);
 
 int main(int argc, char *argv[]) {
-  std::string cfgfile, pidfile, user, group;
+  std::string cfgfile, pidfile, user, group, recordfile, replayfile, tracedump;
   uid_t userid;
   gid_t groupid;
   bool initcfg(false), daemonize(false);
@@ -47,6 +54,12 @@ int main(int argc, char *argv[]) {
      "User to run as")
     ("group,g",po::value<std::string>(&group)->default_value("operator"),
      "Group to run as")
+    ("record,r",po::value<std::string>(&recordfile),
+     "Record the Controller's traffic into a trace file")
+    ("replay",po::value<std::string>(&replayfile),
+     "Replay a trace through the control logic, and compare the decisions")
+    ("tracedump",po::value<std::string>(&tracedump)->default_value("/var/tmp/aegir-brewd.trace.json"),
+     "Where SIGUSR1 dumps the span tracer's timeline, with AEGIR_TRACE")
       ;
 
   po::variables_map vm;
@@ -84,7 +97,7 @@ int main(int argc, char *argv[]) {
   auto cfg = aegir::Config::getInstance();
   if ( initcfg ) {
     try {
-      cfg->save(cfgfile);
+      aegir::Config::edit()->save(cfgfile);
     }
     catch(aegir::Exception &e) {
       fprintf(stderr, "Error while saving configuration: %s\n", e.what());
@@ -94,7 +107,9 @@ int main(int argc, char *argv[]) {
     printf("Initialized config file: %s\n", cfgfile.c_str());
     return 0;
   }
-  // initcfg is done as well, normal operation from here
+  // initcfg is done as well
+  if ( replayfile.length() ) return replay(cfgfile, replayfile);
+  // normal operation from here
   log.log("Aegir starting up...");
 
   // looking up user, gid
@@ -167,13 +182,37 @@ int main(int argc, char *argv[]) {
 
   // config file parsing
   try {
-    cfg->load(cfgfile);
+    cfg = aegir::Config::reload(cfgfile);
   }
   catch (aegir::Exception &e) {
     log.fatal("Error while loading config: %s", e.what());
     return 2;
   }
 
+  // keeping the pages in memory, before the threads are started
+  if ( cfg->getMemLock() ) {
+    try {
+      aegir::Scheduling::lockMemory();
+      log.info("Memory locked");
+    }
+    catch (aegir::Exception &e) {
+      log.error("%s", e.what());
+    }
+  }
+
+  // the trace recording, from the very start
+  if ( recordfile.length() ) {
+    try {
+      aegir::TraceRecorder::getInstance()->open(recordfile);
+      log.info("Recording trace into %s", recordfile.c_str());
+    }
+    catch (aegir::Exception &e) {
+      log.error("Unable to record trace: %s", e.what());
+    }
+  }
+
+  aegir::SpanTracer::getInstance().setDumpFile(tracedump);
+
   // We have the config, now set GPIO up
   aegir::GPIO *gpio;
 
@@ -189,8 +228,9 @@ int main(int argc, char *argv[]) {
   auto threadmgr = aegir::ThreadManager::getInstance();
 
   try {
-    // Initialize the SPI bus
-    std::map<int, std::string> dsmap{{0,"cs0"},{1,"cs1"},{2,"cs2"},{3,"cs3"}};
+    // Initialize the SPI bus, with a chip select for every configured sensor
+    std::map<int, std::string> dsmap;
+    cfg->getSPIDSChips(dsmap);
     aegir::DirectSelect ds(*gpio, dsmap);
     aegir::SPI spi(ds, *gpio, cfg->getSPIDevice());
 
@@ -203,6 +243,11 @@ int main(int argc, char *argv[]) {
     // Init the PR thread
     aegir::PRThread prt;
 
+    // and the optional embedded HTTP server
+    std::unique_ptr<aegir::HTTPThread> httpt;
+    if ( cfg->getHTTPPort() )
+      httpt = std::make_unique<aegir::HTTPThread>();
+
     /// this is the main loop
     threadmgr->start();
     delete ioh;
@@ -218,8 +263,10 @@ int main(int argc, char *argv[]) {
 
   // deallocating stuff here
   delete gpio;
+  aegir::TraceRecorder::getInstance()->close();
 
   log.info("Exitting...");
+  aegir::logging::shutdown();
   return 0;
 }
 
@@ -239,3 +286,37 @@ uid_t getgroup(const std::string &_name) {
   return grp->gr_gid;
 }
 
+
+int replay(const std::string &_cfgfile, const std::string &_trace) {
+  try {
+    aegir::Config::reload(_cfgfile);
+  }
+  catch (aegir::Exception &e) {
+    fprintf(stderr, "Error while loading config: %s\n", e.what());
+    return 2;
+  }
+
+  aegir::Replay::Report report;
+  try {
+    aegir::Replay replay(_trace);
+    report = replay.run();
+  }
+  catch (std::exception &e) {
+    fprintf(stderr, "Error while replaying %s: %s\n", _trace.c_str(), e.what());
+    return 2;
+  }
+
+  for (auto &diff: report.differences) {
+    printf("Cycle %u at %u:\n", diff.cycle, diff.time);
+    for (auto &it: diff.recorded) printf("  - %s\n", it.c_str());
+    for (auto &it: diff.replayed) printf("  + %s\n", it.c_str());
+  }
+  printf("Cycles: %u Inputs: %u Commands: %u Outputs: %u\n",
+	 report.cycles, report.inputs, report.commands, report.outputs);
+  printf("Differing cycles: %u\n", report.differing);
+  if ( report.cycles )
+    printf("Cycle time: %.3fs total, %.1fus per cycle\n",
+	   report.cycletime, 1e6*report.cycletime/report.cycles);
+
+  return report.differing ? 7 : 0;
+}
@@ -26,6 +26,11 @@ namespace aegir {
   };
 
   ThermoCouple::ThermoCouple(const uint8_t _i) {
+    // the extra sensors' ids are valid whether or not the config names them
+    if ( _i >= _SIZE && _i < _MAX ) {
+      c_value = Value(_i);
+      return;
+    }
     for (int i=0; i < sizeof(g_sensornames)/sizeof(sensorstr); ++i ) {
       if ( g_sensornames[i].sensor == _i ) {
 	c_value = g_sensornames[i].sensor;
@@ -62,4 +67,36 @@ namespace aegir {
     }
     throw Exception("ThermoCouple value has reserved use");
   }
+
+  void SensorNames::set(const uint8_t _i, const std::string &_name) {
+    if ( _i < ThermoCouple::_SIZE || _i >= ThermoCouple::_MAX )
+      throw Exception("Sensor id %i isn't for an extra sensor", _i);
+    if ( !_name.length() )
+      throw Exception("Empty sensor name");
+    for (int i=0; i < sizeof(g_sensornames)/sizeof(sensorstr); ++i )
+      if ( _name == g_sensornames[i].name )
+	throw Exception("Sensor name '%s' is reserved", _name.c_str());
+    for (int i=0; i < ThermoCouple::_MAX - ThermoCouple::_SIZE; ++i )
+      if ( c_names[i] == _name && ThermoCouple::_SIZE + i != _i )
+	throw Exception("Sensor name '%s' is already used", _name.c_str());
+    c_names[_i - ThermoCouple::_SIZE] = _name;
+  }
+
+  void SensorNames::clear() {
+    for (auto &name: c_names) name.clear();
+  }
+
+  ThermoCouple SensorNames::find(const std::string &_name) const {
+    for (int i=0; i < ThermoCouple::_MAX - ThermoCouple::_SIZE; ++i )
+      if ( c_names[i].length() && c_names[i] == _name )
+	return ThermoCouple(uint8_t(ThermoCouple::_SIZE + i));
+    return ThermoCouple(_name);
+  }
+
+  const char* SensorNames::name(ThermoCouple _tc) const {
+    if ( _tc >= ThermoCouple::_SIZE && _tc < ThermoCouple::_MAX
+	 && c_names[_tc - ThermoCouple::_SIZE].length() )
+      return c_names[_tc - ThermoCouple::_SIZE].c_str();
+    return _tc.toStr();
+  }
 }
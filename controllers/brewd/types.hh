@@ -9,6 +9,7 @@
 #include <string>
 #include <ostream>
 #include <iomanip>
+#include <utility>
 
 namespace aegir {
 
@@ -23,7 +24,10 @@ namespace aegir {
       RIMS=HERMS,
       BK, // boil kettle
       HLT, // hot liquor tank
-      _SIZE // unused, indicates the size
+      _SIZE, // unused, indicates the number of the well-known sensors
+      // the extra sensors (fermenter, 2nd RIMS...) are named from the config,
+      // and take the ids from _SIZE up to the capacity
+      _MAX=8
     };
 
     ThermoCouple() = default;
@@ -39,27 +43,68 @@ namespace aegir {
     Value c_value;
 
   public:
+    // the well-known sensors' names, the extra ones are named by SensorNames
     const char* toStr() const;
   };
 
+  /*
+    The names of the extra sensors. Every Config snapshot carries its own,
+    so a reload never changes the names a reader of an older one sees.
+   */
+  class SensorNames {
+  public:
+    // names an extra sensor, _i is between _SIZE and _MAX
+    void set(const uint8_t _i, const std::string &_name);
+    void clear();
+    // looks up a well-known or a named extra sensor
+    ThermoCouple find(const std::string &_name) const;
+    const char* name(ThermoCouple _tc) const;
+
+  private:
+    std::string c_names[ThermoCouple::_MAX - ThermoCouple::_SIZE];
+  };
+
   struct ThermoReadings {
-    float data[ThermoCouple::_SIZE];
+    float data[ThermoCouple::_MAX];
+    // the number of sensors read, the well-known ones are always there
+    uint8_t size = ThermoCouple::_SIZE;
     inline float& operator[](std::size_t _idx) {return data[_idx];};
     inline const float& operator[](std::size_t _idx) const {return data[_idx];};
+
+    // calls _f(i) for the first _n sensors, unrolled for the common counts
+    template<typename F>
+    static inline void forEach(uint8_t _n, F &&_f) {
+      switch (_n) {
+      case 4: unrolled(_f, std::make_index_sequence<4>{}); break;
+      case 5: unrolled(_f, std::make_index_sequence<5>{}); break;
+      case 6: unrolled(_f, std::make_index_sequence<6>{}); break;
+      case 8: unrolled(_f, std::make_index_sequence<8>{}); break;
+      default:
+	for (uint8_t i=0; i < _n; ++i) _f(i);
+      }
+    }
+    template<typename F>
+    inline void forEach(F &&_f) const { forEach(size, std::forward<F>(_f)); };
+
+    template<typename F, std::size_t... I>
+    static inline void unrolled(F &_f, std::index_sequence<I...>) {
+      (_f(uint8_t(I)), ...);
+    }
+
     friend std::ostream& operator<<(std::ostream& os, const ThermoReadings& r) {
       os << "ThermoReadings(";
-      for (uint8_t i=0; i<ThermoCouple::_SIZE;++i) {
-	if ( i == 0 ) {
-	  os << ThermoCouple(i).toStr()<< ":"
-	     << std::fixed
-	     << std::setw(5) << std::setprecision(2)
-	     << r.data[i];
-	} else {
-	  os << ", " << ThermoCouple(i).toStr()<< ":"
-	     << std::fixed
-	     << std::setw(5) << std::setprecision(2)
-	     << r.data[i];
+      for (uint8_t i=0; i<r.size;++i) {
+	if ( i > 0 ) os << ", ";
+	try {
+	  os << ThermoCouple(i).toStr();
+	}
+	catch (std::exception &e) {
+	  os << '#' << int(i);
 	}
+	os << ":"
+	   << std::fixed
+	   << std::setw(5) << std::setprecision(2)
+	   << r.data[i];
       }
       os << ")";
       return os;
@@ -0,0 +1,151 @@
+/*
+  Asynchronous logging
+ */
+
+#include "AsyncLog.hh"
+#include "LogChannel.hh"
+
+#include <cstdio>
+#include <cstdarg>
+#include <cstring>
+
+#include <catch2/catch_test_macros.hpp>
+
+// captures and formats the arguments like the background thread does
+static std::string roundtrip(const char *_fmt, ...) {
+  uint8_t buff[1024];
+  std::va_list args;
+
+  va_start(args, _fmt);
+  uint32_t len = aegir::AsyncLog::capture(_fmt, args, buff, sizeof(buff));
+  va_end(args);
+  return aegir::AsyncLog::format(_fmt, buff, len);
+}
+
+static std::string vprintf(const char *_fmt, ...) {
+  char buff[1024];
+  std::va_list args;
+
+  va_start(args, _fmt);
+  int len = std::vsnprintf(buff, sizeof(buff), _fmt, args);
+  va_end(args);
+  return std::string(buff, len);
+}
+
+// captures into a buffer for a single integer
+static std::string truncated(const char *_fmt, ...) {
+  uint8_t buff[8];
+  std::va_list args;
+
+  va_start(args, _fmt);
+  uint32_t len = aegir::AsyncLog::capture(_fmt, args, buff, sizeof(buff));
+  va_end(args);
+  return aegir::AsyncLog::format(_fmt, buff, len);
+}
+
+static bool push(const char *_fmt, ...) {
+  std::va_list args;
+
+  va_start(args, _fmt);
+  bool ret = aegir::AsyncLog::getInstance().push("test", blt::severity_level::info, _fmt, args);
+  va_end(args);
+  return ret;
+}
+
+TEST_CASE("AsyncLog formats like printf", "[AsyncLog]") {
+#define SAME(...) REQUIRE(roundtrip(__VA_ARGS__) == vprintf(__VA_ARGS__))
+  SAME("no arguments");
+  SAME("Pausing heat: RIMS:%.2f Target:%.2f Overhead:%.2f (%.2f)", 65.123f, 64.5, 2.5f, 67.0);
+  SAME("Error on PIN '%s'/%lu: %s", "mtheat", 6lu, "unknown");
+  SAME("%i%% %u %hhu %c %li %x", -42, 42u, (unsigned char)255, 'x', -1234567890123l, 0xbeefu);
+  SAME("%5.1f|%-8s|%08.3f|%*d|%.*s", 3.14159, "ab", -2.5, 6, 42, 3, "abcdef");
+  SAME("%hd %lld %zu %e %g", (short)-7, -9000000000ll, (std::size_t)12, 1e-9, 0.5);
+  SAME("%s", (const char*)nullptr);
+#undef SAME
+  // a broken conversion is kept as it is
+  REQUIRE(roundtrip("trailing %") == "trailing %");
+
+  // the arguments running out keep the text before them
+  REQUIRE(truncated("a:%i b:%i", 1, 2) == "a:1 b:");
+}
+
+TEST_CASE("LogRing wraps around", "[AsyncLog]") {
+  aegir::LogRing ring(256);
+  uint32_t size;
+  int pushed = 0, popped = 0;
+
+  REQUIRE(ring.peek(size) == nullptr);
+
+  for (int round=0; round < 100; ++round) {
+    // fill it up
+    while ( uint8_t *p = ring.reserve(40) ) {
+      uint32_t len = 1 + pushed % 37;
+      std::memset(p, pushed & 0xff, len);
+      ring.commit(len);
+      ++pushed;
+    }
+    REQUIRE(pushed > popped);
+    // and drain some of it
+    for (int i=0; i < 3; ++i) {
+      const uint8_t *p = ring.peek(size);
+      REQUIRE(p != nullptr);
+      REQUIRE(size == 1 + popped % 37);
+      REQUIRE(p[0] == (popped & 0xff));
+      REQUIRE(p[size-1] == (popped & 0xff));
+      ring.release();
+      ++popped;
+    }
+  }
+  while ( const uint8_t *p = ring.peek(size) ) {
+    REQUIRE(p[0] == (popped & 0xff));
+    ring.release();
+    ++popped;
+  }
+  REQUIRE(popped == pushed);
+}
+
+TEST_CASE("AsyncLog needs to be started", "[AsyncLog]") {
+  REQUIRE_FALSE(aegir::AsyncLog::getInstance().isRunning());
+  REQUIRE_FALSE(push("not started %i", 1));
+}
+
+// captures and formats the fields like the background thread does
+static std::string fields(const char *_event, std::initializer_list<aegir::logging::Field> _fields,
+			  uint32_t _max = 1024) {
+  uint8_t buff[1024];
+
+  uint32_t len = aegir::AsyncLog::capture(_fields.begin(), _fields.size(), buff, _max);
+  return aegir::AsyncLog::formatFields(_event, buff, len);
+}
+
+TEST_CASE("AsyncLog formats the structured records", "[AsyncLog]") {
+  std::string name("mash tun");
+
+  REQUIRE(fields("tempcontrol", {{"dT_rims", 0.125f}, {"heratio", 0.5}, {"now", 1700000000l},
+				 {"cycles", 42u}, {"nodata", false}})
+	  == "tempcontrol dT_rims=0.125 heratio=0.5 now=1700000000 cycles=42 nodata=false");
+  REQUIRE(fields("", {{"a", -1}, {"b", "x"}}) == "a=-1 b=x");
+  // the strings are quoted when they need to be
+  REQUIRE(fields("ev", {{"name", name}, {"q", "say \"hi\""}, {"e", ""}})
+	  == "ev name=\"mash tun\" q=\"say \\\"hi\\\"\" e=\"\"");
+  // the fields that don't fit are left out
+  REQUIRE(fields("ev", {{"a", 1}, {"b", 2}}, 16) == "ev a=1");
+}
+
+TEST_CASE("The log macros don't evaluate the filtered arguments", "[AsyncLog]") {
+  aegir::LogChannel log("test");
+  int evaluated = 0;
+  auto arg = [&]() { return ++evaluated; };
+
+  aegir::logging::setLevel(blt::severity_level::info);
+  AEGIR_LOG_DEBUG(log, "debug %i", arg());
+  AEGIR_LOG_TRACE(log, "trace %i", arg());
+  AEGIR_LOG_EVENT(log, debug, "event", {"v", arg()});
+  REQUIRE(evaluated == 0);
+
+  aegir::logging::setLevel(blt::severity_level::trace);
+  AEGIR_LOG_DEBUG(log, "debug %i", arg());
+  AEGIR_LOG_EVENT(log, trace, "event", {"v", arg()});
+  REQUIRE(evaluated == 2);
+  aegir::logging::setLevel(blt::severity_level::info);
+}
@@ -0,0 +1,73 @@
+/*
+  Auto-tuning of the heating parameters
+ */
+
+#include "AutoTuner.hh"
+#include "SimulatedPlant.hh"
+
+#include <cmath>
+
+#include <catch2/catch_test_macros.hpp>
+
+// runs the tuner on the simulated plant until it finishes
+static void tune(aegir::tests::SimulatedPlant &_plant, aegir::AutoTuner &_tuner) {
+  _tuner.start(_plant.getNow(), _plant.getHEPower(), _plant.getVolume(), 0.3f);
+
+  for (int t=0; t < 4*3600 && _tuner.isRunning(); ++t) {
+    auto last = _plant.getReadings().last();
+    _plant.setRatio(_tuner.update(_plant.getNow(), last[aegir::ThermoCouple::MT],
+				  last[aegir::ThermoCouple::RIMS]));
+    _plant.tick();
+  }
+}
+
+TEST_CASE("AutoTuner identifies the simulated plant", "[AutoTuner]") {
+  aegir::tests::SimulatedPlant::Params params;
+  // a weaker element than its rating
+  params.hepower = 3.0;
+  aegir::tests::SimulatedPlant plant(40, params);
+  aegir::AutoTuner tuner;
+
+  tune(plant, tuner);
+
+  auto &r = tuner.getResults();
+  INFO("phase:" << tuner.getPhaseName() << " error:" << tuner.getError()
+       << " K:" << r.gain << " tau:" << r.tau << " L:" << r.deadtime << " g:" << r.mtrate
+       << " cycle:" << r.hecycletime << " overhead:" << r.heatoverhead
+       << " delay:" << r.hedelay << " mcf:" << r.maxcorrectionfactor
+       << " settling:" << r.settlingtime << " overshoot:" << r.overshoot);
+  REQUIRE(tuner.getPhase() == aegir::AutoTuner::Phases::Done);
+
+  // the tube heats up by P/(4.2*F), the mash tun by F/V
+  float gain = params.hepower / (4.2f * params.flow);
+  float mtrate = params.flow / params.volume;
+  REQUIRE(std::fabs(r.gain - gain) < gain * 0.1f);
+  REQUIRE(std::fabs(r.mtrate - mtrate) < mtrate * 0.2f);
+  REQUIRE(r.tau > params.elementlag * 0.5f);
+  REQUIRE(r.tau < params.elementlag * 2);
+
+  // the proposed values are all loadable
+  REQUIRE(r.hecycletime >= 1.0f);
+  REQUIRE(r.hecycletime <= 5.0f);
+  REQUIRE(r.heatoverhead >= 0.5f);
+  REQUIRE(r.heatoverhead < 5.0f);
+  REQUIRE(r.hedelay <= 30);
+  REQUIRE(r.maxcorrectionfactor >= 1.0f);
+  REQUIRE(r.maxcorrectionfactor <= 1.25f);
+  REQUIRE(r.overshoot <= 0.3f);
+  REQUIRE(r.settlingtime > 0);
+  REQUIRE(r.settlingtime < 3600);
+}
+
+TEST_CASE("AutoTuner fails without heating", "[AutoTuner]") {
+  aegir::tests::SimulatedPlant::Params params;
+  params.hepower = 0.01;
+  aegir::tests::SimulatedPlant plant(40, params);
+  aegir::AutoTuner tuner;
+
+  tune(plant, tuner);
+
+  REQUIRE(tuner.getPhase() == aegir::AutoTuner::Phases::Failed);
+  REQUIRE_FALSE(tuner.getError().empty());
+  REQUIRE(tuner.update(plant.getNow(), 40, 40) == 0);
+}
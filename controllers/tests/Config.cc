@@ -17,7 +17,7 @@ TEST_CASE("Config", "[Config]") {
     REQUIRE(cfg == cfg2);
   }
 
-  cfg->load(CFG_TEST_FILE);
+  cfg = aegir::Config::reload(CFG_TEST_FILE);
   INFO("Config loaded");
 
   REQUIRE(cfg->getSPIDevice() == "/dev/spigen0.0");
@@ -36,4 +36,58 @@ TEST_CASE("Config", "[Config]") {
   REQUIRE(tcs.tcs[aegir::ThermoCouple::BK] == 3);
   REQUIRE(tcs.tcs[aegir::ThermoCouple::HLT] == 2);
   REQUIRE(tcs.tcs[aegir::ThermoCouple::HERMS] == 0);
+
+  REQUIRE(pinlayout["hltheat"] == 27);
+  REQUIRE(cfg->getMaxPower() == 9000);
+  REQUIRE(cfg->getHeaters().size() == 1);
+  REQUIRE(cfg->getHeaters()[0].pin == "hltheat");
+  REQUIRE(cfg->getHeaters()[0].power == 2000);
+  REQUIRE(cfg->getHeaters()[0].vessel == aegir::ThermoCouple::HLT);
+  REQUIRE(cfg->getHeaters()[0].temp == 78.0f);
+
+  // the budgets not set keep their defaults
+  REQUIRE(cfg->getLoopBudget().stages == 150);
+  REQUIRE(cfg->getLoopBudget().worst == 5);
+  REQUIRE(cfg->getLoopBudget().cycle == 500);
+
+  // only the threads listed are scheduled
+  auto &threads = cfg->getThreadSched();
+  REQUIRE(threads.size() == 1);
+  REQUIRE(threads.at("IOHandler").cpus == std::vector<uint32_t>{0});
+  REQUIRE(threads.at("IOHandler").policy == aegir::SchedPolicies::FIFO);
+  REQUIRE(threads.at("IOHandler").priority == 20);
+  REQUIRE_FALSE(cfg->getMemLock());
+  REQUIRE(cfg->getStackPrefault() == 64);
+
+  // merged into the defaults
+  REQUIRE(cfg->getSupervisor("Controller").timeout == 3000);
+  REQUIRE(cfg->getSupervisor("Controller").maxrestarts == 5);
+  REQUIRE(cfg->getSupervisor("IOHandler").timeout == 2000);
+  REQUIRE(cfg->getSupervisor("PR").restart == aegir::RestartPolicies::Never);
+  REQUIRE(cfg->getSupervisor("HTTP").timeout == 0);
+  REQUIRE(cfg->getSupervisor("HTTP").restart == aegir::RestartPolicies::OnFailure);
+  REQUIRE(cfg->getWatchdogTimeout() == 3000);
+  REQUIRE(cfg->getWatchdogDevice() == "/dev/watchdog");
+  REQUIRE_FALSE(cfg->getWatchdogStandin());
+}
+
+TEST_CASE("Config snapshots", "[Config]") {
+  auto cfg = aegir::Config::reload(CFG_TEST_FILE);
+  uint64_t version = cfg->getVersion();
+
+  // a reload is a new snapshot, the old one lives on unchanged
+  auto next = aegir::Config::reload();
+  REQUIRE(next != cfg);
+  REQUIRE(next->getVersion() == version + 1);
+  REQUIRE(aegir::Config::getInstance() == next);
+  REQUIRE(cfg->getHeatOverhead() == 2.5f);
+
+  // a broken file keeps the current one
+  REQUIRE_THROWS(aegir::Config::reload("tests/data/nonexistent.yaml"));
+  REQUIRE(aegir::Config::getInstance() == next);
+
+  // the copies are private
+  auto copy = aegir::Config::edit();
+  copy->setHeatOverhead(3.0f);
+  REQUIRE(aegir::Config::getInstance()->getHeatOverhead() == 2.5f);
 }
@@ -0,0 +1,202 @@
+/*
+  Control strategies on a simulated RIMS system
+ */
+
+#include "HeuristicStrategy.hh"
+#include "MPCStrategy.hh"
+#include "SimulatedPlant.hh"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+namespace {
+  using aegir::tests::SimulatedPlant;
+
+  struct Step {
+    float target;
+    // the RIMS overheat while heating up and while holding
+    float overheat, holdoverheat;
+    uint32_t hold;
+    // the temperature drop on adding the malts
+    float doughin;
+    bool preheat;
+  };
+
+  // preheat, dough-in, protein, saccharification and mash-out rests
+  const std::vector<Step> c_profile{
+    {52, 6, 6, 0, 0, true},
+    {52, 2, 0.8, 600, 2.5, false},
+    {64, 2, 0.8, 1800, 0, false},
+    {72, 2, 0.8, 1200, 0, false},
+    {78, 8, 8, 300, 0, false},
+  };
+
+  // the Config defaults
+  constexpr float c_accuracy = 0.3;
+  constexpr float c_heatoverhead = 2.0;
+
+  struct Result {
+    // the worst over all the steps, the settling time is from the
+    // target change till the MT stays within the accuracy
+    float overshoot;
+    uint32_t settling;
+    float rimsexcess;
+    // kWh for the whole profile
+    float energy;
+  };
+
+  // drives the strategy the way the Controller does, including its RIMS
+  // overheat protection
+  Result runProfile(aegir::ControlStrategy &_strategy, SimulatedPlant &_plant) {
+    Result res{0, 0, 0, 0};
+
+    for (auto &step: c_profile) {
+      float overheat = step.overheat;
+      uint32_t start = _plant.getElapsed();
+      uint32_t reachedat = 0, lastout = start;
+      bool reached = false, paused = false;
+      int next = 0;
+
+      _plant.setPreHeating(step.preheat);
+      if ( step.doughin > 0 ) _plant.doughIn(step.doughin);
+      _strategy.restart();
+
+      while ( _plant.getElapsed() - start < 3*3600 ) {
+	auto last = _plant.getReadings().last();
+	float mt = last[aegir::ThermoCouple::MT];
+	float rims = last[aegir::ThermoCouple::RIMS];
+
+	if ( !paused && rims >= step.target + c_heatoverhead*1.15 ) {
+	  paused = true;
+	  _plant.setRatio(0.01);
+	} else if ( paused && rims < step.target + c_heatoverhead*0.95 ) {
+	  paused = false;
+	  next = 0;
+	}
+
+	if ( !paused && next <= 0 ) {
+	  auto decision = _strategy.control(_plant, step.target, overheat);
+	  if ( decision.decided ) _plant.setRatio(decision.heratio);
+	  next = std::clamp(decision.nextcontrol, 3, 30);
+	}
+
+	_plant.tick();
+	--next;
+
+	if ( !reached && mt >= step.target - c_accuracy ) {
+	  reached = true;
+	  reachedat = lastout = _plant.getElapsed();
+	  overheat = step.holdoverheat;
+	  next = 0;
+	}
+
+	if ( reached ) {
+	  if ( std::fabs(_plant.getMT() - step.target) > c_accuracy )
+	    lastout = _plant.getElapsed();
+	  if ( !step.preheat ) {
+	    res.overshoot = std::max(res.overshoot, _plant.getMT() - step.target);
+	    res.rimsexcess = std::max(res.rimsexcess,
+				      _plant.getRIMS() - (step.target + step.overheat));
+	  }
+	  if ( _plant.getElapsed() - reachedat >= step.hold ) break;
+	}
+      }
+
+      if ( !reached ) lastout = start + 3*3600;
+      if ( !step.preheat ) res.settling = std::max(res.settling, lastout - start);
+    }
+    res.energy = _plant.getEnergy();
+
+    return res;
+  }
+}
+
+TEST_CASE("HeuristicStrategy leaves the element alone without readings", "[ControlStrategy]") {
+  // a zero reading is a missing thermocouple
+  SimulatedPlant::Params params;
+  params.noise = 0;
+  SimulatedPlant plant(0, params);
+  aegir::HeuristicStrategy heuristic;
+
+  auto decision = heuristic.control(plant, 60, 2);
+  REQUIRE_FALSE(decision.decided);
+  REQUIRE(decision.nextcontrol == 3);
+}
+
+TEST_CASE("MPCStrategy fits the model", "[ControlStrategy]") {
+  SimulatedPlant::Params params;
+  params.noise = 0;
+  SimulatedPlant plant(50, params);
+  aegir::MPCStrategy mpc;
+
+  // open loop excitation
+  for (float ratio: {0.6f, 0.1f, 0.9f, 0.3f, 0.0f, 0.7f, 0.2f, 1.0f, 0.4f}) {
+    plant.setRatio(ratio);
+    for (int i=0; i<100; ++i) plant.tick();
+  }
+  mpc.control(plant, 60, 2);
+
+  auto &model = mpc.getModel();
+  // steady state: element power / (4.2 * flow)
+  float gain = params.hepower / (4.2 * params.flow);
+  // the MT is heated by the whole element power
+  float heating = params.hepower * aegir::MPCStrategy::c_sampletime / (4.2 * params.volume);
+
+  INFO("tau:" << model.getTau() << " K:" << model.getGain() << " d:" << model.getDeadTime()
+       << " g:" << model.g << " l:" << model.l);
+  REQUIRE(model.fitted);
+  REQUIRE(model.getGain() > gain * 0.75);
+  REQUIRE(model.getGain() < gain * 1.25);
+  REQUIRE(model.getTau() > 5);
+  REQUIRE(model.getTau() < 40);
+  REQUIRE(model.getDeadTime() <= 20);
+  REQUIRE(model.g * model.getGain() > heating * 0.7);
+  REQUIRE(model.g * model.getGain() < heating * 1.3);
+}
+
+TEST_CASE("MPCStrategy on a step mash", "[ControlStrategy]") {
+  SimulatedPlant plant(20);
+  aegir::MPCStrategy mpc;
+
+  auto res = runProfile(mpc, plant);
+
+  INFO("overshoot:" << res.overshoot << " settling:" << res.settling
+       << " rimsexcess:" << res.rimsexcess << " energy:" << res.energy);
+  REQUIRE(res.overshoot < 0.5);
+  REQUIRE(res.settling < 1200);
+  REQUIRE(res.rimsexcess < 1.0);
+}
+
+TEST_CASE("Control strategies replay", "[.][benchmark][ControlStrategy]") {
+  std::vector<std::pair<const char*, SimulatedPlant::Params>> plants;
+  SimulatedPlant::Params params;
+
+  plants.emplace_back("default", params);
+  params.volume = 45;
+  params.flow = 0.08;
+  plants.emplace_back("large batch, slow pump", params);
+  params = SimulatedPlant::Params();
+  params.hepower = 2.2;
+  params.hosedelay = 15;
+  params.loss = 5e-5;
+  plants.emplace_back("weak element, long hose", params);
+
+  std::printf("%-24s %-10s %10s %10s %10s %10s\n", "plant", "strategy",
+	      "overshoot", "settling", "rimsexcess", "kWh");
+  for (auto &it: plants) {
+    for (int s=0; s<2; ++s) {
+      SimulatedPlant plant(20, it.second);
+      std::unique_ptr<aegir::ControlStrategy> strategy;
+
+      if ( s == 0 ) strategy = std::make_unique<aegir::HeuristicStrategy>();
+      else strategy = std::make_unique<aegir::MPCStrategy>();
+
+      auto res = runProfile(*strategy, plant);
+      std::printf("%-24s %-10s %10.2f %10u %10.2f %10.3f\n", it.first, strategy->getName(),
+		  res.overshoot, res.settling, res.rimsexcess, res.energy);
+    }
+  }
+}
@@ -0,0 +1,113 @@
+/*
+  Completion estimates
+ */
+
+#include "ETAEngine.hh"
+
+#include <cmath>
+
+#include <catch2/catch_test_macros.hpp>
+
+// feeds _secs readings of _tc from _temp(t), returns the last time
+template<typename F>
+static time_t feed(aegir::ETAEngine &_eta, aegir::ThermoCouple _tc, time_t _start,
+		   uint32_t _secs, F _temp) {
+  aegir::ThermoReadings tr{};
+
+  for (uint32_t t=0; t < _secs; ++t) {
+    tr[_tc] = _temp(t);
+    _eta.addReadings(_start + t, tr);
+  }
+  return _start + _secs - 1;
+}
+
+TEST_CASE("ETAEngine on a linear heating", "[ETAEngine]") {
+  aegir::ETAEngine eta;
+
+  // not enough readings yet
+  REQUIRE(eta.timeTo(aegir::ThermoCouple::MT, 30).seconds < 0);
+
+  feed(eta, aegir::ThermoCouple::MT, 1000, 600, [](uint32_t t) { return 20 + 0.01f*t; });
+
+  auto e = eta.timeTo(aegir::ThermoCouple::MT, 30);
+  INFO("seconds:" << e.seconds << " confidence:" << e.confidence);
+  REQUIRE(std::abs(e.seconds - 402) <= 5);
+  REQUIRE(e.confidence > 0.9f);
+
+  // already there
+  e = eta.timeTo(aegir::ThermoCouple::MT, 25);
+  REQUIRE(e.seconds == 0);
+  REQUIRE(e.confidence == 1.0f);
+}
+
+TEST_CASE("ETAEngine on an exponential cooling", "[ETAEngine]") {
+  aegir::ETAEngine eta;
+  const float tau = 600;
+  auto temp = [&](uint32_t t) { return 20 + 80*std::exp(-(t+0.0f)/tau); };
+
+  feed(eta, aegir::ThermoCouple::BK, 1000, 600, temp);
+
+  // from the last reading to 25C
+  float expected = tau * std::log((temp(599) - 20) / 5);
+  auto e = eta.timeTo(aegir::ThermoCouple::BK, 25);
+  INFO("seconds:" << e.seconds << " expected:" << expected << " confidence:" << e.confidence);
+  REQUIRE(std::abs(e.seconds - expected) < 0.05f*expected);
+  REQUIRE(e.confidence > 0.5f);
+
+  // below the asymptote it's never reached by the curve
+  REQUIRE(eta.timeTo(aegir::ThermoCouple::BK, 15).confidence < e.confidence);
+}
+
+TEST_CASE("ETAEngine learns the rates of the stages", "[ETAEngine]") {
+  aegir::ETAEngine eta;
+
+  // no learned power, the nominal one
+  auto e = eta.heatTime(30, 20, 60, 3.5);
+  REQUIRE(e.seconds == std::lround(4.2*30*40/3.5));
+
+  // a pre-heat with 2.5kW delivered on 30l
+  const float rate = 2.5f / (4.2f * 30);
+  feed(eta, aegir::ThermoCouple::MT, 1000, 1, [](uint32_t t) { return 20.0f; });
+  eta.mark();
+  feed(eta, aegir::ThermoCouple::MT, 1001, 1200,
+		    [&](uint32_t t) { return 20 + rate*(t+1); });
+  eta.learn(aegir::ThermoCouple::MT, 30);
+
+  REQUIRE(std::abs(eta.getEffectivePower() - 2.5f) < 0.01f);
+  auto learned = eta.heatTime(30, 20, 60, 3.5);
+  REQUIRE(std::abs(learned.seconds - 4.2*30*40/2.5) < 10);
+  REQUIRE(learned.confidence > e.confidence);
+
+  // the next brew: no readings, the learned rate
+  eta.reset();
+  REQUIRE(eta.timeTo(aegir::ThermoCouple::MT, 60).seconds < 0);
+  e = eta.byRate(aegir::ThermoCouple::MT, 20, 60);
+  REQUIRE(std::abs(e.seconds - 40/rate) < 10);
+
+  // nothing learned on the cooling
+  REQUIRE(eta.byRate(aegir::ThermoCouple::MT, 60, 20).seconds < 0);
+}
+
+TEST_CASE("ETAEngine learns from a block of readings", "[ETAEngine]") {
+  aegir::ETAEngine eta;
+  aegir::ThermoReadings tr{};
+
+  // read every 2s, a block spans a minute
+  eta.setInterval(2);
+  auto stage = [&](time_t _start, uint32_t _secs) {
+    eta.reset();
+    for (uint32_t t=0; t <= _secs; t += 2) {
+      tr[aegir::ThermoCouple::BK] = 20 + 0.1f*t;
+      eta.addReadings(_start + t, tr);
+      if ( !t ) eta.mark();
+    }
+    eta.learn(aegir::ThermoCouple::BK);
+  };
+
+  // 20 readings aren't enough
+  stage(1000, 40);
+  REQUIRE(eta.byRate(aegir::ThermoCouple::BK, 20, 30).seconds < 0);
+
+  stage(2000, 80);
+  REQUIRE(eta.byRate(aegir::ThermoCouple::BK, 20, 30).seconds == 100);
+}
@@ -0,0 +1,88 @@
+/*
+  Flow rate from the heat balance of the RIMS tube
+ */
+
+#include "FlowRateAccumulator.hh"
+#include "HeuristicStrategy.hh"
+#include "SimulatedPlant.hh"
+
+#include <bit>
+
+#include <catch2/catch_test_macros.hpp>
+
+// bit-identical, NaNs included
+static bool same(float _a, float _b) {
+  return std::bit_cast<uint32_t>(_a) == std::bit_cast<uint32_t>(_b);
+}
+
+TEST_CASE("FlowRateAccumulator replays a simulated brew", "[FlowRateAccumulator]") {
+  aegir::tests::SimulatedPlant plant(45);
+  aegir::HeuristicStrategy heuristic;
+  aegir::FlowRateAccumulator acc;
+  uint32_t compared = 0, nextcontrol = 0;
+
+  for (float target: {52.0f, 64.0f, 72.0f}) {
+    for (int t=0; t<900; ++t) {
+      if ( plant.getElapsed() >= nextcontrol ) {
+	auto d = heuristic.control(plant, target, 2);
+	if ( d.decided ) plant.setRatio(d.heratio);
+	nextcontrol = plant.getElapsed() + d.nextcontrol;
+      }
+      plant.tick();
+
+      if ( plant.getReadings().size() < 30 ) continue;
+      float expected = aegir::FlowRateAccumulator::rescan(plant.getReadings(), plant.getHERatios(),
+							  plant.getStartAt(), plant.getNow(), plant.getHEPower());
+      float got = acc.get(plant.getReadings(), plant.getHERatios(),
+			  plant.getStartAt(), plant.getNow(), plant.getHEPower());
+      INFO("t:" << plant.getElapsed() << " expected:" << expected << " got:" << got);
+      REQUIRE(same(expected, got));
+      ++compared;
+    }
+  }
+  REQUIRE(compared > 2000);
+  // only the window's segments are kept
+  REQUIRE(acc.size() < plant.getHERatios().size() / 2);
+}
+
+TEST_CASE("FlowRateAccumulator with gaps in the TSDB", "[FlowRateAccumulator]") {
+  aegir::FlowRateAccumulator acc;
+  aegir::HERatioDB heratios;
+  aegir::TSDB db;
+  aegir::ThermoReadings tr{};
+  const uint32_t start = 1000;
+  float mt = 40;
+
+  auto check = [&](uint32_t _now) {
+    float expected = aegir::FlowRateAccumulator::rescan(db, heratios, start, _now, 3.5);
+    float got = acc.get(db, heratios, start, _now, 3.5);
+    INFO("now:" << _now << " expected:" << expected << " got:" << got);
+    REQUIRE(same(expected, got));
+  };
+
+  for (uint32_t t=start; t<start+600; ++t) {
+    // the readings are missing every now and then
+    if ( t % 37 != 5 && t % 53 != 7 ) {
+      mt += 0.01;
+      tr[aegir::ThermoCouple::MT] = mt;
+      // and the tube sometimes cools below the mash tun
+      tr[aegir::ThermoCouple::RIMS] = mt + ((t / 50) % 4 == 3 ? -0.5f : 3.0f);
+      db.insert(t, tr);
+    }
+    // a new on-ratio, its reading comes with the next tick
+    if ( t % 7 == 0 ) heratios.insert(t+1, (t % 10) / 10.0f);
+    check(t);
+  }
+
+  // a new brew
+  db.clear();
+  heratios.clear();
+  tr[aegir::ThermoCouple::RIMS] = mt + 3;
+  for (uint32_t t=start+5000; t<start+5100; ++t) {
+    db.insert(t, tr);
+    if ( t % 5 == 0 ) heratios.insert(t, 0.5f);
+  }
+  float expected = aegir::FlowRateAccumulator::rescan(db, heratios, start+5000, start+5100, 3.5);
+  REQUIRE(expected > 0);
+  REQUIRE(same(expected, acc.get(db, heratios, start+5000, start+5100, 3.5)));
+}
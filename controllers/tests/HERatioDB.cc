@@ -0,0 +1,39 @@
+/*
+  Heating element on-ratio history
+ */
+
+#include "HERatioDB.hh"
+#include "Exception.hh"
+
+#include <catch2/catch_test_macros.hpp>
+
+TEST_CASE("HERatioDB grows", "[HERatioDB]") {
+  aegir::HERatioDB db;
+
+  // well over a page worth of entries
+  for (int i=0; i<10000; ++i)
+    db.insert(1000 + i*10, i/10000.0f);
+
+  REQUIRE(db.size() == 10000);
+  REQUIRE(db[0].time == 1000);
+  REQUIRE(db[9999].time == 1000 + 9999*10);
+  REQUIRE(db[9999].ratio == 9999/10000.0f);
+  REQUIRE_THROWS_AS(db[10000], aegir::Exception);
+
+  db.clear();
+  REQUIRE(db.size() == 0);
+}
+
+TEST_CASE("HERatioDB ratio at a time", "[HERatioDB]") {
+  aegir::HERatioDB db;
+
+  REQUIRE(db.ratioAt(100) == 0);
+
+  db.insert(100, 0.5f).insert(110, 0.25f).insert(130, 1.0f);
+  REQUIRE(db.ratioAt(99) == 0);
+  REQUIRE(db.ratioAt(100) == 0.5f);
+  REQUIRE(db.ratioAt(109) == 0.5f);
+  REQUIRE(db.ratioAt(110) == 0.25f);
+  REQUIRE(db.ratioAt(129) == 0.25f);
+  REQUIRE(db.ratioAt(1000) == 1.0f);
+}
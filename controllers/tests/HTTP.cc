@@ -0,0 +1,83 @@
+/*
+  HTTP request parsing
+ */
+
+#include "HTTP.hh"
+#include "Exception.hh"
+
+#include <catch2/catch_test_macros.hpp>
+
+using namespace aegir;
+
+TEST_CASE("HTTP requests", "[HTTP]") {
+  HTTP::Request req;
+  std::string in("GET /api/state?x=1 HTTP/1.1\r\n"
+		 "Host: localhost\r\n"
+		 "If-None-Match:  \"12\" \r\n"
+		 "Connection: keep-alive, Upgrade\r\n"
+		 "\r\n"
+		 "POST /api/command HTTP/1.0\r\n"
+		 "Content-Length: 5\r\n"
+		 "\r\n"
+		 "{\"a\"}");
+
+  std::size_t consumed = HTTP::parseRequest(in.data(), in.size(), req);
+  REQUIRE(consumed > 0);
+  REQUIRE(req.method == "GET");
+  REQUIRE(req.path == "/api/state");
+  REQUIRE(req.query == "x=1");
+  REQUIRE(req.header("if-none-match") != nullptr);
+  REQUIRE(*req.header("if-none-match") == "\"12\"");
+  REQUIRE(req.hasToken("connection", "upgrade"));
+  REQUIRE(req.keepAlive());
+  REQUIRE(req.body.empty());
+
+  in.erase(0, consumed);
+  // the body is not complete yet
+  REQUIRE(HTTP::parseRequest(in.data(), in.size()-1, req) == 0);
+  REQUIRE(HTTP::parseRequest(in.data(), in.size(), req) == in.size());
+  REQUIRE(req.method == "POST");
+  REQUIRE(req.body == "{\"a\"}");
+  // HTTP/1.0 closes by default
+  REQUIRE(!req.keepAlive());
+}
+
+TEST_CASE("HTTP malformed requests", "[HTTP]") {
+  HTTP::Request req;
+
+  for (std::string in: {"GET\r\n\r\n", "GET / HTTP/2.0\r\n\r\n",
+			"GET / HTTP/1.1\r\nbogus\r\n\r\n",
+			"POST / HTTP/1.1\r\nContent-Length: x\r\n\r\n",
+			"POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"}) {
+    REQUIRE_THROWS_AS(HTTP::parseRequest(in.data(), in.size(), req), aegir::Exception);
+  }
+
+  // a header without an end is refused once it's too large
+  std::string big("GET / HTTP/1.1\r\nX: ");
+  big.append(HTTP::c_maxheader, 'x');
+  REQUIRE_THROWS_AS(HTTP::parseRequest(big.data(), big.size(), req), aegir::Exception);
+}
+
+TEST_CASE("HTTP same-origin check", "[HTTP]") {
+  HTTP::Request req;
+
+  // not a browser
+  req.headers["host"] = "brewd.lan:8080";
+  REQUIRE(req.sameOrigin());
+
+  req.headers["origin"] = "http://brewd.lan:8080";
+  REQUIRE(req.sameOrigin());
+  req.headers["origin"] = "http://BREWD.lan:8080/";
+  REQUIRE(req.sameOrigin());
+
+  for (auto origin: {"http://evil.example", "http://brewd.lan", "http://brewd.lan:8080.evil.example",
+		     "null", ""}) {
+    req.headers["origin"] = origin;
+    REQUIRE_FALSE(req.sameOrigin());
+  }
+
+  // nothing to compare to
+  req.headers.erase("host");
+  req.headers["origin"] = "http://brewd.lan:8080";
+  REQUIRE_FALSE(req.sameOrigin());
+}
@@ -0,0 +1,166 @@
+/*
+  JSON codecs, the fast path must agree with jsoncpp
+ */
+
+#include "JSONCodec.hh"
+#include "Exception.hh"
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
+
+#include <string>
+#include <vector>
+
+namespace {
+  // a getState reply, as served by the PR workers
+  Json::Value stateDocument() {
+    Json::Value root, data;
+
+    data["state"] = "Mashing";
+    data["currtemp"]["MT"] = 65.25;
+    data["currtemp"]["RIMS"] = 66.5;
+    data["currtemp"]["BK"] = 21.125;
+    data["currtemp"]["HLT"] = 0;
+    data["targettemp"] = 66.0;
+    data["levelerror"] = false;
+    data["programid"] = 42;
+    data["mashstep"]["id"] = 1;
+    data["mashstep"]["pos"] = 1;
+    data["mashstep"]["time"] = 1200;
+    data["cooling"]["BK"] = 21.125;
+    data["hopping"] = Json::Value(Json::ValueType::nullValue);
+
+    root["status"] = "success";
+    root["version"] = 1234;
+    root["data"] = data;
+    return root;
+  }
+
+  // a full getTempHistory reply
+  Json::Value tempHistoryDocument() {
+    Json::Value root, data;
+
+    data["dt"] = Json::Value(Json::ValueType::arrayValue);
+    data["rims"] = Json::Value(Json::ValueType::arrayValue);
+    data["mt"] = Json::Value(Json::ValueType::arrayValue);
+    for (int i=0; i<512; ++i) {
+      data["dt"].append(i*2);
+      data["rims"].append(20.0 + i*0.125);
+      data["mt"].append(19.5 + i*0.0625);
+    }
+    data["last"] = 512;
+
+    root["status"] = "success";
+    root["data"] = data;
+    return root;
+  }
+}
+
+TEST_CASE("JSONCodec roundtrip", "[JSONCodec]") {
+  aegir::JsonCppCodec jsoncpp;
+  aegir::FastJSONCodec fast;
+
+  for (auto &doc: std::vector<Json::Value>{stateDocument(), tempHistoryDocument()}) {
+    std::string a, b;
+    Json::Value pa, pb;
+
+    jsoncpp.write(doc, a);
+    fast.write(doc, b);
+
+    // both parsers read both writers' output back to the same value
+    jsoncpp.parse(b.data(), b.size(), pa);
+    fast.parse(a.data(), a.size(), pb);
+    REQUIRE(pa == doc);
+    REQUIRE(pb == doc);
+
+    fast.parse(b.data(), b.size(), pb);
+    REQUIRE(pb == doc);
+  }
+}
+
+TEST_CASE("JSONCodec types and escapes", "[JSONCodec]") {
+  aegir::FastJSONCodec fast;
+  Json::Value v;
+  std::string in(" {\"s\":\"a\\\"b\\\\c\\n\\u00e9\\ud83c\\udf7a\", \"i\":-12, \"u\":18446744073709551615,"
+		 " \"r\":1.5e2, \"b\":[true,false,null], \"e\":{}, \"z\":[]} ");
+
+  fast.parse(in.data(), in.size(), v);
+  REQUIRE(v["s"].asString() == "a\"b\\c\n\xc3\xa9\xf0\x9f\x8d\xba");
+  REQUIRE(v["i"].type() == Json::ValueType::intValue);
+  REQUIRE(v["i"].asInt() == -12);
+  REQUIRE(v["u"].type() == Json::ValueType::uintValue);
+  REQUIRE(v["u"].asLargestUInt() == 18446744073709551615ull);
+  REQUIRE(v["r"].type() == Json::ValueType::realValue);
+  REQUIRE(v["r"].asDouble() == 150.0);
+  REQUIRE(v["b"].size() == 3);
+  REQUIRE(v["b"][0].asBool());
+  REQUIRE(v["b"][2].isNull());
+  REQUIRE(v["e"].isObject());
+  REQUIRE(v["z"].isArray());
+
+  std::string out;
+  Json::Value w;
+  fast.write(v, out);
+  fast.parse(out.data(), out.size(), w);
+  REQUIRE(w == v);
+
+  // reals stay reals
+  fast.write(Json::Value(2.0), out);
+  REQUIRE(out == "2.0");
+  fast.write(Json::Value("\t\x01"), out);
+  REQUIRE(out == "\"\\t\\u0001\"");
+}
+
+TEST_CASE("JSONCodec malformed input", "[JSONCodec]") {
+  aegir::FastJSONCodec fast;
+  Json::Value v;
+
+  for (std::string in: {"", "{", "{\"a\"}", "{\"a\":1,}", "[1 2]", "tru", "01",
+			"1.", "\"abc", "\"\\x\"", "\"\\ud83c\"", "{} x"}) {
+    REQUIRE_THROWS_AS(fast.parse(in.data(), in.size(), v), aegir::Exception);
+  }
+}
+
+TEST_CASE("JSONCodec benchmark", "[.][benchmark][JSONCodec]") {
+  aegir::JsonCppCodec jsoncpp;
+  aegir::FastJSONCodec fast;
+  Json::Value state(stateDocument()), history(tempHistoryDocument());
+  std::string statestr, historystr, out;
+  Json::Value v;
+
+  fast.write(state, statestr);
+  fast.write(history, historystr);
+
+  BENCHMARK("jsoncpp getState encode") {
+    jsoncpp.write(state, out);
+    return out.size();
+  };
+  BENCHMARK("fast getState encode") {
+    fast.write(state, out);
+    return out.size();
+  };
+  BENCHMARK("jsoncpp getState decode") {
+    jsoncpp.parse(statestr.data(), statestr.size(), v);
+    return v.size();
+  };
+  BENCHMARK("fast getState decode") {
+    fast.parse(statestr.data(), statestr.size(), v);
+    return v.size();
+  };
+  BENCHMARK("jsoncpp getTempHistory encode") {
+    jsoncpp.write(history, out);
+    return out.size();
+  };
+  BENCHMARK("fast getTempHistory encode") {
+    fast.write(history, out);
+    return out.size();
+  };
+  BENCHMARK("jsoncpp getTempHistory decode") {
+    jsoncpp.parse(historystr.data(), historystr.size(), v);
+    return v.size();
+  };
+  BENCHMARK("fast getTempHistory decode") {
+    fast.parse(historystr.data(), historystr.size(), v);
+    return v.size();
+  };
+}
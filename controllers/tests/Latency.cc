@@ -0,0 +1,155 @@
+/*
+  Sensor-to-actuator latency on a simulated schedule
+  The IOHandler's sensor and pin timers, the Controller's control and
+  tempcontrol timers are replayed against each other on a simulated
+  clock, the readings and the pin changes go through the real messages
+  with their acquisition stamps. The IOHandler is a single thread, so its
+  pin polls wait for the SPI reads, just like on the real system. The
+  heating element's new ratio is only applied on its window's boundary,
+  that's when the latency is recorded.
+ */
+
+#include "HeuristicStrategy.hh"
+#include "Message.hh"
+#include "Metrics.hh"
+#include "SimulatedPlant.hh"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <vector>
+
+namespace {
+  using aegir::tests::SimulatedPlant;
+
+  struct Schedule {
+    const char *name;
+    // the sensor timer, secs
+    uint32_t tcival;
+    // the pin timer, msecs
+    uint32_t pinival;
+    // reading one sensor, usecs
+    uint32_t spiread;
+    // the control timer's phase to the sensor timer, usecs
+    uint32_t ctrloffset;
+  };
+
+  struct Queued {
+    uint64_t sent;
+    aegir::msgstring msg;
+  };
+
+  constexpr uint32_t c_sensors = 4;
+  constexpr uint64_t c_second = 1000000;
+  // the heating element's window, the hecycletime
+  constexpr uint64_t c_hewindow = 3 * c_second;
+  // handling the pins and running a decision, usecs
+  constexpr uint64_t c_pollcost = 50;
+  constexpr uint64_t c_decisioncost = 200;
+
+  // the next firing of a periodic timer after _now, the missed ones are coalesced
+  uint64_t nextPeriod(uint64_t _now, uint64_t _phase, uint64_t _period) {
+    if ( _now < _phase ) return _phase;
+    return _phase + ((_now - _phase) / _period + 1) * _period;
+  }
+
+  void simulate(const Schedule &_sch, uint64_t _duration, aegir::Metrics::Histogram &_hist) {
+    SimulatedPlant plant(20);
+    aegir::HeuristicStrategy strategy;
+    std::deque<Queued> iopub, iocmd;
+    uint64_t tcival = _sch.tcival * c_second, pinival = _sch.pinival * 1000;
+    uint64_t nextread = 0, nextpoll = 0, nextcontrol = _sch.ctrloffset;
+    uint64_t nexttc = _sch.ctrloffset + c_second;
+    uint64_t iofree = 0, acquired = 0;
+    float ratio = -1;
+    // the heating window isn't running before the first ratio, the
+    // pending ratio waits for its boundary
+    uint64_t nextwindow = UINT64_MAX, pendingacq = 0;
+    float pending = -1;
+
+    while ( true ) {
+      uint64_t now = std::min({nextread, nextpoll, nextcontrol, nexttc, nextwindow});
+      if ( now >= _duration ) break;
+
+      if ( now == nextread ) {
+	// the IOHandler reads the sensors one after the other
+	uint64_t start = std::max(now, iofree);
+	while ( plant.getElapsed() < start / c_second ) plant.tick();
+	aegir::ThermoReadingMessage msg(plant.getReadings().last().readings, plant.getNow(), start);
+	iofree = start + c_sensors * _sch.spiread;
+	iopub.push_back(Queued{iofree, msg.serialize()});
+	nextread = nextPeriod(iofree, 0, tcival);
+      } else if ( now == nextpoll ) {
+	// and applies the pin changes sent so far
+	uint64_t start = std::max(now, iofree);
+	while ( !iocmd.empty() && iocmd.front().sent <= start ) {
+	  aegir::PinStateMessage msg(iocmd.front().msg);
+	  pending = msg.getOnratio();
+	  if ( msg.getAcquired() ) pendingacq = msg.getAcquired();
+	  iocmd.pop_front();
+	}
+	// the first one starts the windows
+	if ( pending >= 0 && nextwindow == UINT64_MAX ) nextwindow = start;
+	iofree = start + c_pollcost;
+	nextpoll = nextPeriod(iofree, 0, pinival);
+      } else if ( now == nextwindow ) {
+	// the window's boundary applies the pending ratio
+	uint64_t start = std::max(now, iofree);
+	if ( pending >= 0 ) {
+	  plant.setRatio(pending);
+	  if ( pendingacq ) _hist.record(start - pendingacq);
+	  pending = -1;
+	  pendingacq = 0;
+	}
+	iofree = start + c_pollcost;
+	nextwindow = start + c_hewindow;
+      } else {
+	// the Controller's cycle drains the readings first
+	while ( !iopub.empty() && iopub.front().sent <= now ) {
+	  acquired = std::max(acquired, aegir::ThermoReadingMessage(iopub.front().msg).getAcquired());
+	  iopub.pop_front();
+	}
+	if ( now == nexttc ) {
+	  auto decision = strategy.control(plant, 65, 2);
+	  if ( decision.decided && decision.heratio != ratio ) {
+	    ratio = decision.heratio;
+	    aegir::PinStateMessage msg("mtheat", aegir::PINState::Pulsate, 3.0f, ratio, acquired);
+	    iocmd.push_back(Queued{now + c_decisioncost, msg.serialize()});
+	  }
+	  nexttc = now + c_decisioncost + std::clamp(decision.nextcontrol, 3, 30) * c_second;
+	}
+	if ( now == nextcontrol ) nextcontrol += c_second;
+      }
+    }
+  }
+}
+
+TEST_CASE("Sensor-to-actuator latency", "[.][benchmark][Latency]") {
+  const std::vector<Schedule> schedules{
+    {"default", 1, 100, 175000, 500000},
+    {"autoconv", 1, 100, 1000, 500000},
+    {"pinival 20ms", 1, 20, 175000, 500000},
+    {"aligned control", 1, 100, 175000, 710000},
+    {"tcival 2s", 2, 100, 175000, 500000},
+  };
+
+  std::printf("%-16s %8s %10s %10s %10s %10s\n", "schedule", "changes",
+	      "p50 ms", "p90 ms", "p99 ms", "max ms");
+  for (auto &it: schedules) {
+    aegir::Metrics::Histogram hist;
+
+    simulate(it, 2*3600*c_second, hist);
+    std::printf("%-16s %8llu %10.1f %10.1f %10.1f %10.1f\n", it.name,
+		(unsigned long long)hist.count(), hist.quantile(0.5) / 1e3,
+		hist.quantile(0.9) / 1e3, hist.quantile(0.99) / 1e3, hist.max() / 1e3);
+
+    // a change is applied within a sensor period, a control period, a
+    // poll and a heating window
+    REQUIRE(hist.count() > 0);
+    REQUIRE(hist.max() < it.tcival * c_second + c_second + it.pinival * 1000
+	    + c_sensors * it.spiread + c_decisioncost + 2 * c_pollcost + c_hewindow);
+  }
+}
@@ -0,0 +1,104 @@
+/*
+  Timing of the control loop's cycles
+ */
+
+#include "LoopMonitor.hh"
+
+#include <catch2/catch_test_macros.hpp>
+
+using aegir::LoopMonitor;
+
+static LoopMonitor::Cycle mkcycle(time_t _time, uint32_t _stages, uint32_t _wakeup = 0) {
+  LoopMonitor::Cycle c{};
+
+  c.time = _time;
+  c.phases[(uint8_t)LoopMonitor::Phase::Wakeup] = _wakeup;
+  c.phases[(uint8_t)LoopMonitor::Phase::Stages] = _stages;
+  c.total = _stages;
+  return c;
+}
+
+TEST_CASE("LoopMonitor keeps the worst cycles", "[LoopMonitor]") {
+  LoopMonitor lm(1000000, 3);
+
+  for (uint32_t t: {100, 500, 200, 900, 300, 700})
+    REQUIRE_FALSE(lm.add(mkcycle(1000, t)));
+
+  REQUIRE(lm.getCycles() == 6);
+  REQUIRE(lm.getOverruns() == 0);
+  REQUIRE(lm.getLast().total == 700);
+  auto &worst = lm.getWorst();
+  REQUIRE(worst.size() == 3);
+  REQUIRE(worst[0].total == 900);
+  REQUIRE(worst[1].total == 700);
+  REQUIRE(worst[2].total == 500);
+
+  lm.setWorst(1);
+  REQUIRE(lm.getWorst().size() == 1);
+  REQUIRE(lm.getWorst()[0].total == 900);
+}
+
+TEST_CASE("LoopMonitor checks the budgets", "[LoopMonitor]") {
+  LoopMonitor lm(1000000, 5);
+  LoopMonitor::Budget budget{};
+
+  budget.phases[(uint8_t)LoopMonitor::Phase::Stages] = 200000;
+  budget.cycle = 500000;
+  lm.setBudget(budget);
+
+  REQUIRE_FALSE(lm.add(mkcycle(1000, 150000)));
+  REQUIRE_FALSE(lm.isAlerting(1000));
+
+  // a phase over its budget raises the alert once within the window
+  REQUIRE(lm.add(mkcycle(1000, 250000)));
+  REQUIRE(lm.getAlert() == "stages is over its budget");
+  REQUIRE(lm.isAlerting(1010));
+  REQUIRE_FALSE(lm.add(mkcycle(1010, 250000)));
+  REQUIRE(lm.getOverruns() == 2);
+
+  // a late wakeup makes the cycle miss its period
+  REQUIRE_FALSE(lm.add(mkcycle(1020, 100000, 950000)));
+  REQUIRE(lm.getAlert() == "the cycle missed its period");
+
+  // and the alert expires
+  REQUIRE_FALSE(lm.isAlerting(1020 + LoopMonitor::c_alertwindow));
+  REQUIRE(lm.add(mkcycle(1020 + LoopMonitor::c_alertwindow, 600000)));
+  REQUIRE(lm.getAlert() == "the cycle is over its budget");
+}
+
+TEST_CASE("LoopMonitor counts the missed periods", "[LoopMonitor]") {
+  LoopMonitor lm(1000000, 5);
+  Json::Value out;
+
+  REQUIRE_FALSE(lm.missed(1000, 0));
+  REQUIRE(lm.missed(1000, 2));
+  REQUIRE_FALSE(lm.missed(1001, 1));
+  REQUIRE(lm.getMissed() == 3);
+  REQUIRE(lm.getOverruns() == 0);
+
+  lm.begin(1002, 1500);
+  lm.lap(LoopMonitor::Phase::Inputs);
+  lm.lap(LoopMonitor::Phase::Stages);
+  lm.end();
+  REQUIRE(lm.getCycles() == 1);
+  REQUIRE(lm.getLast().phases[(uint8_t)LoopMonitor::Phase::Wakeup] == 1500);
+
+  lm.toJSON(out, 1002);
+  REQUIRE(out["missed"].asUInt64() == 3);
+  REQUIRE(out["cycles"].asUInt64() == 1);
+  REQUIRE(out["last"]["wakeup"].asDouble() == 1.5);
+  REQUIRE(out["worst"].size() == 1);
+  REQUIRE(out["alert"]["active"].asBool());
+  REQUIRE(out["alert"]["reason"].asString() == "1 timer period(s) missed");
+
+  // getState only gets the alert
+  Json::Value alert;
+  lm.alertToJSON(alert, 1002);
+  REQUIRE(alert["alerting"].asBool());
+  REQUIRE_FALSE(alert.isMember("cycles"));
+  REQUIRE_FALSE(alert.isMember("last"));
+  REQUIRE_FALSE(alert.isMember("worst"));
+  alert.clear();
+  lm.alertToJSON(alert, 1002 + LoopMonitor::c_alertwindow);
+  REQUIRE_FALSE(alert["alerting"].asBool());
+}
@@ -0,0 +1,132 @@
+/*
+  Mash step scheduling
+ */
+
+#include "MashPlanner.hh"
+#include "MPCStrategy.hh"
+#include "SimulatedPlant.hh"
+
+#include <catch2/catch_test_macros.hpp>
+
+static const aegir::Program::MashSteps g_steps{{0, 52, 10}, {1, 64, 20}, {2, 72, 10}};
+
+TEST_CASE("MashPlanner starts the next step early", "[MashPlanner]") {
+  aegir::MashPlanner planner;
+  time_t t = 1000;
+
+  planner.reset(g_steps, 0.3, 0.01, 900, t);
+  planner.stepReached(0, t);
+
+  // without a known lag, the whole hold
+  while ( !planner.update(0, ++t, 52) );
+  REQUIRE(t - 1000 == 600);
+
+  // the MT leaves the step 30s after the heating started
+  time_t rampstart = t;
+  while ( t < rampstart + 29 ) REQUIRE(planner.update(0, ++t, 52));
+  REQUIRE(planner.update(0, ++t, 53));
+  REQUIRE(planner.getLag() == 30);
+  REQUIRE(planner.getReports()[0].held == 600 + 29);
+  REQUIRE(planner.getReports()[0].adherence == 1.0f);
+
+  // the ramp took 10 minutes
+  t = rampstart + 600;
+  planner.stepReached(1, t);
+  REQUIRE(planner.getRampRate() == 12.0f / 600);
+  REQUIRE(planner.getReports()[1].reached == t);
+
+  // and the next one starts early by the lag
+  time_t reached = t;
+  while ( !planner.update(1, ++t, 64) );
+  REQUIRE(t - reached == 20*60 - 30);
+}
+
+TEST_CASE("MashPlanner extends the hold below the temperature", "[MashPlanner]") {
+  aegir::MashPlanner planner;
+  time_t t = 1000;
+
+  planner.reset(g_steps, 0.3, 0.01, 900, t);
+  planner.stepReached(0, t);
+
+  // 100s below the step's temperature
+  for (int i=0; i<100; ++i) REQUIRE_FALSE(planner.update(0, ++t, 51));
+  while ( !planner.update(0, ++t, 52) );
+  REQUIRE(t - 1000 == 100 + 600);
+
+  // being late to the plan
+  REQUIRE(planner.getDelay(t + 2000) > 0);
+}
+
+TEST_CASE("MashPlanner caps a hold the mash doesn't reach", "[MashPlanner]") {
+  aegir::MashPlanner planner;
+  time_t t = 1000;
+
+  planner.reset(g_steps, 0.3, 0.01, 900, t);
+  planner.stepReached(0, t);
+
+  // settled just below the step's temperature
+  while ( !planner.update(0, ++t, 51.5) );
+  REQUIRE(t - 1000 == 600 + 900);
+
+  auto &r = planner.getReports()[0];
+  REQUIRE(r.capped);
+  REQUIRE(r.held == 0);
+  REQUIRE(r.adherence == 0);
+  REQUIRE_FALSE(planner.getReports()[1].capped);
+}
+
+/*
+ * The Controller's stageMashing() on the simulated plant, with or without
+ * the planner: returns when the mash is over
+ */
+static uint32_t mash(bool _planned, float &_minadherence) {
+  aegir::tests::SimulatedPlant plant(52);
+  aegir::MPCStrategy mpc;
+  aegir::MashPlanner planner;
+  const float accuracy = 0.3f;
+  int step = 0;
+  time_t reached = plant.getNow();
+  float target = g_steps[0].temp;
+
+  planner.reset(g_steps, accuracy, 0.005, 900, plant.getNow());
+  planner.stepReached(0, plant.getNow());
+
+  while ( step < (int)g_steps.size() && plant.getElapsed() < 4*3600 ) {
+    float mt = plant.getReadings().last()[aegir::ThermoCouple::MT];
+    time_t now = plant.getNow();
+    bool next = _planned ? planner.update(step, now, mt) :
+      (now - reached > g_steps[step].holdtime*60);
+    if ( !_planned ) planner.update(step, now, mt);
+
+    target = g_steps[step].temp;
+    if ( next ) {
+      if ( step+1 == (int)g_steps.size() ) break;
+      target = g_steps[step+1].temp;
+      if ( mt + accuracy > target ) {
+	++step;
+	reached = now;
+	planner.stepReached(step, now);
+      }
+    }
+
+    if ( plant.getElapsed() % 10 == 0 )
+      plant.setRatio(mpc.control(plant, target, 2).heratio);
+    plant.tick();
+  }
+
+  _minadherence = 1;
+  for (std::size_t i=0; i+1 < g_steps.size(); ++i)
+    _minadherence = std::min(_minadherence, planner.getReports()[i].adherence);
+  return plant.getElapsed();
+}
+
+TEST_CASE("MashPlanner on a simulated mash", "[MashPlanner]") {
+  float planned, unplanned;
+  uint32_t withplanner = mash(true, planned);
+  uint32_t without = mash(false, unplanned);
+
+  INFO("planned:" << withplanner << "s adherence:" << planned
+       << " unplanned:" << without << "s adherence:" << unplanned);
+  REQUIRE(planned >= 0.99f);
+  REQUIRE(withplanner < without);
+}
@@ -21,3 +21,55 @@ TEST_CASE("TSDB::ThermoReadingMessage", "[Message]") {
     REQUIRE(out[i] == Catch::Approx(in[i]));
   }
 }
+
+TEST_CASE("ThermoReadingMessage with extra sensors", "[Message]") {
+  aegir::ThermoReadings in, out;
+
+  in.size = aegir::ThermoCouple::_SIZE + 2;
+  for (int i=0; i<in.size; ++i)
+    in[i] = 0.5f * (1+i);
+
+  auto srcmsg = aegir::ThermoReadingMessage(in, 42);
+  auto buffer = srcmsg.serialize();
+  REQUIRE(buffer.length() == 2 + in.size*sizeof(float) + sizeof(uint32_t));
+
+  auto dstmsg = aegir::ThermoReadingMessage(buffer);
+  out = dstmsg.getTemps();
+  REQUIRE(out.size == in.size);
+  for (int i=0; i<in.size; ++i) {
+    REQUIRE(out[i] == Catch::Approx(in[i]));
+  }
+  REQUIRE(dstmsg.getTimestamp() == 42);
+
+  // truncated
+  buffer.resize(buffer.length()-1);
+  REQUIRE_THROWS(aegir::ThermoReadingMessage(buffer));
+}
+
+TEST_CASE("Messages carry the acquisition stamps", "[Message]") {
+  aegir::ThermoReadings tr;
+
+  for (int i=0; i<tr.size; ++i)
+    tr[i] = 20.0f + i;
+
+  // the stamp is only sent when it's known
+  auto trmsg = aegir::ThermoReadingMessage(tr, 42, 123456789012ull);
+  auto buffer = trmsg.serialize();
+  REQUIRE(buffer.length() == 2 + tr.size*sizeof(float) + sizeof(uint32_t) + sizeof(uint64_t));
+  auto trdst = aegir::ThermoReadingMessage(buffer);
+  REQUIRE(trdst.getTimestamp() == 42);
+  REQUIRE(trdst.getAcquired() == 123456789012ull);
+  REQUIRE(aegir::ThermoReadingMessage(aegir::ThermoReadingMessage(tr, 42).serialize()).getAcquired() == 0);
+
+  auto psmsg = aegir::PinStateMessage("mtheat", aegir::PINState::Pulsate, 3.0f, 0.4f, 987654321ull);
+  auto psdst = aegir::PinStateMessage(psmsg.serialize());
+  REQUIRE(psdst.getName() == "mtheat");
+  REQUIRE(psdst.getState() == aegir::PINState::Pulsate);
+  REQUIRE(psdst.getOnratio() == Catch::Approx(0.4f));
+  REQUIRE(psdst.getAcquired() == 987654321ull);
+
+  // and the ones without it are still understood
+  auto old = aegir::PinStateMessage("mtpump", aegir::PINState::On);
+  REQUIRE(old.serialize().length() == 3 + 8 + 6);
+  REQUIRE(aegir::PinStateMessage(old.serialize()).getAcquired() == 0);
+}
@@ -0,0 +1,84 @@
+/*
+  Runtime metrics
+ */
+
+#include "Metrics.hh"
+#include "Exception.hh"
+
+#include <thread>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+
+TEST_CASE("Metrics histogram buckets", "[Metrics]") {
+  using Histogram = aegir::Metrics::Histogram;
+
+  // contiguous, and every bucket starts at its lower bound
+  for (uint32_t i=0; i < Histogram::c_nbuckets; ++i) {
+    REQUIRE(Histogram::bucket(Histogram::lowerBound(i)) == i);
+    if ( i ) REQUIRE(Histogram::bucket(Histogram::lowerBound(i) - 1) == i - 1);
+  }
+  // within 12.5%
+  for (uint64_t v = 8; v < (1ull << 36); v = v*3/2 + 1) {
+    uint32_t b = Histogram::bucket(v);
+    REQUIRE(Histogram::lowerBound(b) <= v);
+    REQUIRE(Histogram::lowerBound(b+1) - Histogram::lowerBound(b) <= Histogram::lowerBound(b)/8 + 1);
+  }
+  // the too large values are in the last one
+  REQUIRE(Histogram::bucket(~0ull) == Histogram::c_nbuckets - 1);
+}
+
+TEST_CASE("Metrics histogram quantiles", "[Metrics]") {
+  aegir::Metrics::Histogram h;
+
+  REQUIRE(h.quantile(0.5) == 0);
+  for (uint64_t v = 1; v <= 1000; ++v) h.record(v);
+
+  REQUIRE(h.count() == 1000);
+  REQUIRE(h.sum() == 500500);
+  REQUIRE(h.max() == 1000);
+  REQUIRE(h.quantile(0.5) >= 500);
+  REQUIRE(h.quantile(0.5) <= 500*9/8);
+  REQUIRE(h.quantile(0.99) >= 990);
+  REQUIRE(h.quantile(1.0) == 1000);
+  REQUIRE(h.countBelow(16) == 15);
+  REQUIRE(h.countBelow(512) == 511);
+}
+
+TEST_CASE("Metrics registry", "[Metrics]") {
+  auto &m = aegir::Metrics::getInstance();
+
+  auto &c = m.counter("test_requests_total", "Requests", "command=\"a\"");
+  REQUIRE(&c == &m.counter("test_requests_total", "Requests", "command=\"a\""));
+  REQUIRE(&c != &m.counter("test_requests_total", "Requests", "command=\"b\""));
+  REQUIRE_THROWS_AS(m.gauge("test_requests_total", "Requests"), aegir::Exception);
+
+  // the updates from several threads
+  std::vector<std::thread> threads;
+  for (int i=0; i < 4; ++i)
+    threads.emplace_back([&c]() { for (int j=0; j < 10000; ++j) c.inc(); });
+  for (auto &it: threads) it.join();
+  REQUIRE(c.get() == 40000);
+
+  m.gauge("test_queue_depth", "Depth").set(3);
+  m.histogram("test_latency_seconds", "Latency").record(1500);
+
+  Json::Value json;
+  m.toJSON(json);
+  REQUIRE(json["test_requests_total"]["type"].asString() == "counter");
+  REQUIRE(json["test_requests_total"]["values"]["command=\"a\""].asUInt64() == 40000);
+  REQUIRE(json["test_queue_depth"]["values"][""].asDouble() == 3);
+  REQUIRE(json["test_latency_seconds"]["values"][""]["count"].asUInt64() == 1);
+
+  std::string text;
+  m.expose(text);
+  INFO(text);
+  REQUIRE(text.find("# TYPE test_requests_total counter\n") != std::string::npos);
+  REQUIRE(text.find("test_requests_total{command=\"a\"} 40000\n") != std::string::npos);
+  REQUIRE(text.find("test_queue_depth 3\n") != std::string::npos);
+  REQUIRE(text.find("test_latency_seconds_bucket{le=\"0.001024\"} 0\n") != std::string::npos);
+  REQUIRE(text.find("test_latency_seconds_bucket{le=\"0.002048\"} 1\n") != std::string::npos);
+  REQUIRE(text.find("test_latency_seconds_bucket{le=\"+Inf\"} 1\n") != std::string::npos);
+  REQUIRE(text.find("test_latency_seconds_sum 0.0015\n") != std::string::npos);
+  REQUIRE(text.find("test_latency_seconds_count 1\n") != std::string::npos);
+}
@@ -0,0 +1,110 @@
+/*
+  Pulse-width modulation scheduling
+ */
+
+#include "PWMScheduler.hh"
+#include "Exception.hh"
+
+#include <cmath>
+
+#include <catch2/catch_test_macros.hpp>
+
+TEST_CASE("PWMScheduler applies the changes on the cycle boundary", "[PWMScheduler]") {
+  aegir::PWMScheduler pwm(20);
+  uint64_t now = 1000;
+
+  REQUIRE(pwm.set(1, 3000, 0.5));
+  REQUIRE(pwm.isActive(1));
+  auto c = pwm.nextCycle(1, now);
+  REQUIRE(c.cycletime == 3000);
+  REQUIRE(c.ontime == 1500);
+  REQUIRE_FALSE(c.rearm);
+
+  // a new ratio within the cycle doesn't change the running one
+  REQUIRE_FALSE(pwm.set(1, 3000, 0.2));
+  REQUIRE_FALSE(pwm.set(1, 3000, 0.3));
+  c = pwm.nextCycle(1, now += 3000);
+  REQUIRE(c.ontime == 900);
+  REQUIRE_FALSE(c.rearm);
+  REQUIRE(pwm.getDelivered(1).ratio == 0.5f);
+
+  // a new cycle time re-arms the timer
+  pwm.set(1, 2000, 0.3);
+  c = pwm.nextCycle(1, now += 3000);
+  REQUIRE(c.cycletime == 2000);
+  REQUIRE(c.ontime == 600);
+  REQUIRE(c.rearm);
+
+  auto &d = pwm.getDelivered(1);
+  REQUIRE(d.cycles == 2);
+  REQUIRE(d.ontime == 1500 + 900);
+  REQUIRE(d.elapsed == 6000);
+
+  pwm.clear(1);
+  REQUIRE_FALSE(pwm.isActive(1));
+  REQUIRE_THROWS_AS(pwm.nextCycle(1, now), aegir::Exception);
+}
+
+TEST_CASE("PWMScheduler returns the change's stamp from the cycle applying it", "[PWMScheduler]") {
+  aegir::PWMScheduler pwm(20);
+  uint64_t now = 1000;
+
+  // a new channel's first cycle applies it right away
+  REQUIRE(pwm.set(1, 3000, 0.5, 111));
+  REQUIRE(pwm.nextCycle(1, now).acquired == 111);
+  REQUIRE(pwm.nextCycle(1, now += 3000).acquired == 0);
+
+  // the latest change is applied, a resend without a stamp keeps it
+  pwm.set(1, 3000, 0.2, 222);
+  pwm.set(1, 3000, 0.3, 333);
+  pwm.set(1, 3000, 0.3);
+  auto c = pwm.nextCycle(1, now += 3000);
+  REQUIRE(c.ontime == 900);
+  REQUIRE(c.acquired == 333);
+  REQUIRE(pwm.nextCycle(1, now += 3000).acquired == 0);
+}
+
+TEST_CASE("PWMScheduler modulates the low ratios", "[PWMScheduler]") {
+  aegir::PWMScheduler pwm(20);
+  uint64_t now = 1000;
+  uint32_t pulses = 0;
+
+  // 3ms per cycle is way below the shortest pulse
+  pwm.set(1, 300, 0.01);
+  for (int i=0; i < 1000; ++i) {
+    auto c = pwm.nextCycle(1, now);
+    if ( c.ontime ) {
+      REQUIRE(c.ontime >= 20);
+      ++pulses;
+    }
+    now += 300;
+  }
+  pwm.nextCycle(1, now);
+
+  auto &d = pwm.getDelivered(1);
+  INFO("pulses:" << pulses << " on:" << d.ontime << " elapsed:" << d.elapsed);
+  REQUIRE(pulses > 0);
+  REQUIRE(std::fabs((1.0*d.ontime)/d.elapsed - 0.01) < 0.0005);
+
+  // the too short off times are carried over as well
+  pwm.set(1, 300, 0.99);
+  uint64_t ontime = d.ontime, elapsed = d.elapsed;
+  for (int i=0; i < 1000; ++i) {
+    auto c = pwm.nextCycle(1, now);
+    REQUIRE((c.ontime == c.cycletime || c.cycletime - c.ontime >= 20));
+    now += 300;
+  }
+  pwm.nextCycle(1, now);
+  REQUIRE(std::fabs((1.0*(d.ontime - ontime))/(d.elapsed - elapsed) - 0.99) < 0.0005);
+}
+
+TEST_CASE("PWMScheduler carries over the shortened cycles", "[PWMScheduler]") {
+  aegir::PWMScheduler pwm(20);
+  uint64_t now = 1000;
+
+  pwm.set(1, 3000, 0.5);
+  REQUIRE(pwm.nextCycle(1, now).ontime == 1500);
+  pwm.shorten(1, 1000);
+  REQUIRE(pwm.nextCycle(1, now += 3000).ontime == 2000);
+  REQUIRE(pwm.getDelivered(1).ontime == 1000);
+}
@@ -0,0 +1,37 @@
+/*
+  Compile-time perfect hash
+ */
+
+#include "PerfectHash.hh"
+
+#include <catch2/catch_test_macros.hpp>
+
+namespace {
+  constexpr aegir::PerfectHash<int, 5> table({
+      {"loadProgram", 1},
+      {"getState", 2},
+      {"setState", 3},
+      {"buzzer", 4},
+      {"override", 5},
+    });
+}
+
+// the lookups are usable at compile time as well
+static_assert(table.find("getState") && *table.find("getState") == 2);
+static_assert(table.find("getstate") == nullptr);
+
+TEST_CASE("PerfectHash lookups", "[PerfectHash]") {
+  REQUIRE(table.size() == 5);
+
+  REQUIRE(table.find("loadProgram") != nullptr);
+  REQUIRE(*table.find("loadProgram") == 1);
+  REQUIRE(*table.find("getState") == 2);
+  REQUIRE(*table.find("setState") == 3);
+  REQUIRE(*table.find("buzzer") == 4);
+  REQUIRE(*table.find("override") == 5);
+
+  REQUIRE(table.find("") == nullptr);
+  REQUIRE(table.find("buzz") == nullptr);
+  REQUIRE(table.find("buzzer2") == nullptr);
+  REQUIRE(table.find("setstate") == nullptr);
+}
@@ -0,0 +1,78 @@
+/*
+  Online plant identification
+ */
+
+#include "PlantEstimator.hh"
+#include "MPCStrategy.hh"
+#include "SimulatedPlant.hh"
+
+#include <catch2/catch_test_macros.hpp>
+
+TEST_CASE("RLS converges", "[PlantEstimator]") {
+  aegir::RLS<2> rls(1.0, 1e3);
+
+  // y = 3x1 - 0.5x2
+  for (int i=0; i<200; ++i) {
+    double x1 = (i % 7) / 7.0, x2 = 50 + (i % 13);
+    rls.update({x1, x2}, 3*x1 - 0.5*x2);
+  }
+  REQUIRE(std::fabs(rls.getTheta(0) - 3) < 1e-3);
+  REQUIRE(std::fabs(rls.getTheta(1) + 0.5) < 1e-3);
+}
+
+TEST_CASE("PlantEstimator on a simulated brew", "[PlantEstimator]") {
+  aegir::tests::SimulatedPlant::Params params;
+  // the element is weaker than its rating
+  params.hepower = 3.0;
+  aegir::tests::SimulatedPlant plant(45, params);
+  aegir::MPCStrategy mpc;
+
+  // a rest and two steps, like the real thing
+  for (float target: {52.0f, 64.0f, 72.0f}) {
+    for (int t=0; t<1200; ++t) {
+      if ( t % 10 == 0 )
+	plant.setRatio(mpc.control(plant, target, 2).heratio);
+      plant.tick();
+    }
+  }
+
+  auto &est = plant.getEstimates();
+  INFO("hepower:" << est.hepower << " loss:" << est.loss << " flow:" << est.flow
+       << " samples:" << est.samples);
+  REQUIRE(est.valid);
+  REQUIRE(est.samples == plant.getReadings().size() - (aegir::PlantEstimator::c_window +
+							aegir::PlantEstimator::c_lag));
+  REQUIRE(std::fabs(est.hepower - params.hepower) < params.hepower * 0.15);
+  REQUIRE(std::fabs(est.flow - params.flow) < params.flow * 0.2);
+  REQUIRE(est.loss >= 0);
+  REQUIRE(est.loss < 0.02);
+}
+
+TEST_CASE("PlantEstimator starts over on a new TSDB", "[PlantEstimator]") {
+  aegir::PlantEstimator est;
+  aegir::HERatioDB heratios;
+  aegir::TSDB db;
+  aegir::ThermoReadings tr{};
+
+  est.reset(3.5);
+  heratios.insert(1000, 0.5);
+  for (int i=0; i<200; ++i) {
+    tr[aegir::ThermoCouple::MT] = 50 + i*0.01;
+    tr[aegir::ThermoCouple::RIMS] = 53 + i*0.01;
+    db.insert(1000 + i, tr);
+  }
+  est.update(db, heratios, 30);
+  uint32_t samples = est.getEstimates().samples;
+  REQUIRE(samples == 200 - (aegir::PlantEstimator::c_window + aegir::PlantEstimator::c_lag));
+
+  // nothing new, nothing happens
+  est.update(db, heratios, 30);
+  REQUIRE(est.getEstimates().samples == samples);
+
+  db.clear();
+  db.insert(2000, tr);
+  est.update(db, heratios, 30);
+  REQUIRE(est.getEstimates().samples == 0);
+  REQUIRE(est.getEstimates().hepower == 3.5f);
+  REQUIRE_FALSE(est.getEstimates().valid);
+}
@@ -0,0 +1,76 @@
+/*
+  Power budget of the heating elements
+ */
+
+#include "PowerBudget.hh"
+
+#include <catch2/catch_test_macros.hpp>
+
+// the highest load of the circuit within the window
+static uint32_t peak(const aegir::PowerBudget &_budget, const aegir::PowerBudget::Slots &_slots,
+		     uint32_t _window) {
+  uint32_t peak = 0;
+
+  for (uint32_t t=0; t < _window; ++t) {
+    uint32_t load = 0;
+    for (auto &[id, power]: _budget.getElements()) {
+      auto it = _slots.find(id);
+      if ( it != _slots.end() && t >= it->second.offset &&
+	   t < it->second.offset + it->second.ontime )
+	load += power;
+    }
+    peak = std::max(peak, load);
+  }
+  return peak;
+}
+
+TEST_CASE("PowerBudget on a single circuit", "[PowerBudget]") {
+  aegir::PowerBudget budget(9000);
+  budget.addElement(25, 9000);
+  budget.addElement(30, 2000);
+
+  // the HLT gets the rest of the window
+  auto slots = budget.allocate(3000, {{25, 1200}, {30, 3000}});
+  REQUIRE(slots[25].offset == 0);
+  REQUIRE(slots[25].ontime == 1200);
+  REQUIRE(slots[30].offset == 1200);
+  REQUIRE(slots[30].ontime == 1800);
+  REQUIRE(peak(budget, slots, 3000) <= 9000);
+
+  // the RIMS element alone
+  slots = budget.allocate(3000, {{25, 3000}});
+  REQUIRE(slots[25].ontime == 3000);
+  REQUIRE(slots.find(30) == slots.end());
+
+  // without a limit they're overlapping
+  budget.setMaxPower(0);
+  slots = budget.allocate(3000, {{25, 1200}, {30, 3000}});
+  REQUIRE(slots[30].offset == 0);
+  REQUIRE(slots[30].ontime == 3000);
+}
+
+TEST_CASE("PowerBudget interleaves the elements", "[PowerBudget]") {
+  aegir::PowerBudget budget(5500);
+  budget.addElement(25, 3500);
+  budget.addElement(30, 3500);
+  budget.addElement(31, 2000);
+
+  auto slots = budget.allocate(3000, {{25, 1000}, {30, 1500}, {31, 2500}});
+  INFO("25:" << slots[25].offset << "+" << slots[25].ontime
+       << " 30:" << slots[30].offset << "+" << slots[30].ontime
+       << " 31:" << slots[31].offset << "+" << slots[31].ontime);
+  REQUIRE(peak(budget, slots, 3000) <= 5500);
+  REQUIRE(slots[25].ontime == 1000);
+  REQUIRE(slots[30].offset == 1000);
+  REQUIRE(slots[30].ontime == 1500);
+  // the 2kW one fits next to either
+  REQUIRE(slots[31].offset == 0);
+  REQUIRE(slots[31].ontime == 2500);
+
+  // the lower priority one is cut short
+  slots = budget.allocate(3000, {{25, 2000}, {30, 2000}, {31, 0}});
+  REQUIRE(slots[25].ontime == 2000);
+  REQUIRE(slots[30].offset == 2000);
+  REQUIRE(slots[30].ontime == 1000);
+  REQUIRE(slots[31].ontime == 0);
+}
@@ -0,0 +1,108 @@
+/*
+  Thread scheduling and the pulse edges' jitter
+ */
+
+#include "Scheduling.hh"
+#include "Exception.hh"
+#include "Metrics.hh"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+using aegir::Scheduling;
+using aegir::SchedPolicies;
+using aegir::ThreadSchedConfig;
+
+TEST_CASE("Scheduling pins the calling thread", "[Scheduling]") {
+  // on threads of their own, the test runner's isn't touched, and the
+  // results are checked back on it
+  std::string pinned;
+  std::thread([&]() {
+    Scheduling::apply(ThreadSchedConfig{{0}, SchedPolicies::Other, 0});
+    pinned = Scheduling::describe();
+  }).join();
+  REQUIRE(pinned == "other cpus 0");
+
+  std::string before, after;
+  std::thread([&]() {
+    before = Scheduling::describe();
+    Scheduling::apply(ThreadSchedConfig{{}, SchedPolicies::Other, 0});
+    after = Scheduling::describe();
+    Scheduling::prefaultStack(64*1024);
+  }).join();
+  REQUIRE(after == before);
+
+  REQUIRE_THROWS_AS(Scheduling::apply(ThreadSchedConfig{{100000}, SchedPolicies::Other, 0}),
+		    aegir::Exception);
+}
+
+namespace {
+  // the lateness of a pulse's edges on a 10ms period, while every CPU is busy
+  void measureEdges(const ThreadSchedConfig *_config, aegir::Metrics::Histogram &_hist, bool &_applied) {
+    std::atomic<bool> run(true);
+    std::vector<std::thread> load;
+
+    for (uint32_t i=0; i < std::max(1u, std::thread::hardware_concurrency()); ++i)
+      load.emplace_back([&]() {
+	volatile uint64_t x = 0;
+	while ( run.load(std::memory_order_relaxed) ) x = x + 1;
+      });
+
+    std::thread([&]() {
+      _applied = true;
+      if ( _config ) {
+	try {
+	  Scheduling::apply(*_config);
+	}
+	catch (aegir::Exception &e) {
+	  _applied = false;
+	  return;
+	}
+      }
+      Scheduling::prefaultStack(64*1024);
+
+      auto next = std::chrono::steady_clock::now();
+      for (int i=0; i < 500; ++i) {
+	next += std::chrono::milliseconds(10);
+	std::this_thread::sleep_until(next);
+	_hist.record(std::chrono::duration_cast<std::chrono::microseconds>
+		     (std::chrono::steady_clock::now() - next).count());
+      }
+    }).join();
+
+    run = false;
+    for (auto &it: load) it.join();
+  }
+}
+
+TEST_CASE("Pulse edge jitter under load", "[.][benchmark][Scheduling]") {
+  ThreadSchedConfig pinned{{0}, SchedPolicies::Other, 0};
+  ThreadSchedConfig fifo{{0}, SchedPolicies::FIFO, 20};
+  const std::vector<std::pair<const char *, const ThreadSchedConfig *>> setups{
+    {"default", nullptr},
+    {"pinned", &pinned},
+    {"fifo/20 pinned", &fifo},
+  };
+
+  std::printf("%-16s %10s %10s %10s %10s\n", "scheduling", "p50 us", "p90 us", "p99 us", "max us");
+  for (auto &it: setups) {
+    aegir::Metrics::Histogram hist;
+    bool applied;
+
+    measureEdges(it.second, hist, applied);
+    if ( !applied ) {
+      std::printf("%-16s skipped, not permitted\n", it.first);
+      continue;
+    }
+    std::printf("%-16s %10llu %10llu %10llu %10llu\n", it.first,
+		(unsigned long long)hist.quantile(0.5), (unsigned long long)hist.quantile(0.9),
+		(unsigned long long)hist.quantile(0.99), (unsigned long long)hist.max());
+    REQUIRE(hist.count() == 500);
+  }
+}
@@ -0,0 +1,147 @@
+/*
+  A simulated RIMS system for the control strategy tests
+  The heating element has a thermal lag, the tube is fed from the mash tun,
+  the tube's output reaches the mash tun through a hose with a transport
+  delay, and the mash tun is losing heat to the environment. The sensors are
+  lagging, noisy and quantized like the MAX31856s. Readings are recorded into
+  the TSDB every second and fed to the plant estimator, just like on the
+  real system.
+ */
+
+#ifndef AEGIR_TESTS_SIMULATEDPLANT_H
+#define AEGIR_TESTS_SIMULATEDPLANT_H
+
+#include <cmath>
+#include <cstdint>
+#include <deque>
+
+#include "ControlStrategy.hh"
+
+namespace aegir::tests {
+
+  class SimulatedPlant: public Plant {
+  public:
+    struct Params {
+      float hepower = 3.5;	// kW
+      float volume = 30;	// liters in the MT
+      float flow = 0.12;	// l/s through the tube
+      float tubevolume = 0.4;	// liters
+      float elementlag = 15;	// secs
+      float hosedelay = 8;	// secs
+      float loss = 2e-5;	// 1/s towards the ambient
+      float ambient = 20;
+      float sensorlag = 3;	// secs
+      float noise = 0.02;	// C, peak
+      float cycletime = 3;	// heating element PWM cycle
+      float maxcorrection = 1.15;	// the Config's default
+    };
+
+    static constexpr float c_step = 0.1;
+
+    SimulatedPlant(float _temp): SimulatedPlant(_temp, Params{}) {};
+    SimulatedPlant(float _temp, const Params &_params):
+      c_params(_params), c_now(c_start), c_t(0),
+      c_mt(_temp), c_rims(_temp), c_q(0), c_ratio(0),
+      c_sensmt(_temp), c_sensrims(_temp), c_seed(12345),
+      c_energy(0), c_preheating(false) {
+      c_hose.assign(std::lround(_params.hosedelay / c_step), _temp);
+      c_estimator.reset(_params.hepower);
+      record();
+    }
+
+    virtual const TSDB &getReadings() const override { return c_db; };
+    virtual const HERatioDB &getHERatios() const override { return c_heratios; };
+    virtual float getHERatio() const override { return c_ratio; };
+    virtual float getTemp(ThermoCouple _tc) const override { return c_db.size() ? c_db.last()[_tc] : 0; };
+    virtual float getHEPower() const override { return c_params.hepower; };
+    virtual float getMaxCorrectionFactor() const override { return c_params.maxcorrection; };
+    virtual float getVolume() const override { return c_params.volume; };
+    virtual time_t getNow() const override { return c_now; };
+    virtual time_t getStartAt() const override { return c_start; };
+    virtual bool isPreHeating() const override { return c_preheating; };
+    virtual const PlantEstimator::Estimates &getEstimates() const override {
+      return c_estimator.getEstimates();
+    };
+
+    inline void setPreHeating(bool _ph) { c_preheating = _ph; };
+    inline void setRatio(float _ratio) {
+      c_ratio = _ratio;
+      c_heratios.insert(c_now, _ratio);
+    }
+    // adding the malts cools the mash down
+    inline void doughIn(float _drop) { c_mt -= _drop; };
+
+    // the true temperatures
+    inline float getMT() const { return c_mt; };
+    inline float getRIMS() const { return c_rims; };
+    // the delivered energy in kWh
+    inline float getEnergy() const { return c_energy / 3600; };
+    inline uint32_t getElapsed() const { return c_now - c_start; };
+
+    // advance the simulation by a second
+    void tick() {
+      for (int i=0; i < int(1/c_step + 0.5); ++i) {
+	// PWM on the element, lagged by its thermal mass
+	float phase = std::fmod(c_t, c_params.cycletime) / c_params.cycletime;
+	float p = phase < c_ratio ? c_params.hepower : 0;
+	c_q += (p - c_q) * c_step / c_params.elementlag;
+	c_energy += p * c_step;
+
+	// the tube is fed from the MT
+	float drims = (c_params.flow * (c_mt - c_rims) + c_q / 4.2f) / c_params.tubevolume;
+	// and its output reaches the MT through the hose
+	float inlet = c_hose.front();
+	c_hose.pop_front();
+	c_hose.push_back(c_rims);
+	float dmt = c_params.flow * (inlet - c_mt) / c_params.volume
+	  - c_params.loss * (c_mt - c_params.ambient);
+
+	c_rims += drims * c_step;
+	c_mt += dmt * c_step;
+
+	c_sensmt += (c_mt - c_sensmt) * c_step / c_params.sensorlag;
+	c_sensrims += (c_rims - c_sensrims) * c_step / c_params.sensorlag;
+	c_t += c_step;
+      }
+      ++c_now;
+      record();
+    }
+
+  private:
+    float noise() {
+      c_seed = c_seed * 1103515245 + 12345;
+      return c_params.noise * (((c_seed >> 16) & 0x7fff) / 16383.5f - 1);
+    }
+
+    static float quantize(float _v) {
+      return std::round(_v * 128) / 128;
+    }
+
+    void record() {
+      ThermoReadings tr;
+
+      for (std::size_t i=0; i < ThermoCouple::_SIZE; ++i) tr[i] = c_params.ambient;
+      tr[ThermoCouple::MT] = quantize(c_sensmt + noise());
+      tr[ThermoCouple::RIMS] = quantize(c_sensrims + noise());
+      c_db.insert(c_now, tr);
+      c_estimator.update(c_db, c_heratios, c_params.volume);
+    }
+
+  private:
+    static constexpr time_t c_start = 1600000000;
+    Params c_params;
+    time_t c_now;
+    float c_t;
+    float c_mt, c_rims, c_q, c_ratio;
+    float c_sensmt, c_sensrims;
+    std::deque<float> c_hose;
+    uint32_t c_seed;
+    float c_energy;
+    bool c_preheating;
+    TSDB c_db;
+    HERatioDB c_heratios;
+    PlantEstimator c_estimator;
+  };
+}
+
+#endif
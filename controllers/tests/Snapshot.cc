@@ -0,0 +1,78 @@
+/*
+  Lock-free config snapshots
+ */
+
+#include "Snapshot.hh"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using aegir::Snapshot;
+
+namespace {
+  // the readers check that they never see a half-made one
+  struct Settings {
+    uint64_t version;
+    std::vector<uint64_t> values;
+  };
+
+  std::shared_ptr<const Settings> mksettings(uint64_t _version) {
+    return std::make_shared<const Settings>(Settings{_version, std::vector<uint64_t>(64, _version)});
+  }
+}
+
+TEST_CASE("Snapshot swaps the current one", "[Snapshot]") {
+  Snapshot<Settings> snap(mksettings(1));
+
+  auto first = snap.load();
+  REQUIRE(first->version == 1);
+  REQUIRE(snap.getEpoch() == 0);
+
+  // the previous one is handed back, and the readers keep theirs
+  auto prev = snap.store(mksettings(2));
+  REQUIRE(prev == first);
+  REQUIRE(snap.getEpoch() == 1);
+  REQUIRE(snap.load()->version == 2);
+  REQUIRE(first->version == 1);
+
+  // the last reference frees it
+  std::weak_ptr<const Settings> weak(first);
+  prev.reset();
+  first.reset();
+  REQUIRE(weak.expired());
+}
+
+TEST_CASE("Snapshot readers and a writer", "[Snapshot]") {
+  Snapshot<Settings> snap(mksettings(0));
+  std::atomic<bool> run(true);
+  std::atomic<uint64_t> torn(0), backwards(0), loads(0);
+  std::vector<std::thread> readers;
+  constexpr uint64_t c_stores = 2000;
+
+  for (int i=0; i < 4; ++i)
+    readers.emplace_back([&]() {
+      uint64_t last = 0;
+      while ( run ) {
+	auto s = snap.load();
+	for (auto v: s->values) if ( v != s->version ) ++torn;
+	if ( s->version < last ) ++backwards;
+	last = s->version;
+	++loads;
+      }
+    });
+
+  // the readers are running before the first store
+  while ( loads < readers.size() ) std::this_thread::yield();
+  for (uint64_t v=1; v <= c_stores; ++v) snap.store(mksettings(v));
+  run = false;
+  for (auto &it: readers) it.join();
+
+  REQUIRE(torn == 0);
+  REQUIRE(backwards == 0);
+  REQUIRE(snap.load()->version == c_stores);
+  REQUIRE(snap.getEpoch() == c_stores);
+}
@@ -0,0 +1,116 @@
+/*
+  Scoped-span tracer
+ */
+
+#include "SpanTracer.hh"
+
+#include <sstream>
+#include <thread>
+
+#include <json/json.h>
+
+#include <catch2/catch_test_macros.hpp>
+
+using aegir::SpanTracer;
+
+TEST_CASE("SpanTracer records the spans and the flows", "[SpanTracer]") {
+  auto &tracer = SpanTracer::getInstance();
+  uint64_t id;
+
+  // on a thread of its own, so the ring starts empty
+  std::thread([&]() {
+    tracer.setThreadName("spans");
+    {
+      SpanTracer::Span outer("outer");
+      {
+	SpanTracer::Span inner("inner", "test");
+      }
+      id = tracer.flowStart("inproc://test");
+    }
+    tracer.flowEnd("inproc://test", id);
+
+    auto events = tracer.threadEvents();
+    REQUIRE(events.size() == 4);
+    // the spans are recorded when they end
+    REQUIRE(std::string(events[0].name) == "inner");
+    REQUIRE(std::string(events[0].cat) == "test");
+    REQUIRE(events[0].phase == SpanTracer::Phase::Complete);
+    REQUIRE(events[1].phase == SpanTracer::Phase::FlowStart);
+    REQUIRE(std::string(events[2].name) == "outer");
+    REQUIRE(events[2].ts <= events[0].ts);
+    REQUIRE(events[2].ts + events[2].dur >= events[0].ts + events[0].dur);
+    REQUIRE(events[3].phase == SpanTracer::Phase::FlowEnd);
+    REQUIRE(events[3].id == id);
+    REQUIRE(events[1].id == id);
+  }).join();
+
+  // the dump is a valid Chrome trace, with the thread's name
+  std::stringstream out;
+  REQUIRE(tracer.dump(out) >= 4);
+
+  Json::Value root;
+  Json::CharReaderBuilder builder;
+  std::string errors;
+  REQUIRE(Json::parseFromStream(builder, out, &root, &errors));
+  REQUIRE(root["traceEvents"].isArray());
+
+  bool named = false, flow = false;
+  for (auto &e: root["traceEvents"]) {
+    if ( e["ph"] == "M" && e["args"]["name"] == "spans" ) named = true;
+    if ( e["ph"] == "f" && e["id"].asUInt64() == id ) {
+      REQUIRE(e["bp"] == "e");
+      flow = true;
+    }
+  }
+  REQUIRE(named);
+  REQUIRE(flow);
+}
+
+TEST_CASE("SpanTracer escapes the names in the dump", "[SpanTracer]") {
+  auto &tracer = SpanTracer::getInstance();
+  // longer than any line buffer, with the characters JSON escapes
+  std::string thread(600, 'x');
+  thread += "\"\\\n";
+  const char *name = tracer.intern("say \"hi\"\t\\");
+
+  std::thread([&]() {
+    tracer.setThreadName(thread);
+    tracer.instant(name, "test");
+  }).join();
+
+  std::stringstream out;
+  REQUIRE(tracer.dump(out) >= 1);
+
+  Json::Value root;
+  Json::CharReaderBuilder builder;
+  std::string errors;
+  INFO(errors);
+  REQUIRE(Json::parseFromStream(builder, out, &root, &errors));
+
+  bool named = false, instant = false;
+  for (auto &e: root["traceEvents"]) {
+    if ( e["ph"] == "M" && e["args"]["name"].asString() == thread ) named = true;
+    if ( e["ph"] == "i" && e["name"].asString() == name ) instant = true;
+  }
+  REQUIRE(named);
+  REQUIRE(instant);
+}
+
+TEST_CASE("SpanTracer keeps the most recent events", "[SpanTracer]") {
+  auto &tracer = SpanTracer::getInstance();
+
+  std::thread([&]() {
+    for (uint32_t i=0; i < SpanTracer::c_ringsize + 100; ++i)
+      tracer.complete(i < 100 ? "old" : "new", "test", i, i+1);
+
+    auto events = tracer.threadEvents();
+    REQUIRE(events.size() == SpanTracer::c_ringsize);
+    REQUIRE(std::string(events.front().name) == "new");
+    REQUIRE(events.front().ts == 100);
+    REQUIRE(events.back().ts == SpanTracer::c_ringsize + 99);
+  }).join();
+
+  // interned strings live on
+  const char *a = tracer.intern(std::string("inproc://iopub"));
+  REQUIRE(a == tracer.intern("inproc://iopub"));
+}
@@ -0,0 +1,45 @@
+/*
+  StateSnapshot publishing
+ */
+
+#include "StateSnapshot.hh"
+
+#include <catch2/catch_test_macros.hpp>
+
+TEST_CASE("StateSnapshot versions", "[StateSnapshot]") {
+  aegir::StateSnapshot snap;
+  Json::Value data;
+
+  REQUIRE(snap.getVersion() == 0);
+
+  data["state"] = "Empty";
+  REQUIRE(snap.publish(data) == 1);
+  // same content keeps the version
+  REQUIRE(snap.publish(data) == 1);
+
+  data["state"] = "Loaded";
+  REQUIRE(snap.publish(data) == 2);
+  REQUIRE(snap.getVersion() == 2);
+
+  aegir::StateSnapshot::Reader r(snap);
+  REQUIRE(r.version() == 2);
+  REQUIRE(r.json() == "{\"state\":\"Loaded\"}");
+  REQUIRE(r.data()["state"].asString() == "Loaded");
+}
+
+TEST_CASE("StateSnapshot pinned readers", "[StateSnapshot]") {
+  aegir::StateSnapshot snap;
+  Json::Value data;
+
+  data["n"] = 0;
+  snap.publish(data);
+
+  // a pinned reader keeps seeing its own version while the writer moves on
+  aegir::StateSnapshot::Reader r(snap);
+  for (int i=1; i<100; ++i) {
+    data["n"] = i;
+    snap.publish(data);
+  }
+  REQUIRE(r.data()["n"].asInt() == 0);
+  REQUIRE(snap.getVersion() == 100);
+}
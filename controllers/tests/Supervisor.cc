@@ -0,0 +1,130 @@
+/*
+  Supervision of the threads
+ */
+
+#include "Supervisor.hh"
+#include "ThreadBase.hh"
+#include "Exception.hh"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+using aegir::Supervisor;
+using aegir::SupervisorConfig;
+using aegir::RestartPolicies;
+
+namespace {
+  class FakeThread: public aegir::ThreadBase {
+  public:
+    // the run()s throwing before a clean exit
+    FakeThread(uint32_t _failures): c_failures(_failures), c_runs(0), c_failsafes(0), c_block(false) {};
+    virtual ~FakeThread() {};
+    virtual void stop() noexcept override { aegir::ThreadBase::stop(); c_block = false; };
+
+    uint32_t c_failures;
+    std::atomic<uint32_t> c_runs, c_failsafes;
+    // run() waits until it's released
+    std::atomic<bool> c_block;
+
+  protected:
+    virtual void run() override {
+      if ( c_runs++ < c_failures ) throw aegir::Exception("failure %u", c_runs.load());
+      while ( c_block ) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    };
+    virtual void failsafe() override { ++c_failsafes; };
+  };
+}
+
+TEST_CASE("Supervisor restarts the failed threads", "[Supervisor]") {
+  Supervisor sv;
+  FakeThread recovers(2), fails(5), never(1);
+
+  sv.add("recovers", recovers, SupervisorConfig{0, RestartPolicies::OnFailure, 3, 1});
+  sv.add("fails", fails, SupervisorConfig{0, RestartPolicies::OnFailure, 3, 1});
+  sv.add("never", never, SupervisorConfig{0, RestartPolicies::Never, 3, 1});
+  REQUIRE(sv.getState("recovers") == Supervisor::States::Starting);
+
+  // the state is kept, run() is called again on the same object
+  sv.execute("recovers");
+  REQUIRE(sv.getState("recovers") == Supervisor::States::Stopped);
+  REQUIRE(sv.getRestarts("recovers") == 2);
+  REQUIRE(recovers.c_runs == 3);
+  REQUIRE(recovers.c_failsafes == 2);
+
+  // gives up after maxrestarts
+  sv.execute("fails");
+  REQUIRE(sv.getState("fails") == Supervisor::States::Failed);
+  REQUIRE(sv.getRestarts("fails") == 3);
+  REQUIRE(fails.c_runs == 4);
+  REQUIRE(fails.c_failsafes == 4);
+
+  sv.execute("never");
+  REQUIRE(sv.getState("never") == Supervisor::States::Failed);
+  REQUIRE(sv.getRestarts("never") == 0);
+  REQUIRE(never.c_failsafes == 1);
+
+  REQUIRE_THROWS_AS(sv.getState("unknown"), aegir::Exception);
+}
+
+TEST_CASE("Supervisor doesn't restart a stopping thread", "[Supervisor]") {
+  Supervisor sv;
+  FakeThread thr(1);
+
+  // a long backoff is cut short by the stop
+  sv.add("thr", thr, SupervisorConfig{0, RestartPolicies::OnFailure, 3, 60000});
+  auto start = std::chrono::steady_clock::now();
+  std::thread t([&]() { sv.execute("thr"); });
+  while ( thr.c_failsafes == 0 ) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  thr.stop();
+  t.join();
+
+  REQUIRE(std::chrono::steady_clock::now() - start < std::chrono::seconds(5));
+  REQUIRE(sv.getState("thr") == Supervisor::States::Stopped);
+  REQUIRE(sv.getRestarts("thr") == 0);
+}
+
+TEST_CASE("Supervisor engages the fail-safe of a stalled thread", "[Supervisor]") {
+  Supervisor sv;
+  FakeThread watched(0), unwatched(0);
+
+  watched.c_block = true;
+  unwatched.c_block = true;
+  sv.add("watched", watched, SupervisorConfig{1000, RestartPolicies::OnFailure, 3, 1});
+  sv.add("unwatched", unwatched, SupervisorConfig{0, RestartPolicies::OnFailure, 3, 1});
+  std::thread t1([&]() { sv.execute("watched"); });
+  std::thread t2([&]() { sv.execute("unwatched"); });
+  while ( watched.c_runs == 0 || unwatched.c_runs == 0 )
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+  uint64_t beat = watched.c_heartbeat;
+  REQUIRE(sv.check(beat + 1000000) == 0);
+  REQUIRE(watched.c_failsafes == 0);
+
+  // once, while it's stalled
+  REQUIRE(sv.check(beat + 1000001) == 1);
+  REQUIRE(sv.check(beat + 5000000) == 1);
+  REQUIRE(sv.getState("watched") == Supervisor::States::Stalled);
+  REQUIRE(watched.c_failsafes == 1);
+  REQUIRE(unwatched.c_failsafes == 0);
+
+  Json::Value out;
+  sv.toJSON(out, beat + 5000000);
+  REQUIRE(out["watched"]["state"].asString() == "stalled");
+  REQUIRE(out["watched"]["heartbeat"].asDouble() == 5.0);
+  REQUIRE_FALSE(out["unwatched"].isMember("heartbeat"));
+
+  // and it's beating again
+  watched.c_heartbeat = beat + 5000000;
+  REQUIRE(sv.check(beat + 5000000) == 0);
+  REQUIRE(sv.getState("watched") == Supervisor::States::Running);
+
+  watched.stop();
+  unwatched.stop();
+  t1.join();
+  t2.join();
+  REQUIRE(sv.getState("watched") == Supervisor::States::Stopped);
+  REQUIRE(watched.c_failsafes == 1);
+}
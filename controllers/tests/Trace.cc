@@ -0,0 +1,77 @@
+/*
+  Recording of the Controller's traffic
+ */
+
+#include "Trace.hh"
+#include "Clock.hh"
+#include "Exception.hh"
+
+#include <cstdio>
+#include <fstream>
+
+#include <catch2/catch_test_macros.hpp>
+
+TEST_CASE("Trace roundtrip", "[Trace]") {
+  const char *file = "trace-test.bin";
+  auto rec = aegir::TraceRecorder::getInstance();
+  aegir::ThermoReadings tr{};
+  tr[0] = 42.5f;
+
+  aegir::PinStateMessage pin("mtheat", aegir::PINState::Pulsate, 3.0f, 0.4f);
+  aegir::ThermoReadingMessage temps(tr, 1000);
+
+  // nothing's recorded before opening
+  rec->record(aegir::Trace::RecordType::Input, pin.serialize());
+
+  rec->open(file);
+  REQUIRE(rec->isRecording());
+  REQUIRE_THROWS_AS(rec->open(file), aegir::Exception);
+  aegir::Clock::setReplay(1000);
+  rec->record(aegir::Trace::RecordType::Input, temps.serialize());
+  rec->record(aegir::Trace::RecordType::Cycle, aegir::msgstring(1, aegir::Trace::Control));
+  aegir::Clock::setReplay(1001);
+  rec->record(aegir::Trace::RecordType::Output, pin.serialize());
+  aegir::Clock::setReplay(0);
+  rec->close();
+  REQUIRE_FALSE(rec->isRecording());
+
+  aegir::TraceReader reader(file);
+  aegir::Trace::Record r;
+  REQUIRE(reader.next(r));
+  REQUIRE(r.type == aegir::Trace::RecordType::Input);
+  REQUIRE(r.time == 1000);
+  REQUIRE(r.data == temps.serialize());
+  REQUIRE(reader.next(r));
+  REQUIRE(r.type == aegir::Trace::RecordType::Cycle);
+  REQUIRE(r.data == aegir::msgstring(1, aegir::Trace::Control));
+  REQUIRE(reader.next(r));
+  REQUIRE(r.type == aegir::Trace::RecordType::Output);
+  REQUIRE(r.time == 1001);
+  REQUIRE(aegir::PinStateMessage(r.data).getName() == "mtheat");
+  REQUIRE_FALSE(reader.next(r));
+
+  std::remove(file);
+}
+
+TEST_CASE("Trace rejects broken files", "[Trace]") {
+  const char *file = "trace-test.bin";
+
+  {
+    std::ofstream out(file, std::ios::binary);
+    out << "not a trace";
+  }
+  REQUIRE_THROWS_AS(aegir::TraceReader(file), aegir::Exception);
+
+  // cut off in the middle of a record
+  {
+    std::ofstream out(file, std::ios::binary);
+    out.write(aegir::Trace::c_magic, sizeof(aegir::Trace::c_magic));
+    out.write("\x01\x00\x00\x00\x00\x10\x00\x00\x00" "abc", 12);
+  }
+  aegir::TraceReader reader(file);
+  aegir::Trace::Record r;
+  REQUIRE_THROWS_AS(reader.next(r), aegir::Exception);
+
+  std::remove(file);
+  REQUIRE_THROWS_AS(aegir::TraceReader(file), aegir::Exception);
+}
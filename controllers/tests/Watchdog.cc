@@ -0,0 +1,178 @@
+/*
+  The Controller's watchdog and the output latch
+ */
+
+#include "Watchdog.hh"
+#include "Exception.hh"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <thread>
+#include <unistd.h>
+
+using aegir::Watchdog;
+
+static uint64_t monotonic() {
+  return std::chrono::duration_cast<std::chrono::microseconds>
+    (std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+TEST_CASE("Watchdog latches when it's not fed", "[Watchdog]") {
+  Watchdog wd(3000);
+
+  // armed by the first feed
+  REQUIRE_FALSE(wd.check(100000000));
+  REQUIRE_FALSE(wd.feed(100000000));
+  REQUIRE_FALSE(wd.check(103000000));
+  REQUIRE_FALSE(wd.isLatched());
+
+  // once, and it stays latched
+  REQUIRE(wd.check(103000001));
+  REQUIRE(wd.isLatched());
+  REQUIRE_FALSE(wd.check(110000000));
+  REQUIRE(wd.getTrips() == 1);
+
+  // the feed releases it, just once
+  REQUIRE(wd.feed(111000000));
+  REQUIRE_FALSE(wd.isLatched());
+  REQUIRE_FALSE(wd.feed(112000000));
+  REQUIRE_FALSE(wd.check(114000000));
+
+  Json::Value out;
+  wd.toJSON(out);
+  REQUIRE(out["latched"].asBool() == false);
+  REQUIRE(out["trips"].asUInt64() == 1);
+  // it changes on every cycle, it's left to the metrics
+  REQUIRE_FALSE(out.isMember("fed"));
+
+  // disabled
+  wd.setTimeout(0);
+  REQUIRE_FALSE(wd.check(200000000));
+}
+
+TEST_CASE("Watchdog pets the file-backed device", "[Watchdog]") {
+  Watchdog wd(3000);
+  char path[] = "/tmp/aegir-watchdog.XXXXXX";
+  int fd = mkstemp(path);
+  REQUIRE(fd >= 0);
+  close(fd);
+
+  auto content = [&]() {
+    std::ifstream in(path);
+    std::string line;
+    std::getline(in, line);
+    return line;
+  };
+
+  // a regular file is only taken as an explicit stand-in
+  REQUIRE_THROWS_AS(wd.openDevice(path), aegir::Exception);
+  REQUIRE_FALSE(wd.hasDevice());
+  wd.openDevice(path, true);
+  REQUIRE(wd.hasDevice());
+  wd.pet(5000000);
+  REQUIRE(content() == "5000000");
+  // not more often than its period
+  wd.pet(5500000);
+  REQUIRE(content() == "5000000");
+  wd.pet(6000000);
+  REQUIRE(content() == "6000000");
+
+  // nor while it's latched, so the board gets reset
+  wd.feed(6000000);
+  REQUIRE(wd.check(9500000));
+  wd.pet(9500000);
+  REQUIRE(content() == "6000000");
+
+  wd.closeDevice(true);
+  REQUIRE_FALSE(wd.hasDevice());
+  unlink(path);
+
+  // a missing device isn't created
+  REQUIRE_THROWS_AS(wd.openDevice(path), aegir::Exception);
+  REQUIRE(access(path, F_OK) < 0);
+  REQUIRE_THROWS_AS(wd.openDevice("/nonexistent/watchdog", true), aegir::Exception);
+}
+
+TEST_CASE("Watchdog latches the outputs to their defval", "[Watchdog]") {
+  aegir::pinconfig_t pins{
+    {"mtheat", {aegir::PinMode::OUT, aegir::PinPull::NONE, false}},
+    {"buzzer", {aegir::PinMode::OUT, aegir::PinPull::NONE, true}},
+    {"swmash", {aegir::PinMode::IN, aegir::PinPull::UP, true}},
+    {"cs0", {aegir::PinMode::OUT, aegir::PinPull::NONE, true}},
+  };
+
+  auto states = Watchdog::latchedStates(pins);
+  REQUIRE(states.size() == 2);
+  REQUIRE(states["mtheat"] == aegir::PINState::Off);
+  REQUIRE(states["buzzer"] == aegir::PINState::On);
+}
+
+TEST_CASE("Watchdog drops the pin commands while latched", "[Watchdog]") {
+  Watchdog wd(3000);
+
+  wd.feed(100000000);
+  REQUIRE(wd.admits(aegir::MessageType::PINSTATE));
+  REQUIRE(wd.check(103000001));
+  REQUIRE_FALSE(wd.admits(aegir::MessageType::PINSTATE));
+  REQUIRE(wd.admits(aegir::MessageType::THERMOREADING));
+  REQUIRE(wd.feed(104000000));
+  REQUIRE(wd.admits(aegir::MessageType::PINSTATE));
+}
+
+TEST_CASE("Watchdog latches within a poll after the timeout", "[Watchdog]") {
+  // 100ms timeout, 5ms pin polls, stalled at every phase of the polls
+  constexpr uint64_t timeout = 100000, poll = 5000, start = 1000000;
+
+  for (uint64_t phase=0; phase < poll; phase += 250) {
+    Watchdog wd(timeout / 1000);
+    uint64_t stalled = start + phase, latched = 0;
+
+    wd.feed(stalled);
+    for (uint64_t now=start; !latched; now += poll)
+      if ( wd.check(now) ) latched = now;
+    REQUIRE(latched - stalled > timeout);
+    REQUIRE(latched - stalled <= timeout + poll);
+  }
+}
+
+TEST_CASE("Watchdog reaches the safe state after a Controller stall", "[.][benchmark][Watchdog]") {
+  // scaled down: 100ms timeout, 10ms control cycles and 5ms pin polls
+  constexpr uint64_t timeout = 100000, poll = 5000;
+  uint64_t worst = 0;
+
+  for (int run=0; run < 5; ++run) {
+    Watchdog wd(timeout / 1000);
+    std::atomic<uint64_t> stalled(0), latched(0);
+
+    std::thread controller([&]() {
+      // stalls after its last feed
+      for (int i=0; i < 10; ++i) {
+	stalled = monotonic();
+	wd.feed(stalled);
+	std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      }
+    });
+    std::thread io([&]() {
+      while ( !latched ) {
+	if ( wd.check(monotonic()) ) latched = monotonic();
+	std::this_thread::sleep_for(std::chrono::microseconds(poll));
+      }
+    });
+    controller.join();
+    io.join();
+
+    REQUIRE(wd.isLatched());
+    worst = std::max(worst, latched - stalled);
+  }
+
+  std::printf("watchdog: worst time-to-safe-state %.1fms, timeout %.1fms, poll %.1fms\n",
+	      worst / 1e3, timeout / 1e3, poll / 1e3);
+  // within the timeout and a poll, and the scheduling's noise
+  REQUIRE(worst > timeout);
+  REQUIRE(worst <= timeout + poll + 50000);
+}
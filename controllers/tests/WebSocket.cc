@@ -0,0 +1,55 @@
+/*
+  WebSocket helpers
+ */
+
+#include "WebSocket.hh"
+#include "Exception.hh"
+
+#include <catch2/catch_test_macros.hpp>
+
+using namespace aegir;
+
+TEST_CASE("WebSocket handshake", "[WebSocket]") {
+  REQUIRE(WebSocket::base64("") == "");
+  REQUIRE(WebSocket::base64("f") == "Zg==");
+  REQUIRE(WebSocket::base64("fo") == "Zm8=");
+  REQUIRE(WebSocket::base64("foo") == "Zm9v");
+  REQUIRE(WebSocket::base64(WebSocket::sha1("abc")) == "qZk+NkcGgWq6PiVxeFDCbJzQ2J0=");
+  // the example from RFC 6455
+  REQUIRE(WebSocket::acceptKey("dGhlIHNhbXBsZSBub25jZQ==") == "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=");
+}
+
+TEST_CASE("WebSocket frames", "[WebSocket]") {
+  WebSocket::Frame frame;
+  std::string buff;
+
+  for (std::size_t size: {0, 5, 125, 126, 300, 70000}) {
+    std::string payload(size, 'x');
+    buff.clear();
+    WebSocket::encodeMaskedFrame(WebSocket::Opcode::Text, payload.data(), payload.size(),
+				 0x37fa213d, buff);
+
+    if ( size > WebSocket::c_maxpayload ) {
+      REQUIRE_THROWS_AS(WebSocket::decodeFrame(buff.data(), buff.size(), true, frame),
+			aegir::Exception);
+      continue;
+    }
+
+    // incomplete frames are not consumed
+    REQUIRE(WebSocket::decodeFrame(buff.data(), buff.size()-1, true, frame) == 0);
+    REQUIRE(WebSocket::decodeFrame(buff.data(), buff.size(), true, frame) == buff.size());
+    REQUIRE(frame.fin);
+    REQUIRE(frame.opcode == WebSocket::Opcode::Text);
+    REQUIRE(frame.payload == payload);
+  }
+
+  // the server's frames are not masked, and clients must mask
+  buff.clear();
+  WebSocket::encodeFrame(WebSocket::Opcode::Ping, "hi", 2, buff);
+  REQUIRE(buff == std::string("\x89\x02hi", 4));
+  REQUIRE(WebSocket::decodeFrame(buff.data(), buff.size(), false, frame) == 4);
+  REQUIRE(frame.opcode == WebSocket::Opcode::Ping);
+  REQUIRE(frame.payload == "hi");
+  REQUIRE_THROWS_AS(WebSocket::decodeFrame(buff.data(), buff.size(), true, frame),
+		    aegir::Exception);
+}
@@ -53,3 +53,37 @@ TEST_CASE("ThermoCouple::toStr", "[types]") {
 
   REQUIRE_THROWS(aegir::ThermoCouple(aegir::ThermoCouple::_SIZE).toStr());
 }
+
+TEST_CASE("ThermoCouple extra sensors", "[types]") {
+  aegir::SensorNames names;
+
+  names.set(aegir::ThermoCouple::_SIZE+1, "Fermenter");
+  REQUIRE(names.find("Fermenter") == aegir::ThermoCouple::_SIZE+1);
+  REQUIRE(names.find("BK") == aegir::ThermoCouple::BK);
+  REQUIRE(std::strcmp(names.name(aegir::ThermoCouple::_SIZE+1), "Fermenter") == 0);
+  REQUIRE(std::strcmp(names.name(aegir::ThermoCouple::HLT), "HotLiquorTank") == 0);
+  // the ids are valid, but only the names know about them
+  REQUIRE(aegir::ThermoCouple((uint8_t)aegir::ThermoCouple::_SIZE) == aegir::ThermoCouple::_SIZE);
+  REQUIRE_THROWS(aegir::ThermoCouple((uint8_t)aegir::ThermoCouple::_MAX));
+  REQUIRE_THROWS(aegir::ThermoCouple("Fermenter"));
+  REQUIRE_THROWS(names.name(aegir::ThermoCouple::_SIZE));
+  // the well-known names and ids are reserved
+  REQUIRE_THROWS(names.set(aegir::ThermoCouple::_SIZE, "BK"));
+  REQUIRE_THROWS(names.set(aegir::ThermoCouple::HLT, "Fermenter2"));
+  REQUIRE_THROWS(names.set(aegir::ThermoCouple::_SIZE, "Fermenter"));
+
+  // a copy keeps its names when the original changes
+  aegir::SensorNames copy = names;
+  names.clear();
+  REQUIRE_THROWS(names.find("Fermenter"));
+  REQUIRE(copy.find("Fermenter") == aegir::ThermoCouple::_SIZE+1);
+}
+
+TEST_CASE("ThermoReadings::forEach", "[types]") {
+  for (uint8_t n=0; n <= aegir::ThermoCouple::_MAX; ++n) {
+    int calls = 0, sum = 0;
+    aegir::ThermoReadings::forEach(n, [&](uint8_t i) { ++calls; sum += i; });
+    REQUIRE(calls == n);
+    REQUIRE(sum == n*(n-1)/2);
+  }
+}